@@ -418,6 +418,7 @@ project "Physics-Lib"
 	files {
 		"src/physics/bounding_volumes.*",
 		"src/physics/collision_broad.*",
+		"src/physics/collision_ccd.*",
 		"src/physics/collision_epa.*",
 		"src/physics/collision_gjk.*",
 		"src/physics/collision_narrow.*",
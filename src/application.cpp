@@ -369,7 +369,7 @@ void application::initialize(main_renderer* renderer, editor_panels* editorPanel
 	debrisParticleSystem.initialize(10000);
 #endif
 
-	stackArena.initialize();
+	stackArena.initialize(0, GB(8), "Frame stack");
 }
 
 #if 0
@@ -455,6 +455,8 @@ void application::submitRendererParams(uint32 numSpotLightShadowPasses, uint32 n
 		{
 			pointShadowRenderPasses[i].sort();
 		}
+
+		computePass.merge();
 	}
 
 	renderer->submitRenderPass(&opaqueRenderPass);
@@ -508,7 +510,17 @@ void application::update(const user_input& input, float dt)
 		scene_entity entity = { entityHandle, scene };
 		heightmap_collider_component* collider = entity.getComponentIfExists<heightmap_collider_component>();
 
-		terrain.update(position.position, collider);
+		// Terrain and collider are written in place, so the scene snapshot (if the game is running) copies them before the first write.
+		if (terrain.needsUpdate(position.position, collider))
+		{
+			scene.preserveForSnapshot<terrain_component>(entityHandle);
+			if (collider)
+			{
+				scene.preserveForSnapshot<heightmap_collider_component>(entityHandle);
+			}
+		}
+
+		terrain.update(position.position, camera.position, collider);
 	}
 
 
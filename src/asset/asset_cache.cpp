@@ -0,0 +1,457 @@
+#include "pch.h"
+#include "asset_cache.h"
+#include "io.h"
+
+#include "core/hash.h"
+#include "core/log.h"
+#include "core/string.h"
+#include "core/yaml.h"
+
+#include <algorithm>
+#include <ctime>
+
+
+struct manifest_entry
+{
+	fs::path source;
+	std::string extension;
+	uint32 flags;
+	uint32 importerVersion;
+	uint64 size;
+	int64 lastUsed;
+	std::vector<fs::path> dependencies;
+};
+
+struct source_hash
+{
+	uint64 size;
+	int64 writeTime;
+	uint64 hash;
+};
+
+static std::mutex mutex;
+
+static bool initialized = false;
+static fs::path cacheDirectory;
+static fs::path manifestPath;
+static uint64 maxCacheSize;
+
+static std::unordered_map<uint64, manifest_entry> entries;
+static std::unordered_map<fs::path, source_hash> sourceHashes;
+static uint64 totalSize;
+static bool manifestDirty;
+
+
+// XXH64.
+
+static const uint64 prime1 = 11400714785074694791ull;
+static const uint64 prime2 = 14029467366897019727ull;
+static const uint64 prime3 = 1609587929392839161ull;
+static const uint64 prime4 = 9650029242287828579ull;
+static const uint64 prime5 = 2870177450012600261ull;
+
+static uint64 rotateLeft(uint64 x, uint32 r) { return (x << r) | (x >> (64 - r)); }
+static uint64 read64(const uint8* p) { uint64 v; memcpy(&v, p, sizeof(v)); return v; }
+static uint32 read32(const uint8* p) { uint32 v; memcpy(&v, p, sizeof(v)); return v; }
+
+static uint64 xxhRound(uint64 acc, uint64 input)
+{
+	acc += input * prime2;
+	acc = rotateLeft(acc, 31);
+	return acc * prime1;
+}
+
+static uint64 mergeRound(uint64 acc, uint64 val)
+{
+	acc ^= xxhRound(0, val);
+	return acc * prime1 + prime4;
+}
+
+uint64 hashMemory(const void* data, uint64 size, uint64 seed)
+{
+	const uint8* p = (const uint8*)data;
+	const uint8* end = p + size;
+
+	uint64 h;
+	if (size >= 32)
+	{
+		uint64 v1 = seed + prime1 + prime2;
+		uint64 v2 = seed + prime2;
+		uint64 v3 = seed;
+		uint64 v4 = seed - prime1;
+
+		const uint8* limit = end - 32;
+		do
+		{
+			v1 = xxhRound(v1, read64(p)); p += 8;
+			v2 = xxhRound(v2, read64(p)); p += 8;
+			v3 = xxhRound(v3, read64(p)); p += 8;
+			v4 = xxhRound(v4, read64(p)); p += 8;
+		} while (p <= limit);
+
+		h = rotateLeft(v1, 1) + rotateLeft(v2, 7) + rotateLeft(v3, 12) + rotateLeft(v4, 18);
+		h = mergeRound(h, v1);
+		h = mergeRound(h, v2);
+		h = mergeRound(h, v3);
+		h = mergeRound(h, v4);
+	}
+	else
+	{
+		h = seed + prime5;
+	}
+
+	h += size;
+
+	while (p + 8 <= end)
+	{
+		h ^= xxhRound(0, read64(p));
+		h = rotateLeft(h, 27) * prime1 + prime4;
+		p += 8;
+	}
+	if (p + 4 <= end)
+	{
+		h ^= (uint64)read32(p) * prime1;
+		h = rotateLeft(h, 23) * prime2 + prime3;
+		p += 4;
+	}
+	while (p < end)
+	{
+		h ^= (*p) * prime5;
+		h = rotateLeft(h, 11) * prime1;
+		++p;
+	}
+
+	h ^= h >> 33;
+	h *= prime2;
+	h ^= h >> 29;
+	h *= prime3;
+	h ^= h >> 32;
+
+	return h;
+}
+
+
+// Manifest.
+
+static std::string keyToString(uint64 key)
+{
+	char buffer[17];
+	snprintf(buffer, sizeof(buffer), "%016llx", key);
+	return buffer;
+}
+
+static fs::path getEntryPath(uint64 key, const char* extension)
+{
+	// Sharded by the first byte, so that no directory gets too large.
+	std::string name = keyToString(key);
+	return cacheDirectory / name.substr(0, 2) / (name + extension);
+}
+
+static int64 getWriteTime(const fs::path& path)
+{
+	std::error_code ec;
+	auto time = fs::last_write_time(path, ec);
+	return ec ? 0 : (int64)time.time_since_epoch().count();
+}
+
+static void loadManifest()
+{
+	std::ifstream stream(manifestPath);
+	if (!stream)
+	{
+		return;
+	}
+
+	YAML::Node n = YAML::Load(stream);
+
+	for (auto entryNode : n["Entries"])
+	{
+		std::string keyString;
+		manifest_entry entry = {};
+
+		YAML_LOAD(entryNode, keyString, "Key");
+		YAML_LOAD(entryNode, entry.source, "Source");
+		YAML_LOAD(entryNode, entry.extension, "Extension");
+		YAML_LOAD(entryNode, entry.flags, "Flags");
+		YAML_LOAD(entryNode, entry.importerVersion, "Importer version");
+		YAML_LOAD(entryNode, entry.size, "Size");
+		YAML_LOAD(entryNode, entry.lastUsed, "Last used");
+		YAML_LOAD(entryNode, entry.dependencies, "Dependencies");
+
+		uint64 key = strtoull(keyString.c_str(), 0, 16);
+
+		// Entries may have been deleted by hand, or by another process sharing the cache.
+		if (key && fs::exists(getEntryPath(key, entry.extension.c_str())))
+		{
+			totalSize += entry.size;
+			entries[key] = std::move(entry);
+		}
+	}
+
+	for (auto sourceNode : n["Sources"])
+	{
+		fs::path path;
+		std::string hashString;
+		source_hash hash = {};
+
+		YAML_LOAD(sourceNode, path, "Path");
+		YAML_LOAD(sourceNode, hash.size, "Size");
+		YAML_LOAD(sourceNode, hash.writeTime, "Write time");
+		YAML_LOAD(sourceNode, hashString, "Hash");
+
+		hash.hash = strtoull(hashString.c_str(), 0, 16);
+		sourceHashes[path] = hash;
+	}
+}
+
+static void writeManifest()
+{
+	YAML::Node out;
+
+	for (const auto& [key, entry] : entries)
+	{
+		YAML::Node n;
+		n["Key"] = keyToString(key);
+		n["Source"] = entry.source;
+		n["Extension"] = entry.extension;
+		n["Flags"] = entry.flags;
+		n["Importer version"] = entry.importerVersion;
+		n["Size"] = entry.size;
+		n["Last used"] = entry.lastUsed;
+		for (const fs::path& dependency : entry.dependencies)
+		{
+			n["Dependencies"].push_back(dependency);
+		}
+		out["Entries"].push_back(n);
+	}
+
+	for (const auto& [path, hash] : sourceHashes)
+	{
+		YAML::Node n;
+		n["Path"] = path;
+		n["Size"] = hash.size;
+		n["Write time"] = hash.writeTime;
+		n["Hash"] = keyToString(hash.hash);
+		out["Sources"].push_back(n);
+	}
+
+	fs::create_directories(cacheDirectory);
+
+	fs::path tempPath = manifestPath;
+	tempPath += ".tmp";
+	{
+		std::ofstream fout(tempPath);
+		fout << out;
+	}
+
+	std::error_code ec;
+	fs::rename(tempPath, manifestPath, ec);
+	if (ec)
+	{
+		LOG_ERROR("Could not write asset cache manifest '%ws'", manifestPath.c_str());
+	}
+
+	manifestDirty = false;
+}
+
+static void ensureInitialized()
+{
+	if (!initialized)
+	{
+		initialized = true;
+
+		if (cacheDirectory.empty())
+		{
+			cacheDirectory = L"asset_cache";
+			maxCacheSize = GB(8);
+		}
+		manifestPath = cacheDirectory / L"manifest.yaml";
+
+		loadManifest();
+	}
+}
+
+// Evicts least recently used entries down to 90% of the budget, so that not every new entry causes an eviction.
+static void evict(uint64 keepKey)
+{
+	if (totalSize <= maxCacheSize)
+	{
+		return;
+	}
+
+	std::vector<std::pair<int64, uint64>> byAge;
+	byAge.reserve(entries.size());
+	for (const auto& [key, entry] : entries)
+	{
+		if (key != keepKey)
+		{
+			byAge.push_back({ entry.lastUsed, key });
+		}
+	}
+	std::sort(byAge.begin(), byAge.end());
+
+	uint64 target = maxCacheSize / 10 * 9;
+	uint32 numEvicted = 0;
+	for (auto [lastUsed, key] : byAge)
+	{
+		if (totalSize <= target)
+		{
+			break;
+		}
+
+		auto it = entries.find(key);
+
+		std::error_code ec;
+		fs::remove(getEntryPath(key, it->second.extension.c_str()), ec);
+
+		totalSize -= it->second.size;
+		entries.erase(it);
+		++numEvicted;
+	}
+
+	LOG_MESSAGE("Evicted %u entries from the asset cache", numEvicted);
+	manifestDirty = true;
+}
+
+
+void initializeAssetCache(const fs::path& directory, uint64 maxSize)
+{
+	const std::lock_guard<std::mutex> lock(mutex);
+
+	cacheDirectory = directory;
+	maxCacheSize = maxSize;
+	ensureInitialized();
+}
+
+void shutdownAssetCache()
+{
+	const std::lock_guard<std::mutex> lock(mutex);
+
+	if (initialized && manifestDirty)
+	{
+		writeManifest();
+	}
+}
+
+uint64 hashFileContent(const fs::path& path)
+{
+	std::error_code ec;
+	uint64 size = fs::file_size(path, ec);
+	int64 writeTime = getWriteTime(path);
+
+	{
+		const std::lock_guard<std::mutex> lock(mutex);
+		ensureInitialized();
+
+		auto it = sourceHashes.find(path);
+		if (it != sourceHashes.end() && it->second.size == size && it->second.writeTime == writeTime)
+		{
+			return it->second.hash;
+		}
+	}
+
+	entire_file file = loadFile(path);
+	uint64 hash = hashMemory(file.content, file.size);
+	freeFile(file);
+
+	{
+		const std::lock_guard<std::mutex> lock(mutex);
+		sourceHashes[path] = { size, writeTime, hash };
+		manifestDirty = true;
+	}
+
+	return hash;
+}
+
+asset_cache_entry lookupAssetCache(uint64 contentHash, uint32 importFlags, uint32 importerVersion, const char* extension)
+{
+	struct
+	{
+		uint64 contentHash;
+		uint64 extensionHash;
+		uint32 importFlags;
+		uint32 importerVersion;
+	} keyData = { contentHash, hashString64(extension), importFlags, importerVersion };
+
+	uint64 key = hashMemory(&keyData, sizeof(keyData));
+
+	const std::lock_guard<std::mutex> lock(mutex);
+	ensureInitialized();
+
+	asset_cache_entry result;
+	result.key = key;
+	result.importFlags = importFlags;
+	result.importerVersion = importerVersion;
+	result.path = getEntryPath(key, extension);
+	result.exists = fs::exists(result.path);
+
+	if (result.exists)
+	{
+		auto it = entries.find(key);
+		if (it != entries.end())
+		{
+			it->second.lastUsed = (int64)time(0);
+			manifestDirty = true;
+		}
+	}
+
+	return result;
+}
+
+bool commitAssetCache(asset_cache_entry& entry, const fs::path& sourcePath, const std::vector<fs::path>& dependencies,
+	const std::function<bool(const fs::path& tempPath)>& write)
+{
+	std::error_code ec;
+	fs::create_directories(entry.path.parent_path(), ec);
+
+	// Unique per thread, since the same asset may be imported concurrently.
+	fs::path tempPath = entry.path;
+	tempPath += ".tmp" + std::to_string(GetCurrentProcessId()) + "_" + std::to_string(GetCurrentThreadId());
+
+	if (!write(tempPath) || !fs::exists(tempPath))
+	{
+		fs::remove(tempPath, ec);
+		LOG_ERROR("Could not write asset cache entry for '%ws'", sourcePath.c_str());
+		return false;
+	}
+
+	uint64 size = fs::file_size(tempPath, ec);
+
+	fs::rename(tempPath, entry.path, ec);
+	if (ec)
+	{
+		// Another process may have written the same entry in the meantime. Since the content is identical, this is fine.
+		fs::remove(tempPath, ec);
+		if (!fs::exists(entry.path))
+		{
+			LOG_ERROR("Could not move asset cache entry '%ws' into place", entry.path.c_str());
+			return false;
+		}
+	}
+	entry.exists = true;
+
+	const std::lock_guard<std::mutex> lock(mutex);
+	ensureInitialized();
+
+	std::string extension = entry.path.filename().string().substr(16);
+
+	manifest_entry& m = entries[entry.key];
+	totalSize -= m.size;
+
+	m.source = sourcePath;
+	m.extension = extension;
+	m.flags = entry.importFlags;
+	m.importerVersion = entry.importerVersion;
+	m.size = size;
+	m.lastUsed = (int64)time(0);
+	m.dependencies = dependencies;
+
+	totalSize += size;
+
+	evict(entry.key);
+
+	manifestDirty = true;
+
+	return true;
+}
+
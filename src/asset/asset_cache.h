@@ -0,0 +1,39 @@
+#pragma once
+
+#include "core/memory.h"
+
+#include <functional>
+
+
+// Content-addressed cache for imported assets. An entry is keyed by the hash of the source content, the import flags and the importer
+// version, so it stays valid across checkouts, syncs and machines, and the cache directory can be shared (e.g. copied from a build
+// machine). Modification times are only used to skip re-hashing unchanged sources, never to decide whether an entry is valid.
+//
+// A manifest next to the cache files records for each entry its source, its dependencies (e.g. the textures referenced by an FBX),
+// its size and when it was last used. When the cache exceeds its size budget, the least recently used entries are evicted.
+//
+// Bump the importer version of an importer whenever its output changes.
+
+struct asset_cache_entry
+{
+	uint64 key;
+	uint32 importFlags;
+	uint32 importerVersion;
+	fs::path path;
+	bool exists;
+};
+
+void initializeAssetCache(const fs::path& directory = L"asset_cache", uint64 maxSize = GB(8));
+void shutdownAssetCache(); // Writes the manifest, if it changed.
+
+// Content hashes. The hash of a file is remembered together with its size and write time, so it is only recomputed if either changes.
+uint64 hashFileContent(const fs::path& path);
+uint64 hashMemory(const void* data, uint64 size, uint64 seed = 0);
+
+// Returns the cache entry for the given source content and import settings. If the entry exists, it is marked as used.
+asset_cache_entry lookupAssetCache(uint64 contentHash, uint32 importFlags, uint32 importerVersion, const char* extension);
+
+// The write function writes the imported asset to the given temporary path. On success, the file is renamed into place, so that
+// readers (also in other processes) never see partially written entries.
+bool commitAssetCache(asset_cache_entry& entry, const fs::path& sourcePath, const std::vector<fs::path>& dependencies,
+	const std::function<bool(const fs::path& tempPath)>& write);
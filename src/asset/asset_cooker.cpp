@@ -0,0 +1,204 @@
+#include "pch.h"
+#include "asset_cooker.h"
+#include "file_registry.h"
+#include "model_asset.h"
+#include "image.h"
+
+#include <DirectXTex/DirectXTex.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <set>
+
+
+using cook_clock = std::chrono::high_resolution_clock;
+
+struct image_cook_task
+{
+	fs::path path;
+	uint32 flags;
+
+	bool operator<(const image_cook_task& o) const { return (path == o.path) ? (flags < o.flags) : (path < o.path); }
+};
+
+static std::mutex printMutex;
+
+
+static double millisecondsSince(cook_clock::time_point start)
+{
+	return std::chrono::duration<double, std::milli>(cook_clock::now() - start).count();
+}
+
+static void report(asset_cook_result& result, bool upToDate, bool success, double milliseconds, const fs::path& path, uint32 flags)
+{
+	const std::lock_guard<std::mutex> lock(printMutex);
+
+	const char* status = upToDate ? "up-to-date" : success ? "cooked" : "FAILED";
+	printf("%-10s %10.1f ms   %ws (flags 0x%x)\n", status, milliseconds, path.c_str(), flags);
+
+	if (upToDate) { ++result.numUpToDate; }
+	else if (success) { ++result.numCooked; }
+	else { ++result.numFailed; }
+}
+
+// Simple fork-join over all tasks. Cooking tasks are long (up to minutes for large FBX files), so there is no need for anything smarter.
+static void cookParallel(uint32 numTasks, uint32 numThreads, const std::function<void(uint32)>& cook)
+{
+	std::atomic<uint32> nextTask = 0;
+
+	auto worker = [&]()
+	{
+		// WIC (used by DirectXTex) requires COM on every thread that loads images.
+		HRESULT comResult = CoInitializeEx(NULL, COINIT_MULTITHREADED);
+
+		for (uint32 i = nextTask++; i < numTasks; i = nextTask++)
+		{
+			cook(i);
+		}
+
+		if (SUCCEEDED(comResult))
+		{
+			CoUninitialize();
+		}
+	};
+
+	std::vector<std::thread> threads;
+	for (uint32 i = 1; i < min(numThreads, numTasks); ++i)
+	{
+		threads.emplace_back(worker);
+	}
+	worker();
+
+	for (std::thread& thread : threads)
+	{
+		thread.join();
+	}
+}
+
+static uint32 normalizeImageFlags(uint32 flags)
+{
+	// Same as the texture loader, so that the cooked entries are the ones the runtime looks up.
+	if (flags & image_load_flags_gen_mips_on_gpu)
+	{
+		flags &= ~image_load_flags_gen_mips_on_cpu;
+		flags |= image_load_flags_allocate_full_mipchain;
+	}
+	return flags;
+}
+
+asset_cook_result cookAllAssets(uint32 numThreads)
+{
+	if (numThreads == 0)
+	{
+		numThreads = max(std::thread::hardware_concurrency(), 1u);
+	}
+
+	auto totalStart = cook_clock::now();
+
+	std::vector<fs::path> meshes;
+	std::vector<fs::path> images;
+	for (const fs::path& path : getAllRegisteredPaths())
+	{
+		std::string extension = path.extension().string();
+		std::transform(extension.begin(), extension.end(), extension.begin(),
+			[](char c) { return std::tolower(c); });
+
+		if (extension == ".fbx" || extension == ".obj")
+		{
+			meshes.push_back(path.lexically_normal());
+		}
+		else if (isImageExtension(extension) || extension == ".svg")
+		{
+			images.push_back(path.lexically_normal());
+		}
+	}
+
+	printf("Cooking %u meshes and %u images on %u threads\n", (uint32)meshes.size(), (uint32)images.size(), numThreads);
+
+	asset_cook_result result;
+
+
+	// Meshes. Each one reports the textures it references, which form the edges of the dependency graph.
+
+	std::vector<std::vector<image_cook_task>> referencedTextures(meshes.size());
+
+	cookParallel((uint32)meshes.size(), numThreads, [&](uint32 i)
+	{
+		const fs::path& path = meshes[i];
+
+		auto start = cook_clock::now();
+		bool upToDate = isModelCached(path);
+
+		// Also load up-to-date models, since the cached model contains the material references.
+		model_asset asset = load3DModelFromFile(path);
+
+		for (const pbr_material_desc& material : asset.materials)
+		{
+			if (!material.albedo.empty()) { referencedTextures[i].push_back({ material.albedo.lexically_normal(), material.albedoFlags }); }
+			if (!material.normal.empty()) { referencedTextures[i].push_back({ material.normal.lexically_normal(), material.normalFlags }); }
+			if (!material.roughness.empty()) { referencedTextures[i].push_back({ material.roughness.lexically_normal(), material.roughnessFlags }); }
+			if (!material.metallic.empty()) { referencedTextures[i].push_back({ material.metallic.lexically_normal(), material.metallicFlags }); }
+		}
+
+		report(result, upToDate, !asset.meshes.empty(), millisecondsSince(start), path, mesh_flag_default);
+	});
+
+
+	// Images. Textures referenced by a material are cooked with the material's flags, all others with the default flags.
+
+	std::set<image_cook_task> imageTaskSet;
+	std::set<fs::path> referencedPaths;
+	for (const auto& textures : referencedTextures)
+	{
+		for (const image_cook_task& texture : textures)
+		{
+			imageTaskSet.insert({ texture.path, normalizeImageFlags(texture.flags) });
+			referencedPaths.insert(texture.path);
+		}
+	}
+	for (const fs::path& path : images)
+	{
+		if (referencedPaths.find(path) == referencedPaths.end())
+		{
+			imageTaskSet.insert({ path, normalizeImageFlags(image_load_flags_default) });
+		}
+	}
+
+	std::vector<image_cook_task> imageTasks;
+	for (const image_cook_task& task : imageTaskSet)
+	{
+		// Without this flag, the image is never read from the cache, so there is nothing to cook.
+		if (task.flags & image_load_flags_cache_to_dds)
+		{
+			imageTasks.push_back(task);
+		}
+	}
+
+	cookParallel((uint32)imageTasks.size(), numThreads, [&](uint32 i)
+	{
+		const image_cook_task& task = imageTasks[i];
+
+		auto start = cook_clock::now();
+		bool upToDate = isImageCached(task.path, task.flags);
+		bool success = true;
+
+		if (!upToDate)
+		{
+			DirectX::ScratchImage scratchImage;
+			D3D12_RESOURCE_DESC textureDesc;
+
+			success = (task.path.extension() == ".svg")
+				? loadSVGFromFile(task.path, task.flags, scratchImage, textureDesc)
+				: loadImageFromFile(task.path, task.flags, scratchImage, textureDesc);
+		}
+
+		report(result, upToDate, success, millisecondsSince(start), task.path, task.flags);
+	});
+
+
+	printf("Cooked %u assets, %u up-to-date, %u failed in %.1f s\n",
+		result.numCooked, result.numUpToDate, result.numFailed, millisecondsSince(totalStart) / 1000.0);
+
+	return result;
+}
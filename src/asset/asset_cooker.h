@@ -0,0 +1,19 @@
+#pragma once
+
+
+// Headless batch import of all meshes and images in the file registry into the asset cache, so that neither the editor nor the
+// game has to preprocess anything on first load. Meant to be run in CI, after a content drop.
+//
+// Meshes are imported first, since the textures they reference (and the flags these are loaded with) are only known after import.
+// Then all images are cooked: Referenced textures with the flags of their material, all other images with the default flags.
+// Both phases are spread across all hardware threads. Cooking is incremental: Up-to-date cache entries are skipped.
+
+struct asset_cook_result
+{
+	uint32 numCooked = 0;
+	uint32 numUpToDate = 0;
+	uint32 numFailed = 0;
+};
+
+// Requires the file registry and asset cache to be initialized. Prints one line per asset with its import time to stdout.
+asset_cook_result cookAllAssets(uint32 numThreads = 0); // 0 uses all hardware threads.
@@ -0,0 +1,112 @@
+#include "pch.h"
+#include "asset_hot_reload.h"
+#include "image.h"
+#include "model_asset.h"
+#include "core/log.h"
+#include "dx/dx_texture.h"
+#include "geometry/mesh.h"
+#include "rendering/pbr_material.h"
+
+#include <algorithm>
+#include <chrono>
+#include <unordered_set>
+
+
+// Time without any change before a batch is reloaded.
+#define ASSET_HOT_RELOAD_DELAY std::chrono::milliseconds(500)
+
+using reload_clock = std::chrono::steady_clock;
+
+static std::unordered_set<fs::path> pendingPaths;
+static reload_clock::time_point lastChangeTime;
+static std::mutex mutex;
+
+
+static bool fileIsLocked(const fs::path& path)
+{
+	HANDLE fileHandle = CreateFileW(path.c_str(), GENERIC_READ, 0, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+	if (fileHandle == INVALID_HANDLE_VALUE)
+	{
+		return true;
+	}
+	CloseHandle(fileHandle);
+	return false;
+}
+
+void notifyAssetChanged(const fs::path& path)
+{
+	const std::lock_guard<std::mutex> lock(mutex);
+
+	pendingPaths.insert(path);
+	lastChangeTime = reload_clock::now();
+}
+
+void checkForChangedAssets()
+{
+	applyReloadedTextures();
+	applyReloadedMeshes();
+
+	std::vector<fs::path> batch;
+
+	{
+		const std::lock_guard<std::mutex> lock(mutex);
+
+		if (pendingPaths.empty() || reload_clock::now() - lastChangeTime < ASSET_HOT_RELOAD_DELAY)
+		{
+			return;
+		}
+
+		for (auto it = pendingPaths.begin(); it != pendingPaths.end();)
+		{
+			if (!fs::exists(*it))
+			{
+				it = pendingPaths.erase(it); // Deleted in the meantime.
+			}
+			else if (!fileIsLocked(*it))
+			{
+				batch.push_back(*it);
+				it = pendingPaths.erase(it);
+			}
+			else
+			{
+				++it;
+			}
+		}
+
+		if (!pendingPaths.empty())
+		{
+			// Retry the locked files after the next quiet period.
+			lastChangeTime = reload_clock::now();
+		}
+	}
+
+	uint32 numTextures = 0;
+	uint32 numMeshes = 0;
+	uint32 numMaterials = 0;
+
+	for (const fs::path& path : batch)
+	{
+		std::string extension = path.extension().string();
+		std::transform(extension.begin(), extension.end(), extension.begin(),
+			[](char c) { return std::tolower(c); });
+
+		if (isImageExtension(extension) || extension == ".svg")
+		{
+			numTextures += reloadTexturesFromFile(path);
+			numMaterials += refreshPBRMaterialsUsingTexture(path);
+		}
+		else if (extension == ".fbx" || extension == ".obj")
+		{
+			numMeshes += reloadMeshesFromFile(path);
+		}
+	}
+
+	if (numTextures || numMeshes || numMaterials)
+	{
+		LOG_MESSAGE("%u asset file%s changed. Reloading %u texture%s and %u mesh%s, refreshed %u material%s",
+			(uint32)batch.size(), (batch.size() > 1) ? "s" : "",
+			numTextures, (numTextures != 1) ? "s" : "",
+			numMeshes, (numMeshes != 1) ? "es" : "",
+			numMaterials, (numMaterials != 1) ? "s" : "");
+	}
+}
@@ -0,0 +1,14 @@
+#pragma once
+
+
+// Hot reload of meshes and textures, analogous to the shader hot reload in dx_pipeline.cpp. The file registry reports changed source
+// files. Changes are collected until no file has changed for a short time, so that exporting many files at once results in one batch
+// and each file is reloaded once. Files still locked by the exporting application are deferred.
+//
+// Each batch re-imports all loaded meshes and textures using the changed files in the background (through the asset cache, so the
+// re-import happens once per content). Finished reloads are swapped into the existing mesh and texture objects between frames, so all
+// references (components, materials) see the new data. Materials, which reference a changed texture they could not load before, are
+// refreshed.
+
+void notifyAssetChanged(const fs::path& path); // Thread safe.
+void checkForChangedAssets(); // Call once per frame on the main thread, between frames.
@@ -1,9 +1,41 @@
 #include "pch.h"
 #include "file_registry.h"
+#include "io.h"
+#include "asset_hot_reload.h"
 #include "core/file_system.h"
 #include "core/log.h"
 #include "core/yaml.h"
 
+#include <unordered_set>
+
+
+// The registry is stored as a binary snapshot plus an append-only journal of the changes since the snapshot. At runtime, a change
+// only appends a small record to the journal. The snapshot is rewritten (and the journal truncated) at startup and whenever the
+// journal grows too large. Replaying the journal is idempotent, so a crash between writing the snapshot and truncating the journal
+// is harmless.
+//
+// The snapshot also stores the write time of every directory. Adding, deleting or renaming an entry changes the write time of its
+// parent directory, so at startup only directories with a changed write time are enumerated. All others are only stat'ed.
+
+#define FILE_REGISTRY_MAGIC 'KNFR'
+#define FILE_REGISTRY_VERSION 1
+
+#define FILE_REGISTRY_MAX_JOURNAL_RECORDS 4096
+
+enum journal_op : uint8
+{
+	journal_op_add,
+	journal_op_delete,
+	journal_op_rename,
+};
+
+struct file_registry_header
+{
+	uint32 magic;
+	uint32 version;
+	uint32 numFiles;
+	uint32 numDirectories;
+};
 
 
 typedef std::unordered_map<fs::path, asset_handle> path_to_handle;
@@ -11,16 +43,163 @@ typedef std::unordered_map<asset_handle, fs::path> handle_to_path;
 
 static path_to_handle pathToHandle;
 static handle_to_path handleToPath;
+static std::unordered_map<fs::path, int64> directoryWriteTimes;
 
 static std::mutex mutex;
-static const fs::path registryPath = fs::path(L"resources/files.yaml").lexically_normal();
+static const fs::path assetDirectory = L"assets";
+static const fs::path snapshotPath = fs::path(L"resources/files.bin").lexically_normal();
+static const fs::path journalPath = fs::path(L"resources/files.journal").lexically_normal();
+static const fs::path legacyRegistryPath = fs::path(L"resources/files.yaml").lexically_normal();
+
+static FILE* journalFile = 0;
+static uint32 numJournalRecords = 0;
+
+
+static void addFile(const fs::path& path, asset_handle handle)
+{
+	pathToHandle.insert({ path, handle });
+	handleToPath.insert({ handle, path });
+}
+
+static void removeFile(const fs::path& path)
+{
+	auto it = pathToHandle.find(path);
+	if (it != pathToHandle.end())
+	{
+		handleToPath.erase(it->second);
+		pathToHandle.erase(it);
+	}
+}
+
+static void renameFile(const fs::path& oldPath, const fs::path& newPath, asset_handle handle)
+{
+	removeFile(oldPath);
+	pathToHandle[newPath] = handle;
+	handleToPath[handle] = newPath; // Replace.
+}
+
+static int64 getWriteTime(const fs::path& path)
+{
+	std::error_code ec;
+	auto time = fs::last_write_time(path, ec);
+	return ec ? 0 : (int64)time.time_since_epoch().count();
+}
+
+
+static void writePath(const fs::path& path, FILE* file)
+{
+	const fs::path::string_type& native = path.native();
+	uint16 length = (uint16)native.length();
+
+	fwrite(&length, sizeof(uint16), 1, file);
+	fwrite(native.c_str(), sizeof(fs::path::value_type), length, file);
+}
+
+static bool readPath(entire_file& file, fs::path& path)
+{
+	uint16* length = file.consume<uint16>();
+	if (!length)
+	{
+		return false;
+	}
+
+	fs::path::value_type* chars = file.consume<fs::path::value_type>(*length);
+	if (!chars)
+	{
+		return false;
+	}
+
+	path = fs::path::string_type(chars, *length);
+	return true;
+}
+
+static bool loadSnapshot()
+{
+	entire_file file = loadFile(snapshotPath);
+	if (!file.content)
+	{
+		return false;
+	}
 
+	file_registry_header* header = file.consume<file_registry_header>();
+	bool valid = header && header->magic == FILE_REGISTRY_MAGIC && header->version == FILE_REGISTRY_VERSION;
 
-static path_to_handle loadRegistryFromDisk()
+	for (uint32 i = 0; valid && i < header->numFiles; ++i)
+	{
+		uint64* handle = file.consume<uint64>();
+		fs::path path;
+		valid = handle && readPath(file, path);
+
+		if (valid)
+		{
+			addFile(path, *handle);
+		}
+	}
+
+	for (uint32 i = 0; valid && i < header->numDirectories; ++i)
+	{
+		int64* writeTime = file.consume<int64>();
+		fs::path path;
+		valid = writeTime && readPath(file, path);
+
+		if (valid)
+		{
+			directoryWriteTimes[path] = *writeTime;
+		}
+	}
+
+	freeFile(file);
+
+	if (!valid)
+	{
+		LOG_ERROR("File registry '%ws' is corrupt. Rebuilding it, which generates new handles for all assets", snapshotPath.c_str());
+
+		pathToHandle.clear();
+		handleToPath.clear();
+		directoryWriteTimes.clear();
+	}
+
+	return valid;
+}
+
+static void replayJournal()
 {
-	path_to_handle loadedRegistry;
+	entire_file file = loadFile(journalPath);
+	if (!file.content)
+	{
+		return;
+	}
+
+	uint32 numRecords = 0;
+	while (true)
+	{
+		// A truncated last record (e.g. after a crash) ends the replay.
+		uint8* op = file.consume<uint8>();
+		uint64* handle = file.consume<uint64>();
+		fs::path path, oldPath;
+		if (!op || !handle || !readPath(file, path) || (*op == journal_op_rename && !readPath(file, oldPath)))
+		{
+			break;
+		}
 
-	std::ifstream stream(registryPath);
+		switch (*op)
+		{
+			case journal_op_add: addFile(path, *handle); break;
+			case journal_op_delete: removeFile(path); break;
+			case journal_op_rename: renameFile(oldPath, path, *handle); break;
+		}
+		++numRecords;
+	}
+
+	freeFile(file);
+
+	LOG_MESSAGE("Replayed %u file registry changes", numRecords);
+}
+
+// Only used once, to keep the asset handles of a registry written by older versions.
+static void loadLegacyRegistry()
+{
+	std::ifstream stream(legacyRegistryPath);
 	YAML::Node n = YAML::Load(stream);
 
 	for (auto entryNode : n)
@@ -33,57 +212,214 @@ static path_to_handle loadRegistryFromDisk()
 
 		if (handle)
 		{
-			loadedRegistry[path] = handle;
+			addFile(path, handle);
+		}
+	}
+}
+
+// Writes the snapshot and truncates the journal.
+static void writeSnapshot()
+{
+	fs::create_directories(snapshotPath.parent_path());
+
+	fs::path tempPath = snapshotPath;
+	tempPath += ".tmp";
+
+	FILE* file = fopen(tempPath.string().c_str(), "wb");
+	if (!file)
+	{
+		LOG_ERROR("Could not write file registry '%ws'", snapshotPath.c_str());
+		return;
+	}
+
+	file_registry_header header;
+	header.magic = FILE_REGISTRY_MAGIC;
+	header.version = FILE_REGISTRY_VERSION;
+	header.numFiles = (uint32)pathToHandle.size();
+	header.numDirectories = (uint32)directoryWriteTimes.size();
+
+	fwrite(&header, sizeof(header), 1, file);
+
+	for (const auto& [path, handle] : pathToHandle)
+	{
+		fwrite(&handle.value, sizeof(uint64), 1, file);
+		writePath(path, file);
+	}
+
+	for (const auto& [path, writeTime] : directoryWriteTimes)
+	{
+		fwrite(&writeTime, sizeof(int64), 1, file);
+		writePath(path, file);
+	}
+
+	fclose(file);
+
+	std::error_code ec;
+	fs::rename(tempPath, snapshotPath, ec);
+	if (ec)
+	{
+		LOG_ERROR("Could not write file registry '%ws'", snapshotPath.c_str());
+		return;
+	}
+
+	if (journalFile)
+	{
+		fclose(journalFile);
+	}
+	journalFile = fopen(journalPath.string().c_str(), "wb");
+	numJournalRecords = 0;
+}
+
+static void appendToJournal(journal_op op, asset_handle handle, const fs::path& path, const fs::path& oldPath = {})
+{
+	if (!journalFile)
+	{
+		journalFile = fopen(journalPath.string().c_str(), "ab");
+		if (!journalFile)
+		{
+			LOG_ERROR("Could not open file registry journal '%ws'", journalPath.c_str());
+			return;
 		}
 	}
 
-	return loadedRegistry;
+	fwrite(&op, sizeof(uint8), 1, journalFile);
+	fwrite(&handle.value, sizeof(uint64), 1, journalFile);
+	writePath(path, journalFile);
+	if (op == journal_op_rename)
+	{
+		writePath(oldPath, journalFile);
+	}
+	fflush(journalFile);
+
+	if (++numJournalRecords >= FILE_REGISTRY_MAX_JOURNAL_RECORDS)
+	{
+		LOG_MESSAGE("Compacting file registry");
+		writeSnapshot();
+	}
 }
 
-static void writeRegistryToDisk()
+
+struct directory_scan_context
 {
-	YAML::Node out;
+	// Known contents of each directory, before the scan.
+	std::unordered_map<fs::path, std::vector<fs::path>> files;
+	std::unordered_map<fs::path, std::unordered_set<fs::path>> subdirectories;
+
+	uint32 numEnumerated = 0;
+	uint32 numUnchanged = 0;
+};
+
+static void registerDirectory(directory_scan_context& context, fs::path directory)
+{
+	// Also registers all parents up to the asset directory, since the registry may not know them (e.g. after loading a legacy registry).
+	while (directory != assetDirectory && directory.has_parent_path())
+	{
+		fs::path parent = directory.parent_path();
+		if (!context.subdirectories[parent].insert(directory).second)
+		{
+			break;
+		}
+		directory = parent;
+	}
+}
+
+static directory_scan_context buildScanContext()
+{
+	directory_scan_context context;
 
 	for (const auto& [path, handle] : pathToHandle)
 	{
-		YAML::Node n;
-		n["Handle"] = handle;
-		n["Path"] = path;
-		out.push_back(n);
+		fs::path parent = path.parent_path();
+		context.files[parent].push_back(path);
+		registerDirectory(context, parent);
 	}
+	for (const auto& [directory, writeTime] : directoryWriteTimes)
+	{
+		registerDirectory(context, directory);
+	}
+
+	return context;
+}
+
+static void removeDirectory(const fs::path& directory, directory_scan_context& context)
+{
+	directoryWriteTimes.erase(directory);
 
-	fs::create_directories(registryPath.parent_path());
-	std::ofstream fout(registryPath);
-	fout << out;
+	for (const fs::path& path : context.files[directory])
+	{
+		removeFile(path);
+	}
+	for (const fs::path& subdirectory : context.subdirectories[directory])
+	{
+		removeDirectory(subdirectory, context);
+	}
 }
 
-static void readDirectory(const fs::path& path, const path_to_handle& loadedRegistry)
+static void scanDirectory(const fs::path& directory, directory_scan_context& context)
 {
-	for (const auto& dirEntry : fs::directory_iterator(path))
+	int64 writeTime = getWriteTime(directory);
+
+	auto it = directoryWriteTimes.find(directory);
+	if (it != directoryWriteTimes.end() && it->second == writeTime)
+	{
+		// The entries of this directory are unchanged, but the contents of subdirectories may have changed.
+		++context.numUnchanged;
+		for (const fs::path& subdirectory : context.subdirectories[directory])
+		{
+			scanDirectory(subdirectory, context);
+		}
+		return;
+	}
+
+	++context.numEnumerated;
+	directoryWriteTimes[directory] = writeTime;
+
+	std::unordered_set<fs::path> presentFiles;
+	std::unordered_set<fs::path> presentSubdirectories;
+
+	for (const auto& dirEntry : fs::directory_iterator(directory))
 	{
 		const auto& path = dirEntry.path();
 		if (dirEntry.is_directory())
 		{
-			readDirectory(path, loadedRegistry);
+			presentSubdirectories.insert(path);
+			scanDirectory(path, context);
 		}
 		else
 		{
-			auto it = loadedRegistry.find(path);
+			presentFiles.insert(path);
 
-			// If already known, use the handle, otherwise generate one.
-			asset_handle handle = (it != loadedRegistry.end()) ? it->second : asset_handle::generate();
+			// If already known, keep the handle, otherwise generate one.
+			if (pathToHandle.find(path) == pathToHandle.end())
+			{
+				addFile(path, asset_handle::generate());
+			}
+		}
+	}
 
-			pathToHandle.insert({ path, handle });
-			handleToPath.insert({ handle, path });
+	for (const fs::path& path : context.files[directory])
+	{
+		if (presentFiles.find(path) == presentFiles.end())
+		{
+			removeFile(path);
+		}
+	}
+	for (const fs::path& subdirectory : context.subdirectories[directory])
+	{
+		if (presentSubdirectories.find(subdirectory) == presentSubdirectories.end())
+		{
+			removeDirectory(subdirectory, context);
 		}
 	}
 }
 
+
 static void handleAssetChange(const file_system_event& e)
 {
-	if (!fs::is_directory(e.path) && e.path != registryPath)
+	if (!fs::is_directory(e.path))
 	{
-		mutex.lock();
+		const std::lock_guard<std::mutex> lock(mutex);
+
 		switch (e.change)
 		{
 			case file_system_change_add:
@@ -93,8 +429,10 @@ static void handleAssetChange(const file_system_event& e)
 				ASSERT(pathToHandle.find(e.path) == pathToHandle.end());
 
 				asset_handle handle = asset_handle::generate();
-				pathToHandle.insert({ e.path, handle });
-				handleToPath.insert({ handle, e.path });
+				addFile(e.path, handle);
+				appendToJournal(journal_op_add, handle, e.path);
+
+				notifyAssetChanged(e.path); // E.g. a texture, which a material references, but which did not exist before.
 			} break;
 
 			case file_system_change_delete:
@@ -106,13 +444,15 @@ static void handleAssetChange(const file_system_event& e)
 				ASSERT(it != pathToHandle.end());
 
 				asset_handle handle = it->second;
-				pathToHandle.erase(it);
-				handleToPath.erase(handle);
+				removeFile(e.path);
+				appendToJournal(journal_op_delete, handle, e.path);
 			} break;
 
 			case file_system_change_modify:
 			{
 				LOG_MESSAGE("Asset '%ws' modified", e.path.c_str());
+
+				notifyAssetChanged(e.path);
 			} break;
 
 			case file_system_change_rename:
@@ -125,16 +465,12 @@ static void handleAssetChange(const file_system_event& e)
 				ASSERT(pathToHandle.find(e.path) == pathToHandle.end()); // New path does not exist.
 
 				asset_handle handle = oldIt->second;
-				pathToHandle.erase(oldIt);
-				pathToHandle.insert({ e.path, handle });
-				handleToPath[handle] = e.path; // Replace.
+				renameFile(e.oldPath, e.path, handle);
+				appendToJournal(journal_op_rename, handle, e.path, e.oldPath);
+
+				notifyAssetChanged(e.path); // Many applications save by writing a temporary file and renaming it.
 			} break;
 		}
-		mutex.unlock();
-
-		// During runtime the registry is only written to in this function, so no need to protect the read with mutex.
-		LOG_MESSAGE("Rewriting file registry");
-		writeRegistryToDisk();
 	}
 }
 
@@ -162,11 +498,37 @@ fs::path getPathFromAssetHandle(asset_handle handle)
 	return it->second;
 }
 
+std::vector<fs::path> getAllRegisteredPaths()
+{
+	const std::lock_guard<std::mutex> lock(mutex);
+
+	std::vector<fs::path> result;
+	result.reserve(pathToHandle.size());
+	for (const auto& [path, handle] : pathToHandle)
+	{
+		result.push_back(path);
+	}
+	return result;
+}
+
 void initializeFileRegistry()
 {
-	auto loadedRegistry = loadRegistryFromDisk();
-	readDirectory(L"assets", loadedRegistry);
-	writeRegistryToDisk();
+	if (loadSnapshot())
+	{
+		replayJournal();
+	}
+	else if (fs::exists(legacyRegistryPath))
+	{
+		loadLegacyRegistry();
+	}
+
+	directory_scan_context context = buildScanContext();
+	scanDirectory(assetDirectory, context);
+
+	LOG_MESSAGE("File registry: %u files, enumerated %u directories, %u unchanged",
+		(uint32)pathToHandle.size(), context.numEnumerated, context.numUnchanged);
+
+	writeSnapshot();
 
-	observeDirectory(L"assets", handleAssetChange);
+	observeDirectory(assetDirectory, handleAssetChange);
 }
@@ -4,6 +4,7 @@
 
 asset_handle getAssetHandleFromPath(const fs::path& path);
 fs::path getPathFromAssetHandle(asset_handle handle);
+std::vector<fs::path> getAllRegisteredPaths();
 
 
 void initializeFileRegistry();
@@ -1,5 +1,6 @@
 #include "pch.h"
 #include "image.h"
+#include "asset_cache.h"
 #include "core/log.h"
 #include "core/memory.h"
 
@@ -14,6 +15,9 @@
 
 #include <wincodec.h>
 
+// Bump this whenever the output of postProcessImage changes.
+#define IMAGE_IMPORTER_VERSION 1
+
 
 bool isImageExtension(const fs::path& extension)
 {
@@ -73,34 +77,31 @@ static DXGI_FORMAT makeLinear(DXGI_FORMAT format)
 	return format;
 }
 
-static bool tryLoadFromCache(const fs::path& filepath, uint32 flags, fs::path& cacheFilepath, DirectX::ScratchImage& scratchImage, DirectX::TexMetadata& metadata)
+// Flags, which do not change the processed image, must not be part of the cache key.
+static uint32 getCacheKeyFlags(uint32 flags)
 {
-	fs::path cachedFilename = filepath;
-	cachedFilename.replace_extension("." + std::to_string(flags) + ".cache.dds");
+	return flags & ~(image_load_flags_cache_to_dds | image_load_flags_always_load_from_source | image_load_flags_synchronous);
+}
 
-	cacheFilepath = L"asset_cache" / cachedFilename;
+static bool tryLoadFromCache(const fs::path& filepath, uint32 flags, asset_cache_entry& cacheEntry, DirectX::ScratchImage& scratchImage, DirectX::TexMetadata& metadata)
+{
+	cacheEntry = {};
 
-	bool fromCache = false;
+	bool readFromCache = !(flags & image_load_flags_always_load_from_source);
+	bool writeToCache = flags & image_load_flags_cache_to_dds;
 
-	if (!(flags & image_load_flags_always_load_from_source))
+	if ((!readFromCache && !writeToCache) || !fs::exists(filepath))
 	{
-		// Look for cached.
+		return false;
+	}
 
-		WIN32_FILE_ATTRIBUTE_DATA cachedData;
-		if (GetFileAttributesExW(cacheFilepath.c_str(), GetFileExInfoStandard, &cachedData))
-		{
-			FILETIME cachedFiletime = cachedData.ftLastWriteTime;
+	cacheEntry = lookupAssetCache(hashFileContent(filepath), getCacheKeyFlags(flags), IMAGE_IMPORTER_VERSION, ".cache.dds");
 
-			WIN32_FILE_ATTRIBUTE_DATA originalData;
-			ASSERT(GetFileAttributesExW(filepath.c_str(), GetFileExInfoStandard, &originalData));
-			FILETIME originalFiletime = originalData.ftLastWriteTime;
+	bool fromCache = false;
 
-			if (CompareFileTime(&cachedFiletime, &originalFiletime) >= 0)
-			{
-				// Cached file is newer than original, so load this.
-				fromCache = SUCCEEDED(DirectX::LoadFromDDSFile(cacheFilepath.c_str(), DirectX::DDS_FLAGS_NONE, &metadata, scratchImage));
-			}
-		}
+	if (readFromCache && cacheEntry.exists)
+	{
+		fromCache = SUCCEEDED(DirectX::LoadFromDDSFile(cacheEntry.path.c_str(), DirectX::DDS_FLAGS_NONE, &metadata, scratchImage));
 	}
 
 	return fromCache;
@@ -130,7 +131,7 @@ static void createDesc(DirectX::TexMetadata& metadata, uint32 flags, D3D12_RESOU
 	}
 }
 
-static void postProcessImage(DirectX::ScratchImage& scratchImage, DirectX::TexMetadata& metadata, uint32 flags, const fs::path& filepath, const fs::path& cacheFilepath)
+static void postProcessImage(DirectX::ScratchImage& scratchImage, DirectX::TexMetadata& metadata, uint32 flags, const fs::path& filepath, asset_cache_entry& cacheEntry)
 {
 	if (flags & image_load_flags_noncolor)
 	{
@@ -225,10 +226,12 @@ static void postProcessImage(DirectX::ScratchImage& scratchImage, DirectX::TexMe
 		}
 	}
 
-	if (flags & image_load_flags_cache_to_dds)
+	if (flags & image_load_flags_cache_to_dds && !cacheEntry.path.empty())
 	{
-		fs::create_directories(cacheFilepath.parent_path());
-		checkResult(DirectX::SaveToDDSFile(scratchImage.GetImages(), scratchImage.GetImageCount(), metadata, DirectX::DDS_FLAGS_NONE, cacheFilepath.c_str()));
+		commitAssetCache(cacheEntry, filepath, {}, [&](const fs::path& tempPath)
+		{
+			return SUCCEEDED(DirectX::SaveToDDSFile(scratchImage.GetImages(), scratchImage.GetImageCount(), metadata, DirectX::DDS_FLAGS_NONE, tempPath.c_str()));
+		});
 	}
 }
 
@@ -242,20 +245,14 @@ bool loadImageFromMemory(const void* data, uint32 size, image_format imageFormat
 	}
 
 
-	fs::path cachedFilename = cachingFilepath.string() + std::to_string(flags) + ".cache.dds";
-	fs::path cacheFilepath = L"asset_cache" / cachedFilename;
+	asset_cache_entry cacheEntry = lookupAssetCache(hashMemory(data, size), getCacheKeyFlags(flags), IMAGE_IMPORTER_VERSION, ".cache.dds");
 
 	bool fromCache = false;
 	DirectX::TexMetadata metadata;
 
-	if (!(flags & image_load_flags_always_load_from_source))
+	if (!(flags & image_load_flags_always_load_from_source) && cacheEntry.exists)
 	{
-		// Look for cached.
-
-		if (fs::exists(cacheFilepath))
-		{
-			fromCache = SUCCEEDED(DirectX::LoadFromDDSFile(cacheFilepath.c_str(), DirectX::DDS_FLAGS_NONE, &metadata, scratchImage));
-		}
+		fromCache = SUCCEEDED(DirectX::LoadFromDDSFile(cacheEntry.path.c_str(), DirectX::DDS_FLAGS_NONE, &metadata, scratchImage));
 	}
 
 	if (!fromCache)
@@ -302,7 +299,7 @@ bool loadImageFromMemory(const void* data, uint32 size, image_format imageFormat
 			}
 		}
 
-		postProcessImage(scratchImage, metadata, flags, cacheFilepath, cacheFilepath);
+		postProcessImage(scratchImage, metadata, flags, cachingFilepath, cacheEntry);
 	}
 
 	createDesc(metadata, flags, textureDesc);
@@ -312,9 +309,9 @@ bool loadImageFromMemory(const void* data, uint32 size, image_format imageFormat
 
 bool loadSVGFromFile(const fs::path& filepath, uint32 flags, DirectX::ScratchImage& scratchImage, D3D12_RESOURCE_DESC& textureDesc)
 {
-	fs::path cacheFilepath;
+	asset_cache_entry cacheEntry;
 	DirectX::TexMetadata metadata;
-	bool fromCache = tryLoadFromCache(filepath, flags, cacheFilepath, scratchImage, metadata);
+	bool fromCache = tryLoadFromCache(filepath, flags, cacheEntry, scratchImage, metadata);
 
 	if (!fromCache)
 	{
@@ -352,7 +349,7 @@ bool loadSVGFromFile(const fs::path& filepath, uint32 flags, DirectX::ScratchIma
 		scratchImage.InitializeFromImage(dxImage);
 		metadata = scratchImage.GetMetadata();
 
-		postProcessImage(scratchImage, metadata, flags, filepath, cacheFilepath);
+		postProcessImage(scratchImage, metadata, flags, filepath, cacheEntry);
 
 		delete[] rawImage;
 	}
@@ -364,9 +361,9 @@ bool loadSVGFromFile(const fs::path& filepath, uint32 flags, DirectX::ScratchIma
 
 bool loadImageFromFile(const fs::path& filepath, uint32 flags, DirectX::ScratchImage& scratchImage, D3D12_RESOURCE_DESC& textureDesc)
 {
-	fs::path cacheFilepath;
+	asset_cache_entry cacheEntry;
 	DirectX::TexMetadata metadata;
-	bool fromCache = tryLoadFromCache(filepath, flags, cacheFilepath, scratchImage, metadata);
+	bool fromCache = tryLoadFromCache(filepath, flags, cacheEntry, scratchImage, metadata);
 
 	if (!fromCache)
 	{
@@ -418,7 +415,7 @@ bool loadImageFromFile(const fs::path& filepath, uint32 flags, DirectX::ScratchI
 			}
 		}
 
-		postProcessImage(scratchImage, metadata, flags, filepath, cacheFilepath);
+		postProcessImage(scratchImage, metadata, flags, filepath, cacheEntry);
 	}
 
 	createDesc(metadata, flags, textureDesc);
@@ -426,6 +423,11 @@ bool loadImageFromFile(const fs::path& filepath, uint32 flags, DirectX::ScratchI
 	return true;
 }
 
+bool isImageCached(const fs::path& filepath, uint32 flags)
+{
+	return fs::exists(filepath) && lookupAssetCache(hashFileContent(filepath), getCacheKeyFlags(flags), IMAGE_IMPORTER_VERSION, ".cache.dds").exists;
+}
+
 bool saveImageToFile(const fs::path& filepath, DirectX::Image image)
 {
 	fs::path extension = filepath.extension();
@@ -4,8 +4,8 @@
 
 
 // If the texture_load_flags_cache_to_dds flags is set, the system will cache the texture as DDS to disk for faster loading next time.
-// Loading from cache is not done if the original file has a newer write time or if the cache was created with different flags.
-// Therefore: If you change these flags in code, delete the texture cache!
+// Cache entries are keyed by the content of the original file and the flags (see asset_cache.h), so changing either simply results in
+// a new entry. If you change how images are processed, bump IMAGE_IMPORTER_VERSION in image.cpp.
 
 enum image_load_flags
 {
@@ -46,6 +46,7 @@ bool loadImageFromMemory(const void* data, uint32 size, image_format imageFormat
 	uint32 flags, DirectX::ScratchImage& scratchImage, D3D12_RESOURCE_DESC& textureDesc);
 bool loadImageFromFile(const fs::path& filepath, uint32 flags, DirectX::ScratchImage& scratchImage, D3D12_RESOURCE_DESC& textureDesc);
 bool loadSVGFromFile(const fs::path& filepath, uint32 flags, DirectX::ScratchImage& scratchImage, D3D12_RESOURCE_DESC& textureDesc);
+bool isImageCached(const fs::path& filepath, uint32 flags); // True, if loading the file with these flags would not need to process the source.
 
 
 bool saveImageToFile(const fs::path& filepath, DirectX::Image image);
@@ -1,7 +1,11 @@
 #include "pch.h"
 #include "model_asset.h"
+#include "asset_cache.h"
 #include "core/log.h"
 
+// Bump this whenever the output of the importers or the layout of the BIN format changes.
+#define MODEL_IMPORTER_VERSION 1
+
 model_asset loadFBX(const fs::path& path, uint32 flags);
 model_asset loadOBJ(const fs::path& path, uint32 flags);
 
@@ -20,19 +24,10 @@ model_asset load3DModelFromFile(const fs::path& path, uint32 meshFlags)
 
 	std::string extension = path.extension().string();
 
-	fs::path cachedFilename = path;
-	cachedFilename.replace_extension("." + std::to_string(meshFlags) + ".cache.bin");
-	fs::path cacheFilepath = L"asset_cache" / cachedFilename;
-
-	if (fs::exists(cacheFilepath))
+	asset_cache_entry cacheEntry = lookupAssetCache(hashFileContent(path), meshFlags, MODEL_IMPORTER_VERSION, ".cache.bin");
+	if (cacheEntry.exists)
 	{
-		auto lastCacheWriteTime = fs::last_write_time(cacheFilepath);
-		auto lastOriginalWriteTime = fs::last_write_time(path);
-
-		if (lastCacheWriteTime > lastOriginalWriteTime)
-		{
-			return loadBIN(cacheFilepath);
-		}
+		return loadBIN(cacheEntry.path);
 	}
 
 
@@ -57,12 +52,32 @@ model_asset load3DModelFromFile(const fs::path& path, uint32 meshFlags)
 		result = loadOBJ(path, meshFlags);
 	}
 
-	fs::create_directories(cacheFilepath.parent_path());
-	writeBIN(result, cacheFilepath);
+	std::vector<fs::path> dependencies;
+	for (const pbr_material_desc& material : result.materials)
+	{
+		for (const fs::path& texture : { material.albedo, material.normal, material.roughness, material.metallic })
+		{
+			if (!texture.empty())
+			{
+				dependencies.push_back(texture);
+			}
+		}
+	}
+
+	commitAssetCache(cacheEntry, path, dependencies, [&result](const fs::path& tempPath)
+	{
+		writeBIN(result, tempPath);
+		return fs::exists(tempPath);
+	});
 
 	return result;
 }
 
+bool isModelCached(const fs::path& path, uint32 meshFlags)
+{
+	return fs::exists(path) && lookupAssetCache(hashFileContent(path), meshFlags, MODEL_IMPORTER_VERSION, ".cache.bin").exists;
+}
+
 bool isMeshExtension(const fs::path& extension)
 {
 	return extension == ".fbx" || extension == ".obj" || extension == ".bin";
@@ -79,6 +79,7 @@ enum mesh_flags
 
 
 model_asset load3DModelFromFile(const fs::path& path, uint32 meshFlags = mesh_flag_default);
+bool isModelCached(const fs::path& path, uint32 meshFlags = mesh_flag_default); // True, if load3DModelFromFile would not need to import the source.
 
 
 bool isMeshExtension(const fs::path& extension);
@@ -10,11 +10,13 @@
 #include "audio.h"
 #include "sound.h"
 #include "channel.h"
+#include "audio_streaming.h"
+#include "software_mixer.h"
 
 #include "core/log.h"
 #include "core/cpu_profiling.h"
 
-#include <unordered_map>
+#include <algorithm>
 #include <x3daudio.h>
 
 
@@ -30,9 +32,141 @@ static property_fader soundTypeVolumeFaders[sound_type_count];
 
 static audio_context context;
 
-typedef std::unordered_map<uint32, ref<audio_channel>> channel_map;
-static channel_map channels;
-static uint32 nextChannelID = 1;
+
+// Channels live in a fixed array of slots, so that they never move (the streaming thread and the voice callbacks point to them). Live
+// slots are kept in a dense list for iteration. Handles store the slot index and a generation, which detects stale handles.
+#define CHANNEL_SLOT_BITS 10
+#define MAX_NUM_AUDIO_CHANNELS (1 << CHANNEL_SLOT_BITS)
+
+struct channel_slot
+{
+	alignas(audio_channel) uint8 storage[sizeof(audio_channel)];
+	uint32 generation = 0;
+	bool used = false;
+
+	audio_channel* get() { return (audio_channel*)storage; }
+};
+
+static channel_slot channelSlots[MAX_NUM_AUDIO_CHANNELS];
+static uint32 activeChannels[MAX_NUM_AUDIO_CHANNELS];
+static uint32 numActiveChannels;
+static uint32 freeChannelSlots[MAX_NUM_AUDIO_CHANNELS];
+static uint32 numFreeChannelSlots;
+
+static uint32 numRealChannels; // Channels with a voice. Updated by the voice manager and on creation.
+
+
+static void initializeChannelSlots()
+{
+	numActiveChannels = 0;
+	numFreeChannelSlots = MAX_NUM_AUDIO_CHANNELS;
+	for (uint32 i = 0; i < MAX_NUM_AUDIO_CHANNELS; ++i)
+	{
+		freeChannelSlots[i] = MAX_NUM_AUDIO_CHANNELS - 1 - i;
+	}
+}
+
+static audio_channel* getChannel(sound_handle handle)
+{
+	uint32 slot = handle.id & (MAX_NUM_AUDIO_CHANNELS - 1);
+	uint32 generation = handle.id >> CHANNEL_SLOT_BITS;
+	return (handle && channelSlots[slot].used && channelSlots[slot].generation == generation) ? channelSlots[slot].get() : 0;
+}
+
+template <typename... args_t>
+static sound_handle createChannel(const args_t&... args)
+{
+	if (numFreeChannelSlots == 0)
+	{
+		LOG_WARNING("Out of audio channels");
+		return {};
+	}
+
+	// New channels start virtual, if the voice limit is reached. The voice manager may swap them in on the next update.
+	bool startVirtual = numRealChannels >= masterAudioSettings.maxRealVoices;
+
+	uint32 slot = freeChannelSlots[--numFreeChannelSlots];
+	channel_slot& s = channelSlots[slot];
+	s.generation = (s.generation + 1) & ((1 << (32 - CHANNEL_SLOT_BITS)) - 1);
+	s.generation = max(s.generation, 1u);
+	s.used = true;
+
+	audio_channel* channel = new(s.storage) audio_channel(context, args..., startVirtual);
+	numRealChannels += channel->hasVoice();
+
+	activeChannels[numActiveChannels++] = slot;
+
+	return { (s.generation << CHANNEL_SLOT_BITS) | slot };
+}
+
+static void destroyChannel(uint32 activeIndex)
+{
+	uint32 slot = activeChannels[activeIndex];
+	activeChannels[activeIndex] = activeChannels[--numActiveChannels];
+
+	channelSlots[slot].get()->~audio_channel();
+	channelSlots[slot].used = false;
+	freeChannelSlots[numFreeChannelSlots++] = slot;
+}
+
+static void destroyAllChannels()
+{
+	while (numActiveChannels)
+	{
+		destroyChannel(numActiveChannels - 1);
+	}
+	numRealChannels = 0;
+}
+
+// Scores all channels by priority and audibility. The best ones get (or keep) a voice, the rest become virtual.
+static void updateVoiceManager()
+{
+	struct channel_score
+	{
+		uint32 priority;
+		float audibility;
+		audio_channel* channel;
+	};
+
+	channel_score scores[MAX_NUM_AUDIO_CHANNELS];
+	uint32 numScores = 0;
+
+	for (uint32 i = 0; i < numActiveChannels; ++i)
+	{
+		audio_channel* channel = channelSlots[activeChannels[i]].get();
+		if (channel->isStopping())
+		{
+			continue;
+		}
+
+		float audibility = channel->estimateAudibility(context.listenerPosition) * soundTypeVolumes[channel->sound->type];
+
+		// Prefer channels which already have a voice, so that channels of similar audibility do not keep swapping.
+		if (channel->hasVoice())
+		{
+			audibility *= 1.25f;
+		}
+
+		scores[numScores++] = { channel->getSettings()->priority, audibility, channel };
+	}
+
+	uint32 maxRealVoices = masterAudioSettings.maxRealVoices;
+	if (numScores > maxRealVoices)
+	{
+		std::nth_element(scores, scores + maxRealVoices, scores + numScores, [](const channel_score& a, const channel_score& b)
+		{
+			return (a.priority != b.priority) ? (a.priority > b.priority) : (a.audibility > b.audibility);
+		});
+	}
+
+	numRealChannels = 0;
+	for (uint32 i = 0; i < numScores; ++i)
+	{
+		bool real = i < maxRealVoices && scores[i].audibility > 0.f;
+		scores[i].channel->setVirtual(!real);
+		numRealChannels += real;
+	}
+}
 
 
 
@@ -87,6 +221,12 @@ static void setReverb()
 {
 	bool reverbOn = masterAudioSettings.reverbEnabled && masterAudioSettings.reverbPreset != reverb_none;
 
+	if (context.mixer)
+	{
+		context.mixer->setReverbEnabled(reverbOn);
+		return;
+	}
+
 	if (reverbOn)
 	{
 		XAUDIO2FX_REVERB_PARAMETERS reverbParameters;
@@ -111,13 +251,61 @@ static void setReverb()
 	}
 }
 
-bool initializeAudio()
+static bool initializeSoftwareAudio(audio_backend backend, const fs::path& offlineOutputPath)
 {
+	context.mixer = new software_mixer;
+	context.mixer->initialize();
+
+	if (backend == audio_backend_null)
+	{
+		context.outputDevice = new null_audio_output_device(*context.mixer);
+	}
+	else
+	{
+		context.outputDevice = new offline_audio_output_device(offlineOutputPath);
+	}
+
+	if (!initializeAudioStreaming())
+	{
+		return false;
+	}
+
+	masterVolumeFader.initialize(masterAudioSettings.volume);
+	context.mixer->setMasterVolume(masterAudioSettings.volume);
+
+	for (uint32 i = 0; i < sound_type_count; ++i)
+	{
+		soundTypeVolumes[i] = oldSoundTypeVolumes[i] = 1.f;
+		soundTypeVolumeFaders[i].initialize(soundTypeVolumes[i]);
+		context.mixer->setSubmixVolume((sound_type)i, soundTypeVolumes[i]);
+	}
+
+	setReverb();
+
+	initializeChannelSlots();
+	loadSoundRegistry();
+
+	return true;
+}
+
+bool initializeAudio(audio_backend backend, const fs::path& offlineOutputPath)
+{
+	if (backend != audio_backend_xaudio2)
+	{
+		return initializeSoftwareAudio(backend, offlineOutputPath);
+	}
+
 	uint32 flags = 0;
 #ifdef _DEBUG
 	flags |= XAUDIO2_DEBUG_ENGINE;
 #endif
 	checkResult(XAudio2Create(context.xaudio.GetAddressOf(), flags));
+
+	if (!initializeAudioStreaming())
+	{
+		return false;
+	}
+
 	checkResult(context.xaudio->CreateMasteringVoice(&context.masterVoice));
 
 	masterVolumeFader.initialize(masterAudioSettings.volume);
@@ -179,6 +367,7 @@ bool initializeAudio()
 	context.listener.OrientTop = { 0.f, 1.f, 0.f };
 	context.listener.pCone = (X3DAUDIO_CONE*)&X3DAudioDefault_DirectionalCone;
 
+	initializeChannelSlots();
 	loadSoundRegistry();
 
 	return true;
@@ -186,7 +375,17 @@ bool initializeAudio()
 
 void shutdownAudio()
 {
-	channels.clear();
+	shutdownAudioStreaming();
+	destroyAllChannels();
+
+	if (context.mixer)
+	{
+		context.outputDevice->shutdown(*context.mixer);
+		delete context.outputDevice;
+		delete context.mixer;
+		context.outputDevice = 0;
+		context.mixer = 0;
+	}
 
 	if (context.xaudio)
 	{
@@ -197,6 +396,9 @@ void shutdownAudio()
 
 void setAudioListener(vec3 position, quat rotation, vec3 velocity)
 {
+	context.listenerPosition = position;
+	context.listenerRotation = rotation;
+
 	vec3 forward = rotation * vec3(0.f, 0.f, -1.f);
 	vec3 up = rotation * vec3(0.f, 1.f, 0.f);
 
@@ -226,7 +428,7 @@ void updateAudio(float dt)
 	oldMasterAudioSettings = masterAudioSettings;
 
 	masterVolumeFader.update(dt);
-	context.masterVoice->SetVolume(masterVolumeFader.current);
+	context.mixer ? context.mixer->setMasterVolume(masterVolumeFader.current) : (void)context.masterVoice->SetVolume(masterVolumeFader.current);
 
 
 
@@ -242,7 +444,8 @@ void updateAudio(float dt)
 		oldSoundTypeVolumes[i] = soundTypeVolumes[i];
 
 		soundTypeVolumeFaders[i].update(dt);
-		context.soundTypeSubmixVoices[i]->SetVolume(soundTypeVolumeFaders[i].current);
+		context.mixer ? context.mixer->setSubmixVolume((sound_type)i, soundTypeVolumeFaders[i].current) 
+			: (void)context.soundTypeSubmixVoices[i]->SetVolume(soundTypeVolumeFaders[i].current);
 	}
 
 
@@ -252,51 +455,65 @@ void updateAudio(float dt)
 
 
 
-	channel_map::iterator stoppedChannels[64];
-	uint32 numStoppedChannels = 0;
+	updateVoiceManager();
 
-	for (auto it = channels.begin(), end = channels.end(); it != end; ++it)
+	uint32 numVoices = 0;
+	for (uint32 i = 0; i < numActiveChannels;)
 	{
-		it->second->update(context, dt);
-		if (it->second->hasStopped())
+		audio_channel* channel = channelSlots[activeChannels[i]].get();
+		channel->update(context, dt);
+		numVoices += channel->hasVoice();
+
+		if (channel->hasStopped())
+		{
+			destroyChannel(i);
+		}
+		else
 		{
-			stoppedChannels[numStoppedChannels++] = it;
-			//LOG_MESSAGE("Deleting channel");
+			++i;
 		}
 	}
 
-	for (uint32 i = 0; i < numStoppedChannels; ++i)
+	CPU_PROFILE_STAT("Audio channels", numActiveChannels);
+	CPU_PROFILE_STAT("Audio voices", numVoices);
+
+	if (context.outputDevice)
 	{
-		channels.erase(stoppedChannels[i]);
+		context.outputDevice->update(*context.mixer, dt);
 	}
 }
 
 
-sound_handle play2DSound(const sound_id& id, const sound_settings& settings)
+static ref<audio_sound> getOrLoadSound(const sound_id& id)
 {
-	if (settings.volume <= 0.f)
-	{
-		return {};
-	}
-
 	ref<audio_sound> sound = getSound(id);
 	if (!sound)
 	{
 		// Not all sounds are file sounds, but we have no chance of creating a synth here.
 		if (!loadFileSound(id))
 		{
-			return {};
+			return 0;
 		}
 
 		sound = getSound(id);
 	}
+	return sound;
+}
 
-	uint32 channelID = nextChannelID++;
-	
-	ref<audio_channel> channel = make_ref<audio_channel>(context, sound, settings);
-	channels.insert({ channelID, channel });
+sound_handle play2DSound(const sound_id& id, const sound_settings& settings)
+{
+	if (settings.volume <= 0.f)
+	{
+		return {};
+	}
+
+	ref<audio_sound> sound = getOrLoadSound(id);
+	if (!sound)
+	{
+		return {};
+	}
 
-	return { channelID };
+	return createChannel(sound, settings);
 }
 
 sound_handle play3DSound(const sound_id& id, vec3 position, const sound_settings& settings)
@@ -306,56 +523,49 @@ sound_handle play3DSound(const sound_id& id, vec3 position, const sound_settings
 		return {};
 	}
 
-	ref<audio_sound> sound = getSound(id);
+	ref<audio_sound> sound = getOrLoadSound(id);
 	if (!sound)
 	{
-		if (!loadFileSound(id))
-		{
-			return {};
-		}
-
-		sound = getSound(id);
+		return {};
 	}
 
-	uint32 channelID = nextChannelID++;
-
-	ref<audio_channel> channel = make_ref<audio_channel>(context, sound, position, settings);
-	channels.insert({ channelID, channel });
-
-	return { channelID };
+	return createChannel(sound, position, settings);
 }
 
 bool soundStillPlaying(sound_handle handle)
 {
-	return handle && (channels.find(handle.id) != channels.end());
+	return getChannel(handle) != 0;
 }
 
 bool stop(sound_handle handle, float fadeOutTime)
 {
-	if (handle)
+	if (audio_channel* channel = getChannel(handle))
 	{
-		auto it = channels.find(handle.id);
-		if (it != channels.end())
-		{
-			it->second->stop(fadeOutTime);
-			return true;
-		}
+		channel->stop(fadeOutTime);
+		return true;
 	}
 	return false;
 }
 
 void restartAllSounds()
 {
-	auto channelsCopy = std::move(channels);
-
-	for (auto it = channelsCopy.begin(), end = channelsCopy.end(); it != end; ++it)
+	// New channels are appended, so only the current ones are visited.
+	uint32 numChannels = numActiveChannels;
+	for (uint32 i = 0; i < numChannels; ++i)
 	{
-		sound_id id = it->second->sound->id;
-		sound_settings settings = *it->second->getSettings();
-		bool positioned = it->second->positioned;
-		vec3 position = it->second->position;
+		audio_channel* channel = channelSlots[activeChannels[i]].get();
+		if (channel->isStopping())
+		{
+			continue;
+		}
+
+		sound_id id = channel->sound->id;
+		sound_settings settings = *channel->getSettings();
+		bool positioned = channel->positioned;
+		vec3 position = channel->position;
 
-		it->second->stop(0.f);
+		// The old channel is removed once its stream has returned all buffers.
+		channel->stop(0.f);
 
 		if (positioned)
 		{
@@ -370,15 +580,8 @@ void restartAllSounds()
 
 sound_settings* getSettings(sound_handle handle)
 {
-	if (handle)
-	{
-		auto it = channels.find(handle.id);
-		if (it != channels.end())
-		{
-			return it->second->getSettings();
-		}
-	}
-	return 0;
+	audio_channel* channel = getChannel(handle);
+	return channel ? channel->getSettings() : 0;
 }
 
 float dbToVolume(float db)
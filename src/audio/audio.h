@@ -14,6 +14,7 @@ struct master_audio_settings
 	float volume = 0.1f;
 	bool reverbEnabled = true;
 	reverb_preset reverbPreset = reverb_preset_default;
+	uint32 maxRealVoices = 64; // Channels beyond this are virtualized by priority and audibility.
 };
 
 
@@ -21,7 +22,14 @@ extern master_audio_settings masterAudioSettings;
 extern float soundTypeVolumes[sound_type_count];
 
 
-bool initializeAudio();
+enum audio_backend
+{
+	audio_backend_xaudio2,
+	audio_backend_null,		// Software mixer, rendered in real time and discarded.
+	audio_backend_offline,	// Software mixer, rendered deterministically from the frame times. Optionally written to a WAV file.
+};
+
+bool initializeAudio(audio_backend backend = audio_backend_xaudio2, const fs::path& offlineOutputPath = {});
 void shutdownAudio();
 
 void setAudioListener(vec3 position, quat rotation, vec3 velocity = vec3(0.f));
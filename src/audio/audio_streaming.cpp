@@ -0,0 +1,504 @@
+#include "pch.h"
+#include "audio_streaming.h"
+#include "channel.h"
+#include "software_mixer.h"
+#include "sound_bank.h"
+
+#include "core/log.h"
+#include "core/memory.h"
+
+#include <algorithm>
+
+
+#define MAX_NUM_STREAMING_BUFFERS 256
+#define MAX_NUM_COMPLETIONS_PER_WAKE 64
+
+
+struct audio_streaming_buffer
+{
+	OVERLAPPED overlapped; // Must be first, so that completion packets can be mapped back to the buffer.
+
+	audio_stream* stream;
+	audio_streaming_buffer* nextFree;
+
+	uint32 size;
+	bool completed;
+	bool endOfStream;
+
+	alignas(16) uint8 data[STREAMING_BUFFER_SIZE];
+};
+
+enum streaming_packet_key
+{
+	streaming_packet_file_read = 1, // Streaming files are associated with the completion port under this key.
+	streaming_packet_buffer_end,
+	streaming_packet_wake,
+	streaming_packet_quit,
+};
+
+static HANDLE completionPort;
+static HANDLE streamingThread;
+
+static std::mutex mutex;
+static std::vector<audio_stream*> streams;
+
+static audio_streaming_buffer* buffers;
+static audio_streaming_buffer* freeBuffers;
+
+
+static audio_streaming_buffer* allocateBuffer(audio_stream* stream)
+{
+	audio_streaming_buffer* buffer = freeBuffers;
+	if (buffer)
+	{
+		freeBuffers = buffer->nextFree;
+
+		buffer->stream = stream;
+		buffer->nextFree = 0;
+		buffer->size = 0;
+		buffer->completed = false;
+		buffer->endOfStream = false;
+	}
+	return buffer;
+}
+
+static void freeBuffer(audio_streaming_buffer* buffer)
+{
+	buffer->stream = 0;
+	buffer->nextFree = freeBuffers;
+	freeBuffers = buffer;
+}
+
+static void pushPending(audio_stream* stream, audio_streaming_buffer* buffer)
+{
+	ASSERT(stream->numPending < STREAMING_BUFFERS_PER_STREAM);
+	stream->pending[(stream->firstPending + stream->numPending) % STREAMING_BUFFERS_PER_STREAM] = buffer;
+	++stream->numPending;
+}
+
+static void advanceReadPosition(audio_stream* stream, audio_streaming_buffer* buffer, uint32 size)
+{
+	stream->readPosition += size;
+	if (stream->readPosition >= stream->sound->chunkSize)
+	{
+		if (stream->loop)
+		{
+			stream->readPosition = 0;
+		}
+		else
+		{
+			stream->endOfData = true;
+			buffer->endOfStream = true;
+		}
+	}
+}
+
+static bool issueFileRead(audio_stream* stream)
+{
+	const audio_sound* sound = stream->sound.get();
+
+	audio_streaming_buffer* buffer = allocateBuffer(stream);
+	if (!buffer)
+	{
+		return false;
+	}
+
+	uint32 size = min(sound->chunkSize - stream->readPosition, (uint32)STREAMING_BUFFER_SIZE);
+
+	buffer->overlapped = {};
+	buffer->overlapped.Offset = sound->chunkPosition + stream->readPosition;
+	buffer->size = size;
+
+	advanceReadPosition(stream, buffer, size);
+
+	// The completion is always posted to the port, even if the read finishes synchronously.
+	if (!ReadFile(sound->fileHandle, buffer->data, size, 0, &buffer->overlapped) && GetLastError() != ERROR_IO_PENDING)
+	{
+		LOG_ERROR("Could not read from streaming file '%ws'", sound->path.c_str());
+		freeBuffer(buffer);
+		stream->endOfData = true;
+		return false;
+	}
+
+	pushPending(stream, buffer);
+	return true;
+}
+
+static bool generateSynthSamples(audio_stream* stream)
+{
+	audio_streaming_buffer* buffer = allocateBuffer(stream);
+	if (!buffer)
+	{
+		return false;
+	}
+
+	const uint32 maxNumSamples = STREAMING_BUFFER_SIZE / sizeof(float);
+
+	uint32 numSamples = stream->synth->getSamples((float*)buffer->data, maxNumSamples);
+	if (numSamples == 0 && stream->loop)
+	{
+		stream->synth = stream->sound->createSynth(stream->synthBuffer);
+		numSamples = stream->synth->getSamples((float*)buffer->data, maxNumSamples);
+	}
+
+	if (numSamples == 0)
+	{
+		freeBuffer(buffer);
+		stream->endOfData = true;
+		return false;
+	}
+
+	buffer->size = numSamples * sizeof(float);
+	buffer->completed = true;
+
+	pushPending(stream, buffer);
+	return true;
+}
+
+static bool decodeBankSamples(audio_stream* stream)
+{
+	const audio_sound* sound = stream->sound.get();
+
+	audio_streaming_buffer* buffer = allocateBuffer(stream);
+	if (!buffer)
+	{
+		return false;
+	}
+
+	uint32 blockAlign = sound->wfx.Format.nBlockAlign;
+	uint32 numFrames = min(sound->chunkSize - stream->readPosition, (uint32)STREAMING_BUFFER_SIZE) / blockAlign;
+
+	decodeSoundBankFrames(sound->bankData, sound->wfx.Format.nChannels, stream->readPosition / blockAlign, numFrames, (int16*)buffer->data);
+
+	buffer->size = numFrames * blockAlign;
+	buffer->completed = true;
+
+	advanceReadPosition(stream, buffer, buffer->size);
+
+	pushPending(stream, buffer);
+	return true;
+}
+
+static bool requestData(audio_stream* stream)
+{
+	if (stream->stopRequested || stream->endOfData || stream->numPending + stream->numQueued >= STREAMING_BUFFERS_PER_STREAM)
+	{
+		return false;
+	}
+
+	const audio_sound* sound = stream->sound.get();
+	return sound->isSynth ? generateSynthSamples(stream) : sound->bankData ? decodeBankSamples(stream) : issueFileRead(stream);
+}
+
+// Reads may complete out of order, so buffers are submitted only once all earlier ones are.
+static void submitCompletedBuffers(audio_stream* stream)
+{
+	while (stream->numPending && stream->pending[stream->firstPending]->completed)
+	{
+		audio_streaming_buffer* buffer = stream->pending[stream->firstPending];
+		stream->firstPending = (stream->firstPending + 1) % STREAMING_BUFFERS_PER_STREAM;
+		--stream->numPending;
+
+		if (stream->stopRequested || buffer->size == 0)
+		{
+			freeBuffer(buffer);
+			continue;
+		}
+
+		if (stream->mixer)
+		{
+			mixer_buffer mBuffer = { buffer->data, buffer->size, false, buffer->endOfStream, buffer };
+			bool submitted = stream->mixer->submitBuffer(stream->mixerVoice, mBuffer);
+			ASSERT(submitted);
+		}
+		else
+		{
+			XAUDIO2_BUFFER xBuffer = { 0 };
+			xBuffer.AudioBytes = buffer->size;
+			xBuffer.pAudioData = buffer->data;
+			xBuffer.pContext = buffer;
+			xBuffer.Flags = buffer->endOfStream ? XAUDIO2_END_OF_STREAM : 0;
+
+			checkResult(stream->voice->SubmitSourceBuffer(&xBuffer));
+		}
+		++stream->numQueued;
+	}
+}
+
+static void scheduleStreams()
+{
+	// Retire streams, which are stopped or have played everything.
+	for (uint32 i = 0; i < (uint32)streams.size();)
+	{
+		audio_stream* stream = streams[i];
+
+		if (stream->stopRequested && !stream->flushed)
+		{
+			// The voice is already stopped. Flushing returns the queued buffers through OnBufferEnd.
+			stream->mixer ? stream->mixer->flushBuffers(stream->mixerVoice) : (void)stream->voice->FlushSourceBuffers();
+			stream->flushed = true;
+		}
+
+		submitCompletedBuffers(stream);
+
+		bool drained = stream->numPending == 0 && stream->numQueued == 0;
+		if (drained && (stream->stopRequested || stream->endOfData))
+		{
+			if (!stream->stopRequested)
+			{
+				stream->channel->stop(0.f);
+			}
+
+			streams[i] = streams.back();
+			streams.pop_back();
+
+			stream->finished = true;
+		}
+		else
+		{
+			++i;
+		}
+	}
+
+	// Streams with the fewest buffers left go first, music before effects. If the pool runs dry, the rest waits for the next wake.
+	audio_stream* candidates[MAX_NUM_STREAMING_BUFFERS];
+	uint32 numCandidates = 0;
+
+	for (audio_stream* stream : streams)
+	{
+		if (!stream->stopRequested && !stream->endOfData && stream->numPending + stream->numQueued < STREAMING_BUFFERS_PER_STREAM
+			&& numCandidates < MAX_NUM_STREAMING_BUFFERS)
+		{
+			candidates[numCandidates++] = stream;
+		}
+	}
+
+	auto priority = [](const audio_stream* stream)
+	{
+		return (stream->numPending + stream->numQueued) * 2 + (stream->sound->type != sound_type_music);
+	};
+
+	std::sort(candidates, candidates + numCandidates, [&](const audio_stream* a, const audio_stream* b)
+	{
+		return priority(a) < priority(b);
+	});
+
+	for (uint32 i = 0; i < numCandidates && freeBuffers; ++i)
+	{
+		while (requestData(candidates[i])) {}
+		submitCompletedBuffers(candidates[i]);
+	}
+}
+
+static DWORD WINAPI streamingThreadProc(void* parameter)
+{
+	while (true)
+	{
+		OVERLAPPED_ENTRY entries[MAX_NUM_COMPLETIONS_PER_WAKE];
+		ULONG numEntries = 0;
+		if (!GetQueuedCompletionStatusEx(completionPort, entries, MAX_NUM_COMPLETIONS_PER_WAKE, &numEntries, INFINITE, FALSE))
+		{
+			break;
+		}
+
+		const std::lock_guard<std::mutex> lock(mutex);
+
+		bool quit = false;
+		for (uint32 i = 0; i < numEntries; ++i)
+		{
+			audio_streaming_buffer* buffer = (audio_streaming_buffer*)entries[i].lpOverlapped;
+
+			switch (entries[i].lpCompletionKey)
+			{
+				case streaming_packet_file_read:
+				{
+					// Failed reads transfer 0 bytes and are skipped on submission.
+					buffer->size = entries[i].dwNumberOfBytesTransferred;
+					buffer->completed = true;
+				} break;
+
+				case streaming_packet_buffer_end:
+				{
+					--buffer->stream->numQueued;
+					freeBuffer(buffer);
+				} break;
+
+				case streaming_packet_quit:
+				{
+					quit = true;
+				} break;
+
+				default:
+					break;
+			}
+		}
+
+		if (quit)
+		{
+			break;
+		}
+
+		scheduleStreams();
+	}
+
+	return 0;
+}
+
+bool initializeAudioStreaming()
+{
+	completionPort = CreateIoCompletionPort(INVALID_HANDLE_VALUE, 0, 0, 1);
+	if (!completionPort)
+	{
+		LOG_ERROR("Could not create audio streaming completion port");
+		return false;
+	}
+
+	buffers = (audio_streaming_buffer*)_aligned_malloc(sizeof(audio_streaming_buffer) * MAX_NUM_STREAMING_BUFFERS, 16);
+	trackMemoryAllocation(memory_tag_audio, sizeof(audio_streaming_buffer) * MAX_NUM_STREAMING_BUFFERS);
+
+	freeBuffers = 0;
+	for (int32 i = MAX_NUM_STREAMING_BUFFERS - 1; i >= 0; --i)
+	{
+		freeBuffer(buffers + i);
+	}
+
+	streamingThread = CreateThread(0, 0, streamingThreadProc, 0, 0, 0);
+	SetThreadPriority(streamingThread, THREAD_PRIORITY_ABOVE_NORMAL);
+	SetThreadDescription(streamingThread, L"Audio streaming");
+
+	return true;
+}
+
+void shutdownAudioStreaming()
+{
+	if (!completionPort)
+	{
+		return;
+	}
+
+	{
+		const std::lock_guard<std::mutex> lock(mutex);
+		for (audio_stream* stream : streams)
+		{
+			stream->mixer ? stream->mixer->stop(stream->mixerVoice) : (void)stream->voice->Stop();
+			stream->stopRequested = true;
+		}
+	}
+	PostQueuedCompletionStatus(completionPort, 0, streaming_packet_wake, 0);
+
+	// Give outstanding reads and buffers a chance to return.
+	for (uint32 i = 0; i < 100; ++i)
+	{
+		{
+			const std::lock_guard<std::mutex> lock(mutex);
+			if (streams.empty())
+			{
+				break;
+			}
+		}
+		Sleep(10);
+	}
+
+	PostQueuedCompletionStatus(completionPort, 0, streaming_packet_quit, 0);
+	WaitForSingleObject(streamingThread, INFINITE);
+	CloseHandle(streamingThread);
+
+	// If streams are still alive, reads may still be writing into the buffers, so these are leaked. The streams themselves are abandoned:
+	// Their voices are stopped and nothing serves them anymore, so they count as finished and their voices can be destroyed.
+	if (streams.empty())
+	{
+		_aligned_free(buffers);
+		trackMemoryFree(memory_tag_audio, sizeof(audio_streaming_buffer) * MAX_NUM_STREAMING_BUFFERS);
+	}
+	else
+	{
+		LOG_WARNING("%u audio stream%s did not drain before shutdown", (uint32)streams.size(), (streams.size() > 1) ? "s" : "");
+		for (audio_stream* stream : streams)
+		{
+			stream->finished = true;
+		}
+	}
+	buffers = 0;
+	freeBuffers = 0;
+	streams.clear();
+
+	CloseHandle(completionPort);
+	completionPort = 0;
+}
+
+HANDLE openAudioStreamFile(const fs::path& path)
+{
+	HANDLE fileHandle = CreateFileW(
+		path.c_str(),
+		GENERIC_READ,
+		FILE_SHARE_READ,
+		NULL,
+		OPEN_EXISTING,
+		FILE_FLAG_OVERLAPPED,
+		NULL);
+
+	if (fileHandle == INVALID_HANDLE_VALUE)
+	{
+		LOG_ERROR("Could not open file '%ws'", path.c_str());
+		return INVALID_HANDLE_VALUE;
+	}
+
+	if (!CreateIoCompletionPort(fileHandle, completionPort, streaming_packet_file_read, 0))
+	{
+		LOG_ERROR("Could not associate file '%ws' with the audio streaming thread", path.c_str());
+		CloseHandle(fileHandle);
+		return INVALID_HANDLE_VALUE;
+	}
+
+	return fileHandle;
+}
+
+void startAudioStream(audio_stream& stream, audio_channel* channel, IXAudio2SourceVoice* voice, const ref<audio_sound>& sound, bool loop,
+	software_mixer* mixer, uint32 mixerVoice, uint32 startPosition)
+{
+	stream.sound = sound;
+	stream.voice = voice;
+	stream.channel = channel;
+	stream.mixer = mixer;
+	stream.mixerVoice = mixerVoice;
+	stream.loop = loop;
+	stream.stopRequested = false;
+	stream.finished = false;
+
+	stream.readPosition = (!sound->isSynth && sound->chunkSize) ? startPosition % sound->chunkSize : 0;
+	stream.endOfData = !sound->isSynth && sound->chunkSize == 0;
+	stream.flushed = false;
+	stream.numQueued = 0;
+	stream.firstPending = 0;
+	stream.numPending = 0;
+
+	stream.synth = sound->isSynth ? sound->createSynth(stream.synthBuffer) : 0;
+
+	{
+		const std::lock_guard<std::mutex> lock(mutex);
+		streams.push_back(&stream);
+
+		// Synths and bank sounds are left to the streaming thread, since generating or decoding samples costs time.
+		if (!sound->isSynth && !sound->bankData)
+		{
+			while (requestData(&stream)) {}
+		}
+	}
+
+	PostQueuedCompletionStatus(completionPort, 0, streaming_packet_wake, 0);
+}
+
+void stopAudioStream(audio_stream& stream)
+{
+	{
+		const std::lock_guard<std::mutex> lock(mutex);
+		stream.stopRequested = true;
+	}
+
+	PostQueuedCompletionStatus(completionPort, 0, streaming_packet_wake, 0);
+}
+
+void onAudioStreamBufferEnd(void* bufferContext)
+{
+	PostQueuedCompletionStatus(completionPort, 0, streaming_packet_buffer_end, (OVERLAPPED*)bufferContext);
+}
@@ -0,0 +1,59 @@
+#pragma once
+
+#include "sound.h"
+
+#include <xaudio2.h>
+
+struct audio_channel;
+struct audio_streaming_buffer;
+struct software_mixer;
+
+
+#define STREAMING_BUFFER_SIZE (1024 * 8 * 6)
+#define STREAMING_BUFFERS_PER_STREAM 3
+
+
+// All streaming channels are served by a single I/O thread. File data is read asynchronously into a shared pool of buffers, and the
+// thread hands out these buffers to the streams which are closest to running dry first.
+struct audio_stream
+{
+	ref<audio_sound> sound;
+	IXAudio2SourceVoice* voice;
+	audio_channel* channel;
+
+	software_mixer* mixer; // If set, the data is submitted to the software mixer voice instead.
+	uint32 mixerVoice;
+
+	volatile bool loop;
+	volatile bool stopRequested;
+	volatile bool finished = true; // Set once all buffers have been returned. Only then can the voice be destroyed.
+
+	// Only accessed with the streaming lock held.
+	uint32 readPosition;
+	bool endOfData;
+	bool flushed;
+	uint32 numQueued; // Submitted to the voice.
+
+	audio_streaming_buffer* pending[STREAMING_BUFFERS_PER_STREAM]; // Reads in flight or not yet submitted, in playback order.
+	uint32 firstPending;
+	uint32 numPending;
+
+	audio_synth* synth;
+	alignas(16) uint8 synthBuffer[MAX_SYNTH_SIZE];
+};
+
+bool initializeAudioStreaming();
+void shutdownAudioStreaming();
+
+// Opens a file for asynchronous reads by the streaming thread.
+HANDLE openAudioStreamFile(const fs::path& path);
+
+// The first file reads are issued right away, so that the data is usually there before the voice needs it. The start position is
+// in bytes relative to the start of the data chunk and is ignored for synths.
+void startAudioStream(audio_stream& stream, audio_channel* channel, IXAudio2SourceVoice* voice, const ref<audio_sound>& sound, bool loop,
+	software_mixer* mixer = 0, uint32 mixerVoice = 0, uint32 startPosition = 0);
+void stopAudioStream(audio_stream& stream);
+
+// Call from IXAudio2VoiceCallback::OnBufferEnd (or software_mixer_voice_callback::onMixerBufferEnd) with the buffer context.
+void onAudioStreamBufferEnd(void* bufferContext);
+
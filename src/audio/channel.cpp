@@ -1,29 +1,25 @@
 #include "pch.h"
 #include "channel.h"
 
+#include "core/log.h"
 
 
-#define MAX_BUFFER_COUNT 3
-#define STREAMING_BUFFER_SIZE (1024 * 8 * 6)
 
 #define UPDATE_3D_PERIOD 3 // > 0.
 
 #define VIRTUALIZE_FADE_TIME 0.1f
 
-DWORD WINAPI streamFileAudio(void* parameter);
-DWORD WINAPI streamSynthAudio(void* parameter);
-
-audio_channel::audio_channel(const audio_context& context, const ref<audio_sound>& sound, const sound_settings& settings)
+audio_channel::audio_channel(const audio_context& context, const ref<audio_sound>& sound, const sound_settings& settings, bool startVirtual)
 {
-	initialize(context, sound, settings, false);
+	initialize(context, sound, settings, false, vec3(0.f), startVirtual);
 }
 
-audio_channel::audio_channel(const audio_context& context, const ref<audio_sound>& sound, vec3 position, const sound_settings& settings)
+audio_channel::audio_channel(const audio_context& context, const ref<audio_sound>& sound, vec3 position, const sound_settings& settings, bool startVirtual)
 {
-	initialize(context, sound, settings, true, position);
+	initialize(context, sound, settings, true, position, startVirtual);
 }
 
-void audio_channel::initialize(const audio_context& context, const ref<audio_sound>& sound, const sound_settings& settings, bool positioned, vec3 position)
+void audio_channel::initialize(const audio_context& context, const ref<audio_sound>& sound, const sound_settings& settings, bool positioned, vec3 position, bool startVirtual)
 {
 	this->sound = sound;
 	this->voiceCallback.channel = this;
@@ -37,48 +33,81 @@ void audio_channel::initialize(const audio_context& context, const ref<audio_sou
 	this->positioned = positioned;
 	this->position = position;
 
-	XAUDIO2_SEND_DESCRIPTOR sendDescriptors[2];
+	const WAVEFORMATEX& wfx = sound->wfx.Format;
+	srcChannels = wfx.nChannels;
+	sampleRate = wfx.nSamplesPerSec;
+	blockAlign = max((uint32)wfx.nBlockAlign, 1u);
+	totalFrames = (sound->stream && sound->isSynth) ? 0 : sound->chunkSize / blockAlign;
 
-	// Direct.
-	sendDescriptors[0].Flags = XAUDIO2_SEND_USEFILTER;
-	sendDescriptors[0].pOutputVoice = context.soundTypeSubmixVoices[sound->type];
+	volumeFader.initialize(settings.volume);
+	pitchFader.initialize(settings.pitch);
 
-	// Reverb.
-	sendDescriptors[1].Flags = XAUDIO2_SEND_USEFILTER;
-	sendDescriptors[1].pOutputVoice = context.reverbSubmixVoices[sound->type];
+	upDownFader.initialize(1.f);
 
-	// Reverb only for positioned voices.
-	const XAUDIO2_VOICE_SENDS sendList = { positioned ? 2u : 1u, sendDescriptors };
+	virtualRequested = startVirtual;
+	if (startVirtual)
+	{
+		state = channel_state_virtual;
+	}
+	else if (!createVoice(context, 0))
+	{
+		state = channel_state_stopped;
+	}
+}
 
-	checkResult(context.xaudio->CreateSourceVoice(&voice, (WAVEFORMATEX*)&sound->wfx, 0, XAUDIO2_DEFAULT_FREQ_RATIO, &voiceCallback, &sendList));
-	checkResult(voice->Start());
+bool audio_channel::createVoice(const audio_context& context, uint64 startFrame)
+{
+	if (context.mixer)
+	{
+		if (!createMixerVoice(context))
+		{
+			return false;
+		}
+	}
+	else
+	{
+		XAUDIO2_SEND_DESCRIPTOR sendDescriptors[2];
 
-	XAUDIO2_VOICE_DETAILS voiceDetails;
-	voice->GetVoiceDetails(&voiceDetails);
-	srcChannels = voiceDetails.InputChannels;
+		// Direct.
+		sendDescriptors[0].Flags = XAUDIO2_SEND_USEFILTER;
+		sendDescriptors[0].pOutputVoice = context.soundTypeSubmixVoices[sound->type];
 
+		// Reverb.
+		sendDescriptors[1].Flags = XAUDIO2_SEND_USEFILTER;
+		sendDescriptors[1].pOutputVoice = context.reverbSubmixVoices[sound->type];
 
-	volumeFader.initialize(settings.volume);
-	pitchFader.initialize(settings.pitch);
+		// Reverb only for positioned voices.
+		const XAUDIO2_VOICE_SENDS sendList = { positioned ? 2u : 1u, sendDescriptors };
+
+		checkResult(context.xaudio->CreateSourceVoice(&voice, (WAVEFORMATEX*)&sound->wfx, 0, XAUDIO2_DEFAULT_FREQ_RATIO, &voiceCallback, &sendList));
+		checkResult(voice->Start());
+	}
+
+	// Push all settings to the new voice.
+	oldVolume = -1.f;
+	oldPitch = -1.f;
+	update3DTimer = 0;
 
-	upDownFader.initialize(1.f);
-	
 	updateSoundSettings(context, 0.f);
 
 	if (sound->stream)
 	{
-		threadStopped = false;
-		bufferEndSemaphore = CreateSemaphore(0, 0, MAX_BUFFER_COUNT, 0);
-
-		auto func = (sound->isSynth) ? streamSynthAudio : streamFileAudio;
-		threadHandle = CreateThread(0, 0, func, this, 0, 0);
+		// Synths cannot seek, so these restart.
+		uint32 startPosition = sound->isSynth ? 0 : (uint32)(startFrame * blockAlign);
+		startAudioStream(stream, this, voice, sound, userSettings.loop, mixer, mixerVoice, startPosition);
+	}
+	else if (mixer)
+	{
+		mixer_buffer buffer = { sound->dataBuffer, sound->chunkSize, userSettings.loop, !userSettings.loop, 0, (uint32)startFrame };
+		mixer->submitBuffer(mixerVoice, buffer);
 	}
 	else
 	{
 		XAUDIO2_BUFFER buffer = { 0 };
 		buffer.AudioBytes = sound->chunkSize;
 		buffer.pAudioData = sound->dataBuffer;
-		if (settings.loop)
+		buffer.PlayBegin = (uint32)startFrame;
+		if (userSettings.loop)
 		{
 			buffer.LoopCount = XAUDIO2_LOOP_INFINITE;
 		}
@@ -89,31 +118,82 @@ void audio_channel::initialize(const audio_context& context, const ref<audio_sou
 
 		checkResult(voice->SubmitSourceBuffer(&buffer));
 	}
+
+	return true;
 }
 
-audio_channel::~audio_channel()
+bool audio_channel::createMixerVoice(const audio_context& context)
 {
-	voice->DestroyVoice();
+	mixer = context.mixer;
+
+	const WAVEFORMATEX& wfx = sound->wfx.Format;
+	bool isFloat = wfx.wFormatTag == WAVE_FORMAT_IEEE_FLOAT
+		|| (wfx.wFormatTag == WAVE_FORMAT_EXTENSIBLE && wfx.wBitsPerSample == 32);
+
+	if (!isFloat && wfx.wBitsPerSample != 16)
+	{
+		LOG_ERROR("Software mixer only supports 16 bit PCM and float sounds");
+		return false;
+	}
+
+	mixer_source_format format;
+	format.format = isFloat ? mixer_sample_format_float : mixer_sample_format_pcm16;
+	format.numChannels = wfx.nChannels;
+	format.sampleRate = wfx.nSamplesPerSec;
+
+	mixerVoice = mixer->createVoice(format, sound->type, positioned, &voiceCallback);
+	if (!mixerVoice)
+	{
+		return false;
+	}
+
+	mixer->start(mixerVoice);
+	return true;
+}
+
+void audio_channel::stopVoice()
+{
+	mixer ? mixer->stop(mixerVoice) : (void)voice->Stop();
+
 	if (sound->stream)
 	{
-		CloseHandle(bufferEndSemaphore);
-		CloseHandle(threadHandle);
+		stopAudioStream(stream);
 	}
 }
 
+void audio_channel::destroyVoice()
+{
+	ASSERT(stream.finished);
+	if (mixerVoice)
+	{
+		mixer->destroyVoice(mixerVoice);
+		mixerVoice = 0;
+	}
+	if (voice)
+	{
+		voice->DestroyVoice();
+		voice = 0;
+	}
+}
+
+audio_channel::~audio_channel()
+{
+	destroyVoice();
+}
+
 void audio_channel::update(const audio_context& context, float dt)
 {
-	switch (state)
+	if (state != channel_state_stopped)
 	{
-		case channel_state_to_play:
+		playbackFrame += dt * pitchFader.current * sampleRate;
+		if (userSettings.loop && totalFrames)
 		{
-			state = channel_state_playing;
-			if (shouldBeVirtual())
-			{
-				state = channel_state_virtual;
-			}
-		} break;
+			playbackFrame = fmod(playbackFrame, (double)totalFrames);
+		}
+	}
 
+	switch (state)
+	{
 		case channel_state_playing:
 		{
 			updateSoundSettings(context, dt);
@@ -127,15 +207,14 @@ void audio_channel::update(const audio_context& context, float dt)
 		case channel_state_stopping:
 		{
 			updateSoundSettings(context, dt);
-			if (upDownFader.current <= 0.f)
+			if (!hasVoice())
 			{
-				voice->Stop();
 				state = channel_state_stopped;
-
-				if (sound->stream)
-				{
-					ReleaseSemaphore(bufferEndSemaphore, 1, 0);
-				}
+			}
+			else if (upDownFader.current <= 0.f)
+			{
+				stopVoice();
+				state = channel_state_stopped;
 			}
 		} break;
 
@@ -147,23 +226,47 @@ void audio_channel::update(const audio_context& context, float dt)
 		{
 			updateSoundSettings(context, dt);
 
-			if (!shouldBeVirtual())
+			if (releasingVoice)
+			{
+				if (stream.finished)
+				{
+					destroyVoice();
+					releasingVoice = false;
+					state = channel_state_virtual;
+				}
+			}
+			else if (!shouldBeVirtual())
 			{
 				upDownFader.startFade(1.f, VIRTUALIZE_FADE_TIME);
 				state = channel_state_playing;
 			}
-			if (upDownFader.current <= 0.f)
+			else if (upDownFader.current <= 0.f)
 			{
-				state = channel_state_virtual;
+				stopVoice();
+				releasingVoice = true;
 			}
 		} break;
 
 		case channel_state_virtual:
 		{
-			if (!shouldBeVirtual())
+			updateSoundSettings(context, dt);
+
+			if (!userSettings.loop && totalFrames && playbackFrame >= totalFrames)
 			{
-				upDownFader.startFade(1.f, VIRTUALIZE_FADE_TIME);
-				state = channel_state_playing;
+				state = channel_state_stopped;
+			}
+			else if (!shouldBeVirtual())
+			{
+				upDownFader.initialize(0.f);
+				if (createVoice(context, (uint64)playbackFrame))
+				{
+					upDownFader.startFade(1.f, VIRTUALIZE_FADE_TIME);
+					state = channel_state_playing;
+				}
+				else
+				{
+					state = channel_state_stopped;
+				}
 			}
 		} break;
 
@@ -172,6 +275,17 @@ void audio_channel::update(const audio_context& context, float dt)
 	}
 }
 
+float audio_channel::estimateAudibility(vec3 listenerPosition) const
+{
+	float audibility = userSettings.volume;
+	if (positioned)
+	{
+		float distance = length(position - listenerPosition);
+		audibility *= (userSettings.radius > 0.f) ? clamp01(1.f - distance / userSettings.radius) : 0.f;
+	}
+	return audibility;
+}
+
 void audio_channel::stop(float fadeOutTime)
 {
 	if (state != channel_state_stopping && state != channel_state_stopped)
@@ -183,7 +297,7 @@ void audio_channel::stop(float fadeOutTime)
 
 bool audio_channel::hasStopped()
 {
-	return state == channel_state_stopped && threadStopped;
+	return state == channel_state_stopped && stream.finished;
 }
 
 void audio_channel::updateSoundSettings(const audio_context& context, float dt)
@@ -200,25 +314,43 @@ void audio_channel::updateSoundSettings(const audio_context& context, float dt)
 	}
 
 	oldUserSettings = userSettings;
+	stream.loop = userSettings.loop;
 
 	upDownFader.update(dt);
 	volumeFader.update(dt);
 	pitchFader.update(dt);
 
+	if (!hasVoice())
+	{
+		return;
+	}
+
 	float v = volumeFader.current * upDownFader.current;
 	if (v != oldVolume)
 	{
-		voice->SetVolume(v);
+		mixer ? mixer->setVolume(mixerVoice, v) : (void)voice->SetVolume(v);
 		oldVolume = v;
 	}
 
 	float p = pitchFader.current;
 	if (p != oldPitch)
 	{
-		voice->SetFrequencyRatio(p);
+		mixer ? mixer->setPitch(mixerVoice, p) : (void)voice->SetFrequencyRatio(p);
 		oldPitch = p;
 	}
 
+	if (mixer)
+	{
+		if (positioned)
+		{
+			float left, right, reverbLevel;
+			computeMixer3DParameters(context.listenerPosition, context.listenerRotation, position, userSettings.radius, left, right, reverbLevel);
+			mixer->setPanning(mixerVoice, left, right);
+			mixer->setReverbLevel(mixerVoice, reverbLevel);
+		}
+		return;
+	}
+
 
 	if (positioned)
 	{
@@ -302,167 +434,5 @@ void audio_channel::updateSoundSettings(const audio_context& context, float dt)
 
 bool audio_channel::shouldBeVirtual()
 {
-	return false;
+	return virtualRequested;
 }
-
-
-
-
-
-
-
-
-
-static DWORD WINAPI streamFileAudio(void* parameter)
-{
-	audio_channel* channel = (audio_channel*)parameter;
-	auto sound = channel->sound;
-	auto voice = channel->voice;
-
-	BYTE buffers[MAX_BUFFER_COUNT][STREAMING_BUFFER_SIZE];
-
-	uint32 currentBufferIndex = 0;
-
-
-	bool quit = false;
-
-	while (!quit)
-	{
-		uint32 currentPosition = 0;
-
-		if (SetFilePointer(sound->fileHandle, sound->chunkPosition, NULL, FILE_BEGIN) == INVALID_SET_FILE_POINTER)
-		{
-			break;
-		}
-
-		while (!quit && currentPosition < sound->chunkSize)
-		{
-			DWORD size = STREAMING_BUFFER_SIZE;
-			if (ReadFile(sound->fileHandle, buffers[currentBufferIndex], size, &size, 0) == 0)
-			{
-				quit = true;
-				break;
-			}
-
-			currentPosition += size;
-
-			XAUDIO2_BUFFER buffer = { 0 };
-			buffer.AudioBytes = size;
-			buffer.pAudioData = buffers[currentBufferIndex];
-			buffer.pContext = channel->bufferEndSemaphore;
-
-			checkResult(voice->SubmitSourceBuffer(&buffer));
-
-			XAUDIO2_VOICE_STATE state;
-			voice->GetState(&state, XAUDIO2_VOICE_NOSAMPLESPLAYED);
-			while (!quit && state.BuffersQueued > MAX_BUFFER_COUNT - 1)
-			{
-				WaitForSingleObject(channel->bufferEndSemaphore, INFINITE);
-				voice->GetState(&state, XAUDIO2_VOICE_NOSAMPLESPLAYED);
-
-				if (channel->state == channel_state_stopped)
-				{
-					quit = true;
-				}
-			}
-			currentBufferIndex++;
-			currentBufferIndex %= MAX_BUFFER_COUNT;
-		}
-
-		if (!channel->userSettings.loop)
-		{
-			break;
-		}
-	}
-
-	if (!quit)
-	{
-		XAUDIO2_VOICE_STATE state;
-		while (voice->GetState(&state, XAUDIO2_VOICE_NOSAMPLESPLAYED), state.BuffersQueued > 0)
-		{
-			WaitForSingleObject(channel->bufferEndSemaphore, INFINITE);
-		}
-	}
-
-	channel->stop(0.f);
-
-	channel->threadStopped = true;
-
-	return 0;
-}
-
-static DWORD WINAPI streamSynthAudio(void* parameter)
-{
-	audio_channel* channel = (audio_channel*)parameter;
-	auto sound = channel->sound;
-	auto voice = channel->voice;
-
-
-
-	float buffers[MAX_BUFFER_COUNT][STREAMING_BUFFER_SIZE];
-
-	uint32 currentBufferIndex = 0;
-
-	bool quit = false;
-
-	while (!quit)
-	{
-		uint8 synthBuffer[MAX_SYNTH_SIZE];
-		audio_synth* synth = sound->createSynth(synthBuffer);
-
-		while (true)
-		{
-			uint32 size = STREAMING_BUFFER_SIZE;
-			size = synth->getSamples(buffers[currentBufferIndex], size);
-
-			if (size == 0)
-			{
-				break;
-			}
-
-			XAUDIO2_BUFFER buffer = { 0 };
-			buffer.AudioBytes = size * sizeof(float);
-			buffer.pAudioData = (BYTE*)buffers[currentBufferIndex];
-			buffer.pContext = channel->bufferEndSemaphore;
-
-			checkResult(voice->SubmitSourceBuffer(&buffer));
-
-			XAUDIO2_VOICE_STATE state;
-			voice->GetState(&state, XAUDIO2_VOICE_NOSAMPLESPLAYED);
-			while (!quit && state.BuffersQueued > MAX_BUFFER_COUNT - 1)
-			{
-				WaitForSingleObject(channel->bufferEndSemaphore, INFINITE);
-				voice->GetState(&state, XAUDIO2_VOICE_NOSAMPLESPLAYED);
-
-				if (channel->state == channel_state_stopped)
-				{
-					quit = true;
-				}
-			}
-			currentBufferIndex++;
-			currentBufferIndex %= MAX_BUFFER_COUNT;
-		}
-
-		if (!channel->userSettings.loop)
-		{
-			break;
-		}
-	}
-
-	if (!quit)
-	{
-		XAUDIO2_VOICE_STATE state;
-		while (voice->GetState(&state, XAUDIO2_VOICE_NOSAMPLESPLAYED), state.BuffersQueued > 0)
-		{
-			WaitForSingleObject(channel->bufferEndSemaphore, INFINITE);
-		}
-	}
-
-	channel->stop(0.f);
-
-	channel->threadStopped = true;
-
-	return 0;
-}
-
-
@@ -1,13 +1,14 @@
 #pragma once
 
 #include "sound.h"
+#include "audio_streaming.h"
+#include "software_mixer.h"
 #include "core/math.h"
 
 #include <x3daudio.h>
 
 enum channel_state
 {
-	channel_state_to_play,
 	channel_state_playing,
 
 	channel_state_stopping,
@@ -67,12 +68,20 @@ struct audio_context
 
 	X3DAUDIO_HANDLE xaudio3D;
 	X3DAUDIO_LISTENER listener;
+
+	// Software backend. If set, none of the XAudio2 members above are valid.
+	software_mixer* mixer = 0;
+	audio_output_device* outputDevice = 0;
+
+	vec3 listenerPosition = vec3(0.f);
+	quat listenerRotation = quat::identity;
 };
 
 struct audio_channel
 {
-	audio_channel(const audio_context& context, const ref<audio_sound>& sound, const sound_settings& settings);
-	audio_channel(const audio_context& context, const ref<audio_sound>& sound, vec3 position, const sound_settings& settings);
+	// Virtual channels have no voice. They only keep track of their playback position, until the voice manager makes them real.
+	audio_channel(const audio_context& context, const ref<audio_sound>& sound, const sound_settings& settings, bool startVirtual = false);
+	audio_channel(const audio_context& context, const ref<audio_sound>& sound, vec3 position, const sound_settings& settings, bool startVirtual = false);
 	~audio_channel();
 
 	void update(const audio_context& context, float dt);
@@ -81,13 +90,26 @@ struct audio_channel
 	sound_settings* getSettings() { return &userSettings; }
 
 	bool hasStopped();
+	bool isStopping() const { return state == channel_state_stopping || state == channel_state_stopped; }
+	bool hasVoice() const { return voice || mixerVoice; }
+
+	// Set by the voice manager before update.
+	void setVirtual(bool v) { virtualRequested = v; }
+
+	// Volume times distance attenuation, without the sound type and master volumes.
+	float estimateAudibility(vec3 listenerPosition) const;
 
 	ref<audio_sound> sound;
 	bool positioned;
 	vec3 position;
 
 private:
-	void initialize(const audio_context& context, const ref<audio_sound>& sound, const sound_settings& settings, bool positioned, vec3 position = vec3(0.f));
+	void initialize(const audio_context& context, const ref<audio_sound>& sound, const sound_settings& settings, bool positioned, vec3 position, bool startVirtual);
+
+	bool createVoice(const audio_context& context, uint64 startFrame);
+	bool createMixerVoice(const audio_context& context);
+	void stopVoice();
+	void destroyVoice();
 
 	void updateSoundSettings(const audio_context& context, float dt);
 
@@ -95,13 +117,25 @@ private:
 
 	uint32 update3DTimer = 0;
 
-	volatile channel_state state = channel_state_to_play;
+	volatile channel_state state = channel_state_playing;
+
+	bool virtualRequested = false;
+	bool releasingVoice = false; // Waiting for the stream to return its buffers, before the voice can be destroyed.
+
+	// Tracked for real and virtual channels, so that a channel can resume at the right position when it becomes real again.
+	double playbackFrame = 0.0;
+	uint64 totalFrames; // 0 if unknown (streamed synths).
+	uint32 sampleRate;
+	uint32 blockAlign;
 
 	property_fader upDownFader;
 	property_fader volumeFader;
 	property_fader pitchFader;
 
-	IXAudio2SourceVoice* voice;
+	IXAudio2SourceVoice* voice = 0;
+
+	software_mixer* mixer = 0;
+	uint32 mixerVoice = 0;
 
 	uint32 srcChannels;
 	
@@ -112,7 +146,7 @@ private:
 	float oldPitch = -1.f;
 
 
-	struct voice_callback : IXAudio2VoiceCallback
+	struct voice_callback : IXAudio2VoiceCallback, software_mixer_voice_callback
 	{
 		audio_channel* channel;
 
@@ -121,17 +155,14 @@ private:
 		virtual void __stdcall OnStreamEnd() override { /*std::cout << "Stream end\n";*/ channel->stop(0.f); }
 		virtual void __stdcall OnVoiceError(void* bufferContext, HRESULT error) override { std::cerr << "Error!\n"; }
 		virtual void __stdcall OnBufferStart(void* bufferContext) override {}
-		virtual void __stdcall OnBufferEnd(void* bufferContext) override { /*std::cout << "Buffer end\n";*/ if (bufferContext) { ReleaseSemaphore((HANDLE)bufferContext, 1, 0); } }
+		virtual void __stdcall OnBufferEnd(void* bufferContext) override { /*std::cout << "Buffer end\n";*/ if (bufferContext) { onAudioStreamBufferEnd(bufferContext); } }
 		virtual void __stdcall OnLoopEnd(void* bufferContext) override {}
+
+		virtual void onMixerBufferEnd(void* bufferContext) override { if (bufferContext) { onAudioStreamBufferEnd(bufferContext); } }
+		virtual void onMixerStreamEnd() override { channel->stop(0.f); }
 	};
 
 	voice_callback voiceCallback;
 
-	HANDLE threadHandle = INVALID_HANDLE_VALUE;
-	friend DWORD WINAPI streamFileAudio(void* parameter);
-	friend DWORD WINAPI streamSynthAudio(void* parameter);
-
-	HANDLE bufferEndSemaphore;
-
-	bool threadStopped = true;
+	audio_stream stream;
 };
@@ -0,0 +1,705 @@
+#include "pch.h"
+#include "software_mixer.h"
+
+#include "core/simd.h"
+#include "core/log.h"
+
+#include <chrono>
+#include <fstream>
+
+
+#define MAX_RESAMPLING_STEP 8.f // Source rate / output rate * pitch.
+
+
+static uint32 alignTo4(uint32 i) { return (i + 3) & ~3u; }
+
+static uint32 getFrameSize(const mixer_source_format& format)
+{
+	return format.numChannels * (format.format == mixer_sample_format_pcm16 ? (uint32)sizeof(int16) : (uint32)sizeof(float));
+}
+
+
+// Sample conversion. Writes planar float. Right is unused for mono sources.
+
+static w4_float loadPCM16(__m128i packed) // Lower 4 int16s.
+{
+	__m128i widened = _mm_srai_epi32(_mm_unpacklo_epi16(packed, packed), 16);
+	return convert(w4_int(widened)) * (1.f / 32768.f);
+}
+
+static void convertPCM16Mono(const int16* source, uint32 numFrames, float* left)
+{
+	uint32 i = 0;
+	for (; i + 4 <= numFrames; i += 4)
+	{
+		loadPCM16(_mm_loadl_epi64((const __m128i*)(source + i))).store(left + i);
+	}
+	for (; i < numFrames; ++i)
+	{
+		left[i] = source[i] * (1.f / 32768.f);
+	}
+}
+
+static void convertPCM16Stereo(const int16* source, uint32 numFrames, float* left, float* right)
+{
+	uint32 i = 0;
+	for (; i + 4 <= numFrames; i += 4)
+	{
+		__m128i packed = _mm_loadu_si128((const __m128i*)(source + i * 2));
+		w4_float a = loadPCM16(packed);						// l0 r0 l1 r1
+		w4_float b = loadPCM16(_mm_srli_si128(packed, 8));	// l2 r2 l3 r3
+
+		w4_float(_mm_shuffle_ps(a.f, b.f, _MM_SHUFFLE(2, 0, 2, 0))).store(left + i);
+		w4_float(_mm_shuffle_ps(a.f, b.f, _MM_SHUFFLE(3, 1, 3, 1))).store(right + i);
+	}
+	for (; i < numFrames; ++i)
+	{
+		left[i] = source[i * 2 + 0] * (1.f / 32768.f);
+		right[i] = source[i * 2 + 1] * (1.f / 32768.f);
+	}
+}
+
+static void convertFloatStereo(const float* source, uint32 numFrames, float* left, float* right)
+{
+	uint32 i = 0;
+	for (; i + 4 <= numFrames; i += 4)
+	{
+		w4_float a(source + i * 2);
+		w4_float b(source + i * 2 + 4);
+
+		w4_float(_mm_shuffle_ps(a.f, b.f, _MM_SHUFFLE(2, 0, 2, 0))).store(left + i);
+		w4_float(_mm_shuffle_ps(a.f, b.f, _MM_SHUFFLE(3, 1, 3, 1))).store(right + i);
+	}
+	for (; i < numFrames; ++i)
+	{
+		left[i] = source[i * 2 + 0];
+		right[i] = source[i * 2 + 1];
+	}
+}
+
+static void convertFrames(const mixer_source_format& format, const void* data, uint32 firstFrame, uint32 numFrames, float* left, float* right)
+{
+	if (format.format == mixer_sample_format_pcm16)
+	{
+		const int16* source = (const int16*)data + firstFrame * format.numChannels;
+		(format.numChannels == 1) ? convertPCM16Mono(source, numFrames, left) : convertPCM16Stereo(source, numFrames, left, right);
+	}
+	else
+	{
+		const float* source = (const float*)data + firstFrame * format.numChannels;
+		if (format.numChannels == 1)
+		{
+			memcpy(left, source, numFrames * sizeof(float));
+		}
+		else
+		{
+			convertFloatStereo(source, numFrames, left, right);
+		}
+	}
+}
+
+// Linear interpolation at positions fraction + i * step. The source must hold floor(fraction + (numFrames - 1) * step) + 2 samples.
+static void resample(const float* source, float fraction, float step, uint32 numFrames, float* out)
+{
+	w4_float offsets(0.f, 1.f, 2.f, 3.f);
+	for (uint32 i = 0; i < numFrames; i += 4)
+	{
+		w4_float position = (w4_float((float)i) + offsets) * step + fraction;
+		w4_int index = _mm_cvttps_epi32(position);
+		w4_float t = position - convert(index);
+
+		w4_float a(source, index.i);
+		w4_float b(source, (index + 1).i);
+		lerp(a, b, t).store(out + i);
+	}
+}
+
+// out += in * gain, with the gain going linearly from 'from' to 'to' over numRampFrames.
+static void mixWithRamp(const float* in, float* out, uint32 numFrames, float from, float to, uint32 numRampFrames)
+{
+	float delta = (to - from) / numRampFrames;
+	w4_float offsets(1.f, 2.f, 3.f, 4.f);
+	for (uint32 i = 0; i < numFrames; i += 4)
+	{
+		w4_float gain = fmadd(w4_float((float)i) + offsets, delta, from);
+		gain = minimum(gain, maximum(from, to));
+		gain = maximum(gain, minimum(from, to));
+		fmadd(w4_float(in + i), gain, w4_float(out + i)).store(out + i);
+	}
+}
+
+
+void software_mixer::schroeder_reverb::initialize(uint32 sampleRate)
+{
+	// Freeverb tunings at 44.1 kHz.
+	const uint32 combLengths[numCombs] = { 1557, 1617, 1491, 1422 };
+	const uint32 allpassLengths[numAllpasses] = { 556, 441 };
+
+	float scale = sampleRate / 44100.f;
+	for (uint32 i = 0; i < numCombs; ++i)
+	{
+		combs[i].assign(max(1u, (uint32)(combLengths[i] * scale)), 0.f);
+		combPositions[i] = 0;
+		combFilterStates[i] = 0.f;
+	}
+	for (uint32 i = 0; i < numAllpasses; ++i)
+	{
+		allpasses[i].assign(max(1u, (uint32)(allpassLengths[i] * scale)), 0.f);
+		allpassPositions[i] = 0;
+	}
+}
+
+void software_mixer::schroeder_reverb::process(const float* input, float* left, float* right, uint32 numFrames)
+{
+	const float feedback = 0.84f;
+	const float damping = 0.2f;
+	const float allpassFeedback = 0.5f;
+	const float wet = 0.25f;
+
+	for (uint32 i = 0; i < numFrames; ++i)
+	{
+		float in = input[i];
+		float out = 0.f;
+
+		for (uint32 c = 0; c < numCombs; ++c)
+		{
+			float& delayed = combs[c][combPositions[c]];
+			out += delayed;
+
+			combFilterStates[c] = delayed * (1.f - damping) + combFilterStates[c] * damping;
+			delayed = in + combFilterStates[c] * feedback;
+
+			if (++combPositions[c] == (uint32)combs[c].size()) { combPositions[c] = 0; }
+		}
+
+		for (uint32 a = 0; a < numAllpasses; ++a)
+		{
+			float& delayed = allpasses[a][allpassPositions[a]];
+			float result = delayed - out;
+			delayed = out + delayed * allpassFeedback;
+			out = result;
+
+			if (++allpassPositions[a] == (uint32)allpasses[a].size()) { allpassPositions[a] = 0; }
+		}
+
+		left[i] += out * wet;
+		right[i] += out * wet;
+	}
+}
+
+
+void software_mixer::initialize(uint32 sampleRate, uint32 blockSize)
+{
+	this->sampleRate = sampleRate;
+	this->blockSize = clamp(alignTo4(blockSize), 4u, (uint32)SOFTWARE_MIXER_MAX_BLOCK_SIZE);
+
+	voices.clear();
+	voices.resize(1);
+
+	uint32 maxNumSourceFrames = alignTo4((uint32)(this->blockSize * MAX_RESAMPLING_STEP) + 2);
+	sourceLeft.assign(maxNumSourceFrames, 0.f);
+	sourceRight.assign(maxNumSourceFrames, 0.f);
+
+	voiceLeft.assign(this->blockSize, 0.f);
+	voiceRight.assign(this->blockSize, 0.f);
+	mixLeft.assign(this->blockSize, 0.f);
+	mixRight.assign(this->blockSize, 0.f);
+
+	for (uint32 i = 0; i < sound_type_count; ++i)
+	{
+		submixLeft[i].assign(this->blockSize, 0.f);
+		submixRight[i].assign(this->blockSize, 0.f);
+		submixReverb[i].assign(this->blockSize, 0.f);
+
+		submixes[i].volume = 1.f;
+		submixes[i].gain.current = submixes[i].gain.target = 1.f;
+		submixes[i].reverb.initialize(sampleRate);
+	}
+
+	masterGain.current = masterGain.target = masterVolume;
+}
+
+software_mixer::mixer_voice* software_mixer::getVoice(uint32 voice)
+{
+	return (voice > 0 && voice < (uint32)voices.size() && voices[voice].used) ? &voices[voice] : 0;
+}
+
+uint32 software_mixer::createVoice(const mixer_source_format& format, sound_type type, bool reverbSend, software_mixer_voice_callback* callback)
+{
+	if ((format.numChannels != 1 && format.numChannels != 2) || format.sampleRate == 0)
+	{
+		LOG_ERROR("Software mixer only supports mono and stereo sources");
+		return 0;
+	}
+
+	const std::lock_guard<std::mutex> lock(mutex);
+
+	uint32 index = 1;
+	while (index < (uint32)voices.size() && voices[index].used) { ++index; }
+	if (index == (uint32)voices.size())
+	{
+		voices.emplace_back();
+	}
+
+	mixer_voice& v = voices[index];
+	v = mixer_voice();
+	v.used = true;
+	v.reverbSend = reverbSend;
+	v.format = format;
+	v.type = type;
+	v.callback = callback;
+	v.firstBuffer = 0;
+	v.numBuffers = 0;
+	v.framePosition = 0;
+	v.fraction = 0.f;
+	v.pitch = 1.f;
+	v.volume = 1.f;
+	v.panLeft = v.panRight = 1.f;
+	v.reverbLevel = 0.f;
+
+	// Start at the target gains, so that the first block does not fade in.
+	v.gainLeft.current = v.gainLeft.target = 1.f;
+	v.gainRight.current = v.gainRight.target = 1.f;
+
+	return index;
+}
+
+void software_mixer::destroyVoice(uint32 voice)
+{
+	const std::lock_guard<std::mutex> lock(mutex);
+	if (mixer_voice* v = getVoice(voice))
+	{
+		v->used = false;
+		v->playing = false;
+	}
+}
+
+bool software_mixer::submitBuffer(uint32 voice, const mixer_buffer& buffer)
+{
+	const std::lock_guard<std::mutex> lock(mutex);
+	mixer_voice* v = getVoice(voice);
+	if (!v || v->numBuffers == SOFTWARE_MIXER_MAX_QUEUED_BUFFERS)
+	{
+		return false;
+	}
+
+	if (v->numBuffers == 0)
+	{
+		v->framePosition = buffer.playBegin;
+		v->fraction = 0.f;
+	}
+
+	v->queue[(v->firstBuffer + v->numBuffers) % SOFTWARE_MIXER_MAX_QUEUED_BUFFERS] = buffer;
+	++v->numBuffers;
+	return true;
+}
+
+void software_mixer::flushBuffers(uint32 voice)
+{
+	const std::lock_guard<std::mutex> lock(mutex);
+	if (mixer_voice* v = getVoice(voice))
+	{
+		while (v->numBuffers)
+		{
+			void* context = v->queue[v->firstBuffer].context;
+			v->firstBuffer = (v->firstBuffer + 1) % SOFTWARE_MIXER_MAX_QUEUED_BUFFERS;
+			--v->numBuffers;
+
+			if (v->callback) { v->callback->onMixerBufferEnd(context); }
+		}
+		v->framePosition = 0;
+		v->fraction = 0.f;
+	}
+}
+
+void software_mixer::start(uint32 voice)
+{
+	const std::lock_guard<std::mutex> lock(mutex);
+	if (mixer_voice* v = getVoice(voice)) { v->playing = true; }
+}
+
+void software_mixer::stop(uint32 voice)
+{
+	const std::lock_guard<std::mutex> lock(mutex);
+	if (mixer_voice* v = getVoice(voice)) { v->playing = false; }
+}
+
+void software_mixer::setVolume(uint32 voice, float volume)
+{
+	const std::lock_guard<std::mutex> lock(mutex);
+	if (mixer_voice* v = getVoice(voice)) { v->volume = volume; }
+}
+
+void software_mixer::setPitch(uint32 voice, float frequencyRatio)
+{
+	const std::lock_guard<std::mutex> lock(mutex);
+	if (mixer_voice* v = getVoice(voice)) { v->pitch = max(frequencyRatio, 0.f); }
+}
+
+void software_mixer::setPanning(uint32 voice, float left, float right)
+{
+	const std::lock_guard<std::mutex> lock(mutex);
+	if (mixer_voice* v = getVoice(voice)) { v->panLeft = left; v->panRight = right; }
+}
+
+void software_mixer::setReverbLevel(uint32 voice, float level)
+{
+	const std::lock_guard<std::mutex> lock(mutex);
+	if (mixer_voice* v = getVoice(voice)) { v->reverbLevel = level; }
+}
+
+void software_mixer::setSubmixVolume(sound_type type, float volume)
+{
+	const std::lock_guard<std::mutex> lock(mutex);
+	submixes[type].volume = volume;
+}
+
+void software_mixer::setMasterVolume(float volume)
+{
+	const std::lock_guard<std::mutex> lock(mutex);
+	masterVolume = volume;
+}
+
+void software_mixer::setReverbEnabled(bool enabled)
+{
+	const std::lock_guard<std::mutex> lock(mutex);
+	reverbEnabled = enabled;
+}
+
+uint32 software_mixer::getNumPlayingVoices()
+{
+	const std::lock_guard<std::mutex> lock(mutex);
+	uint32 result = 0;
+	for (const mixer_voice& v : voices)
+	{
+		result += v.used && v.playing;
+	}
+	return result;
+}
+
+// Writes numFrames frames, starting at the current play position. Frames after the end of the queue are silent.
+uint32 software_mixer::fetchSourceFrames(mixer_voice& voice, uint32 numFrames, float* left, float* right)
+{
+	uint32 frameSize = getFrameSize(voice.format);
+
+	uint32 written = 0;
+	uint32 bufferIndex = 0;
+	uint32 frame = voice.framePosition;
+
+	while (written < numFrames && bufferIndex < voice.numBuffers)
+	{
+		const mixer_buffer& buffer = voice.queue[(voice.firstBuffer + bufferIndex) % SOFTWARE_MIXER_MAX_QUEUED_BUFFERS];
+		uint32 bufferFrames = buffer.numBytes / frameSize;
+
+		if (frame >= bufferFrames)
+		{
+			frame = 0;
+			if (!buffer.loop || bufferFrames == 0)
+			{
+				++bufferIndex;
+			}
+			continue;
+		}
+
+		uint32 count = min(numFrames - written, bufferFrames - frame);
+		convertFrames(voice.format, buffer.data, frame, count, left + written, right + written);
+
+		written += count;
+		frame += count;
+	}
+
+	uint32 valid = written;
+	for (; written < numFrames; ++written)
+	{
+		left[written] = 0.f;
+		right[written] = 0.f;
+	}
+	return valid;
+}
+
+void software_mixer::advance(mixer_voice& voice, uint32 numFrames)
+{
+	uint32 frameSize = getFrameSize(voice.format);
+
+	voice.framePosition += numFrames;
+	while (voice.numBuffers)
+	{
+		mixer_buffer buffer = voice.queue[voice.firstBuffer];
+		uint32 bufferFrames = buffer.numBytes / frameSize;
+
+		if (voice.framePosition < bufferFrames)
+		{
+			break;
+		}
+		if (buffer.loop && bufferFrames)
+		{
+			voice.framePosition %= bufferFrames;
+			break;
+		}
+
+		voice.framePosition -= bufferFrames;
+		voice.firstBuffer = (voice.firstBuffer + 1) % SOFTWARE_MIXER_MAX_QUEUED_BUFFERS;
+		--voice.numBuffers;
+
+		if (voice.callback) { voice.callback->onMixerBufferEnd(buffer.context); }
+
+		if (buffer.endOfStream)
+		{
+			voice.playing = false;
+			voice.framePosition = 0;
+			voice.fraction = 0.f;
+			if (voice.callback) { voice.callback->onMixerStreamEnd(); }
+			break;
+		}
+	}
+
+	if (!voice.numBuffers)
+	{
+		// Starved or finished. Whatever was skipped past the end is lost.
+		voice.framePosition = 0;
+	}
+}
+
+void software_mixer::renderBlock(float* output, uint32 numFrames)
+{
+	uint32 numPaddedFrames = alignTo4(numFrames);
+
+	for (uint32 t = 0; t < sound_type_count; ++t)
+	{
+		memset(submixLeft[t].data(), 0, numPaddedFrames * sizeof(float));
+		memset(submixRight[t].data(), 0, numPaddedFrames * sizeof(float));
+		memset(submixReverb[t].data(), 0, numPaddedFrames * sizeof(float));
+	}
+
+	for (mixer_voice& voice : voices)
+	{
+		if (!voice.used || !voice.playing)
+		{
+			continue;
+		}
+
+		float step = min((float)voice.format.sampleRate / sampleRate * voice.pitch, MAX_RESAMPLING_STEP);
+
+		// Resampling of the padded frames may read one frame further.
+		uint32 numSourceFrames = (uint32)(voice.fraction + step * (numPaddedFrames - 1)) + 2;
+		fetchSourceFrames(voice, numSourceFrames, sourceLeft.data(), sourceRight.data());
+
+		bool stereo = voice.format.numChannels == 2;
+		resample(sourceLeft.data(), voice.fraction, step, numPaddedFrames, voiceLeft.data());
+		if (stereo)
+		{
+			resample(sourceRight.data(), voice.fraction, step, numPaddedFrames, voiceRight.data());
+		}
+
+		voice.gainLeft.target = voice.volume * voice.panLeft;
+		voice.gainRight.target = voice.volume * voice.panRight;
+		voice.reverbGain.target = voice.reverbSend ? voice.volume * voice.reverbLevel : 0.f;
+
+		const float* right = stereo ? voiceRight.data() : voiceLeft.data();
+		mixWithRamp(voiceLeft.data(), submixLeft[voice.type].data(), numPaddedFrames, voice.gainLeft.current, voice.gainLeft.target, numFrames);
+		mixWithRamp(right, submixRight[voice.type].data(), numPaddedFrames, voice.gainRight.current, voice.gainRight.target, numFrames);
+
+		if (voice.reverbGain.current > 0.f || voice.reverbGain.target > 0.f)
+		{
+			float from = voice.reverbGain.current, to = voice.reverbGain.target;
+			if (stereo)
+			{
+				from *= 0.5f;
+				to *= 0.5f;
+				mixWithRamp(voiceRight.data(), submixReverb[voice.type].data(), numPaddedFrames, from, to, numFrames);
+			}
+			mixWithRamp(voiceLeft.data(), submixReverb[voice.type].data(), numPaddedFrames, from, to, numFrames);
+		}
+
+		voice.gainLeft.current = voice.gainLeft.target;
+		voice.gainRight.current = voice.gainRight.target;
+		voice.reverbGain.current = voice.reverbGain.target;
+
+		float end = voice.fraction + step * numFrames;
+		uint32 consumed = (uint32)end;
+		voice.fraction = end - consumed;
+		advance(voice, consumed);
+	}
+
+	memset(mixLeft.data(), 0, numPaddedFrames * sizeof(float));
+	memset(mixRight.data(), 0, numPaddedFrames * sizeof(float));
+
+	for (uint32 t = 0; t < sound_type_count; ++t)
+	{
+		submix& s = submixes[t];
+
+		if (reverbEnabled)
+		{
+			s.reverb.process(submixReverb[t].data(), submixLeft[t].data(), submixRight[t].data(), numFrames);
+		}
+
+		s.gain.target = s.volume;
+		mixWithRamp(submixLeft[t].data(), mixLeft.data(), numPaddedFrames, s.gain.current, s.gain.target, numFrames);
+		mixWithRamp(submixRight[t].data(), mixRight.data(), numPaddedFrames, s.gain.current, s.gain.target, numFrames);
+		s.gain.current = s.gain.target;
+	}
+
+	// Master gain and interleave.
+	masterGain.target = masterVolume;
+	float delta = (masterGain.target - masterGain.current) / numFrames;
+
+	uint32 i = 0;
+	w4_float offsets(1.f, 2.f, 3.f, 4.f);
+	for (; i + 4 <= numFrames; i += 4)
+	{
+		w4_float gain = fmadd(w4_float((float)i) + offsets, delta, masterGain.current);
+		w4_float l = w4_float(mixLeft.data() + i) * gain;
+		w4_float r = w4_float(mixRight.data() + i) * gain;
+
+		w4_float(_mm_unpacklo_ps(l.f, r.f)).store(output + i * 2);
+		w4_float(_mm_unpackhi_ps(l.f, r.f)).store(output + i * 2 + 4);
+	}
+	for (; i < numFrames; ++i)
+	{
+		float gain = masterGain.current + (i + 1) * delta;
+		output[i * 2 + 0] = mixLeft[i] * gain;
+		output[i * 2 + 1] = mixRight[i] * gain;
+	}
+
+	masterGain.current = masterGain.target;
+}
+
+void software_mixer::render(float* output, uint32 numFrames)
+{
+	while (numFrames)
+	{
+		uint32 count = min(numFrames, blockSize);
+
+		{
+			const std::lock_guard<std::mutex> lock(mutex);
+			renderBlock(output, count);
+		}
+
+		output += count * 2;
+		numFrames -= count;
+	}
+}
+
+
+void computeMixer3DParameters(vec3 listenerPosition, quat listenerRotation, vec3 position, float radius, float& outLeft, float& outRight, float& outReverbLevel)
+{
+	vec3 local = conjugate(listenerRotation) * (position - listenerPosition);
+	float distance = length(local);
+
+	float attenuation = (radius > 0.f) ? clamp01(1.f - distance / radius) : 0.f;
+
+	// Equal power panning. Right is +x in listener space.
+	float x = (distance > 1e-4f) ? local.x / distance : 0.f;
+	float angle = (x + 1.f) * (M_PI * 0.25f);
+
+	outLeft = cos(angle) * attenuation;
+	outRight = sin(angle) * attenuation;
+	outReverbLevel = attenuation;
+}
+
+
+null_audio_output_device::null_audio_output_device(software_mixer& mixer)
+{
+	thread = std::thread([this, &mixer]()
+	{
+		using clock = std::chrono::high_resolution_clock;
+
+		std::vector<float> block(mixer.getBlockSize() * 2);
+		auto blockDuration = std::chrono::duration_cast<clock::duration>(std::chrono::duration<double>((double)mixer.getBlockSize() / mixer.getSampleRate()));
+
+		auto next = clock::now();
+		while (!quit)
+		{
+			auto start = clock::now();
+			mixer.render(block.data(), mixer.getBlockSize());
+			auto end = clock::now();
+
+			renderTimeMicroseconds += std::chrono::duration_cast<std::chrono::microseconds>(end - start).count();
+			numRenderedFrames += mixer.getBlockSize();
+
+			next += blockDuration;
+			std::this_thread::sleep_until(next);
+		}
+	});
+}
+
+void null_audio_output_device::shutdown(software_mixer& mixer)
+{
+	quit = true;
+	if (thread.joinable())
+	{
+		thread.join();
+	}
+}
+
+void offline_audio_output_device::render(software_mixer& mixer, uint32 numFrames)
+{
+	uint64 offset = samples.size();
+	samples.resize(offset + numFrames * 2);
+	mixer.render(samples.data() + offset, numFrames);
+}
+
+void offline_audio_output_device::update(software_mixer& mixer, float dt)
+{
+	timeRemainder += (double)dt * mixer.getSampleRate();
+	uint32 numFrames = (uint32)timeRemainder;
+	timeRemainder -= numFrames;
+
+	render(mixer, numFrames);
+}
+
+void offline_audio_output_device::shutdown(software_mixer& mixer)
+{
+	if (!outputPath.empty())
+	{
+		if (writeWAV(outputPath, samples.data(), (uint32)(samples.size() / 2), 2, mixer.getSampleRate()))
+		{
+			LOG_MESSAGE("Wrote offline audio to '%ws'", outputPath.c_str());
+		}
+	}
+}
+
+bool writeWAV(const fs::path& path, const float* samples, uint32 numFrames, uint32 numChannels, uint32 sampleRate)
+{
+	std::ofstream out(path, std::ios::binary);
+	if (!out)
+	{
+		LOG_ERROR("Could not open file '%ws' for writing", path.c_str());
+		return false;
+	}
+
+	uint32 dataSize = numFrames * numChannels * (uint32)sizeof(float);
+
+	struct
+	{
+		char riff[4] = { 'R', 'I', 'F', 'F' };
+		uint32 riffSize;
+		char wave[4] = { 'W', 'A', 'V', 'E' };
+
+		char fmt[4] = { 'f', 'm', 't', ' ' };
+		uint32 fmtSize = 16;
+		uint16 formatTag = 3; // IEEE float.
+		uint16 numChannels;
+		uint32 sampleRate;
+		uint32 bytesPerSecond;
+		uint16 blockAlign;
+		uint16 bitsPerSample = 32;
+
+		char data[4] = { 'd', 'a', 't', 'a' };
+		uint32 dataSize;
+	} header;
+
+	static_assert(sizeof(header) == 44);
+
+	header.riffSize = 36 + dataSize;
+	header.numChannels = (uint16)numChannels;
+	header.sampleRate = sampleRate;
+	header.bytesPerSecond = sampleRate * numChannels * (uint32)sizeof(float);
+	header.blockAlign = (uint16)(numChannels * sizeof(float));
+	header.dataSize = dataSize;
+
+	out.write((const char*)&header, sizeof(header));
+	out.write((const char*)samples, dataSize);
+
+	return out.good();
+}
@@ -0,0 +1,205 @@
+#pragma once
+
+#include "sound.h"
+#include "reverb.h"
+#include "core/math.h"
+
+#include <mutex>
+#include <thread>
+
+
+// Software replacement for the XAudio2 voice graph: Source voices -> sound type submixes (+ reverb) -> master. Does not depend
+// on any platform audio API, so it can render headless. The output is always interleaved stereo float. All voice processing (sample
+// conversion, resampling, panning and gain ramps) is 4-wide SIMD. Filters and the I3DL2 reverb parameters are not modelled, the
+// reverb is a fixed Schroeder reverb.
+
+#define SOFTWARE_MIXER_MAX_QUEUED_BUFFERS 8
+#define SOFTWARE_MIXER_MAX_BLOCK_SIZE 1024
+
+enum mixer_sample_format
+{
+	mixer_sample_format_pcm16,
+	mixer_sample_format_float,
+};
+
+struct mixer_source_format
+{
+	mixer_sample_format format;
+	uint32 numChannels; // 1 or 2.
+	uint32 sampleRate;
+};
+
+// Callbacks are invoked from the rendering thread, with the mixer locked. They must not call back into the mixer.
+struct software_mixer_voice_callback
+{
+	virtual void onMixerBufferEnd(void* bufferContext) {}
+	virtual void onMixerStreamEnd() {}
+};
+
+struct mixer_buffer
+{
+	const void* data;
+	uint32 numBytes;
+	bool loop;
+	bool endOfStream;
+	void* context;
+	uint32 playBegin; // First frame to play. Only used if the voice's queue is empty.
+};
+
+struct software_mixer
+{
+	void initialize(uint32 sampleRate = 48000, uint32 blockSize = 256);
+
+	uint32 createVoice(const mixer_source_format& format, sound_type type, bool reverbSend, software_mixer_voice_callback* callback); // Returns 0 on failure.
+	void destroyVoice(uint32 voice);
+
+	bool submitBuffer(uint32 voice, const mixer_buffer& buffer);
+	void flushBuffers(uint32 voice); // Calls onMixerBufferEnd for all queued buffers.
+
+	void start(uint32 voice);
+	void stop(uint32 voice);
+
+	// Gains are ramped over one block to avoid clicks.
+	void setVolume(uint32 voice, float volume);
+	void setPitch(uint32 voice, float frequencyRatio);
+	void setPanning(uint32 voice, float left, float right);
+	void setReverbLevel(uint32 voice, float level);
+
+	void setSubmixVolume(sound_type type, float volume);
+	void setMasterVolume(float volume);
+	void setReverbEnabled(bool enabled);
+
+	// Renders interleaved stereo. numFrames does not need to be a multiple of the block size.
+	void render(float* output, uint32 numFrames);
+
+	uint32 getSampleRate() const { return sampleRate; }
+	uint32 getBlockSize() const { return blockSize; }
+	uint32 getNumPlayingVoices();
+
+private:
+	struct gain_ramp
+	{
+		float current = 0.f;
+		float target = 0.f;
+	};
+
+	struct mixer_voice
+	{
+		bool used = false;
+		bool playing = false;
+		bool reverbSend;
+
+		mixer_source_format format;
+		sound_type type;
+		software_mixer_voice_callback* callback;
+
+		mixer_buffer queue[SOFTWARE_MIXER_MAX_QUEUED_BUFFERS];
+		uint32 firstBuffer;
+		uint32 numBuffers;
+
+		uint32 framePosition; // In the first buffer.
+		float fraction;
+		float pitch;
+
+		float volume;
+		float panLeft, panRight;
+
+		gain_ramp gainLeft, gainRight, reverbGain;
+		float reverbLevel;
+	};
+
+	struct schroeder_reverb
+	{
+		static const uint32 numCombs = 4;
+		static const uint32 numAllpasses = 2;
+
+		std::vector<float> combs[numCombs];
+		std::vector<float> allpasses[numAllpasses];
+		uint32 combPositions[numCombs];
+		uint32 allpassPositions[numAllpasses];
+		float combFilterStates[numCombs];
+
+		void initialize(uint32 sampleRate);
+		void process(const float* input, float* left, float* right, uint32 numFrames);
+	};
+
+	struct submix
+	{
+		float volume = 1.f;
+		gain_ramp gain;
+		schroeder_reverb reverb;
+	};
+
+	mixer_voice* getVoice(uint32 voice);
+	void renderBlock(float* output, uint32 numFrames);
+	uint32 fetchSourceFrames(mixer_voice& voice, uint32 numFrames, float* left, float* right);
+	void advance(mixer_voice& voice, uint32 numFrames);
+
+	std::mutex mutex;
+
+	uint32 sampleRate = 0;
+	uint32 blockSize = 0;
+
+	std::vector<mixer_voice> voices; // Index 0 is never used, so that 0 can mean "no voice".
+
+	submix submixes[sound_type_count];
+	float masterVolume = 1.f;
+	gain_ramp masterGain;
+	bool reverbEnabled = true;
+
+	// Scratch, one block each.
+	std::vector<float> sourceLeft, sourceRight;
+	std::vector<float> voiceLeft, voiceRight;
+	std::vector<float> submixLeft[sound_type_count], submixRight[sound_type_count], submixReverb[sound_type_count];
+	std::vector<float> mixLeft, mixRight;
+};
+
+
+// Computes the stereo panning and the distance attenuation of a positioned sound, with the same linear falloff as the XAudio2 path.
+void computeMixer3DParameters(vec3 listenerPosition, quat listenerRotation, vec3 position, float radius, float& outLeft, float& outRight, float& outReverbLevel);
+
+
+// Output devices, which drive the rendering of a software mixer.
+struct audio_output_device
+{
+	virtual ~audio_output_device() {}
+
+	// Called once per frame by updateAudio.
+	virtual void update(software_mixer& mixer, float dt) {}
+	virtual void shutdown(software_mixer& mixer) {}
+};
+
+// Renders on its own thread in real time and discards the result. Used for headless runs and voice count benchmarks.
+struct null_audio_output_device : audio_output_device
+{
+	null_audio_output_device(software_mixer& mixer);
+	virtual void shutdown(software_mixer& mixer) override;
+
+	volatile uint64 numRenderedFrames = 0;
+	volatile uint64 renderTimeMicroseconds = 0;
+
+private:
+	std::thread thread;
+	volatile bool quit = false;
+};
+
+// Renders exactly the frame time passed to update (accumulated at sample precision), so that the output only depends on the sequence
+// of frame times. Writes the result as a WAV file on shutdown, if a path is given.
+struct offline_audio_output_device : audio_output_device
+{
+	offline_audio_output_device(const fs::path& outputPath = {}) : outputPath(outputPath) {}
+
+	virtual void update(software_mixer& mixer, float dt) override;
+	virtual void shutdown(software_mixer& mixer) override;
+
+	void render(software_mixer& mixer, uint32 numFrames);
+
+	std::vector<float> samples; // Interleaved stereo.
+
+private:
+	fs::path outputPath;
+	double timeRemainder = 0.0;
+};
+
+bool writeWAV(const fs::path& path, const float* samples, uint32 numFrames, uint32 numChannels, uint32 sampleRate);
+
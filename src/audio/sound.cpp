@@ -2,6 +2,8 @@
 #include "sound.h"
 #include "audio.h"
 #include "sound_management.h"
+#include "audio_streaming.h"
+#include "sound_bank.h"
 
 #include "core/log.h"
 #include "asset/file_registry.h"
@@ -26,6 +28,8 @@ static bool readChunkData(HANDLE fileHandle, void* buffer, uint32 buffersize, ui
 static std::unordered_map<uint64, ref<audio_sound>> fileSounds;
 static std::unordered_map<uint64, ref<audio_sound>> synthSounds;
 
+static std::vector<ref<sound_bank>> soundBanks;
+
 
 bool checkForExistingFileSound(sound_id id) 
 { 
@@ -51,6 +55,39 @@ void registerSound(sound_id id, const ref<audio_sound>& sound)
     }
 }
 
+static bool loadBankSound(sound_id id, const sound_spec& spec)
+{
+    for (const ref<sound_bank>& bank : soundBanks)
+    {
+        if (const sound_bank_entry* entry = bank->find(id.hash))
+        {
+            WAVEFORMATEX wfx = {};
+            wfx.wFormatTag = WAVE_FORMAT_PCM;
+            wfx.nChannels = entry->numChannels;
+            wfx.nSamplesPerSec = entry->sampleRate;
+            wfx.wBitsPerSample = 16;
+            wfx.nBlockAlign = entry->numChannels * (uint32)sizeof(int16);
+            wfx.nAvgBytesPerSec = entry->sampleRate * wfx.nBlockAlign;
+
+            ref<audio_sound> sound = make_ref<audio_sound>();
+            sound->id = id;
+            sound->path = bank->path;
+            sound->stream = true; // Decoded by the streaming thread.
+            sound->wfx = { wfx };
+            sound->chunkSize = entry->numFrames * wfx.nBlockAlign;
+            sound->chunkPosition = 0;
+            sound->bank = bank;
+            sound->bankData = bank->getData(*entry);
+            sound->isSynth = false;
+            sound->type = spec.type;
+
+            registerSound(id, sound);
+            return true;
+        }
+    }
+    return false;
+}
+
 bool loadFileSound(sound_id id)
 {
     if (checkForExistingFileSound(id))
@@ -61,6 +98,11 @@ bool loadFileSound(sound_id id)
     {
         const sound_spec& spec = getSoundSpec(id);
 
+        if (!spec.stream && loadBankSound(id, spec))
+        {
+            return true;
+        }
+
         fs::path path = getPathFromAssetHandle(spec.asset);
         if (!path.empty())
         {
@@ -85,13 +127,24 @@ bool loadFileSound(sound_id id)
                         {
                             dataBuffer = new BYTE[chunkSize];
                             success = readChunkData(fileHandle, dataBuffer, chunkSize, chunkPosition);
-                            if (!success)
+                            if (success)
+                            {
+                                trackMemoryAllocation(memory_tag_audio, chunkSize);
+                            }
+                            else
                             {
                                 delete[] dataBuffer;
                             }
 
                             closeFile(fileHandle);
                         }
+                        else
+                        {
+                            // The header is parsed synchronously, the data is read asynchronously by the streaming thread.
+                            closeFile(fileHandle);
+                            fileHandle = openAudioStreamFile(path);
+                            success = fileHandle != INVALID_HANDLE_VALUE;
+                        }
                     }
                 }
 
@@ -147,12 +200,29 @@ ref<audio_sound> getSound(sound_id id)
     return result;
 }
 
+bool mountSoundBank(const fs::path& path)
+{
+    ref<sound_bank> bank = loadSoundBank(path);
+    if (bank)
+    {
+        soundBanks.push_back(bank);
+    }
+    return bank != 0;
+}
+
+void unmountAllSoundBanks()
+{
+    // Loaded sounds keep their bank alive.
+    soundBanks.clear();
+}
+
 audio_sound::~audio_sound()
 {
     closeFile(fileHandle);
     if (dataBuffer)
     {
         delete[] dataBuffer;
+        trackMemoryFree(memory_tag_audio, chunkSize);
     }
 }
 
@@ -314,6 +384,28 @@ static bool getWFX(HANDLE fileHandle, const fs::path& path, WAVEFORMATEXTENSIBLE
 }
 
 
+bool readWAVFile(const fs::path& path, WAVEFORMATEXTENSIBLE& wfx, std::vector<uint8>& data)
+{
+    HANDLE fileHandle = openFile(path);
+    if (fileHandle == INVALID_HANDLE_VALUE)
+    {
+        return false;
+    }
+
+    bool success = false;
+
+    uint32 chunkSize, chunkPosition;
+    if (getWFX(fileHandle, path, wfx) && findChunk(fileHandle, fourccDATA, chunkSize, chunkPosition))
+    {
+        data.resize(chunkSize);
+        success = readChunkData(fileHandle, data.data(), chunkSize, chunkPosition);
+    }
+
+    closeFile(fileHandle);
+    return success;
+}
+
+
 bool isSoundExtension(const fs::path& extension)
 {
     return extension == ".wav";
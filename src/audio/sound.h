@@ -3,10 +3,12 @@
 #include "synth.h"
 #include "core/string.h"
 #include "asset/asset.h"
+#include "core/memory.h"
 
 #include <xaudio2.h>
 #include <functional>
 
+struct sound_bank;
 
 struct sound_id
 {
@@ -54,6 +56,10 @@ struct audio_sound
     uint32 chunkPosition;
     BYTE* dataBuffer = 0;
 
+    // Sounds from a sound bank are stored compressed and decoded by the streaming thread. chunkSize is the decoded size.
+    ref<sound_bank> bank;
+    const uint8* bankData = 0;
+
     sound_type type;
 
     virtual ~audio_sound();
@@ -67,6 +73,7 @@ struct sound_settings
     float pitch = 1.f;
     float radius = 30.f;
     bool loop = false;
+    uint32 priority = 0; // Higher priorities get a voice first, regardless of audibility.
 
     float volumeFadeTime = 0.1f;
     float pitchFadeTime = 0.1f;
@@ -80,6 +87,12 @@ void unloadAllSounds();
 
 bool loadFileSound(sound_id id);
 
+// Non-streamed sounds are looked up in the mounted banks first, before falling back to their WAV file.
+bool mountSoundBank(const fs::path& path);
+void unmountAllSoundBanks();
+
+bool readWAVFile(const fs::path& path, WAVEFORMATEXTENSIBLE& wfx, std::vector<uint8>& data);
+
 template <typename synth_t, typename... args>
 static bool loadSynthSound(const char* idStr, sound_type type, bool stream, const args&... a)
 {
@@ -132,6 +145,7 @@ static bool loadSynthSound(const char* idStr, sound_type type, bool stream, cons
             uint32 size = sizeof(float) * totalNumSamples;
 
             dataBuffer = new BYTE[size];
+            trackMemoryAllocation(memory_tag_audio, size);
             synth.getSamples((float*)dataBuffer, totalNumSamples);
 
             dataSize = size;
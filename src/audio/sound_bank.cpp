@@ -0,0 +1,340 @@
+#include "pch.h"
+#include "sound_bank.h"
+
+#include "core/simd.h"
+#include "core/log.h"
+#include "asset/io.h"
+
+#include <fstream>
+
+
+#define SOUND_BANK_MAGIC 'KNBS'
+#define SOUND_BANK_VERSION 1
+
+struct sound_bank_header
+{
+	uint32 magic;
+	uint32 version;
+	uint32 tableSize; // Power of two.
+	uint32 numSounds;
+};
+
+static_assert(sizeof(sound_bank_entry) == 24);
+
+
+static const int32 adpcmStepTable[89] =
+{
+	7, 8, 9, 10, 11, 12, 13, 14, 16, 17, 19, 21, 23, 25, 28, 31, 34, 37, 41, 45, 50, 55, 60, 66, 73, 80, 88, 97, 107, 118, 130, 143,
+	157, 173, 190, 209, 230, 253, 279, 307, 337, 371, 408, 449, 494, 544, 598, 658, 724, 796, 876, 963, 1060, 1166, 1282, 1411, 1552,
+	1707, 1878, 2066, 2272, 2499, 2749, 3024, 3327, 3660, 4026, 4428, 4871, 5358, 5894, 6484, 7132, 7845, 8630, 9493, 10442, 11487,
+	12635, 13899, 15289, 16818, 18500, 20350, 22385, 24623, 27086, 29794, 32767,
+};
+
+static const int32 adpcmIndexTable[8] = { -1, -1, -1, -1, 2, 4, 6, 8 };
+
+
+// Encoding. Scalar, since this only runs when building a bank.
+
+static uint32 encodeADPCMSample(int32 sample, int32& predictor, int32& index)
+{
+	int32 step = adpcmStepTable[index];
+
+	int32 diff = sample - predictor;
+	uint32 nibble = 0;
+	if (diff < 0)
+	{
+		nibble = 8;
+		diff = -diff;
+	}
+
+	if (diff >= step) { nibble |= 4; diff -= step; }
+	if (diff >= step >> 1) { nibble |= 2; diff -= step >> 1; }
+	if (diff >= step >> 2) { nibble |= 1; }
+
+	// Track the decoder state exactly.
+	int32 delta = step >> 3;
+	if (nibble & 4) { delta += step; }
+	if (nibble & 2) { delta += step >> 1; }
+	if (nibble & 1) { delta += step >> 2; }
+	if (nibble & 8) { delta = -delta; }
+
+	predictor = clamp(predictor + delta, -32768, 32767);
+	index = clamp(index + adpcmIndexTable[nibble & 7], 0, 88);
+
+	return nibble;
+}
+
+static void encodeChannelBlock(const int16* samples, uint32 numChannels, uint32 channel, uint32 numFrames, int32& index, uint8* out)
+{
+	// Short blocks are padded with the last sample.
+	int32 block[SOUND_BANK_BLOCK_FRAMES];
+	for (uint32 i = 0; i < SOUND_BANK_BLOCK_FRAMES; ++i)
+	{
+		block[i] = (numFrames > 0) ? samples[min(i, numFrames - 1) * numChannels + channel] : 0;
+	}
+
+	uint32* headers = (uint32*)out;
+	uint32* nibbles = (uint32*)(out + 16);
+
+	for (uint32 run = 0; run < 4; ++run)
+	{
+		const int32* runSamples = block + run * SOUND_BANK_RUN_LENGTH;
+
+		int32 predictor = runSamples[0];
+		headers[run] = (uint32)(uint16)predictor | ((uint32)index << 16);
+
+		for (uint32 group = 0; group < SOUND_BANK_RUN_LENGTH / 8; ++group)
+		{
+			uint32 packed = 0;
+			for (uint32 i = 0; i < 8; ++i)
+			{
+				packed |= encodeADPCMSample(runSamples[group * 8 + i], predictor, index) << (i * 4);
+			}
+			nibbles[group * 4 + run] = packed;
+		}
+	}
+}
+
+bool writeSoundBank(const fs::path& path, const sound_bank_source* sources, uint32 numSources)
+{
+	uint32 tableSize = 16;
+	while (tableSize < numSources * 2)
+	{
+		tableSize *= 2;
+	}
+
+	std::vector<sound_bank_entry> table(tableSize);
+	std::vector<uint32> sourceIndices(tableSize);
+
+	uint32 dataOffset = (uint32)(sizeof(sound_bank_header) + sizeof(sound_bank_entry) * tableSize);
+	dataOffset = alignTo(dataOffset, 16);
+
+	uint32 numSounds = 0;
+	for (uint32 i = 0; i < numSources; ++i)
+	{
+		const sound_bank_source& source = sources[i];
+		if (source.numChannels == 0 || source.numChannels > SOUND_BANK_MAX_CHANNELS)
+		{
+			LOG_WARNING("Skipping sound with %u channels in sound bank. Only mono and stereo sounds are supported", source.numChannels);
+			continue;
+		}
+
+		uint32 slot = (uint32)source.hash & (tableSize - 1);
+		while (table[slot].hash != 0 && table[slot].hash != source.hash)
+		{
+			slot = (slot + 1) & (tableSize - 1);
+		}
+		if (source.hash == 0 || table[slot].hash == source.hash)
+		{
+			continue;
+		}
+
+		sound_bank_entry& entry = table[slot];
+		entry.hash = source.hash;
+		entry.dataOffset = dataOffset;
+		entry.numFrames = source.numFrames;
+		entry.sampleRate = source.sampleRate;
+		entry.numChannels = (uint16)source.numChannels;
+		sourceIndices[slot] = i;
+
+		dataOffset += getSoundBankDataSize(source.numFrames, source.numChannels);
+		++numSounds;
+	}
+
+	std::vector<uint8> data(dataOffset);
+
+	sound_bank_header& header = *(sound_bank_header*)data.data();
+	header.magic = SOUND_BANK_MAGIC;
+	header.version = SOUND_BANK_VERSION;
+	header.tableSize = tableSize;
+	header.numSounds = numSounds;
+
+	memcpy(data.data() + sizeof(sound_bank_header), table.data(), sizeof(sound_bank_entry) * tableSize);
+
+	for (uint32 slot = 0; slot < tableSize; ++slot)
+	{
+		const sound_bank_entry& entry = table[slot];
+		if (entry.hash == 0)
+		{
+			continue;
+		}
+
+		const sound_bank_source& source = sources[sourceIndices[slot]];
+
+		uint8* out = data.data() + entry.dataOffset;
+		int32 indices[SOUND_BANK_MAX_CHANNELS] = {}; // Each channel carries its step index through the whole sound.
+		for (uint32 frame = 0; frame < source.numFrames; frame += SOUND_BANK_BLOCK_FRAMES)
+		{
+			uint32 numFrames = min(source.numFrames - frame, (uint32)SOUND_BANK_BLOCK_FRAMES);
+			for (uint32 channel = 0; channel < source.numChannels; ++channel)
+			{
+				encodeChannelBlock(source.samples + frame * source.numChannels, source.numChannels, channel, numFrames, indices[channel], out);
+				out += SOUND_BANK_CHANNEL_BLOCK_SIZE;
+			}
+		}
+	}
+
+	std::ofstream stream(path, std::ios::binary);
+	if (!stream)
+	{
+		LOG_ERROR("Could not open file '%ws' for writing", path.c_str());
+		return false;
+	}
+
+	stream.write((const char*)data.data(), data.size());
+	return stream.good();
+}
+
+
+// Loading.
+
+sound_bank::~sound_bank()
+{
+	if (data)
+	{
+		freeFile({ data, size });
+		trackMemoryFree(memory_tag_audio, size);
+	}
+}
+
+const sound_bank_entry* sound_bank::find(uint64 hash) const
+{
+	if (!table || hash == 0)
+	{
+		return 0;
+	}
+
+	uint32 slot = (uint32)hash & tableMask;
+	while (table[slot].hash != 0)
+	{
+		if (table[slot].hash == hash)
+		{
+			return &table[slot];
+		}
+		slot = (slot + 1) & tableMask;
+	}
+	return 0;
+}
+
+ref<sound_bank> loadSoundBank(const fs::path& path)
+{
+	entire_file file = loadFile(path);
+	if (!file.content)
+	{
+		return 0;
+	}
+
+	ref<sound_bank> bank = make_ref<sound_bank>();
+	bank->path = path;
+	bank->data = file.content;
+	bank->size = file.size;
+	trackMemoryAllocation(memory_tag_audio, file.size);
+
+	sound_bank_header* header = file.consume<sound_bank_header>();
+	if (!header || header->magic != SOUND_BANK_MAGIC || header->version != SOUND_BANK_VERSION
+		|| header->tableSize == 0 || (header->tableSize & (header->tableSize - 1)) != 0)
+	{
+		LOG_ERROR("File '%ws' is not a valid sound bank", path.c_str());
+		return 0;
+	}
+
+	sound_bank_entry* table = file.consume<sound_bank_entry>(header->tableSize);
+	if (!table)
+	{
+		LOG_ERROR("Sound bank '%ws' is truncated", path.c_str());
+		return 0;
+	}
+
+	for (uint32 i = 0; i < header->tableSize; ++i)
+	{
+		const sound_bank_entry& entry = table[i];
+		if (entry.hash != 0 && ((uint64)entry.dataOffset + getSoundBankDataSize(entry.numFrames, entry.numChannels) > file.size
+			|| entry.numChannels == 0 || entry.numChannels > SOUND_BANK_MAX_CHANNELS || (entry.dataOffset & 15) != 0))
+		{
+			LOG_ERROR("Sound bank '%ws' is corrupt", path.c_str());
+			return 0;
+		}
+	}
+
+	bank->table = table;
+	bank->tableMask = header->tableSize - 1;
+	bank->numSounds = header->numSounds;
+
+	LOG_MESSAGE("Loaded sound bank '%ws' with %u sounds (%llu KB)", path.c_str(), bank->numSounds, file.size / 1024);
+
+	return bank;
+}
+
+
+// Decoding. The 4 runs of a channel block are decoded in parallel, one per SIMD lane.
+
+static void decodeChannelBlock(const uint8* in, int16 (&out)[SOUND_BANK_RUN_LENGTH][4])
+{
+	w4_int headers = _mm_load_si128((const __m128i*)in);
+
+	w4_int predictor = _mm_srai_epi32(_mm_slli_epi32(headers, 16), 16);
+	w4_int index = (headers >> 16) & 0xFF;
+
+	w4_int zero = w4_int::zero();
+
+	for (uint32 group = 0; group < SOUND_BANK_RUN_LENGTH / 8; ++group)
+	{
+		w4_int packed = _mm_load_si128((const __m128i*)(in + 16 + group * 16));
+
+		for (uint32 i = 0; i < 8; ++i)
+		{
+			w4_int nibble = (packed >> (i * 4)) & 0xF;
+
+			w4_int step(adpcmStepTable, index);
+
+			w4_int delta = step >> 3;
+			delta += step & ((nibble & 4) != zero);
+			delta += (step >> 1) & ((nibble & 2) != zero);
+			delta += (step >> 2) & ((nibble & 1) != zero);
+
+			w4_int negative = (nibble & 8) != zero;
+			delta = (delta ^ negative) - negative;
+
+			predictor = _mm_max_epi32(_mm_min_epi32(predictor + delta, w4_int(32767)), w4_int(-32768));
+
+			w4_int magnitude = nibble & 7;
+			index += ifThen(magnitude > w4_int(3), (magnitude - w4_int(3)) << 1, w4_int(-1));
+			index = _mm_max_epi32(_mm_min_epi32(index, w4_int(88)), zero);
+
+			_mm_storel_epi64((__m128i*)out[group * 8 + i], _mm_packs_epi32(predictor, predictor));
+		}
+	}
+}
+
+void decodeSoundBankFrames(const uint8* blocks, uint32 numChannels, uint32 firstFrame, uint32 numFrames, int16* output)
+{
+	ASSERT(numChannels <= SOUND_BANK_MAX_CHANNELS);
+
+	alignas(16) int16 decoded[SOUND_BANK_MAX_CHANNELS][SOUND_BANK_RUN_LENGTH][4];
+
+	uint32 frame = firstFrame;
+	uint32 endFrame = firstFrame + numFrames;
+	while (frame < endFrame)
+	{
+		uint32 blockIndex = frame / SOUND_BANK_BLOCK_FRAMES;
+		const uint8* block = blocks + blockIndex * numChannels * SOUND_BANK_CHANNEL_BLOCK_SIZE;
+
+		for (uint32 channel = 0; channel < numChannels; ++channel)
+		{
+			decodeChannelBlock(block + channel * SOUND_BANK_CHANNEL_BLOCK_SIZE, decoded[channel]);
+		}
+
+		uint32 blockBegin = blockIndex * SOUND_BANK_BLOCK_FRAMES;
+		uint32 blockEnd = min(blockBegin + SOUND_BANK_BLOCK_FRAMES, endFrame);
+
+		// Frame f of the block is sample f % 64 of run f / 64.
+		for (; frame < blockEnd; ++frame)
+		{
+			uint32 f = frame - blockBegin;
+			for (uint32 channel = 0; channel < numChannels; ++channel)
+			{
+				*output++ = decoded[channel][f % SOUND_BANK_RUN_LENGTH][f / SOUND_BANK_RUN_LENGTH];
+			}
+		}
+	}
+}
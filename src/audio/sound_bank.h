@@ -0,0 +1,67 @@
+#pragma once
+
+#include "core/memory.h"
+
+
+// Sound banks pack many non-streamed sounds into one file, compressed with a block ADPCM codec (about 3.5:1 for 16 bit PCM). Banks
+// stay compressed in memory, the streaming thread decodes them on playback.
+//
+// Each block holds 256 frames. Per channel, a block is split into 4 runs of 64 samples, each with its own IMA-ADPCM state, so that
+// the 4 runs decode in parallel in one SIMD register. Per channel, a block stores the 4 run headers (int16 predictor | step index << 16),
+// followed by 8 groups of 4 uint32s. Uint32 k of group g holds the nibbles of samples g * 8 .. g * 8 + 7 of run k.
+
+#define SOUND_BANK_BLOCK_FRAMES 256
+#define SOUND_BANK_RUN_LENGTH (SOUND_BANK_BLOCK_FRAMES / 4)
+#define SOUND_BANK_CHANNEL_BLOCK_SIZE (16 + SOUND_BANK_BLOCK_FRAMES / 2)
+#define SOUND_BANK_MAX_CHANNELS 2
+
+struct sound_bank_entry
+{
+	uint64 hash; // Sound id hash. 0 marks an empty slot.
+	uint32 dataOffset;
+	uint32 numFrames;
+	uint32 sampleRate;
+	uint16 numChannels;
+	uint16 padding;
+};
+
+// Source data for writeSoundBank. Samples are interleaved 16 bit PCM.
+struct sound_bank_source
+{
+	uint64 hash;
+	uint32 sampleRate;
+	uint32 numChannels;
+	uint32 numFrames;
+	const int16* samples;
+};
+
+struct sound_bank
+{
+	~sound_bank();
+
+	// Open addressing with linear probing, so a lookup usually touches a single entry.
+	const sound_bank_entry* find(uint64 hash) const;
+	const uint8* getData(const sound_bank_entry& entry) const { return data + entry.dataOffset; }
+
+	fs::path path;
+
+	uint8* data = 0;
+	uint64 size = 0;
+
+	const sound_bank_entry* table = 0;
+	uint32 tableMask = 0;
+	uint32 numSounds = 0;
+};
+
+bool writeSoundBank(const fs::path& path, const sound_bank_source* sources, uint32 numSources);
+
+ref<sound_bank> loadSoundBank(const fs::path& path);
+
+static uint32 getSoundBankDataSize(uint32 numFrames, uint32 numChannels)
+{
+	uint32 numBlocks = (numFrames + SOUND_BANK_BLOCK_FRAMES - 1) / SOUND_BANK_BLOCK_FRAMES;
+	return numBlocks * numChannels * SOUND_BANK_CHANNEL_BLOCK_SIZE;
+}
+
+// Decodes frames [firstFrame, firstFrame + numFrames) into interleaved 16 bit PCM.
+void decodeSoundBankFrames(const uint8* blocks, uint32 numChannels, uint32 firstFrame, uint32 numFrames, int16* output);
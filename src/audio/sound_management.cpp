@@ -1,6 +1,8 @@
 #include "pch.h"
 #include "sound_management.h"
 #include "audio.h"
+#include "sound_bank.h"
+#include "asset/file_registry.h"
 #include "editor/editor_icons.h"
 
 #include "core/log.h"
@@ -12,6 +14,7 @@
 
 static std::unordered_map<uint64, sound_spec> soundRegistry;
 static const fs::path registryPath = fs::path(L"resources/sounds.yaml").lexically_normal();
+static const fs::path soundBankPath = fs::path(L"resources/sounds.sbk").lexically_normal();
 
 
 
@@ -33,6 +36,11 @@ void loadSoundRegistry()
 
         soundRegistry[hash] = spec;
     }
+
+    if (fs::exists(soundBankPath))
+    {
+        mountSoundBank(soundBankPath);
+    }
 }
 
 static void saveSoundRegistry()
@@ -57,6 +65,60 @@ static void saveSoundRegistry()
     fout << out;
 }
 
+// Packs all non-streamed 16 bit sounds of the registry into one bank.
+static void buildSoundBank()
+{
+    std::vector<std::vector<uint8>> datas;
+    std::vector<sound_bank_source> sources;
+
+    datas.reserve(soundRegistry.size());
+    sources.reserve(soundRegistry.size());
+
+    for (auto& [hash, spec] : soundRegistry)
+    {
+        fs::path path = getPathFromAssetHandle(spec.asset);
+        if (spec.stream || path.empty())
+        {
+            continue;
+        }
+
+        WAVEFORMATEXTENSIBLE wfx;
+        std::vector<uint8> data;
+        if (!readWAVFile(path, wfx, data))
+        {
+            continue;
+        }
+
+        bool isPCM16 = (wfx.Format.wFormatTag == WAVE_FORMAT_PCM || wfx.Format.wFormatTag == WAVE_FORMAT_EXTENSIBLE) && wfx.Format.wBitsPerSample == 16;
+        if (!isPCM16)
+        {
+            LOG_WARNING("Sound '%s' is not 16 bit PCM and is not added to the sound bank", spec.name.c_str());
+            continue;
+        }
+
+        datas.push_back(std::move(data));
+
+        sound_bank_source source;
+        source.hash = hash;
+        source.sampleRate = wfx.Format.nSamplesPerSec;
+        source.numChannels = wfx.Format.nChannels;
+        source.numFrames = (uint32)datas.back().size() / wfx.Format.nBlockAlign;
+        source.samples = (const int16*)datas.back().data();
+        sources.push_back(source);
+    }
+
+    if (writeSoundBank(soundBankPath, sources.data(), (uint32)sources.size()))
+    {
+        LOG_MESSAGE("Wrote sound bank with %u sounds", (uint32)sources.size());
+
+        unmountAllSoundBanks();
+        mountSoundBank(soundBankPath);
+
+        unloadAllSounds();
+        restartAllSounds();
+    }
+}
+
 void drawSoundEditor(bool& open)
 {
     if (open)
@@ -78,6 +140,12 @@ void drawSoundEditor(bool& open)
                 dirty = false;
             }
 
+            ImGui::SameLine();
+            if (ImGui::Button("Build sound bank"))
+            {
+                buildSoundBank();
+            }
+
             for (auto& [id, spec] : soundRegistry)
             {
                 std::string& name = spec.name;
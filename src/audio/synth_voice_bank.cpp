@@ -0,0 +1,347 @@
+#include "pch.h"
+#include "synth_voice_bank.h"
+
+
+#define SYNTH_RENDER_CHUNK_SIZE 64 // Timed releases and voice retirement are checked at this granularity.
+
+#define STAGE_ATTACK 0.f
+#define STAGE_DECAY 1.f
+#define STAGE_SUSTAIN 2.f
+#define STAGE_RELEASE 3.f
+#define STAGE_DONE 4.f
+
+static void setLane(w8_float& v, uint32 lane, float value)
+{
+	((float*)&v)[lane] = value;
+}
+
+static float getLane(const w8_float& v, uint32 lane)
+{
+	return ((const float*)&v)[lane];
+}
+
+uint32 synth_voice_bank::noteOn(const synth_voice_params& params)
+{
+	const std::lock_guard<std::mutex> lock(mutex);
+
+	uint32 groupIndex = (uint32)groups.size();
+	for (uint32 i = 0; i < (uint32)groups.size(); ++i)
+	{
+		if (groups[i].waveform == params.waveform && groups[i].activeMask != 0xFF)
+		{
+			groupIndex = i;
+			break;
+		}
+	}
+
+	if (groupIndex == (uint32)groups.size())
+	{
+		// Reuse an empty group before growing.
+		for (uint32 i = 0; i < (uint32)groups.size(); ++i)
+		{
+			if (groups[i].activeMask == 0)
+			{
+				groupIndex = i;
+				break;
+			}
+		}
+
+		if (groupIndex == (uint32)groups.size())
+		{
+			if (groupIndex * 8 >= SYNTH_VOICE_BANK_MAX_VOICES)
+			{
+				return 0;
+			}
+
+			voice_group& group = groups.emplace_back();
+			group.phase = group.phaseStep = group.invPhaseStep = group.volume = 0.f;
+			group.stage = STAGE_DONE;
+			group.envelope = group.attackRate = group.decayRate = group.sustainLevel = group.releaseRate = 0.f;
+			group.filterCoefficient = 1.f;
+			group.filterState = 0.f;
+			for (uint32 lane = 0; lane < 8; ++lane)
+			{
+				group.samplesUntilRelease[lane] = UINT32_MAX;
+				group.generations[lane] = 0;
+			}
+		}
+
+		groups[groupIndex].waveform = params.waveform;
+	}
+
+	voice_group& group = groups[groupIndex];
+	uint32 lane = indexOfLeastSignificantSetBit(~group.activeMask);
+
+	float sr = (float)sampleRate;
+	float phaseStep = clamp(params.frequency / sr, 0.f, 0.5f);
+
+	setLane(group.phase, lane, 0.f);
+	setLane(group.phaseStep, lane, phaseStep);
+	setLane(group.invPhaseStep, lane, (phaseStep > 0.f) ? 1.f / phaseStep : 0.f);
+	setLane(group.volume, lane, params.volume);
+
+	float sustain = clamp01(params.sustain);
+	setLane(group.stage, lane, STAGE_ATTACK);
+	setLane(group.envelope, lane, 0.f);
+	setLane(group.attackRate, lane, (params.attack > 0.f) ? 1.f / (params.attack * sr) : 1.f);
+	setLane(group.decayRate, lane, (params.decay > 0.f) ? -(1.f - sustain) / (params.decay * sr) : -1.f);
+	setLane(group.sustainLevel, lane, sustain);
+	setLane(group.releaseRate, lane, (params.release > 0.f) ? -1.f / (params.release * sr) : -1.f);
+
+	setLane(group.filterCoefficient, lane, (params.lowpassCutoff > 0.f) ? 1.f - expf(-M_TAU * params.lowpassCutoff / sr) : 1.f);
+	setLane(group.filterState, lane, 0.f);
+
+	group.samplesUntilRelease[lane] = (params.duration > 0.f) ? (uint32)(params.duration * sr) : UINT32_MAX;
+
+	uint32 generation = (group.generations[lane] + 1) & ((1u << (32 - SYNTH_VOICE_BANK_INDEX_BITS)) - 1);
+	generation = max(generation, 1u);
+	group.generations[lane] = generation;
+
+	group.activeMask |= 1 << lane;
+
+	return (generation << SYNTH_VOICE_BANK_INDEX_BITS) | (groupIndex * 8 + lane);
+}
+
+synth_voice_bank::voice_group* synth_voice_bank::getGroup(uint32 voice, uint32& lane)
+{
+	uint32 index = voice & ((1 << SYNTH_VOICE_BANK_INDEX_BITS) - 1);
+	uint32 generation = voice >> SYNTH_VOICE_BANK_INDEX_BITS;
+
+	uint32 groupIndex = index / 8;
+	lane = index % 8;
+
+	if (groupIndex >= (uint32)groups.size())
+	{
+		return 0;
+	}
+
+	voice_group& group = groups[groupIndex];
+	if (!(group.activeMask & (1 << lane)) || group.generations[lane] != generation)
+	{
+		return 0;
+	}
+	return &group;
+}
+
+void synth_voice_bank::noteOff(uint32 voice)
+{
+	const std::lock_guard<std::mutex> lock(mutex);
+
+	uint32 lane;
+	if (voice_group* group = getGroup(voice, lane))
+	{
+		if (getLane(group->stage, lane) < STAGE_RELEASE)
+		{
+			setLane(group->stage, lane, STAGE_RELEASE);
+		}
+		group->samplesUntilRelease[lane] = UINT32_MAX;
+	}
+}
+
+void synth_voice_bank::setFrequency(uint32 voice, float frequency)
+{
+	const std::lock_guard<std::mutex> lock(mutex);
+
+	uint32 lane;
+	if (voice_group* group = getGroup(voice, lane))
+	{
+		float phaseStep = clamp(frequency / (float)sampleRate, 0.f, 0.5f);
+		setLane(group->phaseStep, lane, phaseStep);
+		setLane(group->invPhaseStep, lane, (phaseStep > 0.f) ? 1.f / phaseStep : 0.f);
+	}
+}
+
+void synth_voice_bank::setVolume(uint32 voice, float volume)
+{
+	const std::lock_guard<std::mutex> lock(mutex);
+
+	uint32 lane;
+	if (voice_group* group = getGroup(voice, lane))
+	{
+		setLane(group->volume, lane, volume);
+	}
+}
+
+uint32 synth_voice_bank::getNumActiveVoices()
+{
+	const std::lock_guard<std::mutex> lock(mutex);
+
+	uint32 result = 0;
+	for (const voice_group& group : groups)
+	{
+		result += _mm_popcnt_u32(group.activeMask);
+	}
+	return result;
+}
+
+// Band-limits the discontinuity of saw and square waves at phase 0.
+static w8_float polyBLEP(w8_float t, w8_float dt, w8_float invDt)
+{
+	w8_float one = 1.f;
+
+	w8_float x0 = t * invDt;
+	w8_float b0 = x0 + x0 - x0 * x0 - one;
+
+	w8_float x1 = (t - one) * invDt;
+	w8_float b1 = fmadd(x1, x1, x1 + x1) + one;
+
+	return ifThen(t < dt, b0, ifThen(t > one - dt, b1, w8_float::zero()));
+}
+
+template <synth_waveform waveform>
+static w8_float oscillate(w8_float phase, w8_float phaseStep, w8_float invPhaseStep)
+{
+	if constexpr (waveform == synth_waveform_sine)
+	{
+		return sin(phase * M_TAU);
+	}
+	else if constexpr (waveform == synth_waveform_triangle)
+	{
+		return fmadd(abs(phase - 0.5f), 4.f, -1.f);
+	}
+	else if constexpr (waveform == synth_waveform_saw)
+	{
+		return fmadd(phase, 2.f, -1.f) - polyBLEP(phase, phaseStep, invPhaseStep);
+	}
+	else
+	{
+		w8_float shifted = phase + 0.5f;
+		shifted = shifted - floor(shifted);
+
+		w8_float naive = ifThen(phase < 0.5f, w8_float(1.f), w8_float(-1.f));
+		return naive + polyBLEP(phase, phaseStep, invPhaseStep) - polyBLEP(shifted, phaseStep, invPhaseStep);
+	}
+}
+
+// Advances all 8 voices of the group by 8 samples per iteration and adds their sum to the output. If numSamples is not a multiple of 8,
+// the voices advance by up to 7 samples more than written, which is inaudible.
+template <synth_waveform waveform>
+static void renderVoiceGroup(w8_float& phase, w8_float phaseStep, w8_float invPhaseStep, w8_float volume,
+	w8_float& stage, w8_float& envelope, w8_float attackRate, w8_float decayRate, w8_float sustainLevel, w8_float releaseRate,
+	w8_float filterCoefficient, w8_float& filterState, float* output, uint32 numSamples)
+{
+	w8_float one = 1.f;
+	w8_float zero = 0.f;
+
+	for (uint32 i = 0; i < numSamples; i += 8)
+	{
+		w8_float s[8];
+		for (uint32 t = 0; t < 8; ++t)
+		{
+			w8_float osc = oscillate<waveform>(phase, phaseStep, invPhaseStep);
+
+			w8_float rate = ifThen(stage == STAGE_ATTACK, attackRate,
+				ifThen(stage == STAGE_DECAY, decayRate,
+				ifThen(stage == STAGE_RELEASE, releaseRate, zero)));
+			envelope += rate;
+
+			auto attackDone = (stage == STAGE_ATTACK) & (envelope >= one);
+			stage = ifThen(attackDone, w8_float(STAGE_DECAY), stage);
+			envelope = minimum(envelope, one);
+
+			auto decayDone = (stage == STAGE_DECAY) & (envelope <= sustainLevel);
+			stage = ifThen(decayDone, w8_float(STAGE_SUSTAIN), stage);
+			envelope = ifThen(decayDone, sustainLevel, envelope);
+
+			auto releaseDone = (stage == STAGE_RELEASE) & (envelope <= zero);
+			stage = ifThen(releaseDone, w8_float(STAGE_DONE), stage);
+			envelope = maximum(envelope, zero);
+
+			filterState = fmadd(filterCoefficient, osc - filterState, filterState);
+
+			s[t] = filterState * envelope * volume;
+
+			phase += phaseStep;
+			phase = phase - floor(phase);
+		}
+
+		// Lane v of s[t] is sample t of voice v. After the transpose, s[v] holds 8 consecutive samples of voice v.
+		transpose(s[0], s[1], s[2], s[3], s[4], s[5], s[6], s[7]);
+		w8_float sum = ((s[0] + s[1]) + (s[2] + s[3])) + ((s[4] + s[5]) + (s[6] + s[7]));
+
+		uint32 count = min(numSamples - i, 8u);
+		if (count == 8)
+		{
+			(w8_float(output + i) + sum).store(output + i);
+		}
+		else
+		{
+			alignas(32) float tail[8];
+			sum.store(tail);
+			for (uint32 j = 0; j < count; ++j)
+			{
+				output[i + j] += tail[j];
+			}
+		}
+	}
+}
+
+void synth_voice_bank::renderGroup(voice_group& g, float* output, uint32 numSamples)
+{
+#define RENDER_WAVEFORM(waveform) \
+	renderVoiceGroup<waveform>(g.phase, g.phaseStep, g.invPhaseStep, g.volume, g.stage, g.envelope, g.attackRate, g.decayRate, \
+		g.sustainLevel, g.releaseRate, g.filterCoefficient, g.filterState, output, numSamples)
+
+	switch (g.waveform)
+	{
+		case synth_waveform_sine: RENDER_WAVEFORM(synth_waveform_sine); break;
+		case synth_waveform_triangle: RENDER_WAVEFORM(synth_waveform_triangle); break;
+		case synth_waveform_saw: RENDER_WAVEFORM(synth_waveform_saw); break;
+		case synth_waveform_square: RENDER_WAVEFORM(synth_waveform_square); break;
+		default: break;
+	}
+
+#undef RENDER_WAVEFORM
+}
+
+void synth_voice_bank::render(float* output, uint32 numSamples)
+{
+	memset(output, 0, sizeof(float) * numSamples);
+
+	const std::lock_guard<std::mutex> lock(mutex);
+
+	for (uint32 begin = 0; begin < numSamples; begin += SYNTH_RENDER_CHUNK_SIZE)
+	{
+		uint32 count = min(numSamples - begin, (uint32)SYNTH_RENDER_CHUNK_SIZE);
+
+		for (voice_group& group : groups)
+		{
+			if (!group.activeMask)
+			{
+				continue;
+			}
+
+			for (uint32 lane = 0; lane < 8; ++lane)
+			{
+				uint32& remaining = group.samplesUntilRelease[lane];
+				if (remaining != UINT32_MAX)
+				{
+					if (remaining <= count)
+					{
+						if (getLane(group.stage, lane) < STAGE_RELEASE)
+						{
+							setLane(group.stage, lane, STAGE_RELEASE);
+						}
+						remaining = UINT32_MAX;
+					}
+					else
+					{
+						remaining -= count;
+					}
+				}
+			}
+
+			renderGroup(group, output + begin, count);
+
+			// Retire finished voices. Their lanes are silent from here on, since the envelope stays at 0.
+			for (uint32 lane = 0; lane < 8; ++lane)
+			{
+				if ((group.activeMask & (1 << lane)) && getLane(group.stage, lane) == STAGE_DONE)
+				{
+					group.activeMask &= ~(1 << lane);
+					setLane(group.volume, lane, 0.f);
+				}
+			}
+		}
+	}
+}
@@ -0,0 +1,104 @@
+#pragma once
+
+#include "synth.h"
+#include "core/simd.h"
+
+#include <mutex>
+
+
+// Renders many simple synthesizer voices (oscillator -> ADSR envelope -> one-pole lowpass) in one pass. Voices are stored in groups
+// of 8, one voice per SIMD lane, so that each operation advances 8 voices by one sample. Every 8 samples, the group is transposed and
+// summed into the output, so there are no per-sample virtual calls and no calls into libm. All voices of a group share the waveform.
+
+#define SYNTH_VOICE_BANK_MAX_VOICES 1024
+#define SYNTH_VOICE_BANK_INDEX_BITS 10
+
+enum synth_waveform
+{
+	synth_waveform_sine,
+	synth_waveform_triangle,
+	synth_waveform_saw,
+	synth_waveform_square,
+
+	synth_waveform_count,
+};
+
+struct synth_voice_params
+{
+	synth_waveform waveform = synth_waveform_sine;
+	float frequency = A_HZ;
+	float volume = 1.f;
+
+	// Envelope. Times in seconds.
+	float attack = 0.01f;
+	float decay = 0.1f;
+	float sustain = 0.7f;
+	float release = 0.2f;
+
+	float lowpassCutoff = 0.f; // In Hz. 0 disables the filter.
+	float duration = 0.f; // The voice is released automatically after this time. 0 plays until noteOff.
+};
+
+// All functions are thread safe. Typically, notes are triggered from the game thread and render is called by the streaming thread.
+struct synth_voice_bank
+{
+	synth_voice_bank(uint32 sampleRate = 48000) : sampleRate(sampleRate) {}
+
+	uint32 noteOn(const synth_voice_params& params); // Returns 0 if all voices are in use.
+	void noteOff(uint32 voice);
+
+	void setFrequency(uint32 voice, float frequency);
+	void setVolume(uint32 voice, float volume);
+
+	// Writes the mono sum of all voices.
+	void render(float* output, uint32 numSamples);
+
+	uint32 getSampleRate() const { return sampleRate; }
+	uint32 getNumActiveVoices();
+
+private:
+	struct voice_group
+	{
+		synth_waveform waveform;
+		uint32 activeMask = 0;
+
+		// Phase is in cycles, [0, 1).
+		w8_float phase, phaseStep, invPhaseStep;
+		w8_float volume;
+
+		// Stages: 0 = attack, 1 = decay, 2 = sustain, 3 = release, 4 = done. Decay and release rates are negative.
+		w8_float stage, envelope;
+		w8_float attackRate, decayRate, sustainLevel, releaseRate;
+
+		w8_float filterCoefficient, filterState;
+
+		uint32 samplesUntilRelease[8]; // UINT32_MAX if not timed.
+		uint32 generations[8];
+	};
+
+	voice_group* getGroup(uint32 voice, uint32& lane);
+	void renderGroup(voice_group& group, float* output, uint32 numSamples);
+
+	std::mutex mutex;
+
+	uint32 sampleRate;
+	std::vector<voice_group> groups;
+};
+
+// Plays a voice bank through a streamed channel. Must be streamed, since the sound never ends.
+struct voice_bank_synth : audio_synth
+{
+	static const uint32 numChannels = 1;
+	static const uint32 sampleHz = 48000;
+
+	voice_bank_synth(const ref<synth_voice_bank>& bank) : bank(bank) { ASSERT(bank->getSampleRate() == sampleHz); }
+
+	virtual uint32 getSamples(float* buffer, uint32 numSamples) override
+	{
+		bank->render(buffer, numSamples);
+		return numSamples;
+	}
+
+private:
+	ref<synth_voice_bank> bank;
+};
@@ -1,6 +1,7 @@
 #include "pch.h"
 #define PROFILING_INTERNAL
 #include "cpu_profiling.h"
+#include "profiling_stats.h"
 #include "dx/dx_context.h"
 #include "core/imgui.h"
 
@@ -43,6 +44,9 @@ static uint32 dummyFrameWriteIndex;
 
 static bool pauseRecording;
 
+static profile_statistics statistics;
+static bool showStatistics;
+
 
 static uint16 stack[MAX_NUM_CPU_PROFILE_THREADS][1024];
 static uint32 depth[MAX_NUM_CPU_PROFILE_THREADS];
@@ -196,6 +200,8 @@ void cpuProfilingResolveTimeStamps()
 				frame->numStats = numStats;
 				memcpy(frame->stats, stats, numStats * sizeof(profile_stat));
 
+				statistics.addFrame(frame->profileBlockPool, frame->totalNumProfileBlocks, frame->stats, frame->numStats, frame->duration);
+
 
 				cpu_profile_frame* oldFrame = frame;
 
@@ -255,6 +261,11 @@ void cpuProfilingResolveTimeStamps()
 				}
 			}
 
+			if (ImGui::Button(showStatistics ? (ICON_FA_CHART_PIE "  Hide statistics") : (ICON_FA_CHART_PIE "  Show statistics")))
+			{
+				showStatistics = !showStatistics;
+			}
+
 			for (uint32 frameIndex = 0; frameIndex < MAX_NUM_CPU_PROFILE_FRAMES; ++frameIndex)
 			{
 				timeline.drawOverviewFrame(profileFrames[frameIndex], frameIndex, currentFrame);
@@ -327,7 +338,35 @@ void cpuProfilingResolveTimeStamps()
 			}
 		}
 		ImGui::End();
+
+		if (showStatistics)
+		{
+			if (ImGui::Begin(ICON_FA_CHART_PIE "  CPU Profiling Statistics", &showStatistics))
+			{
+				statistics.draw();
+			}
+			ImGui::End();
+		}
 	}
 }
 
+void cpuProfilingSetStatisticsWindow(uint32 numFrames)
+{
+	statistics.setWindowSize(numFrames);
+}
+
+bool cpuProfilingDumpStatistics(const fs::path& path)
+{
+	if (path.extension() == ".json")
+	{
+		return statistics.writeJSON(path);
+	}
+	return statistics.writeCSV(path);
+}
+
+uint32 cpuProfilingCompareAgainstBaseline(const fs::path& baselinePath, float relativeThreshold, float absoluteThreshold)
+{
+	return statistics.compareAgainstBaseline(baselinePath, relativeThreshold, absoluteThreshold);
+}
+
 #endif
@@ -119,6 +119,17 @@ void cpuProfilingResolveTimeStamps();
 #undef recordProfileEvent
 
 
+// Rolling statistics (min, mean, p50, p95, p99, max) of all blocks and stats over the last N frames.
+
+void cpuProfilingSetStatisticsWindow(uint32 numFrames);
+
+// The format is chosen by the file extension (.csv or .json).
+bool cpuProfilingDumpStatistics(const fs::path& path);
+
+// Compares the current statistics against a CSV file previously written by cpuProfilingDumpStatistics. Returns the number of regressions.
+uint32 cpuProfilingCompareAgainstBaseline(const fs::path& baselinePath, float relativeThreshold = 0.1f, float absoluteThreshold = 0.05f);
+
+
 
 
 
@@ -162,6 +173,10 @@ struct cpu_print_profile_block_recorder
 #define cpuProfilingFrameEndMarker(...)
 #define cpuProfilingResolveTimeStamps(...)
 
+#define cpuProfilingSetStatisticsWindow(...)
+#define cpuProfilingDumpStatistics(...) false
+#define cpuProfilingCompareAgainstBaseline(...) 0u
+
 #define CPU_PRINT_PROFILE_BLOCK(...)
 
 #endif
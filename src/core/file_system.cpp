@@ -158,3 +158,86 @@ bool observeDirectory(const fs::path& directory, const file_system_observer& cal
 
 	return result;
 }
+
+mapped_file::mapped_file(mapped_file&& o) noexcept
+{
+	*this = std::move(o);
+}
+
+mapped_file& mapped_file::operator=(mapped_file&& o) noexcept
+{
+	close();
+
+	data = o.data;
+	size = o.size;
+	file = o.file;
+	mapping = o.mapping;
+
+	o.data = 0;
+	o.size = 0;
+	o.file = INVALID_HANDLE_VALUE;
+	o.mapping = 0;
+
+	return *this;
+}
+
+mapped_file::~mapped_file()
+{
+	close();
+}
+
+bool mapped_file::open(const fs::path& path)
+{
+	close();
+
+	file = CreateFileW(path.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+	if (file == INVALID_HANDLE_VALUE)
+	{
+		return false;
+	}
+
+	LARGE_INTEGER fileSize;
+	if (!GetFileSizeEx(file, &fileSize) || fileSize.QuadPart == 0)
+	{
+		close();
+		return false;
+	}
+
+	mapping = CreateFileMappingW(file, NULL, PAGE_READONLY, 0, 0, NULL);
+	if (!mapping)
+	{
+		close();
+		return false;
+	}
+
+	data = (const uint8*)MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+	if (!data)
+	{
+		close();
+		return false;
+	}
+
+	size = (uint64)fileSize.QuadPart;
+	return true;
+}
+
+void mapped_file::close()
+{
+	if (data)
+	{
+		UnmapViewOfFile(data);
+	}
+	if (mapping)
+	{
+		CloseHandle(mapping);
+	}
+	if (file != INVALID_HANDLE_VALUE)
+	{
+		CloseHandle(file);
+	}
+
+	data = 0;
+	size = 0;
+	mapping = 0;
+	file = INVALID_HANDLE_VALUE;
+}
@@ -21,3 +21,25 @@ struct file_system_event
 typedef std::function<void(const file_system_event&)> file_system_observer;
 
 bool observeDirectory(const fs::path& directory, const file_system_observer& callback, bool watchSubDirectories = true);
+
+
+// Read-only memory mapping of a whole file. The mapping is released when the object is destroyed.
+struct mapped_file
+{
+	mapped_file() {}
+	mapped_file(const mapped_file&) = delete;
+	mapped_file(mapped_file&& o) noexcept;
+	mapped_file& operator=(const mapped_file&) = delete;
+	mapped_file& operator=(mapped_file&& o) noexcept;
+	~mapped_file();
+
+	bool open(const fs::path& path);
+	void close();
+
+	const uint8* data = 0;
+	uint64 size = 0;
+
+private:
+	HANDLE file = INVALID_HANDLE_VALUE;
+	HANDLE mapping = 0;
+};
@@ -48,7 +48,7 @@ void logMessageInternal(message_type type, const char* file, const char* functio
 
 void initializeMessageLog()
 {
-	arena.initialize(0, GB(1));
+	arena.initialize(0, GB(1), "Message log");
 }
 
 void updateMessageLog(float dt)
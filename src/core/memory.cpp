@@ -1,13 +1,165 @@
 #include "pch.h"
 #include "memory.h"
 #include "math.h"
+#include "log.h"
 
-void memory_arena::initialize(uint64 minimumBlockSize, uint64 reserveSize)
+#include <atomic>
+#include <algorithm>
+
+
+static std::atomic<uint64> allocatedPerTag[memory_tag_count];
+static std::atomic<uint64> allocatedHighWaterMarkPerTag[memory_tag_count];
+static std::atomic<uint64> numAllocationsPerTag[memory_tag_count];
+static std::atomic<uint64> reservedPerTag[memory_tag_count];
+static std::atomic<uint64> committedPerTag[memory_tag_count];
+static std::atomic<uint64> budgetPerTag[memory_tag_count];
+static std::atomic<bool> overBudgetPerTag[memory_tag_count];
+
+// Arenas may be constructed and destroyed during static initialization and shutdown, so the registry is never destroyed.
+static std::vector<memory_arena*>& arenaRegistry() { static auto* arenas = new std::vector<memory_arena*>; return *arenas; }
+static std::mutex& arenaRegistryMutex() { static auto* mutex = new std::mutex; return *mutex; }
+
+// Returns true if the tag has just gone over its budget. Does no I/O, so that it can be called while an arena is locked.
+static bool checkMemoryBudget(memory_tag tag)
+{
+	uint64 budget = budgetPerTag[tag];
+	if (budget == 0)
+	{
+		return false;
+	}
+
+	uint64 total = allocatedPerTag[tag] + committedPerTag[tag];
+	if (total > budget)
+	{
+		return !overBudgetPerTag[tag].exchange(true);
+	}
+
+	overBudgetPerTag[tag] = false;
+	return false;
+}
+
+static void reportMemoryBudgetExceeded(memory_tag tag)
+{
+	// The message log allocates from an arena itself, so don't recurse into it.
+	static thread_local bool reporting = false;
+	if (reporting)
+	{
+		return;
+	}
+
+	uint64 total = allocatedPerTag[tag] + committedPerTag[tag];
+	uint64 budget = budgetPerTag[tag];
+
+	reporting = true;
+	LOG_WARNING("Memory budget of tag '%s' exceeded: %llu MB used, %llu MB budget", memoryTagNames[tag], BYTE_TO_MB(total), BYTE_TO_MB(budget));
+	reporting = false;
+}
+
+static void checkAndReportMemoryBudget(memory_tag tag)
+{
+	if (checkMemoryBudget(tag))
+	{
+		reportMemoryBudgetExceeded(tag);
+	}
+}
+
+void trackMemoryAllocation(memory_tag tag, uint64 size)
+{
+	uint64 allocated = allocatedPerTag[tag].fetch_add(size) + size;
+	++numAllocationsPerTag[tag];
+
+	uint64 highWaterMark = allocatedHighWaterMarkPerTag[tag];
+	while (allocated > highWaterMark && !allocatedHighWaterMarkPerTag[tag].compare_exchange_weak(highWaterMark, allocated)) {}
+
+	checkAndReportMemoryBudget(tag);
+}
+
+void trackMemoryFree(memory_tag tag, uint64 size)
+{
+	allocatedPerTag[tag] -= size;
+	--numAllocationsPerTag[tag];
+	checkAndReportMemoryBudget(tag);
+}
+
+void setMemoryBudget(memory_tag tag, uint64 budget)
+{
+	budgetPerTag[tag] = budget;
+	overBudgetPerTag[tag] = false;
+	checkAndReportMemoryBudget(tag);
+}
+
+bool setMemoryBudget(const char* tagName, uint64 budget)
+{
+	for (uint32 i = 0; i < memory_tag_count; ++i)
+	{
+		if (_stricmp(tagName, memoryTagNames[i]) == 0)
+		{
+			setMemoryBudget((memory_tag)i, budget);
+			return true;
+		}
+	}
+	return false;
+}
+
+memory_tag_stats getMemoryTagStats(memory_tag tag)
+{
+	memory_tag_stats result;
+	result.allocated = allocatedPerTag[tag];
+	result.allocatedHighWaterMark = allocatedHighWaterMarkPerTag[tag];
+	result.numAllocations = numAllocationsPerTag[tag];
+	result.reserved = reservedPerTag[tag];
+	result.committed = committedPerTag[tag];
+	result.budget = budgetPerTag[tag];
+	return result;
+}
+
+std::vector<memory_arena_stats> getMemoryArenaStats()
+{
+	std::lock_guard<std::mutex> lock(arenaRegistryMutex());
+
+	std::vector<memory_arena_stats> result;
+	result.reserve(arenaRegistry().size());
+	for (memory_arena* arena : arenaRegistry())
+	{
+		result.push_back(arena->getStats());
+	}
+	return result;
+}
+
+void printMemoryStats(std::ostream& out)
+{
+	out << "Tag, Allocated (KB), Allocated peak (KB), Live allocations, Arena reserved (KB), Arena committed (KB), Budget (KB)\n";
+	for (uint32 i = 0; i < memory_tag_count; ++i)
+	{
+		memory_tag_stats stats = getMemoryTagStats((memory_tag)i);
+		out << memoryTagNames[i] << ", " << BYTE_TO_KB(stats.allocated) << ", " << BYTE_TO_KB(stats.allocatedHighWaterMark) << ", " << stats.numAllocations << ", "
+			<< BYTE_TO_KB(stats.reserved) << ", " << BYTE_TO_KB(stats.committed) << ", " << BYTE_TO_KB(stats.budget) << '\n';
+	}
+
+	out << "\nArena, Tag, Reserved (KB), Committed (KB), Used (KB), Peak used (KB)\n";
+	for (const memory_arena_stats& stats : getMemoryArenaStats())
+	{
+		out << stats.name << ", " << memoryTagNames[stats.tag] << ", " << BYTE_TO_KB(stats.reserved) << ", " << BYTE_TO_KB(stats.committed) << ", "
+			<< BYTE_TO_KB(stats.used) << ", " << BYTE_TO_KB(stats.highWaterMark) << '\n';
+	}
+}
+
+void memory_arena::initialize(uint64 minimumBlockSize, uint64 reserveSize, const char* name, memory_tag tag)
 {
 	reset(true);
 
 	memory = (uint8*)VirtualAlloc(0, reserveSize, MEM_RESERVE, PAGE_READWRITE);
 
+	this->name = name;
+	this->tag = tag;
+	highWaterMark = 0;
+	reservedPerTag[tag] += reserveSize;
+
+	{
+		std::lock_guard<std::mutex> lock(arenaRegistryMutex());
+		arenaRegistry().push_back(this);
+	}
+
 	SYSTEM_INFO systemInfo;
 	GetSystemInfo(&systemInfo);
 
@@ -20,11 +172,16 @@ void memory_arena::initialize(uint64 minimumBlockSize, uint64 reserveSize)
 void memory_arena::ensureFreeSize(uint64 size)
 {
 	mutex.lock();
-	ensureFreeSizeInternal(size);
+	bool overBudget = ensureFreeSizeInternal(size);
 	mutex.unlock();
+
+	if (overBudget)
+	{
+		reportMemoryBudgetExceeded(tag);
+	}
 }
 
-void memory_arena::ensureFreeSizeInternal(uint64 size)
+bool memory_arena::ensureFreeSizeInternal(uint64 size)
 {
 	if (sizeLeftCurrent < size)
 	{
@@ -35,7 +192,11 @@ void memory_arena::ensureFreeSizeInternal(uint64 size)
 		sizeLeftTotal += allocationSize;
 		sizeLeftCurrent += allocationSize;
 		committedMemory += allocationSize;
+
+		committedPerTag[tag] += allocationSize;
+		return checkMemoryBudget(tag);
 	}
+	return false;
 }
 
 void* memory_arena::allocate(uint64 size, uint64 alignment, bool clearToZero)
@@ -57,15 +218,22 @@ void* memory_arena::allocate(uint64 size, uint64 alignment, bool clearToZero)
 
 	ASSERT(sizeLeftTotal >= size);
 
-	ensureFreeSizeInternal(size);
+	bool overBudget = ensureFreeSizeInternal(size);
 
 	uint8* result = memory + current;
 	current += size;
 	sizeLeftCurrent -= size;
 	sizeLeftTotal -= size;
 
+	highWaterMark = max(highWaterMark, current);
+
 	mutex.unlock();
 
+	if (overBudget)
+	{
+		reportMemoryBudgetExceeded(tag);
+	}
+
 	if (clearToZero)
 	{
 		memset(result, 0, size);
@@ -84,6 +252,8 @@ void memory_arena::setCurrentTo(void* ptr)
 	current = (uint8*)ptr - memory;
 	sizeLeftCurrent = committedMemory - current;
 	sizeLeftTotal = reserveSize - current;
+
+	highWaterMark = max(highWaterMark, current);
 }
 
 void memory_arena::reset(bool freeMemory)
@@ -91,6 +261,16 @@ void memory_arena::reset(bool freeMemory)
 	if (memory && freeMemory)
 	{
 		VirtualFree(memory, 0, MEM_RELEASE);
+
+		reservedPerTag[tag] -= reserveSize;
+		committedPerTag[tag] -= committedMemory;
+
+		{
+			std::lock_guard<std::mutex> lock(arenaRegistryMutex());
+			auto& arenas = arenaRegistry();
+			arenas.erase(std::remove(arenas.begin(), arenas.end(), this), arenas.end());
+		}
+
 		memory = 0;
 		committedMemory = 0;
 	}
@@ -109,3 +289,17 @@ void memory_arena::resetToMarker(memory_marker marker)
 	sizeLeftCurrent = committedMemory - current;
 	sizeLeftTotal = reserveSize - current;
 }
+
+memory_arena_stats memory_arena::getStats() const
+{
+	std::lock_guard<std::mutex> lock(mutex);
+
+	memory_arena_stats result;
+	result.name = name ? name : "Unnamed arena";
+	result.tag = tag;
+	result.reserved = reserveSize;
+	result.committed = committedMemory;
+	result.used = current;
+	result.highWaterMark = highWaterMark;
+	return result;
+}
@@ -44,6 +44,101 @@ static bool rangesOverlap(void* fromA, void* toA, void* fromB, void* toB)
 	return true;
 }
 
+
+// Tagged memory tracking. Arenas report their reserved and committed memory to their tag, other allocations (e.g. through
+// tracked_allocator or manual calls to trackMemoryAllocation) report the allocated size. All functions are thread safe.
+
+enum memory_tag : uint8
+{
+	memory_tag_untagged,
+	memory_tag_asset,
+	memory_tag_physics,
+	memory_tag_animation,
+	memory_tag_render,
+	memory_tag_audio,
+
+	memory_tag_count,
+};
+
+static const char* memoryTagNames[] =
+{
+	"Untagged",
+	"Asset",
+	"Physics",
+	"Animation",
+	"Render",
+	"Audio",
+};
+
+struct memory_tag_stats
+{
+	uint64 allocated;			// Allocated outside of arenas.
+	uint64 allocatedHighWaterMark;
+	uint64 numAllocations;		// Currently live allocations outside of arenas.
+
+	uint64 reserved;			// Reserved by arenas.
+	uint64 committed;			// Committed by arenas.
+
+	uint64 budget;				// 0 means no budget.
+};
+
+struct memory_arena_stats
+{
+	const char* name;
+	memory_tag tag;
+
+	uint64 reserved;
+	uint64 committed;
+	uint64 used;
+	uint64 highWaterMark;
+};
+
+void trackMemoryAllocation(memory_tag tag, uint64 size);
+void trackMemoryFree(memory_tag tag, uint64 size);
+
+// Prints a warning whenever the allocated plus committed memory of this tag exceeds the budget. 0 disables the budget.
+void setMemoryBudget(memory_tag tag, uint64 budget);
+bool setMemoryBudget(const char* tagName, uint64 budget); // Case insensitive. Returns false for unknown tags.
+
+memory_tag_stats getMemoryTagStats(memory_tag tag);
+std::vector<memory_arena_stats> getMemoryArenaStats();
+
+// Headless dump of all tags and arenas.
+void printMemoryStats(std::ostream& out);
+
+
+// STL allocator which reports its allocations to a memory tag. Use for long-lived subsystem containers.
+template <typename T, memory_tag tag>
+struct tracked_allocator
+{
+	typedef T value_type;
+
+	template <typename U>
+	struct rebind { typedef tracked_allocator<U, tag> other; };
+
+	tracked_allocator() = default;
+	template <typename U> tracked_allocator(const tracked_allocator<U, tag>&) {}
+
+	T* allocate(size_t count)
+	{
+		trackMemoryAllocation(tag, count * sizeof(T));
+		return std::allocator<T>().allocate(count);
+	}
+
+	void deallocate(T* ptr, size_t count)
+	{
+		trackMemoryFree(tag, count * sizeof(T));
+		std::allocator<T>().deallocate(ptr, count);
+	}
+
+	template <typename U> bool operator==(const tracked_allocator<U, tag>&) const { return true; }
+	template <typename U> bool operator!=(const tracked_allocator<U, tag>&) const { return false; }
+};
+
+template <typename T, memory_tag tag>
+using tracked_vector = std::vector<T, tracked_allocator<T, tag>>;
+
+
 struct memory_marker
 {
 	uint64 before;
@@ -56,7 +151,7 @@ struct memory_arena
 	memory_arena(memory_arena&&) = default;
 	~memory_arena() { reset(true); }
 
-	void initialize(uint64 minimumBlockSize = 0, uint64 reserveSize = GB(8));
+	void initialize(uint64 minimumBlockSize = 0, uint64 reserveSize = GB(8), const char* name = "Unnamed arena", memory_tag tag = memory_tag_untagged);
 
 
 	void ensureFreeSize(uint64 size);
@@ -90,10 +185,12 @@ struct memory_arena
 
 	uint8* base() { return memory; }
 
+	memory_arena_stats getStats() const;
+
 
 protected:
 
-	void ensureFreeSizeInternal(uint64 size);
+	bool ensureFreeSizeInternal(uint64 size); // Returns true if this pushed the tag over its budget. Report after unlocking.
 
 	uint8* memory = 0;
 	uint64 committedMemory = 0;
@@ -108,7 +205,11 @@ protected:
 
 	uint64 reserveSize = 0;
 
-	std::mutex mutex;
+	uint64 highWaterMark = 0;
+	const char* name = 0;
+	memory_tag tag = memory_tag_untagged;
+
+	mutable std::mutex mutex;
 };
 
 struct scope_temp_memory
@@ -0,0 +1,121 @@
+#include "pch.h"
+#include "memory_profiling.h"
+#include "memory.h"
+#include "cpu_profiling.h"
+#include "imgui.h"
+
+
+bool memoryProfilerWindowOpen = false;
+
+static const char* memoryStatLabels[] =
+{
+	"Memory untagged (MB)",
+	"Memory asset (MB)",
+	"Memory physics (MB)",
+	"Memory animation (MB)",
+	"Memory render (MB)",
+	"Memory audio (MB)",
+};
+
+static_assert(arraysize(memoryStatLabels) == memory_tag_count);
+static_assert(arraysize(memoryTagNames) == memory_tag_count);
+
+static float toMB(uint64 bytes)
+{
+	return (float)bytes / (1024.f * 1024.f);
+}
+
+void updateMemoryProfiler()
+{
+	memory_tag_stats stats[memory_tag_count];
+	for (uint32 i = 0; i < memory_tag_count; ++i)
+	{
+		stats[i] = getMemoryTagStats((memory_tag)i);
+		CPU_PROFILE_STAT(memoryStatLabels[i], toMB(stats[i].allocated + stats[i].committed));
+	}
+
+	if (memoryProfilerWindowOpen)
+	{
+		if (ImGui::Begin(ICON_FA_MEMORY "  Memory", &memoryProfilerWindowOpen))
+		{
+			if (ImGui::Button(ICON_FA_CLIPBOARD "  Dump to stdout"))
+			{
+				printMemoryStats(std::cout);
+			}
+
+			ImGui::Text("Subsystems");
+			if (ImGui::BeginTable("##tags", 7, ImGuiTableFlags_BordersInnerV | ImGuiTableFlags_Resizable | ImGuiTableFlags_RowBg))
+			{
+				ImGui::TableSetupColumn("Tag");
+				ImGui::TableSetupColumn("Allocated (MB)");
+				ImGui::TableSetupColumn("Peak allocated (MB)");
+				ImGui::TableSetupColumn("Live allocations");
+				ImGui::TableSetupColumn("Arena committed (MB)");
+				ImGui::TableSetupColumn("Arena reserved (MB)");
+				ImGui::TableSetupColumn("Budget (MB)");
+				ImGui::TableHeadersRow();
+
+				for (uint32 i = 0; i < memory_tag_count; ++i)
+				{
+					const memory_tag_stats& s = stats[i];
+					bool overBudget = s.budget && (s.allocated + s.committed > s.budget);
+
+					ImGui::TableNextRow();
+					ImGui::TableNextColumn();
+					if (overBudget)
+					{
+						ImGui::TextColored(ImGui::red, "%s", memoryTagNames[i]);
+					}
+					else
+					{
+						ImGui::Text("%s", memoryTagNames[i]);
+					}
+					ImGui::TableNextColumn(); ImGui::Text("%.2f", toMB(s.allocated));
+					ImGui::TableNextColumn(); ImGui::Text("%.2f", toMB(s.allocatedHighWaterMark));
+					ImGui::TableNextColumn(); ImGui::Text("%llu", s.numAllocations);
+					ImGui::TableNextColumn(); ImGui::Text("%.2f", toMB(s.committed));
+					ImGui::TableNextColumn(); ImGui::Text("%.2f", toMB(s.reserved));
+
+					ImGui::TableNextColumn();
+					ImGui::PushID(i);
+					int32 budgetMB = (int32)BYTE_TO_MB(s.budget);
+					ImGui::SetNextItemWidth(-1.f);
+					if (ImGui::InputInt("##budget", &budgetMB, 0, 0, ImGuiInputTextFlags_EnterReturnsTrue))
+					{
+						setMemoryBudget((memory_tag)i, MB((uint64)max(budgetMB, 0)));
+					}
+					ImGui::PopID();
+				}
+
+				ImGui::EndTable();
+			}
+
+			ImGui::Dummy(ImVec2(0.f, 10.f));
+			ImGui::Text("Arenas");
+			if (ImGui::BeginTable("##arenas", 6, ImGuiTableFlags_BordersInnerV | ImGuiTableFlags_Resizable | ImGuiTableFlags_RowBg))
+			{
+				ImGui::TableSetupColumn("Name");
+				ImGui::TableSetupColumn("Tag");
+				ImGui::TableSetupColumn("Used (MB)");
+				ImGui::TableSetupColumn("Peak used (MB)");
+				ImGui::TableSetupColumn("Committed (MB)");
+				ImGui::TableSetupColumn("Reserved (MB)");
+				ImGui::TableHeadersRow();
+
+				for (const memory_arena_stats& s : getMemoryArenaStats())
+				{
+					ImGui::TableNextRow();
+					ImGui::TableNextColumn(); ImGui::Text("%s", s.name);
+					ImGui::TableNextColumn(); ImGui::Text("%s", memoryTagNames[s.tag]);
+					ImGui::TableNextColumn(); ImGui::Text("%.2f", toMB(s.used));
+					ImGui::TableNextColumn(); ImGui::Text("%.2f", toMB(s.highWaterMark));
+					ImGui::TableNextColumn(); ImGui::Text("%.2f", toMB(s.committed));
+					ImGui::TableNextColumn(); ImGui::Text("%.2f", toMB(s.reserved));
+				}
+
+				ImGui::EndTable();
+			}
+		}
+		ImGui::End();
+	}
+}
@@ -0,0 +1,6 @@
+#pragma once
+
+extern bool memoryProfilerWindowOpen;
+
+// Reports the per-tag memory usage as profile stats and draws the memory profiler window if it is open.
+void updateMemoryProfiler();
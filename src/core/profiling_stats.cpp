@@ -0,0 +1,517 @@
+#include "pch.h"
+#define PROFILING_INTERNAL
+#include "profiling_stats.h"
+#include "cpu_profiling.h"
+#include "core/math.h"
+#include "core/string.h"
+#include "core/log.h"
+#include "core/imgui.h"
+#include "editor/file_dialog.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <fstream>
+
+#if ENABLE_CPU_PROFILING
+
+static const uint64 frameSeriesKey = COMPILE_TIME_STRING_HASH_64("__frame__");
+static const uint64 statSeriesRootKey = COMPILE_TIME_STRING_HASH_64("__stats__");
+
+static uint64 combineSeriesKeys(uint64 parent, uint64 name)
+{
+	return (parent * 1099511628211llu) ^ (name + 0x9e3779b97f4a7c15llu + (parent << 6) + (parent >> 2));
+}
+
+profile_series_summary profile_series::summarize() const
+{
+	profile_series_summary result = {};
+	if (numSamples == 0)
+	{
+		return result;
+	}
+
+	std::vector<float> sorted(samples.begin(), samples.begin() + numSamples);
+	std::sort(sorted.begin(), sorted.end());
+
+	double sum = 0.0;
+	for (float f : sorted)
+	{
+		sum += f;
+	}
+
+	// Nearest-rank percentiles.
+	auto percentile = [&sorted](float p)
+	{
+		uint32 rank = (uint32)ceil(p * sorted.size());
+		rank = clamp(rank, 1u, (uint32)sorted.size());
+		return sorted[rank - 1];
+	};
+
+	result.count = numSamples;
+	result.minimum = sorted.front();
+	result.maximum = sorted.back();
+	result.mean = (float)(sum / numSamples);
+	result.p50 = percentile(0.50f);
+	result.p95 = percentile(0.95f);
+	result.p99 = percentile(0.99f);
+	return result;
+}
+
+void profile_statistics::setWindowSize(uint32 numFrames)
+{
+	windowSize = max(numFrames, 1u);
+	for (profile_series& s : series)
+	{
+		s.samples.clear();
+		s.writeIndex = 0;
+		s.numSamples = 0;
+	}
+	regressions.clear();
+}
+
+uint32 profile_statistics::findOrCreateSeries(uint64 key, const char* name, uint32 parent, profile_series_type type)
+{
+	auto it = seriesIndex.find(key);
+	if (it != seriesIndex.end())
+	{
+		return it->second;
+	}
+
+	profile_series s;
+	s.key = key;
+	s.type = type;
+	if (parent != INVALID_PROFILE_BLOCK)
+	{
+		s.path = series[parent].path + "/" + name;
+		s.depth = series[parent].depth + 1;
+	}
+	else
+	{
+		s.path = name;
+		s.depth = 0;
+	}
+
+	uint32 index = (uint32)series.size();
+	series.push_back(std::move(s));
+	seriesIndex.insert({ key, index });
+	return index;
+}
+
+void profile_statistics::pushSample(profile_series& s, float value)
+{
+	if (s.samples.size() != windowSize)
+	{
+		s.samples.resize(windowSize);
+	}
+
+	s.samples[s.writeIndex] = value;
+	s.writeIndex = (s.writeIndex + 1) % windowSize;
+	s.numSamples = min(s.numSamples + 1, windowSize);
+}
+
+void profile_statistics::addFrame(const profile_block* blocks, uint32 numBlocks, const profile_stat* stats, uint32 numStats, float frameDuration)
+{
+	++frameCounter;
+	touchedThisFrame.clear();
+
+	auto accumulate = [this](uint32 index, float value)
+	{
+		profile_series& s = series[index];
+		if (s.lastTouchedFrame != frameCounter)
+		{
+			s.lastTouchedFrame = frameCounter;
+			s.accumulatedThisFrame = 0.f;
+			touchedThisFrame.push_back(index);
+		}
+		s.accumulatedThisFrame += value;
+	};
+
+	accumulate(findOrCreateSeries(frameSeriesKey, "Frame", INVALID_PROFILE_BLOCK, profile_series_type_frame), frameDuration);
+
+	// Parents are always stored before their children in the block pool, so we can resolve the series of each block in one pass.
+	blockToSeries.resize(numBlocks);
+	for (uint32 i = 0; i < numBlocks; ++i)
+	{
+		const profile_block& block = blocks[i];
+
+		uint32 parent = (block.parent == INVALID_PROFILE_BLOCK) ? INVALID_PROFILE_BLOCK : blockToSeries[block.parent];
+		uint64 parentKey = (parent == INVALID_PROFILE_BLOCK) ? 0 : series[parent].key;
+		uint64 key = combineSeriesKeys(parentKey, hashString64(block.name));
+
+		uint32 index = findOrCreateSeries(key, block.name, parent, profile_series_type_block);
+		blockToSeries[i] = index;
+
+		// Blocks which started in a previous frame have a negative relative start. Only count the part inside this frame.
+		float duration = block.duration + min(block.relStart, 0.f);
+		accumulate(index, max(duration, 0.f));
+	}
+
+	for (uint32 i = 0; i < numStats; ++i)
+	{
+		const profile_stat& stat = stats[i];
+
+		float value;
+		switch (stat.type)
+		{
+			case profile_stat_type_bool: value = stat.boolValue ? 1.f : 0.f; break;
+			case profile_stat_type_int32: value = (float)stat.int32Value; break;
+			case profile_stat_type_uint32: value = (float)stat.uint32Value; break;
+			case profile_stat_type_int64: value = (float)stat.int64Value; break;
+			case profile_stat_type_uint64: value = (float)stat.uint64Value; break;
+			case profile_stat_type_float: value = stat.floatValue; break;
+			default: continue; // Strings are not aggregated.
+		}
+
+		uint64 key = combineSeriesKeys(statSeriesRootKey, hashString64(stat.label));
+		accumulate(findOrCreateSeries(key, stat.label, INVALID_PROFILE_BLOCK, profile_series_type_stat), value);
+	}
+
+	for (uint32 index : touchedThisFrame)
+	{
+		profile_series& s = series[index];
+		pushSample(s, s.accumulatedThisFrame);
+	}
+
+	// A block which did not run this frame took zero time. Without these samples, blocks which only run in some frames (e.g. 
+	// streaming) would only be averaged over the frames in which they ran. Missing stats have no value and are skipped.
+	for (profile_series& s : series)
+	{
+		if (s.type == profile_series_type_block && s.lastTouchedFrame != frameCounter)
+		{
+			pushSample(s, 0.f);
+		}
+	}
+}
+
+void profile_statistics::sortSeries(std::vector<uint32>& indices) const
+{
+	indices.resize(series.size());
+	for (uint32 i = 0; i < (uint32)series.size(); ++i)
+	{
+		indices[i] = i;
+	}
+
+	std::sort(indices.begin(), indices.end(), [this](uint32 a, uint32 b)
+	{
+		const profile_series& sa = series[a];
+		const profile_series& sb = series[b];
+		return (sa.type != sb.type) ? (sa.type < sb.type) : (sa.path < sb.path);
+	});
+}
+
+static void writeCSVString(std::ostream& out, const std::string& s)
+{
+	out << '"';
+	for (char c : s)
+	{
+		if (c == '"') { out << '"'; }
+		out << c;
+	}
+	out << '"';
+}
+
+static void writeJSONString(std::ostream& out, const std::string& s)
+{
+	out << '"';
+	for (char c : s)
+	{
+		if (c == '"' || c == '\\') { out << '\\'; }
+		out << c;
+	}
+	out << '"';
+}
+
+bool profile_statistics::writeCSV(const fs::path& path) const
+{
+	std::ofstream out(path);
+	if (!out)
+	{
+		LOG_ERROR("Could not open file '%ws' for writing profile statistics", path.c_str());
+		return false;
+	}
+
+	std::vector<uint32> indices;
+	sortSeries(indices);
+
+	out << "type,path,count,min,mean,p50,p95,p99,max\n";
+	for (uint32 index : indices)
+	{
+		const profile_series& s = series[index];
+		profile_series_summary summary = s.summarize();
+		if (summary.count == 0)
+		{
+			continue;
+		}
+
+		out << profileSeriesTypeNames[s.type] << ',';
+		writeCSVString(out, s.path);
+		out << ',' << summary.count << ',' << summary.minimum << ',' << summary.mean << ',' << summary.p50 << ',' << summary.p95 << ',' << summary.p99 << ',' << summary.maximum << '\n';
+	}
+
+	return true;
+}
+
+bool profile_statistics::writeJSON(const fs::path& path) const
+{
+	std::ofstream out(path);
+	if (!out)
+	{
+		LOG_ERROR("Could not open file '%ws' for writing profile statistics", path.c_str());
+		return false;
+	}
+
+	std::vector<uint32> indices;
+	sortSeries(indices);
+
+	out << "{\n\t\"windowSize\": " << windowSize << ",\n\t\"series\": [";
+
+	bool first = true;
+	for (uint32 index : indices)
+	{
+		const profile_series& s = series[index];
+		profile_series_summary summary = s.summarize();
+		if (summary.count == 0)
+		{
+			continue;
+		}
+
+		out << (first ? "\n" : ",\n");
+		first = false;
+
+		out << "\t\t{ \"type\": \"" << profileSeriesTypeNames[s.type] << "\", \"path\": ";
+		writeJSONString(out, s.path);
+		out << ", \"count\": " << summary.count
+			<< ", \"min\": " << summary.minimum
+			<< ", \"mean\": " << summary.mean
+			<< ", \"p50\": " << summary.p50
+			<< ", \"p95\": " << summary.p95
+			<< ", \"p99\": " << summary.p99
+			<< ", \"max\": " << summary.maximum << " }";
+	}
+
+	out << "\n\t]\n}\n";
+	return true;
+}
+
+static bool readCSVLine(const std::string& line, std::vector<std::string>& fields)
+{
+	fields.clear();
+
+	std::string current;
+	bool quoted = false;
+	for (uint32 i = 0; i < (uint32)line.size(); ++i)
+	{
+		char c = line[i];
+		if (quoted)
+		{
+			if (c == '"')
+			{
+				if (i + 1 < line.size() && line[i + 1] == '"') { current.push_back('"'); ++i; }
+				else { quoted = false; }
+			}
+			else
+			{
+				current.push_back(c);
+			}
+		}
+		else if (c == '"') { quoted = true; }
+		else if (c == ',') { fields.push_back(std::move(current)); current.clear(); }
+		else if (c != '\r') { current.push_back(c); }
+	}
+	fields.push_back(std::move(current));
+
+	return !quoted;
+}
+
+static bool parseCSVField(const std::string& field, uint32& out)
+{
+	char* end;
+	errno = 0;
+	unsigned long value = strtoul(field.c_str(), &end, 10);
+	if (field.empty() || *end != 0 || errno == ERANGE || value > UINT32_MAX)
+	{
+		return false;
+	}
+	out = (uint32)value;
+	return true;
+}
+
+static bool parseCSVField(const std::string& field, float& out)
+{
+	char* end;
+	errno = 0;
+	out = strtof(field.c_str(), &end);
+	return !field.empty() && *end == 0 && errno != ERANGE;
+}
+
+uint32 profile_statistics::compareAgainstBaseline(const fs::path& baselinePath, float relativeThreshold, float absoluteThreshold)
+{
+	regressions.clear();
+
+	std::ifstream stream(baselinePath);
+	if (!stream)
+	{
+		LOG_ERROR("Could not open profile baseline '%ws'", baselinePath.c_str());
+		return 0;
+	}
+
+	std::unordered_map<std::string, profile_series_summary> baseline;
+
+	std::string line;
+	std::vector<std::string> fields;
+	std::getline(stream, line); // Header.
+	uint32 lineNumber = 1;
+	while (std::getline(stream, line))
+	{
+		++lineNumber;
+
+		profile_series_summary summary;
+		if (!readCSVLine(line, fields) || fields.size() != 9
+			|| !parseCSVField(fields[2], summary.count)
+			|| !parseCSVField(fields[3], summary.minimum)
+			|| !parseCSVField(fields[4], summary.mean)
+			|| !parseCSVField(fields[5], summary.p50)
+			|| !parseCSVField(fields[6], summary.p95)
+			|| !parseCSVField(fields[7], summary.p99)
+			|| !parseCSVField(fields[8], summary.maximum))
+		{
+			if (!line.empty())
+			{
+				LOG_WARNING("Skipping malformed line %u in profile baseline '%ws'", lineNumber, baselinePath.c_str());
+			}
+			continue;
+		}
+
+		baseline.insert({ fields[0] + ':' + fields[1], summary });
+	}
+
+	for (const profile_series& s : series)
+	{
+		auto it = baseline.find(std::string(profileSeriesTypeNames[s.type]) + ':' + s.path);
+		if (it == baseline.end())
+		{
+			continue;
+		}
+
+		profile_series_summary current = s.summarize();
+		if (current.count == 0)
+		{
+			continue;
+		}
+
+		const profile_series_summary& base = it->second;
+
+		auto check = [&](const char* metric, float baseValue, float currentValue)
+		{
+			if (currentValue - baseValue > absoluteThreshold && currentValue > baseValue * (1.f + relativeThreshold))
+			{
+				regressions.push_back({ s.path + " (" + metric + ")", baseValue, currentValue });
+				LOG_WARNING("Profile regression in '%s' (%s): %f -> %f", s.path.c_str(), metric, baseValue, currentValue);
+				std::cout << "Profile regression in '" << s.path << "' (" << metric << "): " << baseValue << " -> " << currentValue << '\n';
+				return true;
+			}
+			return false;
+		};
+
+		check("p50", base.p50, current.p50) || check("p95", base.p95, current.p95);
+	}
+
+	return (uint32)regressions.size();
+}
+
+void profile_statistics::draw()
+{
+	int32 size = (int32)windowSize;
+	ImGui::SetNextItemWidth(150.f);
+	if (ImGui::InputInt("Window (frames)", &size, 64, 256, ImGuiInputTextFlags_EnterReturnsTrue))
+	{
+		setWindowSize((uint32)clamp(size, 1, 1 << 16));
+	}
+
+	ImGui::SameLine();
+	if (ImGui::Button(ICON_FA_SAVE "  Dump CSV"))
+	{
+		std::string path = saveFileDialog("CSV files", "csv");
+		if (!path.empty()) { writeCSV(path); }
+	}
+	ImGui::SameLine();
+	if (ImGui::Button(ICON_FA_SAVE "  Dump JSON"))
+	{
+		std::string path = saveFileDialog("JSON files", "json");
+		if (!path.empty()) { writeJSON(path); }
+	}
+	ImGui::SameLine();
+	if (ImGui::Button(ICON_FA_BALANCE_SCALE "  Compare against baseline"))
+	{
+		std::string path = openFileDialog("CSV files", "csv");
+		if (!path.empty()) { compareAgainstBaseline(path, 0.1f, 0.05f); }
+	}
+
+	if (!regressions.empty())
+	{
+		ImGui::TextColored(ImGui::red, "%u regressions against baseline", (uint32)regressions.size());
+		for (const profile_regression& r : regressions)
+		{
+			ImGui::BulletText("%s: %.3f -> %.3f", r.path.c_str(), r.baseline, r.current);
+		}
+	}
+
+	// Sorting the samples of every series is not free, so only refresh the displayed summaries every few frames.
+	if (cachedSummaries.size() != series.size() || frameCounter - cachedSummariesFrame >= 30)
+	{
+		sortSeries(sortedSeries);
+		cachedSummaries.resize(series.size());
+		for (uint32 i = 0; i < (uint32)series.size(); ++i)
+		{
+			cachedSummaries[i] = series[i].summarize();
+		}
+		cachedSummariesFrame = frameCounter;
+	}
+
+	if (ImGui::BeginTable("##stats", 8, ImGuiTableFlags_BordersInnerV | ImGuiTableFlags_Resizable | ImGuiTableFlags_RowBg | ImGuiTableFlags_ScrollY))
+	{
+		ImGui::TableSetupColumn("Path");
+		ImGui::TableSetupColumn("Count");
+		ImGui::TableSetupColumn("Min");
+		ImGui::TableSetupColumn("Mean");
+		ImGui::TableSetupColumn("p50");
+		ImGui::TableSetupColumn("p95");
+		ImGui::TableSetupColumn("p99");
+		ImGui::TableSetupColumn("Max");
+		ImGui::TableSetupScrollFreeze(0, 1);
+		ImGui::TableHeadersRow();
+
+		for (uint32 index : sortedSeries)
+		{
+			const profile_series& s = series[index];
+			const profile_series_summary& summary = cachedSummaries[index];
+			if (summary.count == 0)
+			{
+				continue;
+			}
+
+			ImGui::TableNextRow();
+			ImGui::TableNextColumn();
+			ImGui::Indent(s.depth * 10.f + 1.f);
+			const char* name = s.path.c_str() + ((s.depth > 0) ? s.path.find_last_of('/') + 1 : 0);
+			ImGui::Text("%s", name);
+			if (ImGui::IsItemHovered())
+			{
+				ImGui::SetTooltip("%s", s.path.c_str());
+			}
+			ImGui::Unindent(s.depth * 10.f + 1.f);
+
+			ImGui::TableNextColumn(); ImGui::Text("%u", summary.count);
+			ImGui::TableNextColumn(); ImGui::Text("%.3f", summary.minimum);
+			ImGui::TableNextColumn(); ImGui::Text("%.3f", summary.mean);
+			ImGui::TableNextColumn(); ImGui::Text("%.3f", summary.p50);
+			ImGui::TableNextColumn(); ImGui::Text("%.3f", summary.p95);
+			ImGui::TableNextColumn(); ImGui::Text("%.3f", summary.p99);
+			ImGui::TableNextColumn(); ImGui::Text("%.3f", summary.maximum);
+		}
+
+		ImGui::EndTable();
+	}
+}
+
+#endif
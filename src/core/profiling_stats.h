@@ -0,0 +1,106 @@
+#pragma once
+
+#include "profiling_internal.h"
+
+#include <unordered_map>
+
+
+// Rolling per-block and per-stat statistics over the last N frames. Blocks are keyed by their hierarchical path
+// (e.g. "Update/Physics/Narrow phase"), so the same block name in different call sites is tracked separately.
+// Blocks with the same path on different threads are summed, i.e. the series holds the total CPU time per frame.
+// From its first occurrence on, a block gets a sample every frame (zero in frames in which it did not run). Stats only get samples
+// in frames in which they were reported.
+
+#ifdef PROFILING_INTERNAL
+
+struct profile_stat;
+
+enum profile_series_type : uint8
+{
+	profile_series_type_frame,
+	profile_series_type_block,
+	profile_series_type_stat,
+
+	profile_series_type_count,
+};
+
+static const char* profileSeriesTypeNames[] =
+{
+	"frame",
+	"block",
+	"stat",
+};
+
+struct profile_series_summary
+{
+	uint32 count;
+	float minimum;
+	float mean;
+	float p50;
+	float p95;
+	float p99;
+	float maximum;
+};
+
+struct profile_series
+{
+	uint64 key;
+	std::string path;
+	profile_series_type type;
+	uint32 depth;
+
+	std::vector<float> samples; // Ring buffer.
+	uint32 writeIndex = 0;
+	uint32 numSamples = 0;
+
+	float accumulatedThisFrame = 0.f;
+	uint64 lastTouchedFrame = -1;
+
+	profile_series_summary summarize() const;
+};
+
+struct profile_regression
+{
+	std::string path;
+	float baseline;
+	float current;
+};
+
+struct profile_statistics
+{
+	void setWindowSize(uint32 numFrames);
+	uint32 getWindowSize() const { return windowSize; }
+
+	void addFrame(const profile_block* blocks, uint32 numBlocks, const profile_stat* stats, uint32 numStats, float frameDuration);
+
+	bool writeCSV(const fs::path& path) const;
+	bool writeJSON(const fs::path& path) const;
+
+	// Compares the p50 and p95 of all series against a CSV written by writeCSV. A series is reported as a regression if its
+	// current value exceeds the baseline by more than relativeThreshold (0.1 = 10%) and by more than absoluteThreshold.
+	uint32 compareAgainstBaseline(const fs::path& baselinePath, float relativeThreshold, float absoluteThreshold);
+
+	void draw();
+
+	std::vector<profile_regression> regressions;
+
+private:
+	uint32 findOrCreateSeries(uint64 key, const char* name, uint32 parent, profile_series_type type);
+	void sortSeries(std::vector<uint32>& indices) const;
+	void pushSample(profile_series& series, float value);
+
+	std::vector<profile_series> series;
+	std::unordered_map<uint64, uint32> seriesIndex;
+
+	std::vector<uint32> blockToSeries; // Temporary, per frame.
+	std::vector<uint32> touchedThisFrame; // Temporary, per frame.
+
+	std::vector<uint32> sortedSeries; // For display, sorted by path.
+	std::vector<profile_series_summary> cachedSummaries; // For display, recomputed periodically.
+	uint64 cachedSummariesFrame = 0;
+
+	uint32 windowSize = 1024;
+	uint64 frameCounter = 0;
+};
+
+#endif
@@ -0,0 +1,97 @@
+#pragma once
+
+#include <type_traits>
+
+
+// Converts a float to a uint32, which sorts in the same order as the float when interpreted as an unsigned integer.
+static uint32 floatToSortableUint(float f)
+{
+	uint32 u = *(uint32*)&f;
+	uint32 mask = (u & 0x80000000) ? 0xFFFFFFFF : 0x80000000;
+	return u ^ mask;
+}
+
+// Stable LSD radix sort with 8-bit digits. Sorts count elements of data, using scratch (of at least the same size) as temporary storage.
+// The result always ends up in data.
+// getKey must return an unsigned integer (uint32 or uint64), whose order is the desired sort order. Digits in which all keys are equal are
+// skipped, so keys with only few varying bits (e.g. function pointers) are sorted in only a few passes.
+template <typename T, typename get_key_t>
+static void radixSort(T* data, T* scratch, uint64 count, const get_key_t& getKey)
+{
+	using key_t = std::decay_t<decltype(getKey(*data))>;
+	static_assert(std::is_unsigned_v<key_t>, "Radix sort keys must be unsigned integers.");
+
+	constexpr uint32 numPasses = (uint32)sizeof(key_t);
+
+	if (count < 2)
+	{
+		return;
+	}
+
+	if (count <= 32)
+	{
+		// Insertion sort is faster for tiny arrays. Also stable.
+		for (uint64 i = 1; i < count; ++i)
+		{
+			T t = std::move(data[i]);
+			key_t key = getKey(t);
+
+			uint64 j = i;
+			for (; j > 0 && getKey(data[j - 1]) > key; --j)
+			{
+				data[j] = std::move(data[j - 1]);
+			}
+			data[j] = std::move(t);
+		}
+		return;
+	}
+
+	// Build the histograms of all digits in a single pass over the data.
+	uint64 histograms[numPasses][256] = {};
+	for (uint64 i = 0; i < count; ++i)
+	{
+		key_t key = getKey(data[i]);
+		for (uint32 pass = 0; pass < numPasses; ++pass)
+		{
+			++histograms[pass][(key >> (pass * 8)) & 0xFF];
+		}
+	}
+
+	T* src = data;
+	T* dst = scratch;
+
+	for (uint32 pass = 0; pass < numPasses; ++pass)
+	{
+		uint32 shift = pass * 8;
+		uint64* histogram = histograms[pass];
+
+		if (histogram[(getKey(src[0]) >> shift) & 0xFF] == count)
+		{
+			continue; // All keys have the same digit.
+		}
+
+		uint64 offset = 0;
+		for (uint32 i = 0; i < 256; ++i)
+		{
+			uint64 c = histogram[i];
+			histogram[i] = offset;
+			offset += c;
+		}
+
+		for (uint64 i = 0; i < count; ++i)
+		{
+			uint32 digit = (uint32)(getKey(src[i]) >> shift) & 0xFF;
+			dst[histogram[digit]++] = std::move(src[i]);
+		}
+
+		std::swap(src, dst);
+	}
+
+	if (src != data)
+	{
+		for (uint64 i = 0; i < count; ++i)
+		{
+			data[i] = std::move(src[i]);
+		}
+	}
+}
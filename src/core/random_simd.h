@@ -0,0 +1,96 @@
+#pragma once
+
+#include "random.h"
+#include "math_simd.h"
+
+
+// 8-wide versions of the hash based noise functions in random.h. The lattice hashes are bit-identical to the scalar versions,
+// so results only differ by floating point rounding. Unlike the scalar versions, the fractional part is always computed as
+// x - floor(x), which only makes a difference for negative coordinates.
+
+#if defined(SIMD_AVX_2)
+
+static w8_int hash(w8_int x)
+{
+	x = x + (x << 10);
+	x ^= (x >> 6);
+	x = x + (x << 3);
+	x ^= (x >> 11);
+	x = x + (x << 15);
+	return x;
+}
+
+static w8_int hash(w8_int x, w8_int y) { return hash(x ^ hash(y)); }
+
+// Construct a float with half-open range [0:1] using low 23 bits.
+static w8_float floatConstruct(w8_int m)
+{
+	m = (m & 0x007FFFFF) | 0x3F800000;
+	return reinterpret(m) - 1.f;
+}
+
+// Pseudo-random value in half-open range [0:1].
+static w8_float random1(w8_float x, w8_float y) { return floatConstruct(hash(reinterpret(x), reinterpret(y))); }
+
+// Returns value and derivative, like the scalar version.
+static w8_vec3 valueNoise(w8_vec2 x)
+{
+	w8_float px = floor(x.x);
+	w8_float py = floor(x.y);
+	w8_float wx = x.x - px;
+	w8_float wy = x.y - py;
+
+	w8_float ux = wx * wx * wx * fmadd(wx, fmadd(wx, 6.f, -15.f), 10.f);
+	w8_float uy = wy * wy * wy * fmadd(wy, fmadd(wy, 6.f, -15.f), 10.f);
+	w8_float dux = 30.f * wx * wx * fmadd(wx, wx - 2.f, 1.f);
+	w8_float duy = 30.f * wy * wy * fmadd(wy, wy - 2.f, 1.f);
+
+	w8_float px1 = px + 1.f;
+	w8_float py1 = py + 1.f;
+
+	w8_float a = random1(px, py);
+	w8_float b = random1(px1, py);
+	w8_float c = random1(px, py1);
+	w8_float d = random1(px1, py1);
+
+	w8_float k0 = a;
+	w8_float k1 = b - a;
+	w8_float k2 = c - a;
+	w8_float k3 = a - b - c + d;
+
+	w8_float value = fmadd(2.f, fmadd(k3, ux * uy, fmadd(k2, uy, fmadd(k1, ux, k0))), -1.f);
+	w8_float derivX = 2.f * dux * fmadd(k3, uy, k1);
+	w8_float derivY = 2.f * duy * fmadd(k3, ux, k2);
+
+	return w8_vec3(value, derivX, derivY);
+}
+
+typedef w8_vec3(*fbm_noise_2D_w8)(w8_vec2);
+
+static w8_vec3 fbm(fbm_noise_2D_w8 noiseFunc, w8_vec2 x, uint32 numOctaves = 6, float lacunarity = 1.98f, float gain = 0.49f)
+{
+	w8_float value = 0.f;
+	w8_float derivX = 0.f;
+	w8_float derivY = 0.f;
+
+	float amplitude = 0.5f;
+	float m = 1.f;
+
+	for (uint32 i = 0; i < numOctaves; ++i)
+	{
+		w8_vec3 n = noiseFunc(x);
+
+		value = fmadd(amplitude, n.x, value);			// Accumulate values.
+		derivX = fmadd(amplitude * m, n.y, derivX);		// Accumulate derivatives.
+		derivY = fmadd(amplitude * m, n.z, derivY);
+
+		amplitude *= gain;
+
+		x.x = x.x * lacunarity;
+		x.y = x.y * lacunarity;
+		m *= lacunarity;
+	}
+	return w8_vec3(value, derivX, derivY);
+}
+
+#endif
@@ -2,10 +2,21 @@
 #include "threading.h"
 #include "math.h"
 #include <intrin.h>
+#include <atomic>
 
 
 
 
+#define INVALID_JOB_THREAD_INDEX 0xFFFFFFFF
+
+static thread_local uint32 currentJobThreadIndex = INVALID_JOB_THREAD_INDEX;
+
+static void setJobThreadIndex(uint32 index)
+{
+	ASSERT(index < MAX_NUM_JOB_THREADS);
+	currentJobThreadIndex = index;
+}
+
 template <typename T, uint32 capacity>
 struct work_queue
 {
@@ -15,7 +26,8 @@ struct work_queue
 
 		for (uint32 i = 0; i < numThreads; ++i)
 		{
-			std::thread thread([this]() { workerThreadProc(); });
+			uint32 jobThreadIndex = i + threadOffset;
+			std::thread thread([this, jobThreadIndex]() { setJobThreadIndex(jobThreadIndex); workerThreadProc(); });
 
 			HANDLE handle = (HANDLE)thread.native_handle();
 			SetThreadPriority(handle, threadPriority);
@@ -115,21 +127,209 @@ struct frame_queue_entry
 	}
 };
 
-struct load_queue_entry
+// Unlike the frame queue, the load queue is ordered by priority, which can change while work is queued. Load work is coarse (whole
+// files), so the queue is a simple array, which is searched for the highest priority on every pop.
+struct async_load_queue
 {
-	std::function<void()> callback;
+	void initialize(uint32 numThreads, uint32 threadOffset, int threadPriority, const wchar* description)
+	{
+		semaphoreHandle = CreateSemaphoreEx(0, 0, numThreads, 0, 0, SEMAPHORE_ALL_ACCESS);
 
-	void process()
+		for (uint32 i = 0; i < numThreads; ++i)
+		{
+			uint32 jobThreadIndex = i + threadOffset;
+			std::thread thread([this, jobThreadIndex]() { setJobThreadIndex(jobThreadIndex); workerThreadProc(); });
+
+			HANDLE handle = (HANDLE)thread.native_handle();
+			SetThreadPriority(handle, threadPriority);
+
+			uint64 affinityMask = 1ull << (i + threadOffset);
+			SetThreadAffinityMask(handle, affinityMask);
+			SetThreadDescription(handle, description);
+
+			thread.detach();
+		}
+	}
+
+	void workerThreadProc()
 	{
-		callback();
+		while (true)
+		{
+			if (!performWork())
+			{
+				WaitForSingleObjectEx(semaphoreHandle, INFINITE, FALSE);
+			}
+		}
+	}
+
+	bool performWork()
+	{
+		ref<async_load_job> job = pop();
+		if (!job)
+		{
+			return false;
+		}
+
+		uint64 startTime = now();
+		++numRunning;
+
+		currentJob = job.get();
+		job->callback();
+		currentJob = 0;
+
+		job->callback = nullptr; // Release captured resources.
+		job->state.store(async_load_done, std::memory_order_release);
+
+		uint64 endTime = now();
+		uint64 waitTime = startTime - job->queueTime;
+
+		--numRunning;
+		++numCompleted;
+		totalWaitTime += waitTime;
+		totalRunTime += endTime - startTime;
+
+		uint64 currentMax = maxWaitTime.load();
+		while (waitTime > currentMax && !maxWaitTime.compare_exchange_weak(currentMax, waitTime)) {}
+
+		return true;
+	}
+
+	ref<async_load_job> push(const std::function<void()>& cb, float priority)
+	{
+		ref<async_load_job> job = make_ref<async_load_job>();
+		job->callback = cb;
+		job->priority = priority;
+		job->queueTime = now();
+
+		if (currentJob)
+		{
+			// Added from inside load work, so this is a dependency of the running work.
+			const std::lock_guard<std::mutex> lock(currentJob->dependenciesMutex);
+			currentJob->dependencies.push_back(job);
+		}
+
+		mutex.lock();
+		job->sequence = nextSequence++;
+		jobs.push_back(job);
+		mutex.unlock();
+
+		++numQueued;
+		ReleaseSemaphore(semaphoreHandle, 1, 0);
+
+		return job;
 	}
+
+	ref<async_load_job> pop()
+	{
+		const std::lock_guard<std::mutex> lock(mutex);
+
+		while (true)
+		{
+			int32 best = -1;
+			float bestPriority = 0.f;
+			for (int32 i = 0; i < (int32)jobs.size(); ++i)
+			{
+				const ref<async_load_job>& job = jobs[i];
+				if (job->getState() == async_load_cancelled)
+				{
+					removeAt(i--);
+					++numCancelled;
+					continue;
+				}
+
+				float priority = job->getPriority();
+				if (best == -1 || priority > bestPriority || (priority == bestPriority && job->sequence < jobs[best]->sequence))
+				{
+					best = i;
+					bestPriority = priority;
+				}
+			}
+
+			if (best == -1)
+			{
+				return 0;
+			}
+
+			ref<async_load_job> result = jobs[best];
+			removeAt(best);
+
+			// The job may have been cancelled since the scan, so the transition must be atomic.
+			uint32 expected = async_load_queued;
+			if (result->state.compare_exchange_strong(expected, async_load_running))
+			{
+				return result;
+			}
+			++numCancelled;
+		}
+	}
+
+	async_load_stats getStats()
+	{
+		async_load_stats stats;
+		stats.numQueued = numQueued;
+		stats.numRunning = numRunning;
+		stats.numCompleted = numCompleted;
+		stats.numCancelled = numCancelled;
+
+		uint64 completed = max(stats.numCompleted, (uint64)1);
+		stats.averageWaitMilliseconds = toMilliseconds(totalWaitTime / completed);
+		stats.averageRunMilliseconds = toMilliseconds(totalRunTime / completed);
+		stats.maxWaitMilliseconds = toMilliseconds(maxWaitTime);
+		return stats;
+	}
+
+	static thread_local async_load_job* currentJob;
+
+private:
+
+	void removeAt(int32 index)
+	{
+		jobs[index] = std::move(jobs.back());
+		jobs.pop_back();
+		--numQueued;
+	}
+
+	static uint64 now()
+	{
+		uint64 result;
+		QueryPerformanceCounter((LARGE_INTEGER*)&result);
+		return result;
+	}
+
+	static float toMilliseconds(uint64 ticks)
+	{
+		static uint64 frequency = []() { uint64 f; QueryPerformanceFrequency((LARGE_INTEGER*)&f); return f; }();
+		return (float)((double)ticks * 1000.0 / (double)frequency);
+	}
+
+	std::vector<ref<async_load_job>> jobs;
+	uint64 nextSequence = 0;
+
+	std::atomic<uint32> numQueued = 0;
+	std::atomic<uint32> numRunning = 0;
+	std::atomic<uint64> numCompleted = 0;
+	std::atomic<uint64> numCancelled = 0;
+	std::atomic<uint64> totalWaitTime = 0;
+	std::atomic<uint64> totalRunTime = 0;
+	std::atomic<uint64> maxWaitTime = 0;
+
+	std::mutex mutex;
+	HANDLE semaphoreHandle;
 };
 
+thread_local async_load_job* async_load_queue::currentJob = 0;
+
 static work_queue<frame_queue_entry, 256> frameQueue;
-static work_queue<load_queue_entry, 256> loadQueue;
+static async_load_queue loadQueue;
+
 
 
 
+uint32 getJobThreadIndex()
+{
+	ASSERT(currentJobThreadIndex != INVALID_JOB_THREAD_INDEX);
+	return currentJobThreadIndex;
+}
 
 void initializeJobSystem()
 {
@@ -137,13 +337,14 @@ void initializeJobSystem()
 	SetThreadAffinityMask(handle, 1);
 	SetThreadPriority(handle, THREAD_PRIORITY_HIGHEST);
 	CloseHandle(handle);
+	setJobThreadIndex(0);
 
 	uint32 numHardwareThreads = std::thread::hardware_concurrency();
 
-	uint32 numFrameThreads = clamp(numHardwareThreads, 1u, 4u);
+	uint32 numFrameThreads = clamp(numHardwareThreads, 1u, (uint32)MAX_NUM_FRAME_THREADS);
 	frameQueue.initialize(numFrameThreads, 1, THREAD_PRIORITY_NORMAL, L"Worker thread"); // 1 is the main thread.
 
-	uint32 numLoadThreads = 8;
+	uint32 numLoadThreads = NUM_LOAD_THREADS;
 	loadQueue.initialize(numLoadThreads, numFrameThreads + 1, THREAD_PRIORITY_BELOW_NORMAL, L"Loader thread"); // 1 is the main thread.
 }
 
@@ -180,10 +381,38 @@ void thread_job_context::waitForWorkCompletion()
 	}
 }
 
-void addAsyncLoadWork(const std::function<void()>& cb)
+ref<async_load_job> addAsyncLoadWork(const std::function<void()>& cb)
 {
-	load_queue_entry entry;
-	entry.callback = cb;
+	async_load_job* parent = async_load_queue::currentJob;
+	return addAsyncLoadWork(cb, parent ? parent->getPriority() : ASYNC_LOAD_PRIORITY_DEFAULT);
+}
 
-	loadQueue.push(entry);
+ref<async_load_job> addAsyncLoadWork(const std::function<void()>& cb, float priority)
+{
+	return loadQueue.push(cb, priority);
+}
+
+async_load_stats getAsyncLoadStats()
+{
+	return loadQueue.getStats();
+}
+
+void async_load_job::setPriority(float p)
+{
+	priority.store(p, std::memory_order_relaxed);
+
+	const std::lock_guard<std::mutex> lock(dependenciesMutex);
+	for (const weakref<async_load_job>& dependency : dependencies)
+	{
+		if (auto sp = dependency.lock())
+		{
+			sp->setPriority(p);
+		}
+	}
+}
+
+void async_load_job::cancel()
+{
+	uint32 expected = async_load_queued;
+	state.compare_exchange_strong(expected, async_load_cancelled);
 }
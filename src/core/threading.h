@@ -1,6 +1,7 @@
 #pragma once
 
 #include <functional>
+#include <atomic>
 
 
 // All functions return the value before the operation.
@@ -23,6 +24,15 @@ static uint32 getThreadIDFast()
 	return threadID;
 }
 
+#define MAX_NUM_FRAME_THREADS 4
+#define NUM_LOAD_THREADS 8
+#define MAX_NUM_JOB_THREADS (1 + MAX_NUM_FRAME_THREADS + NUM_LOAD_THREADS) // Main thread, frame worker threads, loader threads.
+
+// Dense index of the calling thread in the job system: 0 is the main thread, followed by the frame worker threads and the loader threads.
+// Indices are assigned once when the job system is initialized and are always smaller than MAX_NUM_JOB_THREADS. Use this to index
+// per-thread data. Must not be called from threads outside the job system.
+uint32 getJobThreadIndex();
+
 
 struct thread_job_context
 {
@@ -32,7 +42,65 @@ struct thread_job_context
 	void waitForWorkCompletion();
 };
 
-void addAsyncLoadWork(const std::function<void()>& cb);
+
+// Async loading. Load work is executed by dedicated loader threads, highest priority first (FIFO among equal priorities).
+// Work added while executing load work (e.g. the textures of the materials of a mesh) is a dependency of the running work: It
+// inherits its priority, and later priority changes of the parent are passed on to all its dependencies.
+
+#define ASYNC_LOAD_PRIORITY_BACKGROUND	0.f
+#define ASYNC_LOAD_PRIORITY_DEFAULT		1.f
+#define ASYNC_LOAD_PRIORITY_WORLD		100.f // Objects in the world, divided by (1 + camera distance).
+#define ASYNC_LOAD_PRIORITY_UI			1000.f
+
+enum async_load_state
+{
+	async_load_queued,
+	async_load_running,
+	async_load_done,
+	async_load_cancelled,
+};
+
+struct async_load_job
+{
+	void setPriority(float priority);
+	float getPriority() const { return priority.load(std::memory_order_relaxed); }
+
+	// Drops the work, if it has not started yet. Dependencies are not cancelled, since they may be shared (e.g. cached textures).
+	void cancel();
+
+	async_load_state getState() const { return (async_load_state)state.load(std::memory_order_acquire); }
+
+private:
+	std::function<void()> callback;
+	std::atomic<float> priority;
+	std::atomic<uint32> state = async_load_queued;
+	uint64 sequence;
+	uint64 queueTime;
+
+	std::mutex dependenciesMutex;
+	std::vector<weakref<async_load_job>> dependencies;
+
+	friend struct async_load_queue;
+};
+
+struct async_load_stats
+{
+	uint32 numQueued;
+	uint32 numRunning;
+	uint64 numCompleted;
+	uint64 numCancelled;
+
+	// Over all completed work.
+	float averageWaitMilliseconds; // Time between adding and starting the work.
+	float averageRunMilliseconds;
+	float maxWaitMilliseconds;
+};
+
+// The returned job can be used to change the priority or cancel the work. It can be ignored.
+ref<async_load_job> addAsyncLoadWork(const std::function<void()>& cb); // Inherits the priority of the calling load work, if any.
+ref<async_load_job> addAsyncLoadWork(const std::function<void()>& cb, float priority);
+
+async_load_stats getAsyncLoadStats();
 
 void initializeJobSystem();
 
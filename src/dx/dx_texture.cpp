@@ -3,6 +3,7 @@
 #include "dx_context.h"
 #include "dx_command_list.h"
 #include "core/hash.h"
+#include "core/log.h"
 #include "asset/file_registry.h"
 #include "rendering/texture_preprocessing.h"
 #include "rendering/render_resources.h"
@@ -67,6 +68,9 @@ static void textureLoaderThread(ref<dx_texture> result, const fs::path& path, ui
 	result->loadState.store(asset_loaded, std::memory_order_release);
 }
 
+// Guards the texture cache. Also held while a new texture's load job is stored and cleared, so that a fast job cannot clear it first.
+static std::mutex mutex;
+
 static ref<dx_texture> loadTextureInternal(const fs::path& path, asset_handle handle, uint32 flags)
 {
 	if (flags & image_load_flags_gen_mips_on_gpu)
@@ -110,9 +114,16 @@ static ref<dx_texture> loadTextureInternal(const fs::path& path, asset_handle ha
 		result->flags = flags;
 		result->loadState = asset_loading;
 
-		addAsyncLoadWork([=]()
+		weakref<dx_texture> weakResult = result;
+		result->loadJob = addAsyncLoadWork([weakResult, path, flags]()
 		{
-			textureLoaderThread(result, path, flags);
+			if (ref<dx_texture> result = weakResult.lock())
+			{
+				textureLoaderThread(result, path, flags);
+
+				const std::lock_guard<std::mutex> lock(mutex);
+				std::atomic_store(&result->loadJob, ref<async_load_job>());
+			}
 		});
 	}
 
@@ -222,7 +233,6 @@ static bool operator==(const texture_key& a, const texture_key& b)
 }
 
 static std::unordered_map<texture_key, weakref<dx_texture>> textureCache;
-static std::mutex mutex;
 
 static ref<dx_texture> loadTextureFromFileAndHandle(const fs::path& filename, asset_handle handle, uint32 flags)
 {
@@ -259,6 +269,119 @@ ref<dx_texture> loadTextureFromHandle(asset_handle handle, uint32 flags)
 	return loadTextureFromFileAndHandle(sceneFilename, handle, flags);
 }
 
+struct texture_reload
+{
+	weakref<dx_texture> target;
+	ref<dx_texture> reloaded;
+};
+
+static std::vector<texture_reload> finishedTextureReloads;
+static std::mutex reloadMutex;
+
+uint32 reloadTexturesFromFile(const fs::path& filename)
+{
+	fs::path path = filename.lexically_normal().make_preferred();
+	asset_handle handle = getAssetHandleFromPath(path);
+	if (!handle)
+	{
+		return 0;
+	}
+
+	std::vector<ref<dx_texture>> targets;
+
+	mutex.lock();
+	for (const auto& [key, texture] : textureCache)
+	{
+		if (key.handle == handle)
+		{
+			// Textures, which are still loading, will pick up the new content anyway.
+			auto sp = texture.lock();
+			if (sp && sp->loadState.load() == asset_loaded)
+			{
+				targets.push_back(sp);
+			}
+		}
+	}
+	mutex.unlock();
+
+	for (const ref<dx_texture>& target : targets)
+	{
+		weakref<dx_texture> weakTarget = target;
+		uint32 flags = target->flags;
+
+		addAsyncLoadWork([weakTarget, path, flags]()
+		{
+			ref<dx_texture> reloaded = make_ref<dx_texture>();
+			textureLoaderThread(reloaded, path, flags);
+
+			if (reloaded->loadState.load() == asset_loaded)
+			{
+				const std::lock_guard<std::mutex> lock(reloadMutex);
+				finishedTextureReloads.push_back({ weakTarget, reloaded });
+			}
+			else
+			{
+				LOG_ERROR("Could not reload texture '%ws'", path.c_str());
+			}
+		});
+	}
+
+	return (uint32)targets.size();
+}
+
+static void swapTextureResources(dx_texture& a, dx_texture& b)
+{
+	std::swap(a.resource, b.resource);
+	std::swap(a.allocation, b.allocation);
+	std::swap(a.srvUavAllocation, b.srvUavAllocation);
+	std::swap(a.rtvAllocation, b.rtvAllocation);
+	std::swap(a.dsvAllocation, b.dsvAllocation);
+	std::swap(a.defaultSRV, b.defaultSRV);
+	std::swap(a.defaultUAV, b.defaultUAV);
+	std::swap(a.stencilSRV, b.stencilSRV);
+	std::swap(a.defaultRTV, b.defaultRTV);
+	std::swap(a.defaultDSV, b.defaultDSV);
+	std::swap(a.width, b.width);
+	std::swap(a.height, b.height);
+	std::swap(a.depth, b.depth);
+	std::swap(a.format, b.format);
+	std::swap(a.initialState, b.initialState);
+	std::swap(a.supportsRTV, b.supportsRTV);
+	std::swap(a.supportsDSV, b.supportsDSV);
+	std::swap(a.supportsUAV, b.supportsUAV);
+	std::swap(a.supportsSRV, b.supportsSRV);
+	std::swap(a.requestedNumMipLevels, b.requestedNumMipLevels);
+	std::swap(a.numMipLevels, b.numMipLevels);
+}
+
+void applyReloadedTextures()
+{
+	std::vector<texture_reload> reloads;
+	{
+		const std::lock_guard<std::mutex> lock(reloadMutex);
+		reloads.swap(finishedTextureReloads);
+	}
+
+	if (reloads.empty())
+	{
+		return;
+	}
+
+	// The uploads were issued on the copy queue.
+	dxContext.renderQueue.waitForOtherQueue(dxContext.copyQueue);
+
+	for (texture_reload& reload : reloads)
+	{
+		if (auto target = reload.target.lock())
+		{
+			// The old resources end up in the reloaded object, which retires them once the GPU is done with them.
+			swapTextureResources(*target, *reload.reloaded);
+		}
+	}
+
+	LOG_MESSAGE("Reloaded %u texture%s", (uint32)reloads.size(), (reloads.size() > 1) ? "s" : "");
+}
+
 ref<dx_texture> loadTextureFromMemory(const void* ptr, uint32 size, image_format imageFormat, const fs::path& cacheFilename, uint32 flags)
 {
 	return loadTextureFromMemoryInternal(ptr, size, imageFormat, cacheFilename, flags);
@@ -1061,6 +1184,11 @@ static void retire(dx_resource resource, dx_descriptor_allocation srvUavAllocati
 
 dx_texture::~dx_texture()
 {
+	if (loadJob)
+	{
+		loadJob->cancel();
+	}
+
 	retire(resource, srvUavAllocation, rtvAllocation, dsvAllocation);
 	if (allocation)
 	{
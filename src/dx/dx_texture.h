@@ -5,6 +5,7 @@
 #include "core/math.h"
 #include "asset/asset.h"
 #include "asset/image.h"
+#include "core/threading.h"
 
 #include <string>
 
@@ -53,6 +54,7 @@ struct dx_texture
 	uint32 flags = 0;
 
 	std::atomic<asset_load_state> loadState = asset_loaded;
+	ref<async_load_job> loadJob; // Set while loading asynchronously. Access with std::atomic_load.
 
 	void setName(const wchar* name);
 	std::wstring getName() const;
@@ -153,6 +155,12 @@ ref<dx_texture> loadTextureFromHandle(asset_handle handle, uint32 flags = image_
 ref<dx_texture> loadTextureFromMemory(const void* ptr, uint32 size, image_format imageFormat, const fs::path& cacheFilename, uint32 flags = image_load_flags_default);
 ref<dx_texture> loadVolumeTextureFromDirectory(const fs::path& dirname, uint32 flags = image_load_flags_compress | image_load_flags_cache_to_dds | image_load_flags_noncolor);
 
+// Hot reload. Re-imports all cached textures loaded from the given file in the background, and returns how many were scheduled.
+// applyReloadedTextures swaps the finished ones into the existing texture objects, so every holder of the texture sees the new
+// contents. Call it on the main thread, between frames.
+uint32 reloadTexturesFromFile(const fs::path& filename);
+void applyReloadedTextures();
+
 void copyTextureToCPUBuffer(const ref<dx_texture>& texture, void* buffer, D3D12_RESOURCE_STATES beforeAndAfterState = D3D12_RESOURCE_STATE_COMMON);
 void saveTextureToFile(const ref<dx_texture>& texture, const fs::path& path);
 void saveTextureToFile(dx_resource texture, uint32 width, uint32 height, DXGI_FORMAT format, const fs::path& path);
@@ -115,6 +115,6 @@ void dx_upload_buffer::reset()
 void dx_page_pool::initialize(uint32 sizeInBytes)
 {
 	pageSize = sizeInBytes;
-	arena.initialize(0, sizeof(dx_page) * 512);
+	arena.initialize(0, sizeof(dx_page) * 512, "Upload buffer pages", memory_tag_render);
 }
 
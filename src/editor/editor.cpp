@@ -2,6 +2,7 @@
 #include "editor.h"
 #include "editor_icons.h"
 #include "core/cpu_profiling.h"
+#include "core/memory_profiling.h"
 #include "core/log.h"
 #include "asset/file_registry.h"
 #include "core/imgui.h"
@@ -71,6 +72,13 @@ struct component_member_undo
 		}
 	}
 
+	// Keeps the oldest value when the same member was edited twice.
+	bool merge(const component_member_undo& newer)
+	{
+		return entity.handle == newer.entity.handle && byteOffset == newer.byteOffset 
+			&& callback == newer.callback && userData == newer.userData;
+	}
+
 private:
 	scene_entity entity;
 	uint64 byteOffset;
@@ -117,6 +125,7 @@ struct settings_undo
 		: value(value), before(before) {}
 
 	void toggle() { std::swap(value, before); }
+	bool merge(const settings_undo& newer) { return &value == &newer.value; }
 
 private:
 	value_t& value;
@@ -129,6 +138,7 @@ struct entity_existence_undo
 	entity_existence_undo(game_scene& scene, scene_entity entity)
 		: scene(scene), entity(entity)
 	{
+		memset(buffer, 0, sizeof(buffer)); // The undo stack compresses the unused tail away.
 		size = serializeEntityToMemory(entity, buffer, sizeof(buffer));
 	}
 
@@ -157,7 +167,7 @@ private:
 
 	game_scene& scene;
 	scene_entity entity;
-	uint8 buffer[1024];
+	uint8 buffer[KB(16)];
 	uint64 size;
 };
 
@@ -419,6 +429,16 @@ bool scene_editor::drawMainMenuBar()
 				deserializeFromFile();
 			}
 
+			if (ImGui::MenuItem(ICON_FA_SAVE "  Save scene as binary"))
+			{
+				serializeToFile(true);
+			}
+
+			if (ImGui::MenuItem(ICON_FA_FOLDER_OPEN "  Load binary scene"))
+			{
+				deserializeFromFile(true);
+			}
+
 			ImGui::Separator();
 			if (ImGui::MenuItem(ICON_FA_TIMES "  Exit", "Esc"))
 			{
@@ -451,6 +471,11 @@ bool scene_editor::drawMainMenuBar()
 				cpuProfilerWindowOpen = !cpuProfilerWindowOpen;
 			}
 
+			if (ImGui::MenuItem(memoryProfilerWindowOpen ? (ICON_FA_MEMORY "  Hide memory profiler") : (ICON_FA_MEMORY "  Show memory profiler")))
+			{
+				memoryProfilerWindowOpen = !memoryProfilerWindowOpen;
+			}
+
 			ImGui::Separator();
 
 			if (ImGui::MenuItem(logWindowOpen ? (ICON_FA_CLIPBOARD_LIST "  Hide message log") : (ICON_FA_CLIPBOARD_LIST "  Show message log"), "Ctrl+L", nullptr, ENABLE_MESSAGE_LOG))
@@ -599,7 +624,7 @@ bool scene_editor::drawMainMenuBar()
 }
 
 template<typename component_t, typename ui_func>
-static void drawComponent(scene_entity entity, const char* componentName, ui_func func)
+static void drawComponent(scene_snapshot& snapshot, scene_entity entity, const char* componentName, ui_func func)
 {
 	const ImGuiTreeNodeFlags treeNodeFlags = ImGuiTreeNodeFlags_DefaultOpen | ImGuiTreeNodeFlags_Framed | ImGuiTreeNodeFlags_SpanAvailWidth | ImGuiTreeNodeFlags_AllowItemOverlap | ImGuiTreeNodeFlags_FramePadding;
 	if (auto* component = entity.getComponentIfExists<component_t>())
@@ -610,6 +635,9 @@ static void drawComponent(scene_entity entity, const char* componentName, ui_fun
 
 		if (open)
 		{
+			// While the game is running, the scene snapshot must see the value before any edit. Only the first call per component copies.
+			snapshot.preserve<component_t>(entity.handle);
+
 			func(*component);
 			ImGui::TreePop();
 		}
@@ -664,6 +692,11 @@ static void editTexture(const char* name, ref<dx_texture>& tex, uint32 loadFlags
 		fs::path relative = fs::relative(path, fs::current_path());
 		if (auto newTex = loadTextureFromFile(relative.string(), loadFlags))
 		{
+			if (auto job = std::atomic_load(&newTex->loadJob))
+			{
+				// The user is looking at this property, so load the texture before anything in the world.
+				job->setPriority(ASYNC_LOAD_PRIORITY_UI);
+			}
 			tex = newTex;
 		}
 	}
@@ -811,7 +844,7 @@ bool scene_editor::drawSceneHierarchy()
 				}
 				if (selectedEntity)
 				{
-					drawComponent<transform_component>(selectedEntity, "TRANSFORM", [this, &objectMovedByWidget](transform_component& transform)
+					drawComponent<transform_component>(this->scene->snapshot, selectedEntity, "TRANSFORM", [this, &objectMovedByWidget](transform_component& transform)
 					{
 						using component_t = transform_component;
 
@@ -827,7 +860,7 @@ bool scene_editor::drawSceneHierarchy()
 							objectMovedByWidget |= ImGui::Drag("Scale", transform.scale, 0.1f));
 					});
 
-					drawComponent<position_component>(selectedEntity, "TRANSFORM", [this, &objectMovedByWidget](position_component& transform)
+					drawComponent<position_component>(this->scene->snapshot, selectedEntity, "TRANSFORM", [this, &objectMovedByWidget](position_component& transform)
 					{
 						using component_t = position_component;
 
@@ -835,7 +868,7 @@ bool scene_editor::drawSceneHierarchy()
 							objectMovedByWidget |= ImGui::Drag("Position", transform.position, 0.1f));
 					});
 
-					drawComponent<position_rotation_component>(selectedEntity, "TRANSFORM", [this, &objectMovedByWidget](position_rotation_component& transform)
+					drawComponent<position_rotation_component>(this->scene->snapshot, selectedEntity, "TRANSFORM", [this, &objectMovedByWidget](position_rotation_component& transform)
 					{
 						using component_t = position_rotation_component;
 
@@ -849,7 +882,7 @@ bool scene_editor::drawSceneHierarchy()
 							}, [](position_rotation_component&, quat rot, void* userData) { *(vec3*)userData = getEuler(rot); }, & selectedEntityEulerRotation);
 					});
 
-					drawComponent<position_scale_component>(selectedEntity, "TRANSFORM", [this, &objectMovedByWidget](position_scale_component& transform)
+					drawComponent<position_scale_component>(this->scene->snapshot, selectedEntity, "TRANSFORM", [this, &objectMovedByWidget](position_scale_component& transform)
 					{
 						using component_t = position_scale_component;
 
@@ -859,12 +892,12 @@ bool scene_editor::drawSceneHierarchy()
 							objectMovedByWidget |= ImGui::Drag("Scale", transform.scale, 0.1f));
 					});
 
-					drawComponent<dynamic_transform_component>(selectedEntity, "DYNAMIC", [](dynamic_transform_component& dynamic)
+					drawComponent<dynamic_transform_component>(this->scene->snapshot, selectedEntity, "DYNAMIC", [](dynamic_transform_component& dynamic)
 					{
 						ImGui::Text("Dynamic");
 					});
 
-					drawComponent<mesh_component>(selectedEntity, "MESH", [this](mesh_component& raster)
+					drawComponent<mesh_component>(this->scene->snapshot, selectedEntity, "MESH", [this](mesh_component& raster)
 					{
 						using component_t = mesh_component;
 
@@ -892,7 +925,7 @@ bool scene_editor::drawSceneHierarchy()
 						}
 					});
 
-					drawComponent<terrain_component>(selectedEntity, "TERRAIN", [this, &objectMovedByWidget](terrain_component& terrain)
+					drawComponent<terrain_component>(this->scene->snapshot, selectedEntity, "TERRAIN", [this, &objectMovedByWidget](terrain_component& terrain)
 					{
 						using component_t = terrain_component;
 
@@ -911,9 +944,27 @@ bool scene_editor::drawSceneHierarchy()
 							UNDOABLE_COMPONENT_SETTING("terrain noise octaves", settings.noiseOctaves,
 								objectMovedByWidget |= ImGui::PropertySlider("Noise octaves", settings.noiseOctaves, 1, 32));
 
+							auto& streaming = terrain.streaming;
+							UNDOABLE_COMPONENT_SETTING("terrain streaming", streaming.enabled,
+								ImGui::PropertyCheckbox("Streaming", streaming.enabled));
+							if (streaming.enabled)
+							{
+								UNDOABLE_COMPONENT_SETTING("terrain streaming load radius", streaming.loadRadius,
+									ImGui::PropertyDrag("Load radius", streaming.loadRadius, 1.f, 0.f));
+								UNDOABLE_COMPONENT_SETTING("terrain streaming memory budget", streaming.memoryBudgetMB,
+									ImGui::PropertySlider("Memory budget (MB)", streaming.memoryBudgetMB, 16, 4096));
+								UNDOABLE_COMPONENT_SETTING("terrain streaming loads in flight", streaming.maxLoadsInFlight,
+									ImGui::PropertySlider("Loads in flight", streaming.maxLoadsInFlight, 1, 32));
+							}
+
 							ImGui::EndProperties();
 						}
 
+						if (ImGui::Button("Benchmark CPU generation"))
+						{
+							benchmarkTerrainGenerationCPU(terrain.genSettings, terrain.chunkSize);
+						}
+
 						if (ImGui::BeginTree("Ground"))
 						{
 							editMaterial(terrain.groundMaterial);
@@ -927,7 +978,7 @@ bool scene_editor::drawSceneHierarchy()
 						}
 					});
 
-					drawComponent<proc_placement_component>(selectedEntity, "PROCEDURAL PLACEMENT", [this](proc_placement_component& placement)
+					drawComponent<proc_placement_component>(this->scene->snapshot, selectedEntity, "PROCEDURAL PLACEMENT", [this](proc_placement_component& placement)
 					{
 						using component_t = proc_placement_component;
 
@@ -953,7 +1004,7 @@ bool scene_editor::drawSceneHierarchy()
 						}
 					});
 
-					drawComponent<grass_component>(selectedEntity, "GRASS", [this](grass_component& grass)
+					drawComponent<grass_component>(this->scene->snapshot, selectedEntity, "GRASS", [this](grass_component& grass)
 					{
 						using component_t = grass_component;
 
@@ -985,7 +1036,7 @@ bool scene_editor::drawSceneHierarchy()
 						}
 					});
 
-					drawComponent<water_component>(selectedEntity, "WATER", [this](water_component& water)
+					drawComponent<water_component>(this->scene->snapshot, selectedEntity, "WATER", [this](water_component& water)
 					{
 						using component_t = water_component;
 
@@ -1011,7 +1062,7 @@ bool scene_editor::drawSceneHierarchy()
 						}
 					});
 
-					drawComponent<animation_component>(selectedEntity, "ANIMATION", [this](animation_component& anim)
+					drawComponent<animation_component>(this->scene->snapshot, selectedEntity, "ANIMATION", [this](animation_component& anim)
 					{
 						if (mesh_component* mesh = selectedEntity.getComponentIfExists<mesh_component>())
 						{
@@ -1094,7 +1145,7 @@ bool scene_editor::drawSceneHierarchy()
 						}
 					});
 
-					drawComponent<rigid_body_component>(selectedEntity, "RIGID BODY", [this, &scene](rigid_body_component& rb)
+					drawComponent<rigid_body_component>(this->scene->snapshot, selectedEntity, "RIGID BODY", [this, &scene](rigid_body_component& rb)
 					{
 						using component_t = rigid_body_component;
 
@@ -1110,6 +1161,8 @@ bool scene_editor::drawSceneHierarchy()
 								ImGui::PropertySlider("Angular velocity damping", rb.angularDamping));
 							UNDOABLE_COMPONENT_SETTING("rigid body gravity factor", rb.gravityFactor,
 								ImGui::PropertySlider("Gravity factor", rb.gravityFactor));
+							UNDOABLE_COMPONENT_SETTING("rigid body continuous collision", rb.continuousCollision,
+								ImGui::PropertyCheckbox("Continuous collision", rb.continuousCollision));
 
 							//ImGui::PropertyValue("Linear velocity", rb.linearVelocity);
 							//ImGui::PropertyValue("Angular velocity", rb.angularVelocity);
@@ -1118,7 +1171,7 @@ bool scene_editor::drawSceneHierarchy()
 						}
 					});
 
-					drawComponent<physics_reference_component>(selectedEntity, "COLLIDERS", [this, &scene](physics_reference_component& reference)
+					drawComponent<physics_reference_component>(this->scene->snapshot, selectedEntity, "COLLIDERS", [this, &scene](physics_reference_component& reference)
 					{
 						// TODO UNDO
 						bool dirty = false;
@@ -1127,7 +1180,7 @@ bool scene_editor::drawSceneHierarchy()
 						{
 							ImGui::PushID((int)colliderEntity.handle);
 
-							drawComponent<collider_component>(colliderEntity, "Collider", [&colliderEntity, &dirty, this](collider_component& collider)
+							drawComponent<collider_component>(this->scene->snapshot, colliderEntity, "Collider", [&colliderEntity, &dirty, this](collider_component& collider)
 							{
 								switch (collider.type)
 								{
@@ -1237,7 +1290,7 @@ bool scene_editor::drawSceneHierarchy()
 						}
 					});
 
-					drawComponent<physics_reference_component>(selectedEntity, "CONSTRAINTS", [this](physics_reference_component& reference)
+					drawComponent<physics_reference_component>(this->scene->snapshot, selectedEntity, "CONSTRAINTS", [this](physics_reference_component& reference)
 					{
 						// TODO UNDO
 						for (auto [constraintEntity, constraintType] : constraint_entity_iterator(selectedEntity))
@@ -1248,7 +1301,7 @@ bool scene_editor::drawSceneHierarchy()
 							{
 								case constraint_type_distance:
 								{
-									drawComponent<distance_constraint>(constraintEntity, "Distance constraint", [this, constraintEntity = constraintEntity](distance_constraint& constraint)
+									drawComponent<distance_constraint>(this->scene->snapshot, constraintEntity, "Distance constraint", [this, constraintEntity = constraintEntity](distance_constraint& constraint)
 									{
 										if (ImGui::BeginProperties())
 										{
@@ -1272,7 +1325,7 @@ bool scene_editor::drawSceneHierarchy()
 
 								case constraint_type_ball:
 								{
-									drawComponent<ball_constraint>(constraintEntity, "Ball constraint", [this, constraintEntity = constraintEntity](ball_constraint& constraint)
+									drawComponent<ball_constraint>(this->scene->snapshot, constraintEntity, "Ball constraint", [this, constraintEntity = constraintEntity](ball_constraint& constraint)
 									{
 										if (ImGui::BeginProperties())
 										{
@@ -1295,7 +1348,7 @@ bool scene_editor::drawSceneHierarchy()
 
 								case constraint_type_fixed:
 								{
-									drawComponent<fixed_constraint>(constraintEntity, "Fixed constraint", [this, constraintEntity = constraintEntity](fixed_constraint& constraint)
+									drawComponent<fixed_constraint>(this->scene->snapshot, constraintEntity, "Fixed constraint", [this, constraintEntity = constraintEntity](fixed_constraint& constraint)
 									{
 										if (ImGui::BeginProperties())
 										{
@@ -1318,7 +1371,7 @@ bool scene_editor::drawSceneHierarchy()
 
 								case constraint_type_hinge:
 								{
-									drawComponent<hinge_constraint>(constraintEntity, "Hinge constraint", [this, constraintEntity = constraintEntity](hinge_constraint& constraint)
+									drawComponent<hinge_constraint>(this->scene->snapshot, constraintEntity, "Hinge constraint", [this, constraintEntity = constraintEntity](hinge_constraint& constraint)
 									{
 										if (ImGui::BeginProperties())
 										{
@@ -1385,7 +1438,7 @@ bool scene_editor::drawSceneHierarchy()
 
 								case constraint_type_cone_twist:
 								{
-									drawComponent<cone_twist_constraint>(constraintEntity, "Cone twist constraint", [this, constraintEntity = constraintEntity](cone_twist_constraint& constraint)
+									drawComponent<cone_twist_constraint>(this->scene->snapshot, constraintEntity, "Cone twist constraint", [this, constraintEntity = constraintEntity](cone_twist_constraint& constraint)
 									{
 										if (ImGui::BeginProperties())
 										{
@@ -1472,7 +1525,7 @@ bool scene_editor::drawSceneHierarchy()
 
 								case constraint_type_slider:
 								{
-									drawComponent<slider_constraint>(constraintEntity, "Slider constraint", [this, constraintEntity = constraintEntity](slider_constraint& constraint)
+									drawComponent<slider_constraint>(this->scene->snapshot, constraintEntity, "Slider constraint", [this, constraintEntity = constraintEntity](slider_constraint& constraint)
 									{
 										if (ImGui::BeginProperties())
 										{
@@ -1542,7 +1595,7 @@ bool scene_editor::drawSceneHierarchy()
 						}
 					});
 
-					drawComponent<cloth_component>(selectedEntity, "CLOTH", [this](cloth_component& cloth)
+					drawComponent<cloth_component>(this->scene->snapshot, selectedEntity, "CLOTH", [this](cloth_component& cloth)
 					{
 						using component_t = cloth_component;
 
@@ -1561,7 +1614,7 @@ bool scene_editor::drawSceneHierarchy()
 						}
 					});
 
-					drawComponent<point_light_component>(selectedEntity, "POINT LIGHT", [this](point_light_component& pl)
+					drawComponent<point_light_component>(this->scene->snapshot, selectedEntity, "POINT LIGHT", [this](point_light_component& pl)
 					{
 						using component_t = point_light_component;
 
@@ -1585,7 +1638,7 @@ bool scene_editor::drawSceneHierarchy()
 						}
 					});
 
-					drawComponent<spot_light_component>(selectedEntity, "SPOT LIGHT", [this](spot_light_component& sl)
+					drawComponent<spot_light_component>(this->scene->snapshot, selectedEntity, "SPOT LIGHT", [this](spot_light_component& sl)
 					{
 						using component_t = spot_light_component;
 
@@ -1691,6 +1744,7 @@ void scene_editor::onObjectMoved()
 	{
 		if (cloth_component* cloth = selectedEntity.getComponentIfExists<cloth_component>())
 		{
+			scene->snapshot.preserve<cloth_component>(selectedEntity.handle);
 			cloth->setWorldPositionOfFixedVertices(selectedEntity.getComponent<transform_component>(), false);
 		}
 	}
@@ -2163,15 +2217,27 @@ bool scene_editor::drawEntityCreationPopup()
 	return clicked;
 }
 
-void scene_editor::serializeToFile()
+void scene_editor::serializeToFile(bool binary)
 {
-	serializeSceneToYAMLFile(*scene, renderer->settings);
+	// Scenes loaded from binary files are saved in the same format.
+	if (binary || scene->savePath.extension() == ".scb")
+	{
+		serializeSceneToBinaryFile(*scene, renderer->settings);
+	}
+	else
+	{
+		serializeSceneToYAMLFile(*scene, renderer->settings);
+	}
 }
 
-bool scene_editor::deserializeFromFile()
+bool scene_editor::deserializeFromFile(bool binary)
 {
 	std::string environmentName;
-	if (deserializeSceneFromYAMLFile(*scene, renderer->settings, environmentName))
+	bool loaded = binary
+		? deserializeSceneFromBinaryFile(*scene, renderer->settings, environmentName)
+		: deserializeSceneFromYAMLFile(*scene, renderer->settings, environmentName);
+
+	if (loaded)
 	{
 		scene->stop();
 
@@ -2684,6 +2750,14 @@ void scene_editor::drawSettings(float dt)
 				UNDOABLE_SETTING("SIMD constraint solver", physicsSettings.simdConstraintSolver,
 					ImGui::PropertyCheckbox("SIMD constraint solver", physicsSettings.simdConstraintSolver));
 
+				UNDOABLE_SETTING("continuous collision detection", physicsSettings.continuousCollisionDetection,
+					ImGui::PropertyCheckbox("Continuous collision detection", physicsSettings.continuousCollisionDetection));
+				if (physicsSettings.continuousCollisionDetection)
+				{
+					UNDOABLE_SETTING("max CCD sub-steps", physicsSettings.maxCCDSubsteps,
+						ImGui::PropertySlider("Max CCD sub-steps", physicsSettings.maxCCDSubsteps, 1, 16));
+				}
+
 				ImGui::EndProperties();
 			}
 			ImGui::EndTree();
@@ -2717,6 +2791,11 @@ void scene_editor::drawSettings(float dt)
 						change |= ImGui::PropertyDropdown("Reverb preset", reverbPresetNames, reverb_preset_count, (uint32&)masterAudioSettings.reverbPreset));
 				}
 
+				ImGui::PropertySeparator();
+
+				UNDOABLE_SETTING("max real voices", masterAudioSettings.maxRealVoices,
+					ImGui::PropertySlider("Max real voices", masterAudioSettings.maxRealVoices, 1, 256));
+
 				ImGui::EndProperties();
 			}
 			ImGui::EndTree();
@@ -52,8 +52,8 @@ private:
 
 	void onObjectMoved();
 
-	void serializeToFile();
-	bool deserializeFromFile();
+	void serializeToFile(bool binary = false);
+	bool deserializeFromFile(bool binary = false);
 
 
 	template <typename value_t, typename action_t, typename... args_t>
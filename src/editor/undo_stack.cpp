@@ -2,88 +2,289 @@
 #include "undo_stack.h"
 #include "core/imgui.h"
 
-undo_stack::undo_stack()
+#define UNDO_MAX_DELTA_CHAIN_LENGTH 16
+
+static void writeVarint(std::vector<uint8>& out, uint64 value)
+{
+	while (value >= 0x80)
+	{
+		out.push_back((uint8)(value | 0x80));
+		value >>= 7;
+	}
+	out.push_back((uint8)value);
+}
+
+static uint64 readVarint(const uint8*& in)
+{
+	uint64 value = 0;
+	uint32 shift = 0;
+	while (*in & 0x80)
+	{
+		value |= (uint64)(*in++ & 0x7F) << shift;
+		shift += 7;
+	}
+	value |= (uint64)(*in++) << shift;
+	return value;
+}
+
+// Alternating zero runs and literal runs. Each run starts with a varint (length << 1 | isZeroRun). Zero runs shorter than 4 bytes are
+// kept in the literals.
+static void encodeZeroRuns(const uint8* data, uint64 size, std::vector<uint8>& out)
+{
+	out.clear();
+
+	uint64 i = 0;
+	while (i < size)
+	{
+		uint64 start = i;
+		if (data[i] == 0)
+		{
+			while (i < size && data[i] == 0) { ++i; }
+			writeVarint(out, ((i - start) << 1) | 1);
+		}
+		else
+		{
+			while (i < size && !(data[i] == 0 && (i + 4 > size || (data[i + 1] == 0 && data[i + 2] == 0 && data[i + 3] == 0)))) { ++i; }
+			writeVarint(out, (i - start) << 1);
+			out.insert(out.end(), data + start, data + i);
+		}
+	}
+
+	out.shrink_to_fit();
+}
+
+// XORs the literals into the output and leaves the bytes under zero runs unchanged.
+static void xorZeroRuns(const std::vector<uint8>& encoded, uint8* out)
+{
+	const uint8* in = encoded.data();
+	const uint8* end = in + encoded.size();
+	while (in < end)
+	{
+		uint64 token = readVarint(in);
+		uint64 length = token >> 1;
+		if (!(token & 1))
+		{
+			for (uint64 i = 0; i < length; ++i)
+			{
+				out[i] ^= in[i];
+			}
+			in += length;
+		}
+		out += length;
+	}
+}
+
+undo_stack::undo_stack(uint64 memoryBudget)
+{
+	this->memoryBudget = memoryBudget;
+}
+
+undo_stack::~undo_stack()
 {
-	memorySize = MB(2);
-	memory = (uint8*)malloc(memorySize);
 	reset();
 }
 
-void undo_stack::pushAction(const char* name, const void* entry, uint64 entrySize, toggle_func toggle)
+void undo_stack::decode(const entry_header* entry, uint8* out) const
 {
-	uint64 nameLength = strlen(name) + 1;
-	uint64 alignedNameLength = alignTo(nameLength, 16);
-	uint64 requiredSpace = sizeof(entry_header) + alignedNameLength + entrySize;
-	uint64 availableSpaceAtEnd = memory + memorySize - nextToWrite;
+	if (entry->delta)
+	{
+		decode(entry->older, out);
+	}
+	else
+	{
+		memset(out, 0, entry->entrySize);
+	}
+	xorZeroRuns(entry->encoded, out);
+}
 
-	uint8* address;
+void undo_stack::encode(entry_header* entry, const uint8* data)
+{
+	memoryUsage -= entry->memoryFootprint();
 
-	if (!newest) // Stack is empty.
+	if (entry->delta)
 	{
-		nextToWrite = memory;
-		address = nextToWrite;
-		oldest = 0;
+		std::vector<uint8>& base = scratch[1];
+		base.resize(entry->entrySize);
+		decode(entry->older, base.data());
+		for (uint64 i = 0; i < entry->entrySize; ++i)
+		{
+			base[i] ^= data[i];
+		}
+		encodeZeroRuns(base.data(), entry->entrySize, entry->encoded);
 	}
 	else
 	{
-		ASSERT(oldest);
-		address = (requiredSpace <= availableSpaceAtEnd) ? nextToWrite : memory;
+		encodeZeroRuns(data, entry->entrySize, entry->encoded);
 	}
 
-	uint8* end = (uint8*)alignTo(address + requiredSpace, 16);
+	memoryUsage += entry->memoryFootprint();
+}
 
-	// Clean up blocks which are overriden by the new block.
-	oldest = newest;
-	if (oldest)
+// Called before the older entry changes or disappears.
+void undo_stack::makeSelfContained(entry_header* entry)
+{
+	if (!entry || !entry->delta)
 	{
-		while (true)
+		return;
+	}
+
+	std::vector<uint8>& data = scratch[1];
+	data.resize(entry->entrySize);
+	decode(entry, data.data());
+
+	entry->delta = false;
+	entry->chainLength = 0;
+	encode(entry, data.data());
+}
+
+void undo_stack::toggleEntry(entry_header* entry)
+{
+	std::vector<uint8>& data = scratch[0];
+	data.resize(entry->entrySize);
+	decode(entry, data.data());
+
+	makeSelfContained(entry->newer);
+
+	entry->toggle(data.data());
+	encode(entry, data.data());
+}
+
+void undo_stack::removeEntry(entry_header* entry)
+{
+	makeSelfContained(entry->newer);
+
+	if (entry->older) { entry->older->newer = entry->newer; }
+	if (entry->newer) { entry->newer->older = entry->older; }
+	if (oldest == entry) { oldest = entry->newer; }
+	if (newest == entry) { newest = entry->older; }
+
+	memoryUsage -= entry->memoryFootprint();
+	delete entry;
+}
+
+void undo_stack::freeNewerThanNewest()
+{
+	entry_header* entry = newest ? newest->newer : oldest;
+	while (entry)
+	{
+		entry_header* next = entry->newer;
+		memoryUsage -= entry->memoryFootprint();
+		delete entry;
+		entry = next;
+	}
+
+	if (newest)
+	{
+		newest->newer = 0;
+	}
+	else
+	{
+		oldest = 0;
+	}
+}
+
+void undo_stack::enforceMemoryBudget()
+{
+	// Only applied entries are compacted, and the newest one is always kept.
+	while (memoryUsage > memoryBudget && newest && oldest != newest)
+	{
+		entry_header* older = oldest;
+		entry_header* newer = oldest->newer;
+
+		// Both entries are applied, so the newer one can be folded into the older one.
+		bool merged = false;
+		if (older->merge && older->merge == newer->merge && older->entrySize == newer->entrySize)
 		{
-			void* oldestBegin = oldest;
-			void* oldestEnd = oldest->getOneAfterEnd();
+			std::vector<uint8>& olderData = scratch[0];
+			olderData.resize(older->entrySize);
+			decode(older, olderData.data());
+
+			std::vector<uint8>& newerData = scratch[1];
+			newerData.resize(newer->entrySize);
+			decode(newer, newerData.data());
 
-			if (rangesOverlap(address, end, oldestBegin, oldestEnd))
+			if (older->merge(olderData.data(), newerData.data()))
 			{
-				oldest = oldest->newer;
-				break;
+				makeSelfContained(newer->newer);
+
+				older->newer = newer->newer;
+				if (newer->newer) { newer->newer->older = older; }
+				if (newest == newer) { newest = older; }
+				older->numMerged += newer->numMerged + 1;
+
+				memoryUsage -= newer->memoryFootprint();
+				delete newer;
+
+				encode(older, olderData.data());
+				merged = true;
 			}
-			if (!oldest->older) { break; }
+		}
 
-			oldest = oldest->older;
+		if (!merged)
+		{
+			removeEntry(older);
 		}
 	}
+}
+
+void undo_stack::setMemoryBudget(uint64 budget)
+{
+	memoryBudget = budget;
+	enforceMemoryBudget();
+}
+
+void undo_stack::pushAction(const char* name, const void* entry, uint64 entrySize, toggle_func toggle, merge_func merge)
+{
+	freeNewerThanNewest();
+
+	entry_header* header = new entry_header;
+	header->toggle = toggle;
+	header->merge = merge;
+	header->newer = 0;
+	header->older = newest;
+	header->entrySize = entrySize;
+	header->delta = false;
+	header->chainLength = 0;
+	header->numMerged = 0;
+	header->name = name;
+
+	memoryUsage += header->memoryFootprint();
 
-	if (oldest)
+	encode(header, (const uint8*)entry);
+
+	// Store as difference to the previous entry, if that is smaller.
+	if (newest && newest->toggle == toggle && newest->entrySize == entrySize && newest->chainLength < UNDO_MAX_DELTA_CHAIN_LENGTH)
 	{
-		oldest->older = 0;
-	}
+		uint64 selfContainedSize = header->encoded.size();
+		memoryUsage -= header->memoryFootprint();
+		std::vector<uint8> selfContained = std::move(header->encoded);
+		memoryUsage += header->memoryFootprint();
 
+		header->delta = true;
+		header->chainLength = newest->chainLength + 1;
+		encode(header, (const uint8*)entry);
 
-	entry_header* header = (entry_header*)address;
-	header->nameLength = alignedNameLength;
-	
-	char* thisName = header->getName();
-	memcpy(thisName, name, nameLength);
+		if (header->encoded.size() >= selfContainedSize)
+		{
+			memoryUsage -= header->memoryFootprint();
+			header->delta = false;
+			header->chainLength = 0;
+			header->encoded = std::move(selfContained);
+			memoryUsage += header->memoryFootprint();
+		}
+	}
 
-	header->older = newest;
 	if (newest)
 	{
 		newest->newer = header;
 	}
-	if (!oldest)
+	else
 	{
 		oldest = header;
 	}
 	newest = header;
 
-	header->newer = 0;
-
-	header->toggle = toggle;
-	header->entrySize = entrySize;
-
-	void* data = header->getData();
-	memcpy(data, entry, entrySize);
-
-	nextToWrite = end;
+	enforceMemoryBudget();
 }
 
 std::pair<bool, const char*> undo_stack::undoPossible()
@@ -91,7 +292,7 @@ std::pair<bool, const char*> undo_stack::undoPossible()
 	return 
 	{ 
 		newest != 0, 
-		newest ? newest->getName() : 0 
+		newest ? newest->name.c_str() : 0 
 	};
 }
 
@@ -100,7 +301,7 @@ std::pair<bool, const char*> undo_stack::redoPossible()
 	return 
 	{ 
 		newest && newest->newer || !newest && oldest,
-		(newest && newest->newer) ? newest->newer->getName() : (!newest && oldest) ? oldest->getName() : 0
+		(newest && newest->newer) ? newest->newer->name.c_str() : (!newest && oldest) ? oldest->name.c_str() : 0
 	};
 }
 
@@ -108,18 +309,8 @@ void undo_stack::undo()
 {
 	if (newest)
 	{
-		void* data = newest->getData();
-		newest->toggle(data);
-
+		toggleEntry(newest);
 		newest = newest->older;
-		if (newest)
-		{
-			nextToWrite = (uint8*)alignTo(((uint8*)data + newest->entrySize), 16);
-		}
-		else
-		{
-			nextToWrite = memory;
-		}
 
 		// Keep link to newer.
 	}
@@ -130,28 +321,21 @@ void undo_stack::redo()
 	if (newest && newest->newer)
 	{
 		newest = newest->newer;
-
-		void* data = newest->getData();
-		newest->toggle(data);
-
-		nextToWrite = (uint8*)alignTo(((uint8*)data + newest->entrySize), 16);
+		toggleEntry(newest);
 	}
 
 	if (!newest && oldest)
 	{
-		void* data = oldest->getData();
-		oldest->toggle(data);
-
-		nextToWrite = (uint8*)alignTo(((uint8*)data + oldest->entrySize), 16);
+		toggleEntry(oldest);
 		newest = oldest;
 	}
 }
 
 void undo_stack::reset()
 {
-	nextToWrite = memory;
-	oldest = 0;
 	newest = 0;
+	freeNewerThanNewest();
+	ASSERT(memoryUsage == 0);
 }
 
 bool undo_stack::showHistory(bool& open)
@@ -167,6 +351,14 @@ bool undo_stack::showHistory(bool& open)
 				reset();
 			}
 
+			ImGui::Text("Memory: %.1f / %.1f KB", memoryUsage / 1024.f, memoryBudget / 1024.f);
+
+			float budgetMB = memoryBudget / (float)MB(1);
+			if (ImGui::SliderFloat("Budget (MB)", &budgetMB, 0.25f, 64.f, "%.2f"))
+			{
+				setMemoryBudget((uint64)(budgetMB * MB(1)));
+			}
+
 			ImGui::Separator();
 
 			bool currentFound = false;
@@ -191,7 +383,15 @@ bool undo_stack::showHistory(bool& open)
 
 				bool current = entry == newest;
 				currentFound |= current;
-				if (ImGui::Selectable(entry->getName(), current) && !current)
+				const char* name = entry->name.c_str();
+				char nameBuffer[128];
+				if (entry->numMerged)
+				{
+					snprintf(nameBuffer, sizeof(nameBuffer), "%s (%u merged)", name, entry->numMerged);
+					name = nameBuffer;
+				}
+
+				if (ImGui::Selectable(name, current) && !current)
 				{
 					clicked = true;
 					target = entry;
@@ -3,12 +3,18 @@
 #include "core/memory.h"
 
 
+// Entries are stored compressed: Zero runs are collapsed, and entries of the same type as their predecessor are stored as the XOR
+// difference to it (so a series of slider edits on the same component costs a few bytes each). When the memory budget is exceeded,
+// the oldest entries are merged (if their type supports it) or dropped.
 struct undo_stack
 {
-	undo_stack();
+	undo_stack(uint64 memoryBudget = MB(2));
+	~undo_stack();
 
+	// Type T must have member function void toggle(). Optionally, T can have a member function bool merge(const T& newer), which
+	// folds a newer action into this one, if both act on the same target. This is used to compact old history.
 	template <typename T>
-	void pushAction(const char* name, const T& entry); // Type T must have member function void toggle().
+	void pushAction(const char* name, const T& entry);
 
 
 	std::pair<bool, const char*> undoPossible();
@@ -21,44 +27,58 @@ struct undo_stack
 	bool showHistory(bool& open);
 	void verify();
 
+	void setMemoryBudget(uint64 budget);
+	uint64 getMemoryBudget() const { return memoryBudget; }
+	uint64 getMemoryUsage() const { return memoryUsage; }
+
 private:
 	typedef void (*toggle_func)(void*);
+	typedef bool (*merge_func)(void* older, const void* newer);
 
-	void pushAction(const char* name, const void* entry, uint64 entrySize, toggle_func toggle);
-	struct alignas(16) entry_header
+	struct entry_header
 	{
 		toggle_func toggle;
+		merge_func merge;
 
 		entry_header* newer;
 		entry_header* older;
 
-		uint64 nameLength; // Includes null-terminator.
-		uint64 entrySize;
-
-		char* getName() const
-		{
-			return (char*)(this + 1);
-		}
+		uint64 entrySize; // Uncompressed.
+		bool delta; // Stored as difference to the older entry, which has the same toggle function and size.
+		uint32 chainLength; // Number of delta entries up to the next self-contained one.
+		uint32 numMerged;
 
-		void* getData()
-		{
-			return (uint8*)getName() + nameLength;
-		}
+		std::string name;
+		std::vector<uint8> encoded;
 
-		void* getOneAfterEnd()
-		{
-			return (uint8*)getData() + entrySize;
-		}
+		uint64 memoryFootprint() const { return sizeof(entry_header) + name.capacity() + encoded.capacity(); }
 	};
 
-	uint8* memory;
-	uint32 memorySize;
+	void pushAction(const char* name, const void* entry, uint64 entrySize, toggle_func toggle, merge_func merge);
+
+	void toggleEntry(entry_header* entry);
+	void decode(const entry_header* entry, uint8* out) const;
+	void encode(entry_header* entry, const uint8* data);
+	void makeSelfContained(entry_header* entry);
+	void removeEntry(entry_header* entry);
+	void freeNewerThanNewest();
+	void enforceMemoryBudget();
+
+	uint64 memoryBudget;
+	uint64 memoryUsage = 0;
 
-	uint8* nextToWrite;
-	entry_header* oldest;
-	entry_header* newest;
+	entry_header* oldest = 0;
+	entry_header* newest = 0; // Last applied entry. Entries newer than this can be redone.
+
+	std::vector<uint8> scratch[2];
 };
 
+template <typename T, typename = void>
+struct undo_has_merge : std::false_type {};
+
+template <typename T>
+struct undo_has_merge<T, std::void_t<decltype(std::declval<T&>().merge(std::declval<const T&>()))>> : std::true_type {};
+
 template<typename T>
 inline void undo_stack::pushAction(const char* name, const T& entry)
 {
@@ -71,5 +91,14 @@ inline void undo_stack::pushAction(const char* name, const T& entry)
 		t->toggle();
 	};
 
-	pushAction(name, &entry, sizeof(T), toggle);
+	merge_func merge = 0;
+	if constexpr (undo_has_merge<T>::value)
+	{
+		merge = [](void* older, const void* newer)
+		{
+			return ((T*)older)->merge(*(const T*)newer);
+		};
+	}
+
+	pushAction(name, &entry, sizeof(T), toggle, merge);
 }
@@ -5,13 +5,71 @@
 #include "core/hash.h"
 #include "asset/file_registry.h"
 #include "asset/model_asset.h"
+#include "core/memory.h"
+#include "core/log.h"
+#include "dx/dx_context.h"
 
 
+template <typename T>
+static uint64 getCPUMemorySize(const std::vector<T>& v)
+{
+	return v.capacity() * sizeof(T);
+}
+
+static uint64 getCPUMemorySize(const model_asset& asset)
+{
+	uint64 result = 0;
+	for (const mesh_asset& mesh : asset.meshes)
+	{
+		for (const submesh_asset& sub : mesh.submeshes)
+		{
+			result += getCPUMemorySize(sub.positions) + getCPUMemorySize(sub.uvs) + getCPUMemorySize(sub.normals) + getCPUMemorySize(sub.tangents)
+				+ getCPUMemorySize(sub.colors) + getCPUMemorySize(sub.skin) + getCPUMemorySize(sub.triangles);
+		}
+	}
+	for (const animation_asset& anim : asset.animations)
+	{
+		result += getCPUMemorySize(anim.positionTimestamps) + getCPUMemorySize(anim.rotationTimestamps) + getCPUMemorySize(anim.scaleTimestamps)
+			+ getCPUMemorySize(anim.positionKeyframes) + getCPUMemorySize(anim.rotationKeyframes) + getCPUMemorySize(anim.scaleKeyframes);
+	}
+	return result;
+}
+
+static uint64 getCPUMemorySize(const animation_skeleton& skeleton)
+{
+	uint64 result = getCPUMemorySize(skeleton.joints);
+	for (const animation_clip& clip : skeleton.clips)
+	{
+		result += getCPUMemorySize(clip.positionTimestamps) + getCPUMemorySize(clip.rotationTimestamps) + getCPUMemorySize(clip.scaleTimestamps)
+			+ getCPUMemorySize(clip.positionKeyframes) + getCPUMemorySize(clip.rotationKeyframes) + getCPUMemorySize(clip.scaleKeyframes)
+			+ getCPUMemorySize(clip.joints);
+	}
+	return result;
+}
+
+multi_mesh::~multi_mesh()
+{
+	if (loadJob)
+	{
+		// Released before the load started, e.g. because the entity was deleted.
+		loadJob->cancel();
+	}
+
+	if (animationMemorySize)
+	{
+		trackMemoryFree(memory_tag_animation, animationMemorySize);
+	}
+}
+
 static void meshLoaderThread(ref<multi_mesh> result, const fs::path& sceneFilename, uint32 flags, mesh_load_callback cb)
 {
 	result->aabb = bounding_box::negativeInfinity();
 
 	model_asset asset = load3DModelFromFile(sceneFilename);
+
+	// The imported asset only lives during this function, but it is usually the peak of the asset memory usage.
+	uint64 assetMemorySize = getCPUMemorySize(asset);
+	trackMemoryAllocation(memory_tag_asset, assetMemorySize);
 	mesh_builder builder(flags);
 	for (auto& mesh : asset.meshes)
 	{
@@ -71,6 +129,15 @@ static void meshLoaderThread(ref<multi_mesh> result, const fs::path& sceneFilena
 		}
 	}
 
+	result->animationMemorySize = getCPUMemorySize(skeleton);
+	if (result->animationMemorySize)
+	{
+		trackMemoryAllocation(memory_tag_animation, result->animationMemorySize);
+	}
+
+	// Most of the imported data has been moved out or copied to the GPU at this point.
+	trackMemoryFree(memory_tag_asset, assetMemorySize);
+
 	if (cb)
 	{
 		cb(builder, result->submeshes, result->aabb);
@@ -82,16 +149,29 @@ static void meshLoaderThread(ref<multi_mesh> result, const fs::path& sceneFilena
 }
 
 
+// Guards the mesh cache. Also held while a new mesh's load job is stored and cleared, so that a fast job cannot clear it first.
+static std::mutex mutex;
+
 static ref<multi_mesh> loadMeshFromFileInternal(const fs::path& sceneFilename, asset_handle handle, uint32 flags, mesh_load_callback cb)
 {
 	ref<multi_mesh> result = make_ref<multi_mesh>();
 	result->handle = handle;
 	result->flags = flags;
+	result->loadCallback = cb;
 	result->loadState = asset_loading;
 
-	addAsyncLoadWork([=]() 
+	// The work only holds a weak reference, so that releasing the mesh before it is loaded cancels the work.
+	weakref<multi_mesh> weakResult = result;
+	result->loadJob = addAsyncLoadWork([weakResult, sceneFilename, flags, cb]()
 	{
-		meshLoaderThread(result, sceneFilename, flags, cb);
+		if (ref<multi_mesh> result = weakResult.lock())
+		{
+			meshLoaderThread(result, sceneFilename, flags, cb);
+
+			// The job is finished, so there is nothing left to prioritize or cancel.
+			const std::lock_guard<std::mutex> lock(mutex);
+			std::atomic_store(&result->loadJob, ref<async_load_job>());
+		}
 	});
 
 	return result;
@@ -124,7 +204,6 @@ static bool operator==(const mesh_key& a, const mesh_key& b)
 }
 
 static std::unordered_map<mesh_key, weakref<multi_mesh>> meshCache;
-static std::mutex mutex;
 
 
 static ref<multi_mesh> loadMeshFromFileAndHandle(const fs::path& filename, asset_handle handle, uint32 flags, mesh_load_callback cb)
@@ -161,3 +240,98 @@ ref<multi_mesh> loadMeshFromHandle(asset_handle handle, uint32 flags, mesh_load_
 	fs::path sceneFilename = getPathFromAssetHandle(handle);
 	return loadMeshFromFileAndHandle(sceneFilename, handle, flags, cb);
 }
+
+struct mesh_reload
+{
+	weakref<multi_mesh> target;
+	ref<multi_mesh> reloaded;
+};
+
+static std::vector<mesh_reload> finishedMeshReloads;
+static std::mutex reloadMutex;
+
+uint32 reloadMeshesFromFile(const fs::path& filename)
+{
+	fs::path path = filename.lexically_normal().make_preferred();
+	asset_handle handle = getAssetHandleFromPath(path);
+	if (!handle)
+	{
+		return 0;
+	}
+
+	std::vector<ref<multi_mesh>> targets;
+
+	mutex.lock();
+	for (const auto& [key, mesh] : meshCache)
+	{
+		if (key.handle == handle)
+		{
+			// Meshes, which are still loading, will pick up the new content anyway.
+			auto sp = mesh.lock();
+			if (sp && sp->loadState.load() == asset_loaded)
+			{
+				targets.push_back(sp);
+			}
+		}
+	}
+	mutex.unlock();
+
+	for (const ref<multi_mesh>& target : targets)
+	{
+		weakref<multi_mesh> weakTarget = target;
+		uint32 flags = target->flags;
+		mesh_load_callback cb = target->loadCallback;
+
+		addAsyncLoadWork([weakTarget, path, flags, cb]()
+		{
+			ref<multi_mesh> reloaded = make_ref<multi_mesh>();
+			meshLoaderThread(reloaded, path, flags, cb);
+
+			if (!reloaded->submeshes.empty())
+			{
+				const std::lock_guard<std::mutex> lock(reloadMutex);
+				finishedMeshReloads.push_back({ weakTarget, reloaded });
+			}
+			else
+			{
+				LOG_ERROR("Could not reload mesh '%ws'", path.c_str());
+			}
+		});
+	}
+
+	return (uint32)targets.size();
+}
+
+void applyReloadedMeshes()
+{
+	std::vector<mesh_reload> reloads;
+	{
+		const std::lock_guard<std::mutex> lock(reloadMutex);
+		reloads.swap(finishedMeshReloads);
+	}
+
+	if (reloads.empty())
+	{
+		return;
+	}
+
+	// The vertex and index buffers were uploaded on the copy queue.
+	dxContext.renderQueue.waitForOtherQueue(dxContext.copyQueue);
+
+	for (mesh_reload& reload : reloads)
+	{
+		if (auto target = reload.target.lock())
+		{
+			// The old buffers and skeleton end up in the reloaded object, which releases them (buffers are retired until the GPU is done).
+			multi_mesh& a = *target;
+			multi_mesh& b = *reload.reloaded;
+			std::swap(a.submeshes, b.submeshes);
+			std::swap(a.skeleton, b.skeleton);
+			std::swap(a.mesh, b.mesh);
+			std::swap(a.aabb, b.aabb);
+			std::swap(a.animationMemorySize, b.animationMemorySize);
+		}
+	}
+
+	LOG_MESSAGE("Reloaded %u mesh%s", (uint32)reloads.size(), (reloads.size() > 1) ? "es" : "");
+}
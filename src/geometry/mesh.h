@@ -5,6 +5,7 @@
 #include "dx/dx_buffer.h"
 #include "animation/animation.h"
 #include "mesh_builder.h"
+#include "core/threading.h"
 
 struct pbr_material;
 
@@ -19,6 +20,8 @@ struct submesh
 	std::string name;
 };
 
+using mesh_load_callback = std::function<void(mesh_builder& builder, std::vector<submesh>& submeshes, const bounding_box& boundingBox)>;
+
 struct multi_mesh
 {
 	std::vector<submesh> submeshes;
@@ -28,12 +31,16 @@ struct multi_mesh
 
 	asset_handle handle;
 	uint32 flags;
+	mesh_load_callback loadCallback; // Kept for hot reload.
 
 	std::atomic<asset_load_state> loadState = asset_loaded;
-};
+	ref<async_load_job> loadJob; // Set while loading. Raise its priority to load this mesh (and its textures) sooner. Access with std::atomic_load.
 
+	uint64 animationMemorySize = 0; // CPU memory of the skeleton and its clips, reported to memory_tag_animation.
+
+	~multi_mesh();
+};
 
-using mesh_load_callback = std::function<void(mesh_builder& builder, std::vector<submesh>& submeshes, const bounding_box& boundingBox)>;
 
 ref<multi_mesh> loadMeshFromFile(const fs::path& filename, uint32 flags = mesh_creation_flags_default, mesh_load_callback cb = nullptr);
 ref<multi_mesh> loadMeshFromHandle(asset_handle handle, uint32 flags = mesh_creation_flags_default, mesh_load_callback cb = nullptr);
@@ -44,6 +51,11 @@ inline ref<multi_mesh> loadAnimatedMeshFromFile(const fs::path& filename, uint32
 	return loadMeshFromFile(filename, flags, cb);
 }
 
+// Hot reload. Re-imports all cached meshes loaded from the given file in the background, and returns how many were scheduled.
+// applyReloadedMeshes swaps the finished ones into the existing mesh objects. Call it on the main thread, between frames.
+uint32 reloadMeshesFromFile(const fs::path& filename);
+void applyReloadedMeshes();
+
 struct mesh_component
 {
 	ref<multi_mesh> mesh;
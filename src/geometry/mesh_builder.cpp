@@ -23,9 +23,9 @@ static vertex_info getVertexInfo(uint32 flags)
 
 mesh_builder::mesh_builder(uint32 vertexFlags, mesh_index_type indexType)
 {
-	positionArena.initialize(0, GB(2));
-	othersArena.initialize(0, GB(2));
-	indexArena.initialize(0, GB(2));
+	positionArena.initialize(0, GB(2), "Mesh builder positions", memory_tag_asset);
+	othersArena.initialize(0, GB(2), "Mesh builder vertex attributes", memory_tag_asset);
+	indexArena.initialize(0, GB(2), "Mesh builder indices", memory_tag_asset);
 
 	this->vertexFlags = vertexFlags;
 	this->indexType = indexType;
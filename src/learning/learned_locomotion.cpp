@@ -431,7 +431,7 @@ extern "C" __declspec(dllexport) void resetPhysics(float* outState)
 	if (!trainingEnv)
 	{
 		trainingEnv = new training_locomotion;
-		stackArena.initialize();
+		stackArena.initialize(0, GB(8), "Learned locomotion stack", memory_tag_physics);
 	}
 
 	totalReward = 0.f;
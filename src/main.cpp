@@ -7,7 +7,11 @@
 #include "core/imgui.h"
 #include "core/log.h"
 #include "core/cpu_profiling.h"
+#include "core/memory.h"
+#include "core/memory_profiling.h"
 #include "asset/file_registry.h"
+#include "asset/asset_cache.h"
+#include "asset/asset_cooker.h"
 #include "editor/file_browser.h"
 #include "application.h"
 #include "editor/editor_icons.h"
@@ -96,8 +100,63 @@ static void renderToMainWindow(dx_window& window)
 	fenceValues[window.currentBackbufferIndex] = result;
 }
 
+// <tag>=<MB>, e.g. Asset=512.
+static void parseMemoryBudgetArgument(const char* argument)
+{
+	const char* separator = strchr(argument, '=');
+	std::string tagName(argument, separator ? separator : argument + strlen(argument));
+	if (!separator || !setMemoryBudget(tagName.c_str(), MB((uint64)atoll(separator + 1))))
+	{
+		std::cerr << "Invalid memory budget '" << argument << "'. Expected <tag>=<MB>.\n";
+	}
+}
+
 int main(int argc, char** argv)
 {
+	// Optional command line arguments for automated performance tracking:
+	// -profile-stats <path>       Dump rolling CPU profile statistics (.csv or .json) at exit.
+	// -profile-baseline <path>    Compare the statistics against a previously dumped CSV at exit.
+	// -profile-window <frames>    Number of frames over which the statistics are computed.
+	// -memory-stats               Print memory usage per subsystem and per arena to stdout at exit.
+	// -memory-budget <tag>=<MB>   Warn when the memory of a tag (e.g. Asset=512) exceeds the budget. Can be repeated.
+	// -audio-null                 Mix audio in software and discard the output.
+	// -audio-offline <path>       Mix audio in software, deterministically from the frame times, and write it to a WAV file at exit.
+	// -cook                       Import all assets into the asset cache without opening a window, then exit. Fails if any asset fails.
+	// -cook-threads <count>       Number of threads used for cooking. Defaults to all hardware threads.
+	fs::path profileStatsPath;
+	fs::path profileBaselinePath;
+	bool printMemoryStatsAtExit = false;
+	audio_backend audioBackend = audio_backend_xaudio2;
+	fs::path audioOutputPath;
+	bool cookAssets = false;
+	uint32 numCookThreads = 0;
+	for (int i = 1; i < argc; ++i)
+	{
+		if (strcmp(argv[i], "-memory-stats") == 0) { printMemoryStatsAtExit = true; continue; }
+		if (strcmp(argv[i], "-audio-null") == 0) { audioBackend = audio_backend_null; continue; }
+		if (strcmp(argv[i], "-cook") == 0) { cookAssets = true; continue; }
+		if (i == argc - 1) { break; }
+
+		if (strcmp(argv[i], "-profile-stats") == 0) { profileStatsPath = argv[++i]; }
+		else if (strcmp(argv[i], "-profile-baseline") == 0) { profileBaselinePath = argv[++i]; }
+		else if (strcmp(argv[i], "-profile-window") == 0) { cpuProfilingSetStatisticsWindow((uint32)atoi(argv[++i])); }
+		else if (strcmp(argv[i], "-audio-offline") == 0) { audioBackend = audio_backend_offline; audioOutputPath = argv[++i]; }
+		else if (strcmp(argv[i], "-cook-threads") == 0) { numCookThreads = (uint32)atoi(argv[++i]); }
+		else if (strcmp(argv[i], "-memory-budget") == 0) { parseMemoryBudgetArgument(argv[++i]); }
+	}
+
+	if (cookAssets)
+	{
+		initializeMessageLog();
+		initializeFileRegistry();
+		initializeAssetCache();
+
+		asset_cook_result cookResult = cookAllAssets(numCookThreads);
+
+		shutdownAssetCache();
+		return (cookResult.numFailed == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+	}
+
 	if (!dxContext.initialize())
 	{
 		return EXIT_FAILURE;
@@ -106,7 +165,8 @@ int main(int argc, char** argv)
 	initializeJobSystem();
 	initializeMessageLog();
 	initializeFileRegistry();
-	initializeAudio();
+	initializeAssetCache();
+	initializeAudio(audioBackend, audioOutputPath);
 
 	{
 		sound_settings soundSettings;
@@ -291,6 +351,8 @@ int main(int argc, char** argv)
 
 		updateMessageLog(dt);
 
+		updateMemoryProfiler();
+
 		updateAudio(dt);
 
 		
@@ -304,11 +366,27 @@ int main(int argc, char** argv)
 		++frameID;
 	}
 
+	if (!profileStatsPath.empty())
+	{
+		cpuProfilingDumpStatistics(profileStatsPath);
+	}
+	uint32 numRegressions = 0;
+	if (!profileBaselinePath.empty())
+	{
+		numRegressions = cpuProfilingCompareAgainstBaseline(profileBaselinePath);
+	}
+	if (printMemoryStatsAtExit)
+	{
+		printMemoryStats(std::cout);
+	}
+
 	dxContext.flushApplication();
 
 	dxContext.quit();
 
 	shutdownAudio();
+	shutdownAssetCache();
 
-	return EXIT_SUCCESS;
+	// Lets CI fail on performance regressions.
+	return (numRegressions > 0) ? EXIT_FAILURE : EXIT_SUCCESS;
 }
@@ -1,6 +1,7 @@
 #pragma once
 
 #include "bounding_volumes.h"
+#include "core/memory.h"
 
 struct cloth_component
 {
@@ -38,12 +39,12 @@ private:
 		float inverseMassSum;
 	};
 
-	std::vector<vec3> positions;
-	std::vector<vec3> prevPositions;
-	std::vector<vec3> velocities;
-	std::vector<vec3> forceAccumulators;
-	std::vector<float> invMasses;
-	std::vector<cloth_constraint> constraints;
+	tracked_vector<vec3, memory_tag_physics> positions;
+	tracked_vector<vec3, memory_tag_physics> prevPositions;
+	tracked_vector<vec3, memory_tag_physics> velocities;
+	tracked_vector<vec3, memory_tag_physics> forceAccumulators;
+	tracked_vector<float, memory_tag_physics> invMasses;
+	tracked_vector<cloth_constraint, memory_tag_physics> constraints;
 
 	void solveVelocities(const std::vector<struct cloth_constraint_temp>& constraintsTemp);
 	void solvePositions();
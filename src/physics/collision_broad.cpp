@@ -6,22 +6,7 @@
 
 #include "bounding_volumes_simd.h"
 
-struct sap_endpoint
-{
-	float value;
-	entity_handle entity = entt::null;
-	bool start;
-	uint16 colliderIndex; // Set each frame.
-
-	sap_endpoint(entity_handle entity, bool start) : entity(entity), start(start) { }
-	sap_endpoint(const sap_endpoint&) = default;
-};
-
-struct sap_context
-{
-	std::vector<sap_endpoint> endpoints;
-	uint32 sortingAxis = 0;
-};
+#include <algorithm>
 
 
 void addColliderToBroadphase(scene_entity entity)
@@ -84,6 +69,89 @@ void clearBroadphase(game_scene& scene)
 	}
 }
 
+void saveBroadphaseState(game_scene& scene, std::vector<uint8>& out)
+{
+	uint32 sortingAxis = 0;
+	uint32 numEndpoints = 0;
+	const sap_endpoint* endpoints = 0;
+
+	if (sap_context* context = scene.registry.ctx().find<sap_context>())
+	{
+		sortingAxis = context->sortingAxis;
+		numEndpoints = (uint32)context->endpoints.size();
+		endpoints = context->endpoints.data();
+	}
+
+	uint64 offset = out.size();
+	out.resize(offset + sizeof(uint32) * 2 + sizeof(sap_endpoint) * numEndpoints);
+
+	memcpy(out.data() + offset, &sortingAxis, sizeof(uint32));
+	memcpy(out.data() + offset + sizeof(uint32), &numEndpoints, sizeof(uint32));
+	if (numEndpoints)
+	{
+		memcpy(out.data() + offset + sizeof(uint32) * 2, endpoints, sizeof(sap_endpoint) * numEndpoints);
+	}
+}
+
+bool restoreBroadphaseState(game_scene& scene, const uint8* data, uint64 size, bool apply)
+{
+	if (size < sizeof(uint32) * 2)
+	{
+		return false;
+	}
+
+	uint32 sortingAxis, numEndpoints;
+	memcpy(&sortingAxis, data, sizeof(uint32));
+	memcpy(&numEndpoints, data + sizeof(uint32), sizeof(uint32));
+
+	if (size != sizeof(uint32) * 2 + sizeof(sap_endpoint) * numEndpoints)
+	{
+		return false;
+	}
+
+	sap_context* context = scene.registry.ctx().find<sap_context>();
+	uint32 currentNumEndpoints = context ? (uint32)context->endpoints.size() : 0;
+	if (currentNumEndpoints != numEndpoints)
+	{
+		return false;
+	}
+
+	if (context && apply)
+	{
+		context->sortingAxis = sortingAxis;
+		memcpy(context->endpoints.data(), data + sizeof(uint32) * 2, sizeof(sap_endpoint) * numEndpoints);
+	}
+	return true;
+}
+
+uint32 broadphaseQuery(game_scene& scene, const bounding_box& bounds, const bounding_box* worldSpaceAABBs, uint16* outColliders)
+{
+	sap_context* context = scene.registry.ctx().find<sap_context>();
+	if (!context || context->endpoints.empty())
+	{
+		return 0;
+	}
+
+	const auto& endpoints = context->endpoints;
+	uint32 axis = context->sortingAxis;
+	float lo = bounds.minCorner.data[axis];
+	float hi = bounds.maxCorner.data[axis];
+
+	// No collider, which starts before lo - maxExtent, can reach lo.
+	auto first = std::lower_bound(endpoints.begin(), endpoints.end(), lo - context->maxExtent,
+		[](const sap_endpoint& ep, float value) { return ep.value < value; });
+
+	uint32 numColliders = 0;
+	for (auto it = first; it != endpoints.end() && it->value <= hi; ++it)
+	{
+		if (it->start && aabbVsAABB(worldSpaceAABBs[it->colliderIndex], bounds))
+		{
+			outColliders[numColliders++] = it->colliderIndex;
+		}
+	}
+	return numColliders;
+}
+
 static uint32 determineOverlapsScalar(const sap_endpoint* endpoints, uint32 numEndpoints, const bounding_box* worldSpaceAABBs, uint32 numColliders, memory_arena& arena,
 	collider_pair* outCollisions)
 {
@@ -343,6 +411,7 @@ uint32 broadphase(game_scene& scene, bounding_box* worldSpaceAABBs, memory_arena
 	vec3 s2(0.f, 0.f, 0.f);
 
 	uint32 sortingAxis = context.sortingAxis;
+	float maxExtent = 0.f;
 
 	CPU_PROFILE_STAT("Broadphase sorting axis", sortingAxis);
 
@@ -364,6 +433,7 @@ uint32 broadphase(game_scene& scene, bounding_box* worldSpaceAABBs, memory_arena
 			float hi = aabb.maxCorner.data[sortingAxis];
 			endpoints[start].value = lo;
 			endpoints[end].value = hi;
+			maxExtent = max(maxExtent, hi - lo);
 
 			endpoints[start].colliderIndex = index;
 			endpoints[end].colliderIndex = index;
@@ -379,6 +449,8 @@ uint32 broadphase(game_scene& scene, bounding_box* worldSpaceAABBs, memory_arena
 		}
 	}
 
+	context.maxExtent = maxExtent;
+
 	{
 		CPU_PROFILE_BLOCK("Sort endpoints");
 
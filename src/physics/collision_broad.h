@@ -14,6 +14,15 @@ struct collider_pair
 
 uint32 broadphase(struct game_scene& scene, bounding_box* worldSpaceAABBs, memory_arena& arena, collider_pair* outOverlaps, bool simd);
 
+// Colliders whose world space bounding box overlaps the given box. Uses the endpoints sorted by the last broadphase call, so the
+// bounding boxes must be the ones passed to it. Writes at most one index per collider.
+uint32 broadphaseQuery(struct game_scene& scene, const bounding_box& bounds, const bounding_box* worldSpaceAABBs, uint16* outColliders);
+
+// Sort-and-sweep state (sorted endpoints and sorting axis) for physics snapshots. The endpoint order influences the order of the
+// reported overlaps, so it is part of the simulation state.
+void saveBroadphaseState(struct game_scene& scene, std::vector<uint8>& out);
+bool restoreBroadphaseState(struct game_scene& scene, const uint8* data, uint64 size, bool apply); // Fails if the number of colliders changed. Only writes if apply is set.
+
 
 
 
@@ -25,3 +34,22 @@ struct sap_endpoint_indirection_component
 	uint16 startEndpoint;
 	uint16 endEndpoint;
 };
+
+struct sap_endpoint
+{
+	float value;
+	entity_handle entity = entt::null;
+	bool start;
+	uint16 colliderIndex; // Set each frame.
+
+	sap_endpoint(entity_handle entity, bool start) : entity(entity), start(start) { }
+	sap_endpoint(const sap_endpoint&) = default;
+};
+
+struct sap_context
+{
+	std::vector<sap_endpoint> endpoints;
+	uint32 sortingAxis = 0;
+
+	float maxExtent = 0.f; // Largest extent of any collider along the sorting axis. Set each frame, used to bound queries.
+};
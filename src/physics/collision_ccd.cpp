@@ -0,0 +1,508 @@
+#include "pch.h"
+#include "collision_ccd.h"
+#include "physics.h"
+#include "collision_gjk.h"
+#include "collision_broad.h"
+#include "terrain/heightmap_collider.h"
+#include "core/cpu_profiling.h"
+
+
+// Impacts are reported at this distance, so that the body never starts the next step inside the obstacle.
+static const float ccdTargetDistance = 0.01f;
+static const uint32 ccdMaxAdvancementIterations = 32;
+
+struct ccd_body_state
+{
+	vec3 position; // Center of gravity.
+	quat rotation;
+	vec3 linearVelocity;
+	vec3 angularVelocity;
+};
+
+struct ccd_hit
+{
+	float t; // Normalized time in the sub-step.
+	vec3 point;
+	vec3 normal; // From the body to the obstacle.
+	float restitution;
+	uint32 other; // Collider index, UINT32_MAX for heightmaps.
+};
+
+// Same integration as rigid_body_component::integrateVelocity.
+static quat integrateRotation(quat rotation, vec3 angularVelocity, float dt)
+{
+	quat deltaRot(0.5f * angularVelocity.x, 0.5f * angularVelocity.y, 0.5f * angularVelocity.z, 0.f);
+	deltaRot = deltaRot * rotation;
+	return normalize(rotation + (deltaRot * dt));
+}
+
+static vec3 movePoint(vec3 p, quat deltaRotation, vec3 pivot, vec3 newPivot)
+{
+	return newPivot + deltaRotation * (p - pivot);
+}
+
+collider_union moveCollider(const collider_union& c, quat deltaRotation, vec3 pivot, vec3 newPivot)
+{
+	collider_union result = c;
+
+	switch (c.type)
+	{
+		case collider_type_sphere:
+		{
+			result.sphere.center = movePoint(c.sphere.center, deltaRotation, pivot, newPivot);
+		} break;
+
+		case collider_type_capsule:
+		{
+			result.capsule.positionA = movePoint(c.capsule.positionA, deltaRotation, pivot, newPivot);
+			result.capsule.positionB = movePoint(c.capsule.positionB, deltaRotation, pivot, newPivot);
+		} break;
+
+		case collider_type_cylinder:
+		{
+			result.cylinder.positionA = movePoint(c.cylinder.positionA, deltaRotation, pivot, newPivot);
+			result.cylinder.positionB = movePoint(c.cylinder.positionB, deltaRotation, pivot, newPivot);
+		} break;
+
+		case collider_type_aabb:
+		{
+			if (deltaRotation == quat::identity)
+			{
+				vec3 offset = newPivot - pivot;
+				result.aabb = bounding_box::fromMinMax(c.aabb.minCorner + offset, c.aabb.maxCorner + offset);
+			}
+			else
+			{
+				result.type = collider_type_obb;
+				result.obb.rotation = deltaRotation;
+				result.obb.center = movePoint(c.aabb.getCenter(), deltaRotation, pivot, newPivot);
+				result.obb.radius = c.aabb.getRadius();
+			}
+		} break;
+
+		case collider_type_obb:
+		{
+			result.obb.rotation = deltaRotation * c.obb.rotation;
+			result.obb.center = movePoint(c.obb.center, deltaRotation, pivot, newPivot);
+		} break;
+
+		case collider_type_hull:
+		{
+			result.hull.rotation = deltaRotation * c.hull.rotation;
+			result.hull.position = movePoint(c.hull.position, deltaRotation, pivot, newPivot);
+		} break;
+	}
+
+	return result;
+}
+
+template <typename func_t>
+static auto visitSupportFunction(const collider_union& c, const func_t& func)
+{
+	switch (c.type)
+	{
+		case collider_type_sphere: return func(sphere_support_fn{ c.sphere });
+		case collider_type_capsule: return func(capsule_support_fn{ c.capsule });
+		case collider_type_cylinder: return func(cylinder_support_fn{ c.cylinder });
+		case collider_type_aabb: return func(aabb_support_fn{ c.aabb });
+		case collider_type_obb: return func(obb_support_fn{ c.obb });
+		default: return func(hull_support_fn{ c.hull });
+	}
+}
+
+bool colliderDistance(const collider_union& a, const collider_union& b, gjk_distance_result& result)
+{
+	return visitSupportFunction(a, [&](const auto& supportA)
+	{
+		return visitSupportFunction(b, [&](const auto& supportB)
+		{
+			return gjkDistance(supportA, supportB, result);
+		});
+	});
+}
+
+bool colliderIntersection(const collider_union& a, const collider_union& b)
+{
+	return visitSupportFunction(a, [&](const auto& supportA)
+	{
+		return visitSupportFunction(b, [&](const auto& supportB)
+		{
+			gjk_simplex simplex;
+			return gjkIntersectionTest(supportA, supportB, simplex);
+		});
+	});
+}
+
+// Largest sphere (roughly) inside the collider. Sweeping this sphere keeps the collider from passing through thin geometry. The
+// rest of the collider is handled by the discrete collision detection.
+static bounding_sphere getInnerSphere(const collider_union& c)
+{
+	switch (c.type)
+	{
+		case collider_type_sphere: return c.sphere;
+		case collider_type_capsule: return { (c.capsule.positionA + c.capsule.positionB) * 0.5f, c.capsule.radius };
+		case collider_type_cylinder: return { (c.cylinder.positionA + c.cylinder.positionB) * 0.5f, min(c.cylinder.radius, 0.5f * length(c.cylinder.positionB - c.cylinder.positionA)) };
+		case collider_type_aabb: { vec3 r = c.aabb.getRadius(); return { c.aabb.getCenter(), min(r.x, min(r.y, r.z)) }; }
+		case collider_type_obb: return { c.obb.center, min(c.obb.radius.x, min(c.obb.radius.y, c.obb.radius.z)) };
+		default:
+		{
+			// The center of the hull's bounding box is not necessarily deep inside the hull, so only use half the extent.
+			const bounding_box& aabb = c.hull.geometryPtr->aabb;
+			vec3 r = aabb.getRadius();
+			return { c.hull.position + c.hull.rotation * aabb.getCenter(), 0.5f * min(r.x, min(r.y, r.z)) };
+		}
+	}
+}
+
+// Radius of the sphere around the pivot, which contains the collider.
+static float getBoundingRadius(const bounding_box& aabb, vec3 pivot)
+{
+	return length(max(abs(aabb.minCorner - pivot), abs(aabb.maxCorner - pivot)));
+}
+
+// Conservative advancement: The distance between the shapes can shrink at most by the motion bound along the separating normal,
+// so advancing by distance / bound never skips a contact.
+static bool conservativeAdvancement(const collider_union& colliderA, vec3 pivot, quat invPivotRotation, float radiusA, const ccd_body_state& body,
+	const collider_union& colliderB, vec3 velocityB, float timeOffset, float h, ccd_hit& outHit)
+{
+	float angularBound = length(body.angularVelocity) * radiusA;
+
+	float t = 0.f;
+	for (uint32 it = 0; it < ccdMaxAdvancementIterations; ++it)
+	{
+		vec3 position = body.position + body.linearVelocity * (t * h);
+		quat rotation = integrateRotation(body.rotation, body.angularVelocity, t * h);
+
+		collider_union a = moveCollider(colliderA, rotation * invPivotRotation, pivot, position);
+		collider_union b = moveCollider(colliderB, quat::identity, vec3(0.f), velocityB * (timeOffset + t * h));
+
+		gjk_distance_result distance;
+		if (!colliderDistance(a, b, distance))
+		{
+			// Overlapping at the start of the sub-step is handled by the discrete collision detection. Later overlaps only happen
+			// through the tolerance of the distance query.
+			return false;
+		}
+
+		vec3 n = distance.normal;
+		if (distance.distance <= ccdTargetDistance)
+		{
+			vec3 pointVelocity = body.linearVelocity + cross(body.angularVelocity, distance.pointA - position);
+			if (dot(pointVelocity - velocityB, n) <= 0.f)
+			{
+				return false; // Separating or sliding.
+			}
+
+			outHit.t = t;
+			outHit.point = distance.pointA;
+			outHit.normal = n;
+			return true;
+		}
+
+		float bound = dot(body.linearVelocity - velocityB, n) + angularBound;
+		if (bound <= 0.f)
+		{
+			return false;
+		}
+
+		t += (distance.distance - 0.5f * ccdTargetDistance) / (bound * h);
+		if (t >= outHit.t)
+		{
+			return false; // Not earlier than the current best hit.
+		}
+	}
+
+	return false;
+}
+
+static bool castAgainstHeightmap(const heightmap_collider_component& heightmap, const collider_union& collider, const ccd_body_state& body, float h, ccd_hit& hit)
+{
+	heightmap_hit result;
+	vec3 reference;
+	vec3 pointVelocity;
+	float maxDistance;
+	bool found;
+
+	if (collider.type == collider_type_capsule)
+	{
+		reference = (collider.capsule.positionA + collider.capsule.positionB) * 0.5f;
+		pointVelocity = body.linearVelocity + cross(body.angularVelocity, reference - body.position);
+		maxDistance = length(pointVelocity) * h;
+		if (maxDistance < 1e-6f)
+		{
+			return false;
+		}
+		found = heightmap.capsuleCast(collider.capsule, pointVelocity * (h / maxDistance), maxDistance, result);
+	}
+	else
+	{
+		bounding_sphere sphere = getInnerSphere(collider);
+		reference = sphere.center;
+		pointVelocity = body.linearVelocity + cross(body.angularVelocity, reference - body.position);
+		maxDistance = length(pointVelocity) * h;
+		if (maxDistance < 1e-6f)
+		{
+			return false;
+		}
+		found = heightmap.sphereCast(sphere, pointVelocity * (h / maxDistance), maxDistance, result);
+	}
+
+	if (!found)
+	{
+		return false;
+	}
+
+	float t = max(0.f, (result.distance - ccdTargetDistance) / maxDistance);
+	vec3 n = -result.normal;
+	if (t >= hit.t || dot(pointVelocity, n) <= 0.f)
+	{
+		return false;
+	}
+
+	hit.t = t;
+	hit.point = result.point;
+	hit.normal = n;
+	hit.restitution = clamp01(max(collider.material.restitution, heightmap.material.restitution));
+	hit.other = UINT32_MAX;
+	return true;
+}
+
+uint32 continuousCollisionDetection(game_scene& scene, const collider_union* worldSpaceColliders, const bounding_box* worldSpaceAABBs, uint32 numColliders,
+	const rigid_body_global_state* rbGlobal, uint32 numRigidBodies, memory_arena& arena, uint32 maxSubsteps, float dt)
+{
+	CPU_PROFILE_BLOCK("Continuous collision detection");
+
+	memory_marker marker = arena.getMarker();
+
+	float* bodyColliderRadii = arena.allocate<float>(numColliders);
+	uint16* candidates = arena.allocate<uint16>(numColliders);
+
+	rigid_body_component* rigidBodies = scene.raw<rigid_body_component>();
+
+	// Colliders grouped by rigid body (counting sort), so that each body finds its own colliders without scanning all of them.
+	uint32* firstColliderPerBody = arena.allocate<uint32>(numRigidBodies + 1, true);
+	uint32* colliderCursors = arena.allocate<uint32>(numRigidBodies);
+	uint16* collidersByBody = arena.allocate<uint16>(numColliders);
+
+	for (uint32 i = 0; i < numColliders; ++i)
+	{
+		if (worldSpaceColliders[i].objectType == physics_object_type_rigid_body)
+		{
+			++firstColliderPerBody[worldSpaceColliders[i].objectIndex + 1];
+		}
+	}
+	for (uint32 i = 0; i < numRigidBodies; ++i)
+	{
+		firstColliderPerBody[i + 1] += firstColliderPerBody[i];
+		colliderCursors[i] = firstColliderPerBody[i];
+	}
+	for (uint32 i = 0; i < numColliders; ++i)
+	{
+		if (worldSpaceColliders[i].objectType == physics_object_type_rigid_body)
+		{
+			collidersByBody[colliderCursors[worldSpaceColliders[i].objectIndex]++] = (uint16)i;
+		}
+	}
+
+	// The broadphase bounds describe the start of the step. Queries are padded by the farthest any other body can move.
+	float maxOtherSpeed = 0.f;
+	for (uint32 i = 0; i < numRigidBodies; ++i)
+	{
+		maxOtherSpeed = max(maxOtherSpeed, length(rigidBodies[i].linearVelocity));
+	}
+
+	uint32 numFastBodies = 0;
+	uint32 numHits = 0;
+
+	uint32 rbIndex = numRigidBodies - 1; // EnTT iterates back to front.
+	for (auto [entityHandle, rb, transform] : scene.group<rigid_body_component, physics_transform1_component>().each())
+	{
+		uint32 index = rbIndex--;
+		const rigid_body_global_state& global = rbGlobal[index];
+
+		if (!rb.continuousCollision || rb.invMass == 0.f)
+		{
+			continue;
+		}
+
+		// Colliders of this body and their extents around the center of gravity.
+		const uint16* bodyColliders = collidersByBody + firstColliderPerBody[index];
+		uint32 numBodyColliders = firstColliderPerBody[index + 1] - firstColliderPerBody[index];
+		float bodyRadius = 0.f;
+		float thickness = FLT_MAX;
+		for (uint32 k = 0; k < numBodyColliders; ++k)
+		{
+			const collider_union& collider = worldSpaceColliders[bodyColliders[k]];
+
+			float radius = getBoundingRadius(worldSpaceAABBs[bodyColliders[k]], global.position);
+			bodyColliderRadii[k] = radius;
+
+			bodyRadius = max(bodyRadius, radius);
+			thickness = min(thickness, getInnerSphere(collider).radius);
+		}
+
+		// Slow bodies cannot tunnel. The discrete collision detection catches them.
+		float motion = (length(rb.linearVelocity) + length(rb.angularVelocity) * bodyRadius) * dt;
+		if (numBodyColliders == 0 || motion <= thickness)
+		{
+			continue;
+		}
+
+		++numFastBodies;
+
+		ccd_body_state body = { global.position, global.rotation, rb.linearVelocity, rb.angularVelocity };
+		vec3 pivot = global.position;
+		quat invPivotRotation = conjugate(global.rotation);
+
+		uint32 numBodyHits = 0;
+		float time = 0.f;
+		for (uint32 substep = 0; substep < maxSubsteps && time < dt; ++substep)
+		{
+			float h = dt - time;
+
+			ccd_hit hit;
+			hit.t = 1.f;
+			bool found = false;
+
+			// Swept bounds of the body over the rest of the step.
+			vec3 end = body.position + body.linearVelocity * h;
+			bounding_box sweptBounds = bounding_box::fromMinMax(min(body.position, end) - vec3(bodyRadius), max(body.position, end) + vec3(bodyRadius));
+
+			bounding_box queryBounds = sweptBounds;
+			queryBounds.pad(vec3(maxOtherSpeed * dt));
+			uint32 numCandidates = broadphaseQuery(scene, queryBounds, worldSpaceAABBs, candidates);
+
+			for (uint32 c = 0; c < numCandidates; ++c)
+			{
+				uint32 j = candidates[c];
+				const collider_union& other = worldSpaceColliders[j];
+
+				vec3 otherVelocity(0.f);
+				if (other.objectType == physics_object_type_rigid_body)
+				{
+					if (other.objectIndex == index)
+					{
+						continue;
+					}
+					otherVelocity = rigidBodies[other.objectIndex].linearVelocity;
+				}
+				else if (other.objectType != physics_object_type_static_collider)
+				{
+					continue; // Triggers and force fields.
+				}
+
+				const bounding_box& aabb = worldSpaceAABBs[j];
+				vec3 otherStart = otherVelocity * time;
+				vec3 otherEnd = otherVelocity * dt;
+				bounding_box otherSweptBounds = bounding_box::fromMinMax(aabb.minCorner + min(otherStart, otherEnd), aabb.maxCorner + max(otherStart, otherEnd));
+				if (!aabbVsAABB(sweptBounds, otherSweptBounds))
+				{
+					continue;
+				}
+
+				for (uint32 i = 0; i < numBodyColliders; ++i)
+				{
+					const collider_union& collider = worldSpaceColliders[bodyColliders[i]];
+					if (conservativeAdvancement(collider, pivot, invPivotRotation, bodyColliderRadii[i], body, other, otherVelocity, time, h, hit))
+					{
+						hit.restitution = clamp01(max(collider.material.restitution, other.material.restitution));
+						hit.other = j;
+						found = true;
+					}
+				}
+			}
+
+			quat deltaRotation = body.rotation * invPivotRotation;
+			for (auto [heightmapEntityHandle, heightmap] : scene.view<heightmap_collider_component>().each())
+			{
+				for (uint32 i = 0; i < numBodyColliders; ++i)
+				{
+					collider_union collider = moveCollider(worldSpaceColliders[bodyColliders[i]], deltaRotation, pivot, body.position);
+					found |= castAgainstHeightmap(heightmap, collider, body, h, hit);
+				}
+			}
+
+			if (!found)
+			{
+				break;
+			}
+
+			// Advance to the impact and apply a restitution impulse. Friction is left to the discrete solver in the next step.
+			float impactTime = hit.t * h;
+			body.position += body.linearVelocity * impactTime;
+			body.rotation = integrateRotation(body.rotation, body.angularVelocity, impactTime);
+			time += impactTime;
+
+			mat3 rot = quaternionToMat3(body.rotation);
+			mat3 invInertia = rot * rb.invInertia * transpose(rot);
+
+			vec3 n = hit.normal;
+			vec3 rA = hit.point - body.position;
+			vec3 relativeVelocity = body.linearVelocity + cross(body.angularVelocity, rA);
+			float k = rb.invMass + dot(n, cross(invInertia * cross(rA, n), rA));
+
+			rigid_body_component* otherBody = 0;
+			const rigid_body_global_state* otherGlobal = 0;
+			vec3 rB;
+			if (hit.other != UINT32_MAX && worldSpaceColliders[hit.other].objectType == physics_object_type_rigid_body)
+			{
+				uint16 otherIndex = worldSpaceColliders[hit.other].objectIndex;
+				otherBody = &rigidBodies[otherIndex];
+				otherGlobal = &rbGlobal[otherIndex];
+
+				vec3 otherPosition = otherGlobal->position + otherBody->linearVelocity * time;
+				rB = hit.point - otherPosition;
+				relativeVelocity -= otherBody->linearVelocity + cross(otherBody->angularVelocity, rB);
+				k += otherGlobal->invMass + dot(n, cross(otherGlobal->invInertia * cross(rB, n), rB));
+			}
+
+			float approachVelocity = dot(relativeVelocity, n);
+			if (approachVelocity > 0.f && k > 0.f)
+			{
+				vec3 impulse = n * ((1.f + hit.restitution) * approachVelocity / k);
+
+				body.linearVelocity -= impulse * rb.invMass;
+				body.angularVelocity -= invInertia * cross(rA, impulse);
+
+				if (otherBody)
+				{
+					otherBody->linearVelocity += impulse * otherGlobal->invMass;
+					otherBody->angularVelocity += otherGlobal->invInertia * cross(rB, impulse);
+
+					maxOtherSpeed = max(maxOtherSpeed, length(otherBody->linearVelocity));
+				}
+			}
+
+			++numBodyHits;
+		}
+
+		if (numBodyHits == 0)
+		{
+			continue; // The transform from the regular integration is already correct.
+		}
+
+		numHits += numBodyHits;
+
+		// Rest of the step, if any.
+		if (time < dt)
+		{
+			float remaining = dt - time;
+			body.position += body.linearVelocity * remaining;
+			body.rotation = integrateRotation(body.rotation, body.angularVelocity, remaining);
+		}
+
+		rb.linearVelocity = body.linearVelocity;
+		rb.angularVelocity = body.angularVelocity;
+
+		transform.rotation = body.rotation;
+		transform.position = body.position - body.rotation * rb.localCOGPosition;
+	}
+
+	CPU_PROFILE_STAT("Num CCD bodies", numFastBodies);
+	CPU_PROFILE_STAT("Num CCD impacts", numHits);
+
+	arena.resetToMarker(marker);
+
+	return numHits;
+}
+
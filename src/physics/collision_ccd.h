@@ -0,0 +1,25 @@
+#pragma once
+
+#include "bounding_volumes.h"
+#include "scene/scene.h"
+#include "core/memory.h"
+
+struct collider_union;
+struct rigid_body_global_state;
+struct gjk_distance_result;
+
+
+// Continuous collision detection for rigid bodies with continuousCollision set. Runs after the velocities have been integrated,
+// i.e. the world space colliders and global states still describe the start of the step, while the rigid body components and
+// transforms hold the end. Only bodies which move farther than their own thickness in this step are processed. Their motion is
+// split at each time of impact (found by conservative advancement against the other colliders and by shape casts against the
+// heightmaps), where a restitution impulse is applied. Obstacles are found by querying the broadphase with the swept bounds, so
+// this must run after the broadphase of the same step. Returns the number of impacts.
+uint32 continuousCollisionDetection(game_scene& scene, const collider_union* worldSpaceColliders, const bounding_box* worldSpaceAABBs, uint32 numColliders,
+	const rigid_body_global_state* rbGlobal, uint32 numRigidBodies, memory_arena& arena, uint32 maxSubsteps, float dt);
+
+// Convex queries between arbitrary world space colliders via GJK. Also used by the scene queries.
+collider_union moveCollider(const collider_union& c, quat deltaRotation, vec3 pivot, vec3 newPivot); // Rotates around the pivot and moves the pivot.
+bool colliderDistance(const collider_union& a, const collider_union& b, gjk_distance_result& result); // Returns false if the colliders intersect.
+bool colliderIntersection(const collider_union& a, const collider_union& b);
+
@@ -211,3 +211,186 @@ gjk_internal_success updateGJKSimplex(gjk_simplex& s, const gjk_support_point& a
 	return gjk_unexpected_error;
 }
 
+// Barycentric weights of the point on segment ab closest to the origin.
+static void closestOnSegmentToOrigin(vec3 a, vec3 b, float& outWA, float& outWB)
+{
+	vec3 ab = b - a;
+	float abab = dot(ab, ab);
+	float t = (abab > 1e-20f) ? clamp01(-dot(a, ab) / abab) : 0.f;
+	outWA = 1.f - t;
+	outWB = t;
+}
+
+// Barycentric weights of the point on triangle abc closest to the origin. Real-Time Collision Detection, 5.1.5.
+static void closestOnTriangleToOrigin(vec3 a, vec3 b, vec3 c, float* outW)
+{
+	vec3 ab = b - a;
+	vec3 ac = c - a;
+
+	float d1 = -dot(ab, a);
+	float d2 = -dot(ac, a);
+	if (d1 <= 0.f && d2 <= 0.f)
+	{
+		outW[0] = 1.f; outW[1] = 0.f; outW[2] = 0.f;
+		return;
+	}
+
+	float d3 = -dot(ab, b);
+	float d4 = -dot(ac, b);
+	if (d3 >= 0.f && d4 <= d3)
+	{
+		outW[0] = 0.f; outW[1] = 1.f; outW[2] = 0.f;
+		return;
+	}
+
+	float vc = d1 * d4 - d3 * d2;
+	if (vc <= 0.f && d1 >= 0.f && d3 <= 0.f)
+	{
+		float v = d1 / (d1 - d3);
+		outW[0] = 1.f - v; outW[1] = v; outW[2] = 0.f;
+		return;
+	}
+
+	float d5 = -dot(ab, c);
+	float d6 = -dot(ac, c);
+	if (d6 >= 0.f && d5 <= d6)
+	{
+		outW[0] = 0.f; outW[1] = 0.f; outW[2] = 1.f;
+		return;
+	}
+
+	float vb = d5 * d2 - d1 * d6;
+	if (vb <= 0.f && d2 >= 0.f && d6 <= 0.f)
+	{
+		float w = d2 / (d2 - d6);
+		outW[0] = 1.f - w; outW[1] = 0.f; outW[2] = w;
+		return;
+	}
+
+	float va = d3 * d6 - d5 * d4;
+	if (va <= 0.f && (d4 - d3) >= 0.f && (d5 - d6) >= 0.f)
+	{
+		float w = (d4 - d3) / ((d4 - d3) + (d5 - d6));
+		outW[0] = 0.f; outW[1] = 1.f - w; outW[2] = w;
+		return;
+	}
+
+	float sum = va + vb + vc;
+	if (sum <= 1e-20f)
+	{
+		// Degenerate triangle. Take the best edge.
+		float bestSq = FLT_MAX;
+		for (uint32 e = 0; e < 3; ++e)
+		{
+			uint32 i0 = e, i1 = (e + 1) % 3;
+			vec3 p[3] = { a, b, c };
+			float w0, w1;
+			closestOnSegmentToOrigin(p[i0], p[i1], w0, w1);
+			vec3 q = p[i0] * w0 + p[i1] * w1;
+			float sq = dot(q, q);
+			if (sq < bestSq)
+			{
+				bestSq = sq;
+				outW[0] = outW[1] = outW[2] = 0.f;
+				outW[i0] = w0;
+				outW[i1] = w1;
+			}
+		}
+		return;
+	}
+
+	float denom = 1.f / sum;
+	float v = vb * denom;
+	float w = vc * denom;
+	outW[0] = 1.f - v - w; outW[1] = v; outW[2] = w;
+}
+
+// Replaces the simplex by the smallest sub-simplex containing the point closest to the origin. Returns the new number of points,
+// which is 4 only if the origin lies inside the tetrahedron.
+uint32 reduceGJKDistanceSimplex(gjk_support_point* points, uint32 numPoints, float* outWeights, vec3& outClosest)
+{
+	float w[4] = {};
+
+	if (numPoints == 1)
+	{
+		w[0] = 1.f;
+	}
+	else if (numPoints == 2)
+	{
+		closestOnSegmentToOrigin(points[0].minkowski, points[1].minkowski, w[0], w[1]);
+	}
+	else if (numPoints == 3)
+	{
+		closestOnTriangleToOrigin(points[0].minkowski, points[1].minkowski, points[2].minkowski, w);
+	}
+	else
+	{
+		static const uint32 faces[4][4] =
+		{
+			{ 0, 1, 2, 3 },
+			{ 0, 3, 1, 2 },
+			{ 0, 2, 3, 1 },
+			{ 1, 3, 2, 0 },
+		};
+
+		float bestSq = FLT_MAX;
+		bool inside = true;
+
+		for (uint32 f = 0; f < 4; ++f)
+		{
+			vec3 a = points[faces[f][0]].minkowski;
+			vec3 b = points[faces[f][1]].minkowski;
+			vec3 c = points[faces[f][2]].minkowski;
+			vec3 d = points[faces[f][3]].minkowski;
+
+			vec3 n = cross(b - a, c - a);
+			float signOrigin = -dot(a, n);
+			float signOpposite = dot(d - a, n);
+
+			// Degenerate tetrahedra test all faces.
+			bool outside = signOrigin * signOpposite < 0.f || signOpposite * signOpposite < 1e-20f;
+			if (!outside)
+			{
+				continue;
+			}
+			inside = false;
+
+			float faceW[3];
+			closestOnTriangleToOrigin(a, b, c, faceW);
+			vec3 q = a * faceW[0] + b * faceW[1] + c * faceW[2];
+			float sq = dot(q, q);
+			if (sq < bestSq)
+			{
+				bestSq = sq;
+				w[0] = w[1] = w[2] = w[3] = 0.f;
+				w[faces[f][0]] = faceW[0];
+				w[faces[f][1]] = faceW[1];
+				w[faces[f][2]] = faceW[2];
+			}
+		}
+
+		if (inside)
+		{
+			outClosest = vec3(0.f);
+			return 4;
+		}
+	}
+
+	// Compact the points with non-zero weight.
+	uint32 result = 0;
+	vec3 closest(0.f);
+	for (uint32 i = 0; i < numPoints; ++i)
+	{
+		if (w[i] > 0.f)
+		{
+			closest += points[i].minkowski * w[i];
+			points[result] = points[i];
+			outWeights[result] = w[i];
+			++result;
+		}
+	}
+
+	outClosest = closest;
+	return result;
+}
+
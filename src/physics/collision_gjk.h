@@ -237,4 +237,74 @@ static bool gjkIntersectionTest(const shapeA_t& shapeA, const shapeB_t& shapeB,
 	return true;
 }
 
+struct gjk_distance_result
+{
+	float distance;
+	vec3 pointA; // Closest points on both shapes.
+	vec3 pointB;
+	vec3 normal; // From A to B.
+};
+
+// Replaces the simplex by the smallest sub-simplex containing the point closest to the origin. Implemented in collision_gjk.cpp.
+uint32 reduceGJKDistanceSimplex(gjk_support_point* points, uint32 numPoints, float* outWeights, vec3& outClosest);
+
+// Returns false if the shapes intersect. Otherwise computes the distance between the shapes and their closest points.
+// Curved shapes only converge up to the given relative tolerance.
+template <typename shapeA_t, typename shapeB_t>
+static bool gjkDistance(const shapeA_t& shapeA, const shapeB_t& shapeB, gjk_distance_result& outResult, uint32 maxIterations = 32, float tolerance = 1e-4f)
+{
+	gjk_support_point points[4];
+	float weights[4];
+
+	points[0] = support(shapeA, shapeB, vec3(1.f, 0.1f, -0.2f)); // Arbitrary.
+	weights[0] = 1.f;
+	uint32 numPoints = 1;
+
+	vec3 v = points[0].minkowski;
+
+	for (uint32 it = 0; it < maxIterations; ++it)
+	{
+		float vv = dot(v, v);
+		if (vv < 1e-12f)
+		{
+			return false;
+		}
+
+		gjk_support_point w = support(shapeA, shapeB, -v);
+		if (vv - dot(v, w.minkowski) <= tolerance * vv)
+		{
+			break; // No more progress towards the origin.
+		}
+
+		points[numPoints++] = w;
+		vec3 closest;
+		numPoints = reduceGJKDistanceSimplex(points, numPoints, weights, closest);
+		if (numPoints == 4)
+		{
+			return false; // Origin is inside the tetrahedron.
+		}
+
+		bool stalled = dot(closest, closest) >= vv;
+		v = closest;
+		if (stalled)
+		{
+			break;
+		}
+	}
+
+	vec3 pointA(0.f), pointB(0.f);
+	for (uint32 i = 0; i < numPoints; ++i)
+	{
+		pointA += points[i].shapeAPoint * weights[i];
+		pointB += points[i].shapeBPoint * weights[i];
+	}
+
+	outResult.distance = length(v);
+	outResult.pointA = pointA;
+	outResult.pointB = pointB;
+	outResult.normal = -v / outResult.distance;
+	return true;
+}
+
+
 
@@ -37,6 +37,38 @@ struct constraint_edge
 	uint16 nextConstraintEdge;
 };
 
+// Per-scene graph of constraints (context variable). Part of the simulation state, so it is rolled back with the scene snapshot.
+struct constraint_context
+{
+	std::vector<constraint_edge> constraintEdges;
+	uint16 firstFreeConstraintEdge = INVALID_CONSTRAINT_EDGE; // Free-list in constraintEdges array.
+
+
+	constraint_edge& getFreeConstraintEdge()
+	{
+		if (firstFreeConstraintEdge == INVALID_CONSTRAINT_EDGE)
+		{
+			firstFreeConstraintEdge = (uint16)constraintEdges.size();
+			constraintEdges.push_back(constraint_edge{ entt::null, constraint_type_none, INVALID_CONSTRAINT_EDGE, INVALID_CONSTRAINT_EDGE });
+		}
+
+		constraint_edge& edge = constraintEdges[firstFreeConstraintEdge];
+
+		firstFreeConstraintEdge = edge.nextConstraintEdge;
+
+		// Edge will be initialized by caller.
+
+		return edge;
+	}
+
+	void freeConstraintEdge(constraint_edge& edge)
+	{
+		uint16 index = (uint16)(&edge - constraintEdges.data());
+		edge.nextConstraintEdge = firstFreeConstraintEdge;
+		firstFreeConstraintEdge = index;
+	}
+};
+
 
 enum constraint_motor_type
 {
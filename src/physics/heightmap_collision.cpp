@@ -1,7 +1,10 @@
 #include "pch.h"
 #include "heightmap_collision.h"
 #include "core/cpu_profiling.h"
+#include "core/math_simd.h"
+#include "core/radix_sort.h"
 #include "collision_gjk.h"
+#include "collision_epa.h"
 
 static void getAABBIncidentEdge(vec3 aabbRadius, vec3 normal, vec3& outA, vec3& outB)
 {
@@ -419,29 +422,165 @@ static uint32 collideAABBvsTriangle(vec3 center, vec3 radius, vec3 a, vec3 b, ve
 	return 1;
 }
 
-static uint32 intersection(const bounding_sphere& s, const bounding_box& aabb, const heightmap_collider_component& heightmap, memory_arena& arena,
-	collision_contact* outContacts)
+template <typename shape_support_t>
+static uint32 collideConvexVsTriangle(const shape_support_t& shapeSupport, vec3 a, vec3 b, vec3 c, collision_contact* outContacts)
+{
+	// The triangle is extruded downwards, so that shapes which already sank into the terrain are pushed up, not through.
+	extruded_triangle_support_fn triangleSupport(a, b, c);
+
+	gjk_simplex gjkSimplex;
+	if (!gjkIntersectionTest(shapeSupport, triangleSupport, gjkSimplex))
+	{
+		return 0;
+	}
+
+	epa_result epa;
+	epaCollisionInfo(gjkSimplex, shapeSupport, triangleSupport, epa);
+
+	collision_contact& contact = outContacts[0];
+	contact.point = epa.point;
+	contact.normal = epa.normal;
+	contact.penetrationDepth = epa.penetrationDepth;
+
+	return 1;
+}
+
+
+#define HEIGHTMAP_TRIANGLE_BATCH_SIZE 256
+
+// Candidate triangles of one collider in SoA layout, so that they can be culled 8 at a time before running the exact tests.
+struct heightmap_triangle_batch
+{
+	float* coordinates[9]; // ax, ay, az, bx, by, bz, cx, cy, cz.
+	uint32 count;
+
+	void initialize(memory_arena& arena)
+	{
+		float* data = arena.allocate<float>(9 * HEIGHTMAP_TRIANGLE_BATCH_SIZE);
+		for (uint32 i = 0; i < 9; ++i)
+		{
+			coordinates[i] = data + i * HEIGHTMAP_TRIANGLE_BATCH_SIZE;
+		}
+		count = 0;
+	}
+
+	void push(vec3 a, vec3 b, vec3 c)
+	{
+		coordinates[0][count] = a.x; coordinates[1][count] = a.y; coordinates[2][count] = a.z;
+		coordinates[3][count] = b.x; coordinates[4][count] = b.y; coordinates[5][count] = b.z;
+		coordinates[6][count] = c.x; coordinates[7][count] = c.y; coordinates[8][count] = c.z;
+		++count;
+	}
+
+	vec3 get(uint32 vertex, uint32 index) const
+	{
+		return vec3(coordinates[vertex * 3 + 0][index], coordinates[vertex * 3 + 1][index], coordinates[vertex * 3 + 2][index]);
+	}
+};
+
+// Conservative bounds of a collider. A triangle can only touch the collider if it overlaps the AABB and its plane passes through the sphere.
+struct heightmap_collider_bounds
+{
+	bounding_box aabb;
+	vec3 sphereCenter;
+	float sphereRadius;
+};
+
+// Returns a bit mask of the triangles [first, first + 8) which may touch the collider.
+static uint32 cullTriangles8(const heightmap_triangle_batch& batch, uint32 first, const heightmap_collider_bounds& bounds)
+{
+	w8_float ax(batch.coordinates[0] + first), ay(batch.coordinates[1] + first), az(batch.coordinates[2] + first);
+	w8_float bx(batch.coordinates[3] + first), by(batch.coordinates[4] + first), bz(batch.coordinates[5] + first);
+	w8_float cx(batch.coordinates[6] + first), cy(batch.coordinates[7] + first), cz(batch.coordinates[8] + first);
+
+	uint32 mask = (batch.count - first >= 8) ? 0xFF : ((1u << (batch.count - first)) - 1);
+
+	// Triangle AABB vs collider AABB.
+	mask &= toBitMask(minimum(ax, minimum(bx, cx)) <= bounds.aabb.maxCorner.x);
+	mask &= toBitMask(maximum(ax, maximum(bx, cx)) >= bounds.aabb.minCorner.x);
+	mask &= toBitMask(minimum(ay, minimum(by, cy)) <= bounds.aabb.maxCorner.y);
+	mask &= toBitMask(maximum(ay, maximum(by, cy)) >= bounds.aabb.minCorner.y);
+	mask &= toBitMask(minimum(az, minimum(bz, cz)) <= bounds.aabb.maxCorner.z);
+	mask &= toBitMask(maximum(az, maximum(bz, cz)) >= bounds.aabb.minCorner.z);
+
+	if (!mask)
+	{
+		return 0;
+	}
+
+	// Plane distance of the bounding sphere, without normalizing the normal: dot(n, p - a)^2 <= r^2 * dot(n, n).
+	w8_float e1x = bx - ax, e1y = by - ay, e1z = bz - az;
+	w8_float e2x = cx - ax, e2y = cy - ay, e2z = cz - az;
+
+	w8_float nx = e1y * e2z - e1z * e2y;
+	w8_float ny = e1z * e2x - e1x * e2z;
+	w8_float nz = e1x * e2y - e1y * e2x;
+
+	w8_float px = w8_float(bounds.sphereCenter.x) - ax;
+	w8_float py = w8_float(bounds.sphereCenter.y) - ay;
+	w8_float pz = w8_float(bounds.sphereCenter.z) - az;
+
+	w8_float d = nx * px + ny * py + nz * pz;
+	w8_float nn = nx * nx + ny * ny + nz * nz;
+
+	mask &= toBitMask(d * d <= nn * (bounds.sphereRadius * bounds.sphereRadius));
+
+	return mask;
+}
+
+// Gathers the triangles in the volume in batches, culls them 8-wide and runs the exact test on the survivors.
+template <typename triangle_test_t>
+static uint32 collideWithTriangles(const heightmap_collider_component& heightmap, const bounding_box& volume, const heightmap_collider_bounds& bounds, 
+	heightmap_triangle_batch& batch, memory_arena& arena, collision_contact* outContacts, const triangle_test_t& test)
 {
 	uint32 numContacts = 0;
 
-	heightmap.iterateTrianglesInVolume(aabb, arena, [s, outContacts, &numContacts](vec3 a, vec3 b, vec3 c)
+	auto flush = [&]()
+	{
+		for (uint32 first = 0; first < batch.count; first += 8)
+		{
+			uint32 mask = cullTriangles8(batch, first, bounds);
+			while (mask)
+			{
+				uint32 index = first + indexOfLeastSignificantSetBit(mask);
+				mask &= mask - 1;
+
+				numContacts += test(batch.get(0, index), batch.get(1, index), batch.get(2, index), outContacts + numContacts);
+			}
+		}
+		batch.count = 0;
+	};
+
+	heightmap.iterateTrianglesInVolume(volume, arena, [&](vec3 a, vec3 b, vec3 c)
 	{
-		numContacts += collideSphereVsTriangle(s.center, s.radius, a, b, c, outContacts + numContacts);
+		batch.push(a, b, c);
+		if (batch.count == HEIGHTMAP_TRIANGLE_BATCH_SIZE)
+		{
+			flush();
+		}
 	});
+	flush();
 
 	// TODO: De-duplicate contacts (for if we hit triangle edges or vertices).
 
 	return numContacts;
 }
 
-static uint32 intersection(const bounding_capsule& capsule, const bounding_box& aabb, const heightmap_collider_component& heightmap, memory_arena& arena,
-	collision_contact* outContacts)
+static uint32 intersection(const bounding_sphere& s, const bounding_box& aabb, const heightmap_collider_bounds& bounds, const heightmap_collider_component& heightmap, 
+	heightmap_triangle_batch& batch, memory_arena& arena, collision_contact* outContacts)
 {
-	uint32 numContacts = 0;
+	return collideWithTriangles(heightmap, aabb, bounds, batch, arena, outContacts, [s](vec3 a, vec3 b, vec3 c, collision_contact* contacts)
+	{
+		return collideSphereVsTriangle(s.center, s.radius, a, b, c, contacts);
+	});
+}
 
+static uint32 intersection(const bounding_capsule& capsule, const bounding_box& aabb, const heightmap_collider_bounds& bounds, const heightmap_collider_component& heightmap, 
+	heightmap_triangle_batch& batch, memory_arena& arena, collision_contact* outContacts)
+{
 	ray r = { capsule.positionA, normalize(capsule.positionB - capsule.positionA) };
 
-	heightmap.iterateTrianglesInVolume(aabb, arena, [r, capsule, outContacts, &numContacts](vec3 a, vec3 b, vec3 c)
+	return collideWithTriangles(heightmap, aabb, bounds, batch, arena, outContacts, [r, capsule](vec3 a, vec3 b, vec3 c, collision_contact* contacts)
 	{
 		vec3 triNormal = normalize(cross(b - a, c - a));
 		float d = -dot(triNormal, a);
@@ -455,48 +594,43 @@ static uint32 intersection(const bounding_capsule& capsule, const bounding_box&
 
 		vec3 reference = closestPoint_PointSegment(closest, { capsule.positionA, capsule.positionB });
 
-		numContacts += collideSphereVsTriangle(reference, capsule.radius, a, b, c, outContacts + numContacts);
+		return collideSphereVsTriangle(reference, capsule.radius, a, b, c, contacts);
 	});
-
-	// TODO: De-duplicate contacts (for if we hit triangle edges or vertices).
-
-	return numContacts;
 }
 
-static uint32 intersection(const bounding_box& box, const bounding_box& aabb, const heightmap_collider_component& heightmap, memory_arena& arena,
-	collision_contact* outContacts)
+static uint32 intersection(const bounding_cylinder& cylinder, const bounding_box& aabb, const heightmap_collider_bounds& bounds, const heightmap_collider_component& heightmap, 
+	heightmap_triangle_batch& batch, memory_arena& arena, collision_contact* outContacts)
 {
-	uint32 numContacts = 0;
+	return collideWithTriangles(heightmap, aabb, bounds, batch, arena, outContacts, [&cylinder](vec3 a, vec3 b, vec3 c, collision_contact* contacts)
+	{
+		return collideConvexVsTriangle(cylinder_support_fn{ cylinder }, a, b, c, contacts);
+	});
+}
 
+static uint32 intersection(const bounding_box& box, const bounding_box& aabb, const heightmap_collider_bounds& bounds, const heightmap_collider_component& heightmap, 
+	heightmap_triangle_batch& batch, memory_arena& arena, collision_contact* outContacts)
+{
 	vec3 center = box.getCenter();
 	vec3 radius = box.getRadius();
 
-	heightmap.iterateTrianglesInVolume(aabb, arena, [center, radius, outContacts, &numContacts](vec3 a, vec3 b, vec3 c)
+	return collideWithTriangles(heightmap, aabb, bounds, batch, arena, outContacts, [center, radius](vec3 a, vec3 b, vec3 c, collision_contact* contacts)
 	{
-		numContacts += collideAABBvsTriangle(center, radius, a, b, c, outContacts + numContacts);
+		return collideAABBvsTriangle(center, radius, a, b, c, contacts);
 	});
-
-	// TODO: De-duplicate contacts (for if we hit triangle edges or vertices).
-
-	return numContacts;
 }
 
-static uint32 intersection(const bounding_oriented_box& obb, const bounding_box& aabb, const heightmap_collider_component& heightmap, memory_arena& arena,
-	collision_contact* outContacts)
+static uint32 intersection(const bounding_oriented_box& obb, const bounding_box& aabb, const heightmap_collider_bounds& bounds, const heightmap_collider_component& heightmap, 
+	heightmap_triangle_batch& batch, memory_arena& arena, collision_contact* outContacts)
 {
-	uint32 numContacts = 0;
-
-	heightmap.iterateTrianglesInVolume(aabb, arena, [obb, outContacts, &numContacts](vec3 a, vec3 b, vec3 c)
+	uint32 numContacts = collideWithTriangles(heightmap, aabb, bounds, batch, arena, outContacts, [obb](vec3 a, vec3 b, vec3 c, collision_contact* contacts)
 	{
 		a = conjugate(obb.rotation) * (a - obb.center);
 		b = conjugate(obb.rotation) * (b - obb.center);
 		c = conjugate(obb.rotation) * (c - obb.center);
 
-		numContacts += collideAABBvsTriangle(vec3(0.f, 0.f, 0.f), obb.radius, a, b, c, outContacts + numContacts);
+		return collideAABBvsTriangle(vec3(0.f, 0.f, 0.f), obb.radius, a, b, c, contacts);
 	});
 
-	// TODO: De-duplicate contacts (for if we hit triangle edges or vertices).
-
 	for (uint32 i = 0; i < numContacts; ++i)
 	{
 		outContacts[i].normal = obb.rotation * outContacts[i].normal;
@@ -506,6 +640,15 @@ static uint32 intersection(const bounding_oriented_box& obb, const bounding_box&
 	return numContacts;
 }
 
+static uint32 intersection(const bounding_hull& hull, const bounding_box& aabb, const heightmap_collider_bounds& bounds, const heightmap_collider_component& heightmap, 
+	heightmap_triangle_batch& batch, memory_arena& arena, collision_contact* outContacts)
+{
+	return collideWithTriangles(heightmap, aabb, bounds, batch, arena, outContacts, [&hull](vec3 a, vec3 b, vec3 c, collision_contact* contacts)
+	{
+		return collideConvexVsTriangle(hull_support_fn{ hull }, a, b, c, contacts);
+	});
+}
+
 narrowphase_result heightmapCollision(const heightmap_collider_component& heightmap, 
 	const collider_union* worldSpaceColliders, const bounding_box* worldSpaceAABBs, uint32 numColliders, 
 	collision_contact* outContacts, constraint_body_pair* outBodyPairs, collider_pair* outColliderPairs, uint8* outContactCountPerCollision, 
@@ -516,6 +659,13 @@ narrowphase_result heightmapCollision(const heightmap_collider_component& height
 	uint32 totalNumContacts = 0;
 	uint32 totalNumCollisions = 0;
 
+	memory_marker marker = arena.getMarker();
+
+	// Reject colliders above the terrain using the coarse min/max levels. The rest is sorted by chunk, so that consecutive colliders
+	// touch the same height data.
+	uint64* candidates = arena.allocate<uint64>(numColliders);
+	uint32 numCandidates = 0;
+
 	for (uint32 i = 0; i < numColliders; ++i)
 	{
 		const collider_union& collider = worldSpaceColliders[i];
@@ -525,6 +675,34 @@ narrowphase_result heightmapCollision(const heightmap_collider_component& height
 			continue;
 		}
 
+		const bounding_box& aabb = worldSpaceAABBs[i];
+		if (heightmap.isAboveTerrain(aabb))
+		{
+			continue;
+		}
+
+		uint64 chunkIndex = heightmap.getChunkIndex(vec2(aabb.minCorner.x, aabb.minCorner.z));
+		candidates[numCandidates++] = (chunkIndex << 32) | i;
+	}
+
+	uint64* scratch = arena.allocate<uint64>(numCandidates);
+	radixSort(candidates, scratch, numCandidates, [](uint64 c) { return c; });
+
+	heightmap_triangle_batch batch;
+	batch.initialize(arena);
+
+	CPU_PROFILE_STAT("Heightmap candidate colliders", numCandidates);
+
+	for (uint32 candidateIndex = 0; candidateIndex < numCandidates; ++candidateIndex)
+	{
+		uint32 i = (uint32)candidates[candidateIndex];
+		const collider_union& collider = worldSpaceColliders[i];
+
+
+		heightmap_collider_bounds bounds;
+		bounds.aabb = worldSpaceAABBs[i];
+		bounds.sphereCenter = bounds.aabb.getCenter();
+		bounds.sphereRadius = length(bounds.aabb.getRadius());
 
 		bounding_box aabb = worldSpaceAABBs[i];
 		aabb.maxCorner.y += 10.f;
@@ -540,24 +718,38 @@ narrowphase_result heightmapCollision(const heightmap_collider_component& height
 		{
 			case collider_type_sphere:
 			{
-				numContacts = intersection(collider.sphere, aabb, heightmap, arena, contactPtr);
+				numContacts = intersection(collider.sphere, aabb, bounds, heightmap, batch, arena, contactPtr);
 				lowestPoint = sphere_support_fn{ collider.sphere }(vec3(0.f, -1.f, 0.f));
 			} break;
 			case collider_type_capsule:
 			{
-				numContacts = intersection(collider.capsule, aabb, heightmap, arena, contactPtr);
+				numContacts = intersection(collider.capsule, aabb, bounds, heightmap, batch, arena, contactPtr);
 				lowestPoint = capsule_support_fn{ collider.capsule }(vec3(0.f, -1.f, 0.f));
 			} break;
+			case collider_type_cylinder:
+			{
+				numContacts = intersection(collider.cylinder, aabb, bounds, heightmap, batch, arena, contactPtr);
+				lowestPoint = cylinder_support_fn{ collider.cylinder }(vec3(0.f, -1.f, 0.f));
+			} break;
 			case collider_type_aabb:
 			{
-				numContacts = intersection(collider.aabb, aabb, heightmap, arena, contactPtr);
+				numContacts = intersection(collider.aabb, aabb, bounds, heightmap, batch, arena, contactPtr);
 				lowestPoint = aabb_support_fn{ collider.aabb }(vec3(0.f, -1.f, 0.f));
 			} break;
 			case collider_type_obb:
 			{
-				numContacts = intersection(collider.obb, aabb, heightmap, arena, contactPtr);
+				numContacts = intersection(collider.obb, aabb, bounds, heightmap, batch, arena, contactPtr);
 				lowestPoint = obb_support_fn{ collider.obb }(vec3(0.f, -1.f, 0.f));
 			} break;
+			case collider_type_hull:
+			{
+				numContacts = intersection(collider.hull, aabb, bounds, heightmap, batch, arena, contactPtr);
+				lowestPoint = hull_support_fn{ collider.hull }(vec3(0.f, -1.f, 0.f));
+			} break;
+			default:
+			{
+				lowestPoint = vec3(bounds.sphereCenter.x, bounds.aabb.minCorner.y, bounds.sphereCenter.z);
+			} break;
 		}
 
 		float heightAtLowestPoint = heightmap.getHeightAt(vec2(lowestPoint.x, lowestPoint.z));
@@ -614,5 +806,7 @@ narrowphase_result heightmapCollision(const heightmap_collider_component& height
 		totalNumContacts += numContacts;
 	}
 
+	arena.resetToMarker(marker);
+
 	return narrowphase_result{ totalNumCollisions, totalNumContacts, 0 };
 }
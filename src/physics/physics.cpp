@@ -3,6 +3,7 @@
 #include "collision_broad.h"
 #include "collision_narrow.h"
 #include "heightmap_collision.h"
+#include "collision_ccd.h"
 #include "core/cpu_profiling.h"
 
 #ifndef PHYSICS_ONLY
@@ -13,37 +14,6 @@
 
 static std::vector<bounding_hull_geometry> boundingHullGeometries;
 
-struct constraint_context
-{
-	std::vector<constraint_edge> constraintEdges;
-	uint16 firstFreeConstraintEdge = INVALID_CONSTRAINT_EDGE; // Free-list in constraintEdges array.
-
-
-	constraint_edge& getFreeConstraintEdge()
-	{
-		if (firstFreeConstraintEdge == INVALID_CONSTRAINT_EDGE)
-		{
-			firstFreeConstraintEdge = (uint16)constraintEdges.size();
-			constraintEdges.push_back(constraint_edge{ entt::null, constraint_type_none, INVALID_CONSTRAINT_EDGE, INVALID_CONSTRAINT_EDGE });
-		}
-
-		constraint_edge& edge = constraintEdges[firstFreeConstraintEdge];
-
-		firstFreeConstraintEdge = edge.nextConstraintEdge;
-
-		// Edge will be initialized by caller.
-
-		return edge;
-	}
-
-	void freeConstraintEdge(constraint_edge& edge)
-	{
-		uint16 index = (uint16)(&edge - constraintEdges.data());
-		edge.nextConstraintEdge = firstFreeConstraintEdge;
-		firstFreeConstraintEdge = index;
-	}
-};
-
 struct force_field_global_state
 {
 	vec3 force;
@@ -628,7 +598,7 @@ void testPhysicsInteraction(game_scene& scene, ray r, float strength)
 	}
 }
 
-static void getWorldSpaceColliders(game_scene& scene, bounding_box* outWorldspaceAABBs, collider_union* outWorldSpaceColliders, uint16 dummyRigidBodyIndex)
+void getWorldSpaceColliders(game_scene& scene, bounding_box* outWorldspaceAABBs, collider_union* outWorldSpaceColliders, uint16 dummyRigidBodyIndex)
 {
 	CPU_PROFILE_BLOCK("Get world space colliders");
 
@@ -1349,10 +1319,16 @@ static void physicsStepInternal(game_scene& scene, memory_arena& arena, const ph
 
 	VALIDATE(rbGlobal, numRigidBodies);
 
+	if (settings.continuousCollisionDetection)
+	{
+		continuousCollisionDetection(scene, worldSpaceColliders, worldSpaceAABBs, numColliders, rbGlobal, numRigidBodies, arena, settings.maxCCDSubsteps, dt);
+	}
+
 	// Cloth. This needs to get integrated with the rest of the system.
 
 	for (auto [entityHandle, cloth] : scene.view<cloth_component>().each())
 	{
+		scene.preserveForSnapshot<cloth_component>(entityHandle);
 		cloth.applyWindForce(globalForceField);
 		cloth.simulate(settings.numClothVelocityIterations, settings.numClothPositionIterations, settings.numClothDriftIterations, dt);
 	}
@@ -1412,6 +1388,224 @@ void physicsStep(game_scene& scene, memory_arena& arena, float& timer, const phy
 	}
 }
 
+#define PHYSICS_SNAPSHOT_VERSION 2
+
+static void appendSnapshotBytes(std::vector<uint8>& data, const void* bytes, uint64 size)
+{
+	uint64 offset = data.size();
+	data.resize(offset + size);
+	if (size)
+	{
+		memcpy(data.data() + offset, bytes, size);
+	}
+}
+
+template <typename T>
+static void appendSnapshotValue(std::vector<uint8>& data, const T& value)
+{
+	appendSnapshotBytes(data, &value, sizeof(T));
+}
+
+struct physics_snapshot_reader
+{
+	const uint8* data;
+	uint64 size;
+	uint64 offset = 0;
+
+	const uint8* read(uint64 s)
+	{
+		if (size - offset < s)
+		{
+			offset = size;
+			valid = false;
+			return 0;
+		}
+		const uint8* result = data + offset;
+		offset += s;
+		return result;
+	}
+
+	template <typename T>
+	T readValue()
+	{
+		T result = {};
+		if (const uint8* p = read(sizeof(T)))
+		{
+			memcpy(&result, p, sizeof(T));
+		}
+		return result;
+	}
+
+	bool valid = true;
+};
+
+// Pools are stored in the storage's packed order, which is also the order in which the simulation iterates them. 
+// Restoring writes the components back in place, so that this order (and with it the floating point results) is preserved.
+template <typename component_t>
+static void savePhysicsSnapshotPool(entt::registry& registry, std::vector<uint8>& data)
+{
+	static_assert(std::is_trivially_copyable_v<component_t>);
+
+	auto& s = registry.storage<component_t>();
+	uint32 count = (uint32)s.size();
+
+	appendSnapshotValue(data, count);
+	appendSnapshotBytes(data, s.data(), sizeof(entity_handle) * count);
+	for (const component_t& component : s)
+	{
+		appendSnapshotValue(data, component);
+	}
+}
+
+// Returns false if the entities owning the component differ from the snapshot. Only writes if apply is set.
+template <typename component_t>
+static bool restorePhysicsSnapshotPool(entt::registry& registry, physics_snapshot_reader& reader, bool apply)
+{
+	auto& s = registry.storage<component_t>();
+	uint32 count = reader.readValue<uint32>();
+	const uint8* entities = reader.read(sizeof(entity_handle) * count);
+	const uint8* components = reader.read(sizeof(component_t) * count);
+
+	if (!reader.valid || count != (uint32)s.size() || memcmp(entities, s.data(), sizeof(entity_handle) * count) != 0)
+	{
+		return false;
+	}
+
+	if (apply)
+	{
+		for (component_t& component : s)
+		{
+			memcpy(&component, components, sizeof(component_t));
+			components += sizeof(component_t);
+		}
+	}
+	return true;
+}
+
+template <typename element_t>
+static void savePhysicsSnapshotVector(const std::vector<element_t>& v, std::vector<uint8>& data)
+{
+	appendSnapshotValue(data, (uint32)v.size());
+	appendSnapshotBytes(data, v.data(), sizeof(element_t) * v.size());
+}
+
+template <typename element_t>
+static void restorePhysicsSnapshotVector(std::vector<element_t>& v, physics_snapshot_reader& reader)
+{
+	uint32 count = reader.readValue<uint32>();
+	const uint8* elements = reader.read(sizeof(element_t) * count);
+	if (reader.valid)
+	{
+		v.resize(count);
+		memcpy(v.data(), elements, sizeof(element_t) * count);
+	}
+}
+
+using physics_snapshot_components = component_group_t<
+	rigid_body_component,
+	physics_transform0_component,
+	physics_transform1_component,
+	sap_endpoint_indirection_component,
+
+	distance_constraint,
+	ball_constraint,
+	fixed_constraint,
+	hinge_constraint,
+	cone_twist_constraint,
+	slider_constraint
+>;
+
+template <typename... component_t>
+static void savePhysicsSnapshotPools(component_group_t<component_t...>, entt::registry& registry, std::vector<uint8>& data)
+{
+	(savePhysicsSnapshotPool<component_t>(registry, data), ...);
+}
+
+template <typename... component_t>
+static bool restorePhysicsSnapshotPools(component_group_t<component_t...>, entt::registry& registry, physics_snapshot_reader& reader, bool apply)
+{
+	return (restorePhysicsSnapshotPool<component_t>(registry, reader, apply) && ...);
+}
+
+void savePhysicsSnapshot(game_scene& scene, float timer, physics_snapshot& snapshot)
+{
+	CPU_PROFILE_BLOCK("Save physics snapshot");
+
+	snapshot.timer = timer;
+
+	std::vector<uint8>& data = snapshot.data;
+	data.clear();
+
+	appendSnapshotValue(data, (uint32)PHYSICS_SNAPSHOT_VERSION);
+	savePhysicsSnapshotPools(physics_snapshot_components{}, scene.registry, data);
+
+	event_context& events = scene.createOrGetContextVariable<event_context>();
+	savePhysicsSnapshotVector(events.prevFrameTriggerOverlaps, data);
+	savePhysicsSnapshotVector(events.prevFrameCollisions, data);
+
+	// Broadphase last, since it has a variable size.
+	saveBroadphaseState(scene, data);
+}
+
+bool restorePhysicsSnapshot(game_scene& scene, const physics_snapshot& snapshot, float& timer)
+{
+	CPU_PROFILE_BLOCK("Restore physics snapshot");
+
+	physics_snapshot_reader reader = { snapshot.data.data(), snapshot.data.size() };
+	if (reader.readValue<uint32>() != PHYSICS_SNAPSHOT_VERSION)
+	{
+		return false;
+	}
+
+	// Validate all pools before touching anything, so that a failed restore leaves the scene unchanged.
+	physics_snapshot_reader validationReader = reader;
+	if (!restorePhysicsSnapshotPools(physics_snapshot_components{}, scene.registry, validationReader, false))
+	{
+		return false;
+	}
+
+	event_context events;
+	restorePhysicsSnapshotVector(events.prevFrameTriggerOverlaps, validationReader);
+	restorePhysicsSnapshotVector(events.prevFrameCollisions, validationReader);
+	if (!validationReader.valid
+		|| !restoreBroadphaseState(scene, validationReader.data + validationReader.offset, validationReader.size - validationReader.offset, false))
+	{
+		return false;
+	}
+
+	restorePhysicsSnapshotPools(physics_snapshot_components{}, scene.registry, reader, true);
+	scene.createOrGetContextVariable<event_context>() = std::move(events);
+	restoreBroadphaseState(scene, validationReader.data + validationReader.offset, validationReader.size - validationReader.offset, true);
+	timer = snapshot.timer;
+
+	return true;
+}
+
+bool rewindAndResimulatePhysics(game_scene& scene, memory_arena& arena, const physics_snapshot& snapshot, const physics_settings& settings, 
+	float& timer, const float* frameDts, uint32 numFrames, const physics_resimulate_frame_func& beforeFrame)
+{
+	CPU_PROFILE_BLOCK("Resimulate physics");
+
+	if (!restorePhysicsSnapshot(scene, snapshot, timer))
+	{
+		return false;
+	}
+
+	// Replay whole frames through physicsStep, so that the steps are grouped into frames and the physics transforms are rotated 
+	// exactly as in the original run. This also re-interpolates the transform components for rendering.
+	for (uint32 frame = 0; frame < numFrames; ++frame)
+	{
+		if (beforeFrame)
+		{
+			beforeFrame(frame);
+		}
+
+		physicsStep(scene, arena, timer, settings, frameDts[frame]);
+	}
+
+	return true;
+}
+
 // This function returns the inertia tensors with respect to the center of gravity, so with a coordinate system centered at the COG.
 physics_properties collider_union::calculatePhysicsProperties()
 {
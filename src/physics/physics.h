@@ -395,6 +395,10 @@ struct physics_settings
 	bool simdNarrowPhase = true;
 	bool simdConstraintSolver = true;
 
+	// Only affects rigid bodies with continuousCollision set.
+	bool continuousCollisionDetection = true;
+	uint32 maxCCDSubsteps = 4;
+
 	collision_begin_event_func collisionBeginCallback;
 	collision_end_event_func collisionEndCallback;
 };
@@ -402,4 +406,29 @@ struct physics_settings
 
 
 void testPhysicsInteraction(game_scene& scene, ray r, float strength = 1000.f);
+
+// World space colliders and bounding boxes in the iteration order of the collider pool. Colliders without rigid body get the dummy index.
+void getWorldSpaceColliders(game_scene& scene, bounding_box* outWorldSpaceAABBs, collider_union* outWorldSpaceColliders, uint16 dummyRigidBodyIndex);
 void physicsStep(game_scene& scene, memory_arena& arena, float& timer, const physics_settings& settings, float dt);
+
+
+// Compact binary copy of the rigid body simulation state: Rigid body velocities and accumulators, physics transforms, constraint
+// parameters, the broadphase and the collision/trigger event history. Static data (colliders, meshes, terrain) is not included, 
+// neither is cloth. A snapshot can only be restored as long as no physics entities have been added or removed since it was taken.
+struct physics_snapshot
+{
+	std::vector<uint8> data;
+	float timer = 0.f; // Physics timer (see physicsStep) at the time of the snapshot.
+};
+
+typedef std::function<void(uint32 frame)> physics_resimulate_frame_func;
+
+// Take snapshots between frames. The timer is the one passed to physicsStep and is restored with the snapshot.
+void savePhysicsSnapshot(game_scene& scene, float timer, physics_snapshot& snapshot);
+bool restorePhysicsSnapshot(game_scene& scene, const physics_snapshot& snapshot, float& timer);
+
+// Restores the snapshot and replays numFrames frames through physicsStep with the recorded frame times. Calls beforeFrame (if set) 
+// before each frame, e.g. to re-apply recorded inputs. Given the same snapshot, settings, frame times and inputs, the result 
+// (including the interpolated transform components) is bit-identical to the original simulation.
+bool rewindAndResimulatePhysics(game_scene& scene, memory_arena& arena, const physics_snapshot& snapshot, const physics_settings& settings, 
+	float& timer, const float* frameDts, uint32 numFrames, const physics_resimulate_frame_func& beforeFrame = nullptr);
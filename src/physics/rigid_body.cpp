@@ -24,6 +24,7 @@ rigid_body_component::rigid_body_component(bool kinematic, float gravityFactor,
 	this->angularVelocity = vec3(0.f);
 	this->forceAccumulator = vec3(0.f);
 	this->torqueAccumulator = vec3(0.f);
+	this->continuousCollision = false;
 }
 
 void rigid_body_component::recalculateProperties(entt::registry* registry, const physics_reference_component& reference)
@@ -43,6 +43,9 @@ struct rigid_body_component
 
 	vec3 forceAccumulator;
 	vec3 torqueAccumulator;
+
+	// Opt-in continuous collision detection for fast, small bodies like projectiles. See collision_ccd.h.
+	bool continuousCollision;
 };
 
 struct physics_transform0_component : trs 
@@ -0,0 +1,686 @@
+#include "pch.h"
+#include "scene_query.h"
+#include "collision_ccd.h"
+#include "collision_gjk.h"
+#include "terrain/heightmap_collider.h"
+#include "core/math_simd.h"
+#include "core/threading.h"
+#include "core/cpu_profiling.h"
+
+#include <algorithm>
+
+
+#define SCENE_QUERY_MAX_LEAF_SIZE 4
+#define SCENE_QUERY_STACK_SIZE 256
+#define SCENE_QUERIES_PER_JOB 256
+
+static const float sweepTolerance = 1e-3f;
+static const uint32 sweepMaxIterations = 32;
+
+
+static bounding_box getColliderAABB(const collider_union& c)
+{
+	switch (c.type)
+	{
+		case collider_type_sphere: return bounding_box::fromCenterRadius(c.sphere.center, vec3(c.sphere.radius));
+		case collider_type_capsule:
+		{
+			vec3 radius(c.capsule.radius);
+			return bounding_box::fromMinMax(min(c.capsule.positionA, c.capsule.positionB) - radius, max(c.capsule.positionA, c.capsule.positionB) + radius);
+		}
+		case collider_type_cylinder:
+		{
+			// Conservative: Treat the cylinder like a capsule.
+			vec3 radius(c.cylinder.radius);
+			return bounding_box::fromMinMax(min(c.cylinder.positionA, c.cylinder.positionB) - radius, max(c.cylinder.positionA, c.cylinder.positionB) + radius);
+		}
+		case collider_type_aabb: return c.aabb;
+		case collider_type_obb: return c.obb.getAABB();
+		default: return c.hull.geometryPtr->aabb.transformToAABB(c.hull.rotation, c.hull.position);
+	}
+}
+
+// Normal of the collider's surface at a point on (or very close to) the surface. Hulls are handled by the ray test directly.
+static vec3 getSurfaceNormal(const collider_union& c, vec3 p)
+{
+	switch (c.type)
+	{
+		case collider_type_sphere: return noz(p - c.sphere.center);
+		case collider_type_capsule: return noz(p - closestPoint_PointSegment(p, line_segment{ c.capsule.positionA, c.capsule.positionB }));
+		case collider_type_cylinder:
+		{
+			vec3 axis = c.cylinder.positionB - c.cylinder.positionA;
+			float height = length(axis);
+			axis /= height;
+
+			float s = dot(p - c.cylinder.positionA, axis);
+			vec3 radial = p - (c.cylinder.positionA + axis * s);
+
+			// Pick the closer feature: One of the caps or the side.
+			float capDistance = min(s, height - s);
+			float sideDistance = c.cylinder.radius - length(radial);
+			if (capDistance < sideDistance)
+			{
+				return (s < 0.5f * height) ? -axis : axis;
+			}
+			return noz(radial);
+		}
+		case collider_type_aabb:
+		case collider_type_obb:
+		{
+			quat rotation = (c.type == collider_type_aabb) ? quat::identity : c.obb.rotation;
+			vec3 center = (c.type == collider_type_aabb) ? c.aabb.getCenter() : c.obb.center;
+			vec3 radius = (c.type == collider_type_aabb) ? c.aabb.getRadius() : c.obb.radius;
+
+			vec3 local = (conjugate(rotation) * (p - center)) / radius;
+			vec3 a = abs(local);
+
+			vec3 n(0.f);
+			uint32 axis = (a.x > a.y) ? ((a.x > a.z) ? 0 : 2) : ((a.y > a.z) ? 1 : 2);
+			n.data[axis] = (local.data[axis] < 0.f) ? -1.f : 1.f;
+			return rotation * n;
+		}
+		default: return vec3(0.f, 1.f, 0.f);
+	}
+}
+
+static bool rayVsHull(const ray& r, const bounding_hull& hull, float& outT, vec3& outNormal)
+{
+	const bounding_hull_geometry& geometry = *hull.geometryPtr;
+	ray localR = { conjugate(hull.rotation) * (r.origin - hull.position), conjugate(hull.rotation) * r.direction };
+
+	float minT = FLT_MAX;
+	bool result = false;
+
+	for (const bounding_hull_face& face : geometry.faces)
+	{
+		vec3 a = geometry.vertices[face.a];
+		vec3 b = geometry.vertices[face.b];
+		vec3 c = geometry.vertices[face.c];
+
+		float t;
+		bool frontFacing;
+		if (localR.intersectTriangle(a, b, c, t, frontFacing) && t < minT)
+		{
+			minT = t;
+			outNormal = face.normal;
+			result = true;
+		}
+	}
+
+	outT = minT;
+	outNormal = hull.rotation * outNormal;
+	return result;
+}
+
+static bool rayVsCollider(const ray& r, const collider_union& c, float& outT, vec3& outNormal)
+{
+	bool hit = false;
+	switch (c.type)
+	{
+		case collider_type_sphere: hit = r.intersectSphere(c.sphere, outT); break;
+		case collider_type_capsule: hit = r.intersectCapsule(c.capsule, outT); break;
+		case collider_type_cylinder: hit = r.intersectCylinder(c.cylinder, outT); break;
+		case collider_type_aabb: hit = r.intersectAABB(c.aabb, outT); break;
+		case collider_type_obb: hit = r.intersectOBB(c.obb, outT); break;
+		case collider_type_hull: return rayVsHull(r, c.hull, outT, outNormal) && outT >= 0.f;
+	}
+
+	if (!hit || outT < 0.f)
+	{
+		return false;
+	}
+
+	outNormal = getSurfaceNormal(c, r.origin + r.direction * outT);
+	return true;
+}
+
+// Linear cast of one convex shape against another. Each iteration advances the shape to the separating plane found by GJK, which
+// can never overshoot the first contact.
+static bool sweepVsCollider(const collider_union& shape, vec3 direction, const collider_union& collider, float maxDistance,
+	float& outT, vec3& outPoint, vec3& outNormal)
+{
+	float t = 0.f;
+	gjk_distance_result distance;
+	bool hasDistance = false;
+
+	for (uint32 it = 0; it < sweepMaxIterations; ++it)
+	{
+		collider_union moved = moveCollider(shape, quat::identity, vec3(0.f), direction * t);
+
+		gjk_distance_result current;
+		if (!colliderDistance(moved, collider, current))
+		{
+			if (!hasDistance)
+			{
+				// Initial overlap.
+				outT = 0.f;
+				outPoint = getColliderAABB(shape).getCenter();
+				outNormal = -direction;
+				return true;
+			}
+			break; // Within the tolerance of the distance query.
+		}
+
+		distance = current;
+		hasDistance = true;
+
+		if (distance.distance <= sweepTolerance)
+		{
+			break;
+		}
+
+		float approach = dot(direction, distance.normal);
+		if (approach <= 0.f)
+		{
+			return false;
+		}
+
+		t += distance.distance / approach;
+		if (t >= maxDistance)
+		{
+			return false;
+		}
+	}
+
+	outT = t;
+	outPoint = distance.pointB;
+	outNormal = -distance.normal;
+	return true;
+}
+
+static bool passesFilter(const collider_union& c, const scene_query_filter& filter)
+{
+	return (filter.objectTypes & (1 << c.objectType)) != 0;
+}
+
+void scene_query_world::build(game_scene& scene)
+{
+	CPU_PROFILE_BLOCK("Build scene query world");
+
+	uint32 numColliders = scene.numberOfComponentsOfType<collider_component>();
+
+	std::vector<bounding_box> worldAABBs(numColliders);
+	std::vector<collider_union> worldColliders(numColliders);
+	getWorldSpaceColliders(scene, worldAABBs.data(), worldColliders.data(), UINT16_MAX);
+
+	// Same iteration order as above.
+	std::vector<entity_handle> worldEntities;
+	worldEntities.reserve(numColliders);
+	for (auto [entityHandle, collider] : scene.view<collider_component>().each())
+	{
+		worldEntities.push_back(collider.parentEntity);
+	}
+
+	std::vector<uint32> indices(numColliders);
+	std::vector<vec3> centers(numColliders);
+	for (uint32 i = 0; i < numColliders; ++i)
+	{
+		indices[i] = i;
+		centers[i] = worldAABBs[i].getCenter();
+	}
+
+	nodes.clear();
+	if (numColliders)
+	{
+		nodes.reserve(numColliders / SCENE_QUERY_MAX_LEAF_SIZE + 1);
+		buildNode(indices.data(), 0, numColliders, worldAABBs.data(), centers.data());
+	}
+
+	// Store the colliders in the order of the leaves.
+	colliders.resize(numColliders);
+	aabbs.resize(numColliders);
+	entities.resize(numColliders);
+	for (uint32 i = 0; i < numColliders; ++i)
+	{
+		colliders[i] = worldColliders[indices[i]];
+		aabbs[i] = worldAABBs[indices[i]];
+		entities[i] = worldEntities[indices[i]];
+	}
+
+	heightmaps.clear();
+	for (auto [entityHandle, heightmap] : scene.view<heightmap_collider_component>().each())
+	{
+		heightmaps.push_back({ entityHandle, &heightmap });
+	}
+}
+
+uint32 scene_query_world::buildNode(uint32* indices, uint32 first, uint32 count, const bounding_box* primitiveAABBs, const vec3* centers)
+{
+	uint32 nodeIndex = (uint32)nodes.size();
+	nodes.emplace_back();
+
+	struct primitive_range
+	{
+		uint32 first;
+		uint32 count;
+	};
+
+	// Split the largest range at the median of its longest axis, until there are 8 ranges or all ranges fit into leaves.
+	primitive_range ranges[8];
+	ranges[0] = { first, count };
+	uint32 numRanges = 1;
+
+	while (numRanges < 8)
+	{
+		int32 largest = -1;
+		for (uint32 r = 0; r < numRanges; ++r)
+		{
+			if (ranges[r].count > SCENE_QUERY_MAX_LEAF_SIZE && (largest == -1 || ranges[r].count > ranges[largest].count))
+			{
+				largest = r;
+			}
+		}
+
+		if (largest == -1)
+		{
+			break;
+		}
+
+		primitive_range& range = ranges[largest];
+
+		bounding_box centerBounds = bounding_box::negativeInfinity();
+		for (uint32 i = range.first; i < range.first + range.count; ++i)
+		{
+			centerBounds.grow(centers[indices[i]]);
+		}
+
+		vec3 extent = centerBounds.maxCorner - centerBounds.minCorner;
+		uint32 axis = (extent.x > extent.y) ? ((extent.x > extent.z) ? 0 : 2) : ((extent.y > extent.z) ? 1 : 2);
+
+		uint32 half = range.count / 2;
+		std::nth_element(indices + range.first, indices + range.first + half, indices + range.first + range.count,
+			[centers, axis](uint32 a, uint32 b) { return centers[a].data[axis] < centers[b].data[axis]; });
+
+		ranges[numRanges++] = { range.first + half, range.count - half };
+		range.count = half;
+	}
+
+	for (uint32 r = 0; r < numRanges; ++r)
+	{
+		bounding_box bounds = bounding_box::negativeInfinity();
+		for (uint32 i = ranges[r].first; i < ranges[r].first + ranges[r].count; ++i)
+		{
+			const bounding_box& aabb = primitiveAABBs[indices[i]];
+			bounds.grow(aabb.minCorner);
+			bounds.grow(aabb.maxCorner);
+		}
+
+		uint32 child = ranges[r].first;
+		uint8 childCount = (uint8)ranges[r].count;
+		if (ranges[r].count > SCENE_QUERY_MAX_LEAF_SIZE)
+		{
+			child = buildNode(indices, ranges[r].first, ranges[r].count, primitiveAABBs, centers);
+			childCount = 0;
+		}
+
+		// The vector may have grown during the recursion.
+		scene_query_bvh_node& node = nodes[nodeIndex];
+		node.minX[r] = bounds.minCorner.x; node.minY[r] = bounds.minCorner.y; node.minZ[r] = bounds.minCorner.z;
+		node.maxX[r] = bounds.maxCorner.x; node.maxY[r] = bounds.maxCorner.y; node.maxZ[r] = bounds.maxCorner.z;
+		node.children[r] = child;
+		node.counts[r] = childCount;
+	}
+
+	scene_query_bvh_node& node = nodes[nodeIndex];
+	node.numChildren = numRanges;
+	for (uint32 r = numRanges; r < 8; ++r)
+	{
+		// Unused lanes are masked out during traversal, but should not contain garbage.
+		node.minX[r] = node.minY[r] = node.minZ[r] = 0.f;
+		node.maxX[r] = node.maxY[r] = node.maxZ[r] = 0.f;
+		node.children[r] = 0;
+		node.counts[r] = 0;
+	}
+
+	return nodeIndex;
+}
+
+// Front-to-back traversal for rays and sweeps. The node bounds are expanded by the extent of the swept box. The leaf function may
+// shrink maxDistance, which culls the remaining nodes.
+template <typename leaf_func>
+void scene_query_world::traverse(vec3 origin, vec3 direction, vec3 extent, float& maxDistance, const leaf_func& func) const
+{
+	if (nodes.empty())
+	{
+		return;
+	}
+
+	// Avoid 0 * inf in the slab test for axis aligned directions.
+	vec3 invDirection = 1.f / vec3(
+		(direction.x == 0.f) ? 1e-20f : direction.x,
+		(direction.y == 0.f) ? 1e-20f : direction.y,
+		(direction.z == 0.f) ? 1e-20f : direction.z);
+
+	w8_float originX = origin.x, originY = origin.y, originZ = origin.z;
+	w8_float invDirX = invDirection.x, invDirY = invDirection.y, invDirZ = invDirection.z;
+	w8_float extentX = extent.x, extentY = extent.y, extentZ = extent.z;
+
+	struct stack_entry
+	{
+		uint32 node;
+		float distance;
+	};
+
+	stack_entry stack[SCENE_QUERY_STACK_SIZE];
+	uint32 stackSize = 0;
+	stack[stackSize++] = { 0, 0.f };
+
+	while (stackSize)
+	{
+		stack_entry entry = stack[--stackSize];
+		if (entry.distance > maxDistance)
+		{
+			continue;
+		}
+
+		const scene_query_bvh_node& node = nodes[entry.node];
+
+		w8_float tx0 = (w8_float(node.minX) - extentX - originX) * invDirX;
+		w8_float tx1 = (w8_float(node.maxX) + extentX - originX) * invDirX;
+		w8_float ty0 = (w8_float(node.minY) - extentY - originY) * invDirY;
+		w8_float ty1 = (w8_float(node.maxY) + extentY - originY) * invDirY;
+		w8_float tz0 = (w8_float(node.minZ) - extentZ - originZ) * invDirZ;
+		w8_float tz1 = (w8_float(node.maxZ) + extentZ - originZ) * invDirZ;
+
+		w8_float tNear = maximum(maximum(minimum(tx0, tx1), minimum(ty0, ty1)), maximum(minimum(tz0, tz1), 0.f));
+		w8_float tFar = minimum(minimum(maximum(tx0, tx1), maximum(ty0, ty1)), minimum(maximum(tz0, tz1), maxDistance));
+
+		uint32 mask = (uint32)toBitMask(tNear <= tFar) & ((1u << node.numChildren) - 1);
+
+		float nearDistances[8];
+		tNear.store(nearDistances);
+
+		stack_entry children[8];
+		uint32 numChildren = 0;
+
+		while (mask)
+		{
+			uint32 i = indexOfLeastSignificantSetBit(mask);
+			mask &= mask - 1;
+
+			if (node.counts[i])
+			{
+				func(node.children[i], (uint32)node.counts[i], maxDistance);
+			}
+			else
+			{
+				children[numChildren++] = { node.children[i], nearDistances[i] };
+			}
+		}
+
+		// Push far to near, so that the nearest child is popped first.
+		std::sort(children, children + numChildren, [](const stack_entry& a, const stack_entry& b) { return a.distance > b.distance; });
+
+		ASSERT(stackSize + numChildren <= SCENE_QUERY_STACK_SIZE);
+		for (uint32 i = 0; i < numChildren; ++i)
+		{
+			stack[stackSize++] = children[i];
+		}
+	}
+}
+
+template <typename leaf_func>
+void scene_query_world::traverse(const bounding_box& volume, const leaf_func& func) const
+{
+	if (nodes.empty())
+	{
+		return;
+	}
+
+	w8_float volumeMinX = volume.minCorner.x, volumeMinY = volume.minCorner.y, volumeMinZ = volume.minCorner.z;
+	w8_float volumeMaxX = volume.maxCorner.x, volumeMaxY = volume.maxCorner.y, volumeMaxZ = volume.maxCorner.z;
+
+	uint32 stack[SCENE_QUERY_STACK_SIZE];
+	uint32 stackSize = 0;
+	stack[stackSize++] = 0;
+
+	while (stackSize)
+	{
+		const scene_query_bvh_node& node = nodes[stack[--stackSize]];
+
+		uint32 mask = (1u << node.numChildren) - 1;
+		mask &= toBitMask(w8_float(node.minX) <= volumeMaxX) & toBitMask(w8_float(node.maxX) >= volumeMinX);
+		mask &= toBitMask(w8_float(node.minY) <= volumeMaxY) & toBitMask(w8_float(node.maxY) >= volumeMinY);
+		mask &= toBitMask(w8_float(node.minZ) <= volumeMaxZ) & toBitMask(w8_float(node.maxZ) >= volumeMinZ);
+
+		while (mask)
+		{
+			uint32 i = indexOfLeastSignificantSetBit(mask);
+			mask &= mask - 1;
+
+			if (node.counts[i])
+			{
+				func(node.children[i], (uint32)node.counts[i]);
+			}
+			else
+			{
+				ASSERT(stackSize < SCENE_QUERY_STACK_SIZE);
+				stack[stackSize++] = node.children[i];
+			}
+		}
+	}
+}
+
+bool scene_query_world::raycast(const ray& r, float maxDistance, scene_query_hit& outHit, const scene_query_filter& filter) const
+{
+	float closest = maxDistance;
+	int32 hitCollider = -1;
+	vec3 hitNormal;
+
+	traverse(r.origin, r.direction, vec3(0.f), closest, [&](uint32 first, uint32 count, float& maxT)
+	{
+		for (uint32 i = first; i < first + count; ++i)
+		{
+			const collider_union& collider = colliders[i];
+
+			float t;
+			vec3 normal;
+			if (passesFilter(collider, filter) && rayVsCollider(r, collider, t, normal) && t < maxT)
+			{
+				maxT = t;
+				hitCollider = (int32)i;
+				hitNormal = normal;
+			}
+		}
+	});
+
+	bool result = false;
+	if (hitCollider != -1)
+	{
+		outHit = { closest, r.origin + r.direction * closest, hitNormal, entities[hitCollider] };
+		result = true;
+	}
+
+	if (filter.heightmaps)
+	{
+		for (const heightmap_reference& reference : heightmaps)
+		{
+			heightmap_hit hit;
+			if (reference.heightmap->raycast(r, closest, hit))
+			{
+				closest = hit.distance;
+				outHit = { hit.distance, hit.point, hit.normal, reference.entity };
+				result = true;
+			}
+		}
+	}
+
+	return result;
+}
+
+bool scene_query_world::sweep(const collider_union& shape, vec3 direction, float maxDistance, scene_query_hit& outHit, const scene_query_filter& filter) const
+{
+	bounding_box shapeAABB = getColliderAABB(shape);
+
+	vec3 end = direction * maxDistance;
+	bounding_box sweptAABB = bounding_box::fromMinMax(shapeAABB.minCorner + min(end, vec3(0.f)), shapeAABB.maxCorner + max(end, vec3(0.f)));
+
+	float closest = maxDistance;
+	bool result = false;
+
+	traverse(shapeAABB.getCenter(), direction, shapeAABB.getRadius(), closest, [&](uint32 first, uint32 count, float& maxT)
+	{
+		for (uint32 i = first; i < first + count; ++i)
+		{
+			const collider_union& collider = colliders[i];
+			if (!passesFilter(collider, filter) || !aabbVsAABB(sweptAABB, aabbs[i]))
+			{
+				continue;
+			}
+
+			float t;
+			vec3 point, normal;
+			if (sweepVsCollider(shape, direction, collider, maxT, t, point, normal) && t < maxT)
+			{
+				maxT = t;
+				outHit = { t, point, normal, entities[i] };
+				result = true;
+			}
+		}
+	});
+
+	if (filter.heightmaps && (shape.type == collider_type_sphere || shape.type == collider_type_capsule))
+	{
+		for (const heightmap_reference& reference : heightmaps)
+		{
+			heightmap_hit hit;
+			bool found = (shape.type == collider_type_sphere)
+				? reference.heightmap->sphereCast(shape.sphere, direction, closest, hit)
+				: reference.heightmap->capsuleCast(shape.capsule, direction, closest, hit);
+
+			if (found)
+			{
+				closest = hit.distance;
+				outHit = { hit.distance, hit.point, hit.normal, reference.entity };
+				result = true;
+			}
+		}
+	}
+
+	return result;
+}
+
+uint32 scene_query_world::overlap(const collider_union& shape, entity_handle* outEntities, uint32 maxNumEntities, const scene_query_filter& filter) const
+{
+	bounding_box shapeAABB = getColliderAABB(shape);
+
+	uint32 numEntities = 0;
+
+	traverse(shapeAABB, [&](uint32 first, uint32 count)
+	{
+		for (uint32 i = first; i < first + count && numEntities < maxNumEntities; ++i)
+		{
+			const collider_union& collider = colliders[i];
+			if (!passesFilter(collider, filter) || !aabbVsAABB(shapeAABB, aabbs[i]))
+			{
+				continue;
+			}
+
+			// Entities with multiple colliders are reported once.
+			if (std::find(outEntities, outEntities + numEntities, entities[i]) != outEntities + numEntities)
+			{
+				continue;
+			}
+
+			if (colliderIntersection(shape, collider))
+			{
+				outEntities[numEntities++] = entities[i];
+			}
+		}
+	});
+
+	return numEntities;
+}
+
+uint32 scene_query_world::raycast(const ray* rays, uint32 numRays, float maxDistance, scene_query_hit* outHits, const scene_query_filter& filter) const
+{
+	CPU_PROFILE_BLOCK("Batched scene raycast");
+
+	volatile uint32 numHits = 0;
+
+	thread_job_context context;
+	for (uint32 first = 0; first < numRays; first += SCENE_QUERIES_PER_JOB)
+	{
+		uint32 end = min(first + SCENE_QUERIES_PER_JOB, numRays);
+		context.addWork([this, rays, first, end, maxDistance, outHits, &filter, &numHits]()
+		{
+			uint32 jobNumHits = 0;
+			for (uint32 i = first; i < end; ++i)
+			{
+				if (raycast(rays[i], maxDistance, outHits[i], filter))
+				{
+					++jobNumHits;
+				}
+				else
+				{
+					outHits[i].distance = FLT_MAX;
+				}
+			}
+			atomicAdd(numHits, jobNumHits);
+		});
+	}
+	context.waitForWorkCompletion();
+
+	return numHits;
+}
+
+uint32 scene_query_world::sweep(const collider_union* shapes, const vec3* directions, uint32 numShapes, float maxDistance, scene_query_hit* outHits, const scene_query_filter& filter) const
+{
+	CPU_PROFILE_BLOCK("Batched scene sweep");
+
+	volatile uint32 numHits = 0;
+
+	thread_job_context context;
+	for (uint32 first = 0; first < numShapes; first += SCENE_QUERIES_PER_JOB)
+	{
+		uint32 end = min(first + SCENE_QUERIES_PER_JOB, numShapes);
+		context.addWork([this, shapes, directions, first, end, maxDistance, outHits, &filter, &numHits]()
+		{
+			uint32 jobNumHits = 0;
+			for (uint32 i = first; i < end; ++i)
+			{
+				if (sweep(shapes[i], directions[i], maxDistance, outHits[i], filter))
+				{
+					++jobNumHits;
+				}
+				else
+				{
+					outHits[i].distance = FLT_MAX;
+				}
+			}
+			atomicAdd(numHits, jobNumHits);
+		});
+	}
+	context.waitForWorkCompletion();
+
+	return numHits;
+}
+
+uint32 scene_query_world::overlap(const collider_union* shapes, uint32 numShapes, entity_handle* outEntities, uint32 maxOverlapsPerShape, uint32* outNumOverlaps,
+	const scene_query_filter& filter) const
+{
+	CPU_PROFILE_BLOCK("Batched scene overlap");
+
+	volatile uint32 numOverlaps = 0;
+
+	thread_job_context context;
+	for (uint32 first = 0; first < numShapes; first += SCENE_QUERIES_PER_JOB)
+	{
+		uint32 end = min(first + SCENE_QUERIES_PER_JOB, numShapes);
+		context.addWork([this, shapes, first, end, outEntities, maxOverlapsPerShape, outNumOverlaps, &filter, &numOverlaps]()
+		{
+			uint32 jobNumOverlaps = 0;
+			for (uint32 i = first; i < end; ++i)
+			{
+				outNumOverlaps[i] = overlap(shapes[i], outEntities + i * maxOverlapsPerShape, maxOverlapsPerShape, filter);
+				jobNumOverlaps += outNumOverlaps[i];
+			}
+			atomicAdd(numOverlaps, jobNumOverlaps);
+		});
+	}
+	context.waitForWorkCompletion();
+
+	return numOverlaps;
+}
+
@@ -0,0 +1,75 @@
+#pragma once
+
+#include "physics.h"
+
+struct heightmap_collider_component;
+
+
+struct scene_query_hit
+{
+	float distance; // FLT_MAX for misses in batched queries.
+	vec3 point;
+	vec3 normal; // Surface normal of the hit object.
+	entity_handle entity; // Parent entity of the hit collider, or the entity of the hit heightmap.
+};
+
+struct scene_query_filter
+{
+	uint32 objectTypes = (1 << physics_object_type_rigid_body) | (1 << physics_object_type_static_collider); // Bit mask of physics_object_type.
+	bool heightmaps = true;
+};
+
+struct scene_query_bvh_node
+{
+	// Bounds of the up to 8 children, tested together.
+	float minX[8], minY[8], minZ[8];
+	float maxX[8], maxY[8], maxZ[8];
+
+	uint32 children[8]; // Node index for inner children, index of the first collider for leaves.
+	uint8 counts[8]; // Number of colliders for leaves, 0 for inner children.
+	uint32 numChildren;
+};
+
+// Snapshot of the colliders (and heightmaps) of a scene for gameplay queries. Build it once per frame, e.g. after the physics step,
+// and query it from any number of threads. The colliders are stored in world space in an 8-wide bounding volume hierarchy, so that
+// each traversal step tests 8 boxes at once. The snapshot references the hull geometries and heightmaps of the scene, so it must be
+// rebuilt when these are added or removed.
+//
+// Query shapes are world space colliders (sphere, capsule, cylinder, box or hull). Sweeps against heightmaps only support spheres and
+// capsules, overlaps ignore heightmaps.
+struct scene_query_world
+{
+	void build(game_scene& scene);
+
+	bool raycast(const ray& r, float maxDistance, scene_query_hit& outHit, const scene_query_filter& filter = {}) const; // Direction must be normalized.
+	bool sweep(const collider_union& shape, vec3 direction, float maxDistance, scene_query_hit& outHit, const scene_query_filter& filter = {}) const;
+	uint32 overlap(const collider_union& shape, entity_handle* outEntities, uint32 maxNumEntities, const scene_query_filter& filter = {}) const; // Each entity is reported once.
+
+	// Batched versions. These distribute the queries over the job system and return the number of hits (or total number of overlaps).
+	uint32 raycast(const ray* rays, uint32 numRays, float maxDistance, scene_query_hit* outHits, const scene_query_filter& filter = {}) const;
+	uint32 sweep(const collider_union* shapes, const vec3* directions, uint32 numShapes, float maxDistance, scene_query_hit* outHits, const scene_query_filter& filter = {}) const;
+	uint32 overlap(const collider_union* shapes, uint32 numShapes, entity_handle* outEntities, uint32 maxOverlapsPerShape, uint32* outNumOverlaps,
+		const scene_query_filter& filter = {}) const; // Overlaps of shape i start at outEntities[i * maxOverlapsPerShape].
+
+	uint32 numColliders() const { return (uint32)colliders.size(); }
+
+private:
+	struct heightmap_reference
+	{
+		entity_handle entity;
+		const heightmap_collider_component* heightmap;
+	};
+
+	uint32 buildNode(uint32* indices, uint32 first, uint32 count, const bounding_box* primitiveAABBs, const vec3* centers);
+
+	template <typename leaf_func>
+	void traverse(vec3 origin, vec3 direction, vec3 extent, float& maxDistance, const leaf_func& func) const;
+	template <typename leaf_func>
+	void traverse(const bounding_box& volume, const leaf_func& func) const;
+
+	std::vector<collider_union> colliders; // In hierarchy order.
+	std::vector<bounding_box> aabbs;
+	std::vector<entity_handle> entities;
+	std::vector<scene_query_bvh_node> nodes;
+	std::vector<heightmap_reference> heightmaps;
+};
@@ -0,0 +1,177 @@
+#include "pch.h"
+#include "frustum_culling.h"
+
+#include "core/math_simd.h"
+#include "core/threading.h"
+
+
+#define CULLING_OBJECTS_PER_JOB 1024
+
+static const float alwaysVisibleRadius = 1e30f;
+static const float neverVisibleRadius = -1e30f;
+
+
+void culling_objects::initialize(memory_arena& arena, uint32 numObjects)
+{
+	this->numObjects = numObjects;
+	this->numPaddedObjects = alignTo(numObjects, 64);
+
+	const uint32 numStreams = 16;
+	float* data = (float*)arena.allocate(sizeof(float) * numPaddedObjects * numStreams, 64);
+
+	float** streams[numStreams] =
+	{
+		&positionX, &positionY, &positionZ,
+		&rotationX, &rotationY, &rotationZ, &rotationW,
+		&scaleX, &scaleY, &scaleZ,
+		&centerX, &centerY, &centerZ,
+		&radiusX, &radiusY, &radiusZ,
+	};
+
+	for (uint32 i = 0; i < numStreams; ++i)
+	{
+		*streams[i] = data + i * numPaddedObjects;
+	}
+
+	for (uint32 i = numObjects; i < numPaddedObjects; ++i)
+	{
+		setNeverVisible(i);
+	}
+}
+
+void culling_objects::set(uint32 index, const bounding_box& aabb, const trs& transform)
+{
+	vec3 center = (aabb.minCorner + aabb.maxCorner) * 0.5f;
+	vec3 radius = (aabb.maxCorner - aabb.minCorner) * 0.5f;
+
+	positionX[index] = transform.position.x;
+	positionY[index] = transform.position.y;
+	positionZ[index] = transform.position.z;
+
+	rotationX[index] = transform.rotation.x;
+	rotationY[index] = transform.rotation.y;
+	rotationZ[index] = transform.rotation.z;
+	rotationW[index] = transform.rotation.w;
+
+	scaleX[index] = transform.scale.x;
+	scaleY[index] = transform.scale.y;
+	scaleZ[index] = transform.scale.z;
+
+	centerX[index] = center.x;
+	centerY[index] = center.y;
+	centerZ[index] = center.z;
+
+	radiusX[index] = radius.x;
+	radiusY[index] = radius.y;
+	radiusZ[index] = radius.z;
+}
+
+void culling_objects::setAlwaysVisible(uint32 index)
+{
+	bounding_box aabb = { vec3(-alwaysVisibleRadius), vec3(alwaysVisibleRadius) };
+	set(index, aabb, trs::identity);
+}
+
+void culling_objects::setNeverVisible(uint32 index)
+{
+	// Negative radius. Every plane and sphere test fails for this box.
+	bounding_box aabb = { vec3(-neverVisibleRadius), vec3(neverVisibleRadius) };
+	set(index, aabb, trs::identity);
+}
+
+static void cullObjectRange(const culling_objects& objects, const culling_view* views, uint32 numViews, culling_result result, uint32 first, uint32 end)
+{
+	for (uint32 i = first; i < end; i += 8)
+	{
+		w8_vec3 position(w8_float(objects.positionX + i), w8_float(objects.positionY + i), w8_float(objects.positionZ + i));
+		w8_quat rotation(w8_float(objects.rotationX + i), w8_float(objects.rotationY + i), w8_float(objects.rotationZ + i), w8_float(objects.rotationW + i));
+		w8_vec3 scale(w8_float(objects.scaleX + i), w8_float(objects.scaleY + i), w8_float(objects.scaleZ + i));
+		w8_vec3 center(w8_float(objects.centerX + i), w8_float(objects.centerY + i), w8_float(objects.centerZ + i));
+		w8_vec3 radius(w8_float(objects.radiusX + i), w8_float(objects.radiusY + i), w8_float(objects.radiusZ + i));
+
+		// Rotation matrix from quaternion.
+		w8_float xx = rotation.x * rotation.x, yy = rotation.y * rotation.y, zz = rotation.z * rotation.z;
+		w8_float xy = rotation.x * rotation.y, xz = rotation.x * rotation.z, yz = rotation.y * rotation.z;
+		w8_float wx = rotation.w * rotation.x, wy = rotation.w * rotation.y, wz = rotation.w * rotation.z;
+
+		w8_float m00 = 1.f - 2.f * (yy + zz), m01 = 2.f * (xy - wz), m02 = 2.f * (xz + wy);
+		w8_float m10 = 2.f * (xy + wz), m11 = 1.f - 2.f * (xx + zz), m12 = 2.f * (yz - wx);
+		w8_float m20 = 2.f * (xz - wy), m21 = 2.f * (yz + wx), m22 = 1.f - 2.f * (xx + yy);
+
+		// World-space AABB: Transformed center and the extents of the rotated box.
+		w8_vec3 c = center * scale;
+		w8_vec3 r = radius * abs(scale);
+
+		w8_vec3 worldCenter(
+			fmadd(m00, c.x, fmadd(m01, c.y, fmadd(m02, c.z, position.x))),
+			fmadd(m10, c.x, fmadd(m11, c.y, fmadd(m12, c.z, position.y))),
+			fmadd(m20, c.x, fmadd(m21, c.y, fmadd(m22, c.z, position.z))));
+
+		w8_vec3 worldRadius(
+			fmadd(abs(m00), r.x, fmadd(abs(m01), r.y, abs(m02) * r.z)),
+			fmadd(abs(m10), r.x, fmadd(abs(m11), r.y, abs(m12) * r.z)),
+			fmadd(abs(m20), r.x, fmadd(abs(m21), r.y, abs(m22) * r.z)));
+
+		uint32 word = i >> 6;
+		uint32 shift = i & 63;
+
+		for (uint32 v = 0; v < numViews; ++v)
+		{
+			const culling_view& view = views[v];
+
+			int mask = (1 << 8) - 1;
+
+			if (view.type == culling_view_frustum)
+			{
+				for (uint32 p = 0; p < 6 && mask; ++p)
+				{
+					vec4 plane = view.frustum.planes[p];
+
+					// Signed distance of the box's positive vertex.
+					w8_float d = fmadd(worldCenter.x, plane.x, fmadd(worldCenter.y, plane.y, fmadd(worldCenter.z, plane.z, plane.w)));
+					d = fmadd(worldRadius.x, abs(plane.x), fmadd(worldRadius.y, abs(plane.y), fmadd(worldRadius.z, abs(plane.z), d)));
+
+					mask &= toBitMask(d >= 0.f);
+				}
+			}
+			else
+			{
+				w8_vec3 s(view.sphere.center.x, view.sphere.center.y, view.sphere.center.z);
+				w8_vec3 e = abs(s - worldCenter) - worldRadius;
+				e = w8_vec3(maximum(e.x, 0.f), maximum(e.y, 0.f), maximum(e.z, 0.f));
+
+				mask = toBitMask(squaredLength(e) <= view.sphere.radius * view.sphere.radius);
+			}
+
+			result.bits[v * result.numWords + word] |= (uint64)mask << shift;
+		}
+	}
+}
+
+culling_result cullObjects(thread_job_context& context, const culling_objects& objects, const culling_view* views, uint32 numViews, memory_arena& arena)
+{
+	culling_result result;
+	result.numViews = numViews;
+	result.numWords = objects.numPaddedObjects / 64;
+	result.bits = arena.allocate<uint64>(result.numWords * numViews, true);
+
+	if (objects.numObjects == 0 || numViews == 0)
+	{
+		return result;
+	}
+
+	culling_view* viewsCopy = arena.allocate<culling_view>(numViews);
+	memcpy(viewsCopy, views, sizeof(culling_view) * numViews);
+
+	// Jobs cover whole 64-bit words, so no two jobs write to the same word.
+	for (uint32 first = 0; first < objects.numPaddedObjects; first += CULLING_OBJECTS_PER_JOB)
+	{
+		uint32 end = min(first + CULLING_OBJECTS_PER_JOB, objects.numPaddedObjects);
+		context.addWork([objects, viewsCopy, numViews, result, first, end]()
+		{
+			cullObjectRange(objects, viewsCopy, numViews, result, first, end);
+		});
+	}
+
+	return result;
+}
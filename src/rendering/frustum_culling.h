@@ -0,0 +1,79 @@
+#pragma once
+
+#include "core/camera.h"
+#include "core/memory.h"
+#include "physics/bounding_volumes.h"
+
+struct thread_job_context;
+
+
+enum culling_view_type
+{
+	culling_view_frustum,
+	culling_view_sphere,
+};
+
+struct culling_view
+{
+	union
+	{
+		camera_frustum_planes frustum;
+		bounding_sphere sphere;
+	};
+
+	culling_view_type type;
+
+	culling_view() {}
+};
+
+// Model-space bounding boxes and transforms of a set of objects in SoA layout. The culling jobs transform these to world space
+// 8 objects at a time. The arrays are padded to a multiple of 64 objects, padding objects are never visible.
+struct culling_objects
+{
+	float* positionX;
+	float* positionY;
+	float* positionZ;
+
+	float* rotationX;
+	float* rotationY;
+	float* rotationZ;
+	float* rotationW;
+
+	float* scaleX;
+	float* scaleY;
+	float* scaleZ;
+
+	float* centerX;
+	float* centerY;
+	float* centerZ;
+
+	float* radiusX;
+	float* radiusY;
+	float* radiusZ;
+
+	uint32 numObjects;
+	uint32 numPaddedObjects;
+
+	void initialize(memory_arena& arena, uint32 numObjects);
+
+	void set(uint32 index, const bounding_box& aabb, const trs& transform);
+	void setAlwaysVisible(uint32 index);
+	void setNeverVisible(uint32 index);
+};
+
+// One bit per object and view. Only valid after the job context passed to cullObjects has finished.
+struct culling_result
+{
+	uint64* bits;
+	uint32 numViews;
+	uint32 numWords; // Per view.
+
+	bool isVisible(uint32 viewIndex, uint32 objectIndex) const
+	{
+		return (bits[viewIndex * numWords + (objectIndex >> 6)] >> (objectIndex & 63)) & 1;
+	}
+};
+
+// Tests all objects against all views in a single pass. The work is split into jobs, which are pushed to the context.
+// All memory (including a copy of the views) is allocated from the arena, so the arena must not be reset before the jobs have finished.
+culling_result cullObjects(thread_job_context& context, const culling_objects& objects, const culling_view* views, uint32 numViews, memory_arena& arena);
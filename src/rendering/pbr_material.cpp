@@ -43,11 +43,11 @@ static bool operator==(const pbr_material_desc& a, const pbr_material_desc& b)
 		&& a.translucency == b.translucency;
 }
 
+static std::unordered_map<pbr_material_desc, weakref<pbr_material>> cache;
+static std::mutex mutex;
+
 ref<pbr_material> createPBRMaterial(const pbr_material_desc& desc)
 {
-	static std::unordered_map<pbr_material_desc, weakref<pbr_material>> cache;
-	static std::mutex mutex;
-
 	mutex.lock();
 
 	auto sp = cache[desc].lock();
@@ -74,6 +74,36 @@ ref<pbr_material> createPBRMaterial(const pbr_material_desc& desc)
 	return sp;
 }
 
+uint32 refreshPBRMaterialsUsingTexture(const fs::path& texturePath)
+{
+	fs::path path = texturePath.lexically_normal().make_preferred();
+	auto matches = [&path](const fs::path& p) { return !p.empty() && p.lexically_normal().make_preferred() == path; };
+
+	uint32 numRefreshed = 0;
+
+	mutex.lock();
+	for (const auto& [desc, weakMaterial] : cache)
+	{
+		auto material = weakMaterial.lock();
+		if (!material)
+		{
+			continue;
+		}
+
+		// Slots, which already hold a texture, are updated in place by the texture hot reload.
+		bool refreshed = false;
+		if (!material->albedo && matches(desc.albedo)) { material->albedo = loadTextureFromFile(desc.albedo, desc.albedoFlags); refreshed = true; }
+		if (!material->normal && matches(desc.normal)) { material->normal = loadTextureFromFile(desc.normal, desc.normalFlags); refreshed = true; }
+		if (!material->roughness && matches(desc.roughness)) { material->roughness = loadTextureFromFile(desc.roughness, desc.roughnessFlags); refreshed = true; }
+		if (!material->metallic && matches(desc.metallic)) { material->metallic = loadTextureFromFile(desc.metallic, desc.metallicFlags); refreshed = true; }
+
+		numRefreshed += refreshed;
+	}
+	mutex.unlock();
+
+	return numRefreshed;
+}
+
 ref<pbr_material> getDefaultPBRMaterial()
 {
 	static ref<pbr_material> material = createPBRMaterial({});
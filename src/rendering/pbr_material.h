@@ -61,3 +61,7 @@ struct pbr_material
 ref<pbr_material> createPBRMaterial(const pbr_material_desc& desc);
 ref<pbr_material> getDefaultPBRMaterial();
 
+// Loads the texture into all cached materials, which reference it, but could not load it before (e.g. because the file was broken or
+// missing). Returns the number of refreshed materials.
+uint32 refreshPBRMaterialsUsingTexture(const fs::path& texturePath);
+
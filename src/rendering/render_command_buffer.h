@@ -1,11 +1,18 @@
 #pragma once
 
 #include "core/memory.h"
+#include "core/threading.h"
+#include "core/radix_sort.h"
 #include "material.h"
 
 struct dx_command_list;
 struct common_render_data;
 
+// Commands can be recorded from all job system threads at once. Each thread records into its own stream (arena and key list). When
+// recording has ended, the streams are merged by sort() or merge(), which must not happen concurrently with recording. Iteration
+// only sees merged commands.
+// Commands are stored type-erased without a vtable. Only commands which are not trivially destructible register a destructor.
+
 template <typename key_t, typename command_header>
 struct render_command_buffer
 {
@@ -19,12 +26,26 @@ private:
 	struct command_wrapper_base
 	{
 		command_header header;
+	};
 
-		virtual ~command_wrapper_base() {}
+	struct command_destructor
+	{
+		void (*destroy)(void*);
+		void* data;
 	};
 
+	struct recording_stream
+	{
+		memory_arena arena;
+		std::vector<command_key> keys;
+		std::vector<command_destructor> destructors;
+	};
+
+	recording_stream streams[MAX_NUM_JOB_THREADS];
+
+	// Merged keys of all streams.
 	std::vector<command_key> keys;
-	memory_arena arena;
+	std::vector<command_key> scratch;
 
 	template <typename pipeline_t, typename command_t>
 	command_t& pushInternal(key_t sortKey)
@@ -34,28 +55,91 @@ private:
 			command_t command;
 		};
 
-		command_wrapper* commandWrapper = arena.allocate<command_wrapper>();
+		recording_stream& stream = streams[getJobThreadIndex()];
+		if (!stream.arena.base())
+		{
+			stream.arena.initialize(0, GB(1), "Render command buffer", memory_tag_render);
+			stream.keys.reserve(128);
+		}
+
+		command_wrapper* commandWrapper = stream.arena.allocate<command_wrapper>();
 		new (commandWrapper) command_wrapper;
 
 		commandWrapper->header.initialize<pipeline_t, command_wrapper>();
 
+		if constexpr (!std::is_trivially_destructible_v<command_wrapper>)
+		{
+			stream.destructors.push_back({ [](void* data) { ((command_wrapper*)data)->~command_wrapper(); }, commandWrapper });
+		}
+
 		command_key key;
 		key.key = sortKey;
 		key.data = commandWrapper;
 
-		keys.push_back(key);
+		stream.keys.push_back(key);
 		return commandWrapper->command;
 	}
 
+	static auto getSortKey(const command_key& k)
+	{
+		if constexpr (std::is_floating_point_v<key_t>)
+		{
+			return floatToSortableUint((float)k.key);
+		}
+		else if constexpr (std::is_signed_v<key_t>)
+		{
+			return (std::make_unsigned_t<key_t>)k.key ^ ((std::make_unsigned_t<key_t>)1 << (sizeof(key_t) * 8 - 1));
+		}
+		else
+		{
+			return k.key;
+		}
+	}
+
 public:
 	render_command_buffer()
 	{
-		arena.initialize(0, GB(4));
 		keys.reserve(128);
 	}
 
-	uint64 size() const { return keys.size(); }
-	void sort() { std::sort(keys.begin(), keys.end(), [](command_key a, command_key b) { return a.key < b.key; }); }
+	uint64 size() const 
+	{ 
+		uint64 result = keys.size();
+		for (const recording_stream& stream : streams)
+		{
+			result += stream.keys.size();
+		}
+		return result;
+	}
+
+	// Moves the commands recorded by all threads into the merged key list. Call this at the end of recording, if the buffer is not sorted.
+	void merge()
+	{
+		for (recording_stream& stream : streams)
+		{
+			if (stream.keys.empty())
+			{
+				continue;
+			}
+
+			if (keys.empty())
+			{
+				std::swap(keys, stream.keys);
+			}
+			else
+			{
+				keys.insert(keys.end(), stream.keys.begin(), stream.keys.end());
+				stream.keys.clear();
+			}
+		}
+	}
+
+	void sort() 
+	{ 
+		merge();
+		scratch.resize(keys.size());
+		radixSort(keys.data(), scratch.data(), keys.size(), getSortKey);
+	}
 
 	template <typename pipeline_t, typename command_t, typename... args_t>
 	command_t& emplace_back(key_t sortKey, args_t&&... args)
@@ -81,13 +165,18 @@ public:
 
 	void clear()
 	{
-		for (auto& key : keys)
+		for (recording_stream& stream : streams)
 		{
-			command_wrapper_base* wrapperBase = (command_wrapper_base*)key.data;
-			wrapperBase->~command_wrapper_base();
+			for (const command_destructor& d : stream.destructors)
+			{
+				d.destroy(d.data);
+			}
+
+			stream.arena.reset();
+			stream.keys.clear();
+			stream.destructors.clear();
 		}
 
-		arena.reset();
 		keys.clear();
 	}
 
@@ -112,10 +201,7 @@ public:
 		}
 	};
 
-	iterator begin() { return iterator{ keys.begin() }; }
-	iterator end() { return iterator{ keys.end() }; }
-
-	iterator begin() const { return iterator{ keys.begin() }; }
+	iterator begin() const { ASSERT(size() == keys.size()); return iterator{ keys.begin() }; } // Recorded commands must be merged before iterating.
 	iterator end() const { return iterator{ keys.end() }; }
 
 };
@@ -345,6 +345,14 @@ struct compute_pass
 		}
 	}
 
+	void merge()
+	{
+		for (uint32 i = 0; i < compute_pass_event_count; ++i)
+		{
+			passes[i].merge();
+		}
+	}
+
 	void updateParticleSystem(struct particle_system* p)
 	{
 		particleSystemUpdates.push_back(p);
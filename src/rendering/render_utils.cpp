@@ -2,6 +2,9 @@
 #include "render_utils.h"
 #include "core/random.h"
 #include "dx/dx_context.h"
+#include "asset/asset_hot_reload.h"
+#include "core/threading.h"
+#include "core/cpu_profiling.h"
 #include "animation/skinning.h"
 #include "texture_preprocessing.h"
 #include "render_resources.h"
@@ -62,9 +65,23 @@ void initializeRenderUtils()
 	}
 }
 
+static void reportAsyncLoadStats()
+{
+	async_load_stats stats = getAsyncLoadStats();
+	CPU_PROFILE_STAT("Async loads queued", stats.numQueued);
+	CPU_PROFILE_STAT("Async loads running", stats.numRunning);
+	CPU_PROFILE_STAT("Async loads completed", stats.numCompleted);
+	CPU_PROFILE_STAT("Async loads cancelled", stats.numCancelled);
+	CPU_PROFILE_STAT("Async load wait avg (ms)", stats.averageWaitMilliseconds);
+	CPU_PROFILE_STAT("Async load wait max (ms)", stats.maxWaitMilliseconds);
+	CPU_PROFILE_STAT("Async load run avg (ms)", stats.averageRunMilliseconds);
+}
+
 void endFrameCommon()
 {
 	checkForChangedPipelines();
+	checkForChangedAssets();
+	reportAsyncLoadStats();
 }
 
 void buildCameraConstantBuffer(const render_camera& camera, float cameraJitterStrength, camera_cb& outCB)
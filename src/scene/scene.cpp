@@ -5,6 +5,9 @@
 #include "terrain/heightmap_collider.h"
 #include "rendering/raytracing.h"
 
+#include <unordered_map>
+#include <optional>
+
 
 game_scene::game_scene()
 {
@@ -85,6 +88,300 @@ void game_scene::cloneTo(game_scene& target)
 	target.registry.ctx() = registry.ctx();
 }
 
+
+
+// Small pools which the simulation writes every frame. These are copied in full when the snapshot is captured.
+using snapshot_copied_components = component_group_t<
+	tag_component,
+	transform_component,
+	position_component,
+	position_rotation_component,
+	position_scale_component,
+	dynamic_transform_component,
+
+#ifndef PHYSICS_ONLY
+	point_light_component,
+	spot_light_component,
+#endif
+
+	animation_component,
+
+	collider_component,
+	rigid_body_component,
+	force_field_component,
+	trigger_component,
+	physics_reference_component,
+	sap_endpoint_indirection_component,
+	constraint_entity_reference_component,
+
+	physics_transform0_component,
+	physics_transform1_component,
+
+	distance_constraint,
+	ball_constraint,
+	fixed_constraint,
+	hinge_constraint,
+	cone_twist_constraint,
+	slider_constraint
+>;
+
+// Pools which the simulation does not touch, or only writes for a few entities. These are usually the large ones (terrain, vegetation,
+// cloth etc.) and are shared with the running game. The editor calls scene_snapshot::preserve before writing to them, systems call
+// game_scene::preserveForSnapshot (terrain streaming, cloth simulation).
+using snapshot_shared_components = component_group_t<
+#ifndef PHYSICS_ONLY
+	terrain_component,
+	cloth_render_component,
+
+	grass_component,
+	proc_placement_component,
+	water_component,
+	tree_component,
+#endif
+	heightmap_collider_component,
+	cloth_component,
+
+	mesh_component,
+
+	raytrace_component
+>;
+
+template <typename component_t>
+struct copied_snapshot_pool
+{
+	std::vector<entity_handle> entities;
+	std::vector<component_t> components;
+
+	void capture(entt::registry& registry)
+	{
+		auto v = registry.view<component_t>();
+		auto& s = registry.storage<component_t>();
+		entities.assign(v.begin(), v.end());
+		components.assign(s.cbegin(), s.cend());
+	}
+
+	void restore(entt::registry& registry)
+	{
+		registry.clear<component_t>();
+		registry.insert<component_t>(entities.begin(), entities.end(), components.begin());
+	}
+};
+
+template <typename component_t>
+struct shared_snapshot_pool
+{
+	std::vector<entity_handle> entities; // Sorted. Owners of the component at capture time.
+	std::unordered_map<entity_handle, component_t> preserved; // Copies taken before the first write or destruction.
+
+	void capture(entt::registry& registry)
+	{
+		auto v = registry.view<component_t>();
+		entities.assign(v.begin(), v.end());
+		std::sort(entities.begin(), entities.end());
+
+		// on_destroy is emitted before the component is removed, so it still sees the original value. on_update is emitted after
+		// the write, which is too late. Writers call preserve explicitly instead.
+		registry.on_destroy<component_t>().template connect<&shared_snapshot_pool::preserve>(*this);
+	}
+
+	void preserveIfType(entt::id_type componentType, entt::registry& registry, entity_handle entity)
+	{
+		if (componentType == entt::type_hash<component_t>::value() && registry.any_of<component_t>(entity))
+		{
+			preserve(registry, entity);
+		}
+	}
+
+	void preserve(entt::registry& registry, entity_handle entity)
+	{
+		if (std::binary_search(entities.begin(), entities.end(), entity) && preserved.find(entity) == preserved.end())
+		{
+			preserved.emplace(entity, registry.get<component_t>(entity));
+		}
+	}
+
+	void disconnect(entt::registry& registry)
+	{
+		registry.on_destroy<component_t>().disconnect(this);
+	}
+
+	void restore(entt::registry& registry)
+	{
+		// Remove components which were added while the game was running.
+		std::vector<entity_handle> added;
+		for (entity_handle entity : registry.view<component_t>())
+		{
+			if (!std::binary_search(entities.begin(), entities.end(), entity))
+			{
+				added.push_back(entity);
+			}
+		}
+		registry.remove<component_t>(added.begin(), added.end());
+
+		for (auto& [entity, component] : preserved)
+		{
+			registry.emplace_or_replace<component_t>(entity, std::move(component));
+		}
+	}
+};
+
+template <typename copied_components, typename shared_components>
+struct snapshot_pools;
+
+template <typename... copied_component_t, typename... shared_component_t>
+struct snapshot_pools<component_group_t<copied_component_t...>, component_group_t<shared_component_t...>>
+{
+	std::tuple<copied_snapshot_pool<copied_component_t>...> copied;
+	std::tuple<shared_snapshot_pool<shared_component_t>...> shared;
+
+	void capture(entt::registry& registry)
+	{
+		std::apply([&registry](auto&... pool) { (pool.capture(registry), ...); }, copied);
+		std::apply([&registry](auto&... pool) { (pool.capture(registry), ...); }, shared);
+	}
+
+	void disconnect(entt::registry& registry)
+	{
+		std::apply([&registry](auto&... pool) { (pool.disconnect(registry), ...); }, shared);
+	}
+
+	void preserve(entt::id_type componentType, entt::registry& registry, entity_handle entity)
+	{
+		std::apply([&](auto&... pool) { (pool.preserveIfType(componentType, registry, entity), ...); }, shared);
+	}
+
+	void restore(entt::registry& registry)
+	{
+		std::apply([&registry](auto&... pool) { (pool.restore(registry), ...); }, copied);
+		std::apply([&registry](auto&... pool) { (pool.restore(registry), ...); }, shared);
+	}
+};
+
+template <typename context_t>
+struct context_snapshot
+{
+	std::optional<context_t> value; // Empty if the variable did not exist at capture time.
+
+	void capture(entt::registry& registry)
+	{
+		if (context_t* context = tryGetContextVariable<context_t>(registry))
+		{
+			value = *context;
+		}
+	}
+
+	void restore(entt::registry& registry)
+	{
+		deleteContextVariable<context_t>(registry);
+		if (value)
+		{
+			registry.ctx().emplace<context_t>(std::move(*value));
+		}
+	}
+};
+
+// Context variables which the simulation writes. All others are caches which are rebuilt from the components (e.g. the static render
+// index), so they are not part of the snapshot.
+using snapshot_context_variables = std::tuple<
+	context_snapshot<sap_context>,
+	context_snapshot<constraint_context>
+>;
+
+struct scene_snapshot_data
+{
+	game_scene* scene;
+
+	std::vector<entity_handle> entities; // Sorted.
+	snapshot_pools<snapshot_copied_components, snapshot_shared_components> pools;
+	snapshot_context_variables context;
+};
+
+void scene_snapshot::capture(game_scene& scene)
+{
+	discard();
+
+	data = make_ref<scene_snapshot_data>();
+	data->scene = &scene;
+
+	scene.forEachEntity([this](entity_handle entity)
+	{
+		data->entities.push_back(entity);
+	});
+	std::sort(data->entities.begin(), data->entities.end());
+
+	data->pools.capture(scene.registry);
+	std::apply([&scene](auto&... context) { (context.capture(scene.registry), ...); }, data->context);
+
+	scene.activeSnapshot = this;
+}
+
+void scene_snapshot::restore(game_scene& scene)
+{
+	if (!data)
+	{
+		return;
+	}
+
+	ASSERT(data->scene == &scene);
+
+	entt::registry& registry = scene.registry;
+	data->pools.disconnect(registry);
+
+	// Destroy entities created while the game was running. This includes helpers like colliders and constraints.
+	std::vector<entity_handle> created;
+	registry.each([this, &created](entity_handle entity)
+	{
+		if (!std::binary_search(data->entities.begin(), data->entities.end(), entity))
+		{
+			created.push_back(entity);
+		}
+	});
+	registry.destroy(created.begin(), created.end());
+
+	// Recreate deleted entities with their original handles.
+	for (entity_handle entity : data->entities)
+	{
+		if (!registry.valid(entity))
+		{
+			entity_handle recreated = registry.create(entity);
+			ASSERT(recreated == entity);
+		}
+	}
+
+	data->pools.restore(registry);
+	std::apply([&registry](auto&... context) { (context.restore(registry), ...); }, data->context);
+
+#ifndef PHYSICS_ONLY
+	// Preserved terrain is a copy with its own height buffers. The collider chunks still point at the heights of the terrain the game
+	// ran with, which have been freed by the restore.
+	for (auto [entityHandle, terrain, collider] : registry.view<terrain_component, heightmap_collider_component>().each())
+	{
+		terrain.relinkCollider(collider);
+	}
+#endif
+
+	scene.activeSnapshot = 0;
+	data.reset();
+}
+
+void scene_snapshot::preserve(entt::id_type componentType, entity_handle entity)
+{
+	if (data)
+	{
+		data->pools.preserve(componentType, data->scene->registry, entity);
+	}
+}
+
+void scene_snapshot::discard()
+{
+	if (data)
+	{
+		data->pools.disconnect(data->scene->registry);
+		data->scene->activeSnapshot = 0;
+		data.reset();
+	}
+}
+
 scene_entity game_scene::copyEntity(scene_entity src)
 {
 	ASSERT(src.hasComponent<tag_component>());
@@ -358,7 +358,12 @@ struct game_scene
 
 	void cloneTo(game_scene& target);
 
+	// Call before systems write to a component in place (e.g. terrain streaming, cloth simulation). No-op if no snapshot is active.
+	template <typename component_t>
+	void preserveForSnapshot(entity_handle entity);
+
 	entt::registry registry;
+	struct scene_snapshot* activeSnapshot = 0; // Set while the game is running in the editor.
 
 
 private:
@@ -389,6 +394,38 @@ inline scene_entity::scene_entity(uint32 id, game_scene& scene) : handle((entity
 
 
 
+// Rollback state of a scene while the game is running in the editor. The game runs directly on the captured scene.
+// Small pools which the simulation writes every frame are copied when the snapshot is taken. All other pools are shared with the
+// running game, and their components are only copied before the first write (see preserve) or when they are destroyed.
+// Restoring destroys entities created since the capture, recreates deleted ones with their original handles and rolls back the copied state.
+struct scene_snapshot
+{
+	void capture(game_scene& scene);
+	void restore(game_scene& scene); // No-op if no snapshot has been captured.
+	void discard();
+
+	bool isValid() const { return data != nullptr; }
+
+	// Call before writing to a component in place. The editor calls this directly, systems go through game_scene::preserveForSnapshot.
+	// No-op if the game is not running.
+	template <typename component_t>
+	void preserve(entity_handle entity) { preserve(entt::type_hash<component_t>::value(), entity); }
+
+private:
+	void preserve(entt::id_type componentType, entity_handle entity);
+
+	ref<struct scene_snapshot_data> data;
+};
+
+template <typename component_t>
+inline void game_scene::preserveForSnapshot(entity_handle entity)
+{
+	if (activeSnapshot)
+	{
+		activeSnapshot->preserve<component_t>(entity);
+	}
+}
+
 enum scene_mode
 {
 	scene_mode_editor,
@@ -400,7 +437,7 @@ struct editor_scene
 {
 	game_scene& getCurrentScene()
 	{
-		return (mode == scene_mode_editor) ? editorScene : runtimeScene;
+		return editorScene;
 	}
 
 	float getTimestepScale()
@@ -412,8 +449,7 @@ struct editor_scene
 	{
 		if (mode == scene_mode_editor)
 		{
-			runtimeScene = game_scene();
-			editorScene.cloneTo(runtimeScene);
+			snapshot.capture(editorScene);
 		}
 		mode = scene_mode_runtime_playing;
 	}
@@ -428,6 +464,7 @@ struct editor_scene
 
 	void stop()
 	{
+		snapshot.restore(editorScene);
 		mode = scene_mode_editor;
 	}
 
@@ -447,7 +484,7 @@ struct editor_scene
 	}
 
 	game_scene editorScene;
-	game_scene runtimeScene;
+	scene_snapshot snapshot; // Valid while the game is running.
 
 	scene_mode mode = scene_mode_editor;
 	float timestepScale = 1.f;
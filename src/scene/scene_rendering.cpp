@@ -6,6 +6,9 @@
 #include "rendering/depth_prepass.h"
 #include "rendering/outline.h"
 #include "rendering/shadow_map.h"
+#include "rendering/frustum_culling.h"
+
+#include "static_render_index.h"
 
 #include "geometry/mesh.h"
 
@@ -14,6 +17,7 @@
 #include "physics/cloth.h"
 
 #include "core/cpu_profiling.h"
+#include "core/threading.h"
 
 
 struct offset_count
@@ -22,26 +26,9 @@ struct offset_count
 	uint32 count;
 };
 
-enum light_frustum_type
-{
-	light_frustum_standard,
-	light_frustum_sphere,
-};
-
-struct light_frustum
-{
-	union
-	{
-		camera_frustum_planes frustum;
-		bounding_sphere sphere;
-	};
-
-	light_frustum_type type;
-};
-
 struct shadow_pass
 {
-	light_frustum frustum;
+	culling_view frustum;
 	shadow_render_pass_base* pass;
 	bool isPointLight;
 };
@@ -52,28 +39,94 @@ struct shadow_passes
 	uint32 numShadowRenderPasses;
 };
 
+// View 0 is the main camera, view i + 1 is the i-th shadow pass.
+struct object_visibility
+{
+	culling_result result;
+
+	bool isVisibleInMainCamera(uint32 objectIndex) const { return result.isVisible(0, objectIndex); }
+	bool isVisibleInShadowPass(uint32 shadowPassIndex, uint32 objectIndex) const { return result.isVisible(shadowPassIndex + 1, objectIndex); }
+};
+
 
-static bool shouldRender(bounding_sphere s, bounding_box aabb, const trs& transform)
+using static_object_excluded_components = component_group_t<
+	animation_component,
+	dynamic_transform_component,
+	tree_component
+>;
+
+static auto getStaticObjectGroup(game_scene& scene)
 {
-	s.center = conjugate(transform.rotation) * (s.center - transform.position) + transform.position;
-	aabb.minCorner *= transform.scale;
-	aabb.maxCorner *= transform.scale;
-	return aabb.contains(s.center) || sphereVsAABB(s, aabb);
+	return scene.group(
+		component_group<transform_component, mesh_component>,
+		static_object_excluded_components{});
 }
 
-static bool shouldRender(const camera_frustum_planes& frustum, const mesh_component& mesh, const transform_component& transform)
+static auto getDynamicObjectGroup(game_scene& scene)
 {
-	return mesh.mesh && (mesh.mesh->loadState.load() == asset_loaded) && ((mesh.mesh->aabb.maxCorner.x == mesh.mesh->aabb.minCorner.x) || !frustum.cullModelSpaceAABB(mesh.mesh->aabb, transform));
+	return scene.group(
+		component_group<transform_component, dynamic_transform_component, mesh_component>,
+		component_group<animation_component>);
 }
 
-static bool shouldRender(const bounding_sphere& frustum, const mesh_component& mesh, const transform_component& transform)
+static auto getTreeGroup(game_scene& scene)
 {
-	return mesh.mesh && (mesh.mesh->loadState.load() == asset_loaded) && ((mesh.mesh->aabb.maxCorner.x == mesh.mesh->aabb.minCorner.x) || shouldRender(frustum, mesh.mesh->aabb, transform));
+	return scene.group(
+		component_group<transform_component, mesh_component, tree_component>);
 }
 
-static bool shouldRender(const light_frustum& frustum, const mesh_component& mesh, const transform_component& transform)
+template <typename group_t>
+static culling_objects packCullingObjects(group_t group, memory_arena& arena)
 {
-	return (frustum.type == light_frustum_standard) ? shouldRender(frustum.frustum, mesh, transform) : shouldRender(frustum.sphere, mesh, transform);
+	culling_objects objects;
+	objects.initialize(arena, (uint32)group.size());
+
+	uint32 index = 0;
+	for (entity_handle entityHandle : group)
+	{
+		auto [transform, mesh] = group.get<transform_component, mesh_component>(entityHandle);
+
+		if (!mesh.mesh || (mesh.mesh->loadState.load() != asset_loaded))
+		{
+			objects.setNeverVisible(index);
+		}
+		else if (mesh.mesh->aabb.maxCorner.x == mesh.mesh->aabb.minCorner.x)
+		{
+			objects.setAlwaysVisible(index); // No valid bounding box.
+		}
+		else
+		{
+			objects.set(index, mesh.mesh->aabb, transform);
+		}
+
+		++index;
+	}
+
+	return objects;
+}
+
+// View 0 is the main camera, view i + 1 is the i-th shadow pass.
+static culling_view* getCullingViews(const camera_frustum_planes& cameraFrustum, const shadow_passes& shadow, memory_arena& arena)
+{
+	culling_view* views = arena.allocate<culling_view>(1 + shadow.numShadowRenderPasses);
+
+	views[0].frustum = cameraFrustum;
+	views[0].type = culling_view_frustum;
+
+	for (uint32 i = 0; i < shadow.numShadowRenderPasses; ++i)
+	{
+		views[i + 1] = shadow.shadowRenderPasses[i].frustum;
+	}
+
+	return views;
+}
+
+template <typename group_t>
+static object_visibility cullGroup(thread_job_context& context, group_t group, const camera_frustum_planes& cameraFrustum, 
+	const shadow_passes& shadow, memory_arena& arena)
+{
+	culling_view* views = getCullingViews(cameraFrustum, shadow, arena);
+	return { cullObjects(context, packCullingObjects(group, arena), views, 1 + shadow.numShadowRenderPasses, arena) };
 }
 
 template <typename group_t>
@@ -203,42 +256,58 @@ static void addToDynamicRenderPass(pbr_material_shader shader, const shadow_rend
 }
 
 
-template <typename group_t>
-static void renderStaticObjectsToMainCamera(group_t group, std::unordered_map<multi_mesh*, offset_count> ocPerMesh,
-	const camera_frustum_planes& frustum, memory_arena& arena, entity_handle selectedObjectID,
+// Offsets of each mesh batch's instances in the per-view instance buffers.
+static offset_count* getOffsetsPerBatch(const static_render_index& index, const static_render_view_result& visible, memory_arena& arena)
+{
+	uint32 numBatches = (uint32)index.batches.size();
+	offset_count* ocPerBatch = arena.allocate<offset_count>(numBatches, true);
+
+	for (uint32 i = 0; i < visible.numVisibleProxies; ++i)
+	{
+		++ocPerBatch[index.proxies[visible.visibleProxies[i]].batch].count;
+	}
+
+	uint32 offset = 0;
+	for (uint32 i = 0; i < numBatches; ++i)
+	{
+		offset_count& oc = ocPerBatch[i];
+		oc.offset = offset;
+		offset += oc.count;
+		oc.count = 0;
+	}
+
+	return ocPerBatch;
+}
+
+// Buffers are allocated by the caller, since the upload buffer and arena markers must not be used from multiple threads.
+static void renderStaticObjectsToMainCamera(const static_render_index& index, const static_render_view_result& visible,
+	dx_allocation transformAllocation, dx_allocation objectIDAllocation, offset_count* ocPerBatch, entity_handle selectedObjectID,
 	opaque_render_pass* opaqueRenderPass, transparent_render_pass* transparentRenderPass, ldr_render_pass* ldrRenderPass)
 {
-	uint32 groupSize = (uint32)group.size();
+	uint32 numVisible = visible.numVisibleProxies;
 
-	dx_allocation transformAllocation = dxContext.allocateDynamicBuffer(groupSize * sizeof(mat4), 4);
 	mat4* transforms = (mat4*)transformAllocation.cpuPtr;
-
-	dx_allocation objectIDAllocation = dxContext.allocateDynamicBuffer(groupSize * sizeof(uint32), 4);
 	uint32* objectIDs = (uint32*)objectIDAllocation.cpuPtr;
 
-	for (auto [entityHandle, transform, mesh] : group.each())
+	for (uint32 i = 0; i < numVisible; ++i)
 	{
-		if (!shouldRender(frustum, mesh, transform))
-		{
-			continue;
-		}
+		const static_render_proxy& proxy = index.proxies[visible.visibleProxies[i]];
 
-		const dx_mesh& dxMesh = mesh.mesh->mesh;
+		offset_count& oc = ocPerBatch[proxy.batch];
 
-		offset_count& oc = ocPerMesh.at(mesh.mesh.get());
-
-		uint32 index = oc.offset + oc.count;
-		transforms[index] = trsToMat4(transform);
-		objectIDs[index] = (uint32)entityHandle;
+		uint32 instanceIndex = oc.offset + oc.count;
+		transforms[instanceIndex] = proxy.transformMatrix;
+		objectIDs[instanceIndex] = (uint32)proxy.entity;
 
 		++oc.count;
 
 
-		if (entityHandle == selectedObjectID)
+		if (proxy.entity == selectedObjectID)
 		{
-			for (auto& sm : mesh.mesh->submeshes)
+			const dx_mesh& dxMesh = proxy.mesh->mesh;
+			for (auto& sm : proxy.mesh->submeshes)
 			{
-				renderOutline(ldrRenderPass, transforms[index], dxMesh.vertexBuffer, dxMesh.indexBuffer, sm.info);
+				renderOutline(ldrRenderPass, transforms[instanceIndex], dxMesh.vertexBuffer, dxMesh.indexBuffer, sm.info);
 			}
 		}
 	}
@@ -249,13 +318,16 @@ static void renderStaticObjectsToMainCamera(group_t group, std::unordered_map<mu
 
 	uint32 numDrawCalls = 0;
 
-	for (auto& [mesh, oc] : ocPerMesh)
+	for (uint32 b = 0; b < (uint32)index.batches.size(); ++b)
 	{
+		const offset_count& oc = ocPerBatch[b];
 		if (oc.count == 0)
 		{
 			continue;
 		}
 
+		const multi_mesh* mesh = index.batches[b].mesh.get();
+
 		D3D12_GPU_VIRTUAL_ADDRESS baseM = transformsAddress + (oc.offset * sizeof(mat4));
 		D3D12_GPU_VIRTUAL_ADDRESS baseObjectID = objectIDAddress + (oc.offset * sizeof(uint32));
 
@@ -293,42 +365,35 @@ static void renderStaticObjectsToMainCamera(group_t group, std::unordered_map<mu
 	CPU_PROFILE_STAT("Static draw calls", numDrawCalls);
 }
 
-template <typename group_t>
-static void renderStaticObjectsToShadowMap(group_t group, std::unordered_map<multi_mesh*, offset_count> ocPerMesh, 
-	const light_frustum& frustum, memory_arena& arena, shadow_render_pass_base* shadowRenderPass)
+static void renderStaticObjectsToShadowMap(const static_render_index& index, const static_render_view_result& visible,
+	dx_allocation transformAllocation, offset_count* ocPerBatch, bool isPointLight, shadow_render_pass_base* shadowRenderPass)
 {
-	uint32 groupSize = (uint32)group.size();
+	uint32 numVisible = visible.numVisibleProxies;
 
-	dx_allocation transformAllocation = dxContext.allocateDynamicBuffer(groupSize * sizeof(mat4), 4);
 	mat4* transforms = (mat4*)transformAllocation.cpuPtr;
 
-	for (auto [entityHandle, transform, mesh] : group.each())
+	for (uint32 i = 0; i < numVisible; ++i)
 	{
-		if (!shouldRender(frustum, mesh, transform))
-		{
-			continue;
-		}
-
-		const dx_mesh& dxMesh = mesh.mesh->mesh;
-
-		offset_count& oc = ocPerMesh.at(mesh.mesh.get());
-
-		uint32 index = oc.offset + oc.count;
-		transforms[index] = trsToMat4(transform);
+		const static_render_proxy& proxy = index.proxies[visible.visibleProxies[i]];
 
+		offset_count& oc = ocPerBatch[proxy.batch];
+		transforms[oc.offset + oc.count] = proxy.transformMatrix;
 		++oc.count;
 	}
 
 
 	D3D12_GPU_VIRTUAL_ADDRESS transformsAddress = transformAllocation.gpuPtr;
 
-	for (auto& [mesh, oc] : ocPerMesh)
+	for (uint32 b = 0; b < (uint32)index.batches.size(); ++b)
 	{
+		const offset_count& oc = ocPerBatch[b];
 		if (oc.count == 0)
 		{
 			continue;
 		}
 
+		const multi_mesh* mesh = index.batches[b].mesh.get();
+
 		D3D12_GPU_VIRTUAL_ADDRESS baseM = transformsAddress + (oc.offset * sizeof(mat4));
 
 		const dx_mesh& dxMesh = mesh->mesh;
@@ -342,36 +407,77 @@ static void renderStaticObjectsToShadowMap(group_t group, std::unordered_map<mul
 		for (auto& sm : mesh->submeshes)
 		{
 			data.submesh = sm.info;
-			addToStaticRenderPass(sm.material->shader, data, shadowRenderPass, frustum.type == light_frustum_sphere);
+			addToStaticRenderPass(sm.material->shader, data, shadowRenderPass, isPointLight);
 		}
 	}
 }
 
-static void renderStaticObjects(game_scene& scene, const camera_frustum_planes& frustum, memory_arena& arena, entity_handle selectedObjectID,
+// Brings the static render index up to date with the scene. Only changed entities touch the hierarchy.
+static static_render_index& updateStaticRenderIndex(game_scene& scene)
+{
+	CPU_PROFILE_BLOCK("Update static render index");
+
+	static_render_index& index = scene.createOrGetContextVariable<static_render_index>();
+
+	index.beginSync();
+	for (auto [entityHandle, transform, mesh] : getStaticObjectGroup(scene).each())
+	{
+		index.sync(entityHandle, mesh.mesh, transform);
+	}
+	index.endSync();
+
+	return index;
+}
+
+static void renderStaticObjects(const static_render_index& index, const static_render_view_result* visible, memory_arena& arena, entity_handle selectedObjectID,
 	opaque_render_pass* opaqueRenderPass, transparent_render_pass* transparentRenderPass, ldr_render_pass* ldrRenderPass, shadow_passes& shadow)
 {
 	CPU_PROFILE_BLOCK("Static objects");
 
-	using specialized_components = component_group_t<
-		animation_component,
-		dynamic_transform_component,
-		tree_component
-	>;
+	memory_marker tempMemoryMarker = arena.getMarker();
 
-	auto group = scene.group(
-		component_group<transform_component, mesh_component>,
-		specialized_components{});
+	// Each view records its commands in its own job. Result 0 is the main camera, result i + 1 is the i-th shadow pass.
+	thread_job_context context;
 
-	std::unordered_map<multi_mesh*, offset_count> ocPerMesh = getOffsetsPerMesh(group);
-	
+	if (visible[0].numVisibleProxies > 0)
+	{
+		uint32 numVisible = visible[0].numVisibleProxies;
+		dx_allocation transformAllocation = dxContext.allocateDynamicBuffer(numVisible * sizeof(mat4), 4);
+		dx_allocation objectIDAllocation = dxContext.allocateDynamicBuffer(numVisible * sizeof(uint32), 4);
+		offset_count* ocPerBatch = getOffsetsPerBatch(index, visible[0], arena);
 
-	renderStaticObjectsToMainCamera(group, ocPerMesh, frustum, arena, selectedObjectID, opaqueRenderPass, transparentRenderPass, ldrRenderPass);
+		context.addWork([&index, visible, transformAllocation, objectIDAllocation, ocPerBatch, selectedObjectID, opaqueRenderPass, transparentRenderPass, ldrRenderPass]()
+		{
+			renderStaticObjectsToMainCamera(index, visible[0], transformAllocation, objectIDAllocation, ocPerBatch, selectedObjectID, 
+				opaqueRenderPass, transparentRenderPass, ldrRenderPass);
+		});
+	}
+	else
+	{
+		CPU_PROFILE_STAT("Static draw calls", 0u);
+	}
 
 	for (uint32 i = 0; i < shadow.numShadowRenderPasses; ++i)
 	{
-		auto& pass = shadow.shadowRenderPasses[i];
-		renderStaticObjectsToShadowMap(group, ocPerMesh, pass.frustum, arena, pass.pass);
+		uint32 numVisible = visible[i + 1].numVisibleProxies;
+		if (numVisible == 0)
+		{
+			continue;
+		}
+
+		dx_allocation transformAllocation = dxContext.allocateDynamicBuffer(numVisible * sizeof(mat4), 4);
+		offset_count* ocPerBatch = getOffsetsPerBatch(index, visible[i + 1], arena);
+
+		shadow_pass pass = shadow.shadowRenderPasses[i];
+		context.addWork([&index, visible, i, transformAllocation, ocPerBatch, pass]()
+		{
+			renderStaticObjectsToShadowMap(index, visible[i + 1], transformAllocation, ocPerBatch, pass.isPointLight, pass.pass);
+		});
 	}
+
+	context.waitForWorkCompletion();
+
+	arena.resetToMarker(tempMemoryMarker);
 }
 
 
@@ -379,7 +485,7 @@ static void renderStaticObjects(game_scene& scene, const camera_frustum_planes&
 
 template <typename group_t>
 static void renderDynamicObjectsToMainCamera(group_t group, std::unordered_map<multi_mesh*, offset_count> ocPerMesh,
-	const camera_frustum_planes& frustum, memory_arena& arena, entity_handle selectedObjectID,
+	const object_visibility& visibility, memory_arena& arena, entity_handle selectedObjectID,
 	opaque_render_pass* opaqueRenderPass, transparent_render_pass* transparentRenderPass, ldr_render_pass* ldrRenderPass)
 {
 	uint32 groupSize = (uint32)group.size();
@@ -391,9 +497,10 @@ static void renderDynamicObjectsToMainCamera(group_t group, std::unordered_map<m
 	dx_allocation objectIDAllocation = dxContext.allocateDynamicBuffer(groupSize * sizeof(uint32), 4);
 	uint32* objectIDs = (uint32*)objectIDAllocation.cpuPtr;
 
+	uint32 objectIndex = 0;
 	for (auto [entityHandle, transform, dynamicTransform, mesh] : group.each())
 	{
-		if (!shouldRender(frustum, mesh, transform))
+		if (!visibility.isVisibleInMainCamera(objectIndex++))
 		{
 			continue;
 		}
@@ -473,16 +580,17 @@ static void renderDynamicObjectsToMainCamera(group_t group, std::unordered_map<m
 
 template <typename group_t>
 static void renderDynamicObjectsToShadowMap(group_t group, std::unordered_map<multi_mesh*, offset_count> ocPerMesh,
-	const light_frustum& frustum, memory_arena& arena, shadow_render_pass_base* shadowRenderPass)
+	const object_visibility& visibility, uint32 shadowPassIndex, bool isPointLight, memory_arena& arena, shadow_render_pass_base* shadowRenderPass)
 {
 	uint32 groupSize = (uint32)group.size();
 
 	dx_allocation transformAllocation = dxContext.allocateDynamicBuffer(groupSize * sizeof(mat4), 4);
 	mat4* transforms = (mat4*)transformAllocation.cpuPtr;
 
+	uint32 objectIndex = 0;
 	for (auto [entityHandle, transform, dynamicTransform, mesh] : group.each())
 	{
-		if (!shouldRender(frustum, mesh, transform))
+		if (!visibility.isVisibleInShadowPass(shadowPassIndex, objectIndex++))
 		{
 			continue;
 		}
@@ -520,32 +628,30 @@ static void renderDynamicObjectsToShadowMap(group_t group, std::unordered_map<mu
 		for (auto& sm : mesh->submeshes)
 		{
 			data.submesh = sm.info;
-			addToDynamicRenderPass(sm.material->shader, data, shadowRenderPass, frustum.type == light_frustum_sphere);
+			addToDynamicRenderPass(sm.material->shader, data, shadowRenderPass, isPointLight);
 		}
 	}
 }
 
-static void renderDynamicObjects(game_scene& scene, const camera_frustum_planes& frustum, memory_arena& arena, entity_handle selectedObjectID,
+static void renderDynamicObjects(game_scene& scene, const object_visibility& visibility, memory_arena& arena, entity_handle selectedObjectID,
 	opaque_render_pass* opaqueRenderPass, transparent_render_pass* transparentRenderPass, ldr_render_pass* ldrRenderPass, shadow_passes& shadow)
 {
 	CPU_PROFILE_BLOCK("Dynamic objects");
 
-	auto group = scene.group(
-		component_group<transform_component, dynamic_transform_component, mesh_component>,
-		component_group<animation_component>);
+	auto group = getDynamicObjectGroup(scene);
 
 
 	std::unordered_map<multi_mesh*, offset_count> ocPerMesh = getOffsetsPerMesh(group);
-	renderDynamicObjectsToMainCamera(group, ocPerMesh, frustum, arena, selectedObjectID, opaqueRenderPass, transparentRenderPass, ldrRenderPass);
+	renderDynamicObjectsToMainCamera(group, ocPerMesh, visibility, arena, selectedObjectID, opaqueRenderPass, transparentRenderPass, ldrRenderPass);
 
 	for (uint32 i = 0; i < shadow.numShadowRenderPasses; ++i)
 	{
 		auto& pass = shadow.shadowRenderPasses[i];
-		renderDynamicObjectsToShadowMap(group, ocPerMesh, pass.frustum, arena, pass.pass);
+		renderDynamicObjectsToShadowMap(group, ocPerMesh, visibility, i, pass.isPointLight, arena, pass.pass);
 	}
 }
 
-static void renderAnimatedObjects(game_scene& scene, const camera_frustum_planes& frustum, memory_arena& arena, entity_handle selectedObjectID,
+static void renderAnimatedObjects(game_scene& scene, memory_arena& arena, entity_handle selectedObjectID,
 	opaque_render_pass* opaqueRenderPass, transparent_render_pass* transparentRenderPass, ldr_render_pass* ldrRenderPass, shadow_passes& shadow)
 {
 	CPU_PROFILE_BLOCK("Animated objects");
@@ -624,7 +730,7 @@ static void renderAnimatedObjects(game_scene& scene, const camera_frustum_planes
 			for (uint32 i = 0; i < shadow.numShadowRenderPasses; ++i)
 			{
 				auto& pass = shadow.shadowRenderPasses[i];
-				addToDynamicRenderPass(sm.material->shader, shadowData, pass.pass, pass.frustum.type == light_frustum_sphere);
+				addToDynamicRenderPass(sm.material->shader, shadowData, pass.pass, pass.isPointLight);
 			}
 
 			if (entityHandle == selectedObjectID)
@@ -662,14 +768,13 @@ static void renderTerrain(const render_camera& camera, game_scene& scene, memory
 	arena.resetToMarker(tempMemoryMarker);
 }
 
-static void renderTrees(game_scene& scene, const camera_frustum_planes& frustum, memory_arena& arena, entity_handle selectedObjectID,
+static void renderTrees(game_scene& scene, const object_visibility& visibility, memory_arena& arena, entity_handle selectedObjectID,
 	opaque_render_pass* opaqueRenderPass, transparent_render_pass* transparentRenderPass, ldr_render_pass* ldrRenderPass, sun_shadow_render_pass* sunShadowRenderPass,
 	float dt)
 {
 	CPU_PROFILE_BLOCK("Trees");
 
-	auto group = scene.group(
-		component_group<transform_component, mesh_component, tree_component>);
+	auto group = getTreeGroup(scene);
 
 	uint32 groupSize = (uint32)group.size();
 
@@ -681,9 +786,10 @@ static void renderTrees(game_scene& scene, const camera_frustum_planes& frustum,
 	dx_allocation objectIDAllocation = dxContext.allocateDynamicBuffer(groupSize * sizeof(uint32), 4);
 	uint32* objectIDs = (uint32*)objectIDAllocation.cpuPtr;
 
+	uint32 objectIndex = 0;
 	for (auto [entityHandle, transform, mesh, tree] : group.each())
 	{
-		if (!shouldRender(frustum, mesh, transform))
+		if (!visibility.isVisibleInMainCamera(objectIndex++))
 		{
 			continue;
 		}
@@ -803,6 +909,46 @@ static void renderCloth(game_scene& scene, entity_handle selectedObjectID,
 	}
 }
 
+// Meshes closer to the camera are loaded first. A mesh used by multiple entities gets the priority of the closest one.
+static void prioritizeLoadingMeshes(const render_camera& camera, game_scene& scene)
+{
+	CPU_PROFILE_BLOCK("Prioritize loading meshes");
+
+	std::unordered_map<async_load_job*, float> priorities;
+	std::vector<ref<async_load_job>> jobs; // Keeps the jobs alive, since the loader threads clear them when they finish.
+
+	for (auto [entityHandle, transform, mesh] : scene.view<transform_component, mesh_component>().each())
+	{
+		if (!mesh.mesh || mesh.mesh->loadState.load(std::memory_order_relaxed) == asset_loaded)
+		{
+			continue;
+		}
+
+		ref<async_load_job> job = std::atomic_load(&mesh.mesh->loadJob);
+		if (!job)
+		{
+			continue;
+		}
+
+		float priority = ASYNC_LOAD_PRIORITY_WORLD / (1.f + length(transform.position - camera.position));
+
+		auto [it, inserted] = priorities.try_emplace(job.get(), priority);
+		if (inserted)
+		{
+			jobs.push_back(std::move(job));
+		}
+		else
+		{
+			it->second = max(it->second, priority);
+		}
+	}
+
+	for (auto [job, priority] : priorities)
+	{
+		job->setPriority(priority);
+	}
+}
+
 static void setupSunShadowPass(directional_light& sun, sun_shadow_render_pass* sunShadowRenderPass, bool invalidateShadowMapCache)
 {
 	shadow_render_command command = determineSunShadowInfo(sun, invalidateShadowMapCache);
@@ -894,6 +1040,8 @@ void renderScene(const render_camera& camera, game_scene& scene, memory_arena& a
 {
 	CPU_PROFILE_BLOCK("Submit scene render commands");
 
+	prioritizeLoadingMeshes(camera, scene);
+
 	setupSunShadowPass(sun, sunShadowRenderPass, invalidateShadowMapCache);
 	setupSpotShadowPasses(scene, lighting, invalidateShadowMapCache);
 	setupPointShadowPasses(scene, lighting, invalidateShadowMapCache);
@@ -909,8 +1057,9 @@ void renderScene(const render_camera& camera, game_scene& scene, memory_arena& a
 	{
 		auto& outPass = dynamicShadowPasses.shadowRenderPasses[dynamicShadowPasses.numShadowRenderPasses++];
 		outPass.frustum.frustum = getWorldSpaceFrustumPlanes(sunShadowRenderPass->cascades[sunShadowRenderPass->numCascades - 1].viewProj);
-		outPass.frustum.type = light_frustum_standard;
+		outPass.frustum.type = culling_view_frustum;
 		outPass.pass = &sunShadowRenderPass->cascades[0];
+		outPass.isPointLight = false;
 
 		if (!sunShadowRenderPass->copyFromStaticCache)
 		{
@@ -923,8 +1072,9 @@ void renderScene(const render_camera& camera, game_scene& scene, memory_arena& a
 		auto pass = &lighting.spotShadowRenderPasses[i];
 		auto& outPass = dynamicShadowPasses.shadowRenderPasses[dynamicShadowPasses.numShadowRenderPasses++];
 		outPass.frustum.frustum = getWorldSpaceFrustumPlanes(pass->viewProjMatrix);
-		outPass.frustum.type = light_frustum_standard;
+		outPass.frustum.type = culling_view_frustum;
 		outPass.pass = pass;
+		outPass.isPointLight = false;
 
 		if (!pass->copyFromStaticCache)
 		{
@@ -937,8 +1087,9 @@ void renderScene(const render_camera& camera, game_scene& scene, memory_arena& a
 		auto pass = &lighting.pointShadowRenderPasses[i];
 		auto& outPass = dynamicShadowPasses.shadowRenderPasses[dynamicShadowPasses.numShadowRenderPasses++];
 		outPass.frustum.sphere = { pass->lightPosition, pass->maxDistance };
-		outPass.frustum.type = light_frustum_sphere;
+		outPass.frustum.type = culling_view_sphere;
 		outPass.pass = pass;
+		outPass.isPointLight = true;
 
 		if (!pass->copyFromStaticCache0)
 		{
@@ -951,11 +1102,27 @@ void renderScene(const render_camera& camera, game_scene& scene, memory_arena& a
 
 	camera_frustum_planes frustum = camera.getWorldSpaceFrustumPlanes();
 
-	renderStaticObjects(scene, frustum, arena, selectedObjectID, opaqueRenderPass, transparentRenderPass, ldrRenderPass, staticShadowPasses);
-	renderDynamicObjects(scene, frustum, arena, selectedObjectID, opaqueRenderPass, transparentRenderPass, ldrRenderPass, dynamicShadowPasses);
-	renderAnimatedObjects(scene, frustum, arena, selectedObjectID, opaqueRenderPass, transparentRenderPass, ldrRenderPass, dynamicShadowPasses);
+	static_render_index& staticIndex = updateStaticRenderIndex(scene);
+
+	static_render_view_result* staticVisibility;
+	object_visibility dynamicVisibility, treeVisibility;
+
+	{
+		CPU_PROFILE_BLOCK("Frustum culling");
+
+		// Culls all object groups against the camera and their shadow passes in parallel.
+		thread_job_context context;
+		staticVisibility = staticIndex.cull(context, getCullingViews(frustum, staticShadowPasses, arena), 1 + staticShadowPasses.numShadowRenderPasses, arena);
+		dynamicVisibility = cullGroup(context, getDynamicObjectGroup(scene), frustum, dynamicShadowPasses, arena);
+		treeVisibility = cullGroup(context, getTreeGroup(scene), frustum, shadow_passes{}, arena);
+		context.waitForWorkCompletion();
+	}
+
+	renderStaticObjects(staticIndex, staticVisibility, arena, selectedObjectID, opaqueRenderPass, transparentRenderPass, ldrRenderPass, staticShadowPasses);
+	renderDynamicObjects(scene, dynamicVisibility, arena, selectedObjectID, opaqueRenderPass, transparentRenderPass, ldrRenderPass, dynamicShadowPasses);
+	renderAnimatedObjects(scene, arena, selectedObjectID, opaqueRenderPass, transparentRenderPass, ldrRenderPass, dynamicShadowPasses);
 	renderTerrain(camera, scene, arena, selectedObjectID, opaqueRenderPass, transparentRenderPass, ldrRenderPass, sunRenderStaticGeometry ? sunShadowRenderPass : 0, dt);
-	renderTrees(scene, frustum, arena, selectedObjectID, opaqueRenderPass, transparentRenderPass, ldrRenderPass, sunShadowRenderPass, dt);
+	renderTrees(scene, treeVisibility, arena, selectedObjectID, opaqueRenderPass, transparentRenderPass, ldrRenderPass, sunShadowRenderPass, dt);
 	renderCloth(scene, selectedObjectID, opaqueRenderPass, transparentRenderPass, ldrRenderPass, sunShadowRenderPass);
 
 	arena.resetToMarker(tempMemoryMarker);
@@ -1,16 +1,30 @@
 #include "pch.h"
 #include "serialization_binary.h"
 #include "asset/file_registry.h"
+#include "editor/file_dialog.h"
 
+#include "core/file_system.h"
+#include "core/threading.h"
+#include "core/cpu_profiling.h"
+#include "core/string.h"
+#include "core/log.h"
+
+#include "geometry/mesh.h"
 #include "physics/physics.h"
+#include "physics/cloth.h"
 #include "terrain/heightmap_collider.h"
 
+#include <fstream>
+#include <unordered_map>
+
 struct write_stream
 {
 	uint8* buffer;
 	uint64 size;
 	uint64 writeOffset = 0;
 
+	std::vector<uint8>* storage = 0; // If set, the stream grows this vector instead of failing when the buffer is full.
+
 
 	template <typename T>
 	void write(T t)
@@ -32,11 +46,38 @@ struct write_stream
 		}
 	}
 
+	void writeBytes(const void* data, uint64 s)
+	{
+		if (check(s))
+		{
+			memcpy(buffer + writeOffset, data, s);
+			writeOffset += s;
+		}
+	}
+
+	void align(uint64 alignment)
+	{
+		uint64 aligned = alignTo(writeOffset, alignment);
+		if (check(aligned - writeOffset))
+		{
+			memset(buffer + writeOffset, 0, aligned - writeOffset);
+			writeOffset = aligned;
+		}
+	}
+
 private:
 	bool check(uint64 s)
 	{
 		if (writeOffset + s >= size)
 		{
+			if (storage)
+			{
+				storage->resize(max((uint64)storage->size() * 2, writeOffset + s + 1));
+				buffer = storage->data();
+				size = storage->size();
+				return true;
+			}
+
 			size = 0;
 			return false;
 		}
@@ -203,6 +244,49 @@ void deserializeFromMemoryStream<cloth_component>(scene_entity entity, read_stre
 template <> void serializeToMemoryStream(scene_entity entity, const cloth_render_component& component, write_stream& stream) {}
 template <> void deserializeFromMemoryStream<cloth_render_component>(scene_entity entity, read_stream& stream) { entity.addComponent<cloth_render_component>(); }
 
+static void serializeConstraintToMemoryStream(scene_entity constraintEntity, constraint_type constraintType, write_stream& stream)
+{
+	auto& ref = constraintEntity.getComponent<constraint_entity_reference_component>();
+
+	stream.write(constraintType);
+	stream.write(ref.entityA);
+	stream.write(ref.entityB);
+
+	switch (constraintType)
+	{
+		case constraint_type_distance: stream.write(constraintEntity.getComponent<distance_constraint>()); break;
+		case constraint_type_ball: stream.write(constraintEntity.getComponent<ball_constraint>()); break;
+		case constraint_type_fixed: stream.write(constraintEntity.getComponent<fixed_constraint>()); break;
+		case constraint_type_hinge: stream.write(constraintEntity.getComponent<hinge_constraint>()); break;
+		case constraint_type_cone_twist: stream.write(constraintEntity.getComponent<cone_twist_constraint>()); break;
+		case constraint_type_slider: stream.write(constraintEntity.getComponent<slider_constraint>()); break;
+	}
+}
+
+// Returns the two constrained entities.
+static std::pair<entity_handle, entity_handle> deserializeConstraintFromMemoryStream(entt::registry* registry, read_stream& stream)
+{
+	READ(constraint_type, constraintType);
+
+	READ(entity_handle, entityHandleA);
+	READ(entity_handle, entityHandleB);
+
+	scene_entity a = { entityHandleA, registry };
+	scene_entity b = { entityHandleB, registry };
+
+	switch (constraintType)
+	{
+		case constraint_type_distance: { READ(distance_constraint, c); addConstraint(a, b, c); break; }
+		case constraint_type_ball: { READ(ball_constraint, c); addConstraint(a, b, c); break; }
+		case constraint_type_fixed: { READ(fixed_constraint, c); addConstraint(a, b, c); break; }
+		case constraint_type_hinge: { READ(hinge_constraint, c); addConstraint(a, b, c); break; }
+		case constraint_type_cone_twist: { READ(cone_twist_constraint, c); addConstraint(a, b, c); break; }
+		case constraint_type_slider: { READ(slider_constraint, c); addConstraint(a, b, c); break; }
+	}
+
+	return { entityHandleA, entityHandleB };
+}
+
 template <>
 void serializeToMemoryStream(scene_entity entity, const physics_reference_component& component, write_stream& stream)
 {
@@ -215,21 +299,7 @@ void serializeToMemoryStream(scene_entity entity, const physics_reference_compon
 	stream.write(component.numConstraints);
 	for (auto [constraintEntity, constraintType] : constraint_entity_iterator(entity))
 	{
-		auto& ref = constraintEntity.getComponent<constraint_entity_reference_component>();
-
-		stream.write(constraintType);
-		stream.write(ref.entityA);
-		stream.write(ref.entityB);
-
-		switch (constraintType)
-		{
-			case constraint_type_distance: stream.write(constraintEntity.getComponent<distance_constraint>()); break;
-			case constraint_type_ball: stream.write(constraintEntity.getComponent<ball_constraint>()); break;
-			case constraint_type_fixed: stream.write(constraintEntity.getComponent<fixed_constraint>()); break;
-			case constraint_type_hinge: stream.write(constraintEntity.getComponent<hinge_constraint>()); break;
-			case constraint_type_cone_twist: stream.write(constraintEntity.getComponent<cone_twist_constraint>()); break;
-			case constraint_type_slider: stream.write(constraintEntity.getComponent<slider_constraint>()); break;
-		}
+		serializeConstraintToMemoryStream(constraintEntity, constraintType, stream);
 	}
 }
 
@@ -246,25 +316,8 @@ void deserializeFromMemoryStream<physics_reference_component>(scene_entity entit
 	READ(uint32, numConstraints);
 	for (uint32 i = 0; i < numConstraints; ++i)
 	{
-		READ(constraint_type, constraintType);
-
-		READ(entity_handle, entityHandleA);
-		READ(entity_handle, entityHandleB);
-
+		auto [entityHandleA, entityHandleB] = deserializeConstraintFromMemoryStream(entity.registry, stream);
 		ASSERT(entity.handle == entityHandleA || entity.handle == entityHandleB);
-
-		scene_entity a = { entityHandleA, entity.registry };
-		scene_entity b = { entityHandleB, entity.registry };
-
-		switch (constraintType)
-		{
-			case constraint_type_distance: { READ(distance_constraint, c); addConstraint(a, b, c); break; }
-			case constraint_type_ball: { READ(ball_constraint, c); addConstraint(a, b, c); break; }
-			case constraint_type_fixed: { READ(fixed_constraint, c); addConstraint(a, b, c); break; }
-			case constraint_type_hinge: { READ(hinge_constraint, c); addConstraint(a, b, c); break; }
-			case constraint_type_cone_twist: { READ(cone_twist_constraint, c); addConstraint(a, b, c); break; }
-			case constraint_type_slider: { READ(slider_constraint, c); addConstraint(a, b, c); break; }
-		}
 	}
 }
 
@@ -353,6 +406,7 @@ void serializeToMemoryStream(scene_entity entity, const terrain_component& compo
 	stream.write(component.chunkSize);
 	stream.write(component.amplitudeScale);
 	stream.write(component.genSettings);
+	stream.write(component.streaming);
 
 	serializeMaterial(component.groundMaterial, stream);
 	serializeMaterial(component.rockMaterial, stream);
@@ -366,12 +420,14 @@ void deserializeFromMemoryStream<terrain_component>(scene_entity entity, read_st
 	READ(float, chunkSize);
 	READ(float, amplitudeScale);
 	READ(terrain_generation_settings, genSettings);
+	READ(terrain_streaming_settings, streaming);
 
 	auto ground = deserializeMaterial(stream);
 	auto rock = deserializeMaterial(stream);
 	auto mud = deserializeMaterial(stream);
 
 	entity.addComponent<terrain_component>(chunksPerDim, chunkSize, amplitudeScale, ground, rock, mud, genSettings);
+	entity.getComponent<terrain_component>().streaming = streaming;
 }
 
 template <>
@@ -511,3 +567,646 @@ bool deserializeEntityFromMemory(scene_entity entity, void* memory, uint64 size)
 
 
 
+
+
+
+
+
+
+
+
+
+// Whole scene files. The file consists of a header, a chunk table and the chunks. Each component pool is stored contiguously in
+// its own chunk: First the handles of all entities owning the component, then the component data. Plain data pools are decoded
+// in parallel and added to the registry with one bulk insert per pool. Components whose construction has side effects
+// (rigid bodies, colliders, cloth, terrain etc.) go through the per-entity functions above afterwards, and constraints are added last.
+// Meshes are referenced through an asset table, so that each mesh is resolved only once, before any pool is decoded.
+
+#define BINARY_SCENE_MAGIC 0x4E435342 // 'BSCN'.
+#define BINARY_SCENE_VERSION 3
+#define BINARY_SCENE_CHUNK_ALIGNMENT 16
+
+#define BINARY_SCENE_CHUNK_SETTINGS			COMPILE_TIME_STRING_HASH_64("Settings")
+#define BINARY_SCENE_CHUNK_ENTITIES			COMPILE_TIME_STRING_HASH_64("Entities")
+#define BINARY_SCENE_CHUNK_MESH_ASSETS		COMPILE_TIME_STRING_HASH_64("Mesh assets")
+#define BINARY_SCENE_CHUNK_CONSTRAINTS		COMPILE_TIME_STRING_HASH_64("Constraints")
+#define BINARY_SCENE_CHUNK_COMPONENT(name)	COMPILE_TIME_STRING_HASH_64("Component/" name)
+
+struct binary_scene_header
+{
+	uint32 magic;
+	uint32 version;
+	uint32 numEntities;
+	uint32 numChunks;
+};
+
+struct binary_scene_chunk
+{
+	uint64 id;
+	uint64 offset; // From the start of the file.
+	uint64 size;
+	uint32 count;
+	uint32 padding;
+};
+
+struct binary_scene_mesh_asset
+{
+	asset_handle handle;
+	uint32 flags;
+	uint32 padding;
+};
+
+struct binary_scene_writer
+{
+	std::vector<uint8> storage;
+	write_stream stream = { 0, 0, 0, &storage };
+	std::vector<binary_scene_chunk> chunks;
+
+	void beginChunk(uint64 id, uint32 count)
+	{
+		stream.align(BINARY_SCENE_CHUNK_ALIGNMENT);
+		chunks.push_back({ id, stream.writeOffset, 0, count, 0 });
+	}
+
+	void endChunk()
+	{
+		binary_scene_chunk& chunk = chunks.back();
+		chunk.size = stream.writeOffset - chunk.offset;
+	}
+
+	// Writes the entity handles of a pool chunk. The component data starts at the next aligned offset.
+	void writeEntities(const std::vector<entity_handle>& entities)
+	{
+		stream.writeBytes(entities.data(), entities.size() * sizeof(entity_handle));
+		stream.align(BINARY_SCENE_CHUNK_ALIGNMENT);
+	}
+};
+
+struct binary_scene_reader
+{
+	const uint8* data;
+	uint64 size;
+
+	const binary_scene_header* header;
+	const binary_scene_chunk* chunks;
+
+	bool initialize(const uint8* data, uint64 size)
+	{
+		this->data = data;
+		this->size = size;
+
+		if (size < sizeof(binary_scene_header))
+		{
+			return false;
+		}
+
+		header = (const binary_scene_header*)data;
+		if (header->magic != BINARY_SCENE_MAGIC || header->version != BINARY_SCENE_VERSION
+			|| size < sizeof(binary_scene_header) + header->numChunks * sizeof(binary_scene_chunk))
+		{
+			return false;
+		}
+
+		chunks = (const binary_scene_chunk*)(header + 1);
+		for (uint32 i = 0; i < header->numChunks; ++i)
+		{
+			if (chunks[i].offset > size || chunks[i].size > size - chunks[i].offset)
+			{
+				return false;
+			}
+		}
+
+		return true;
+	}
+
+	const binary_scene_chunk* findChunk(uint64 id) const
+	{
+		for (uint32 i = 0; i < header->numChunks; ++i)
+		{
+			if (chunks[i].id == id)
+			{
+				return &chunks[i];
+			}
+		}
+		return 0;
+	}
+
+	const entity_handle* getEntities(const binary_scene_chunk& chunk) const
+	{
+		return (const entity_handle*)(data + chunk.offset);
+	}
+
+	read_stream getRecords(const binary_scene_chunk& chunk) const
+	{
+		uint64 entitiesSize = alignTo(chunk.count * sizeof(entity_handle), BINARY_SCENE_CHUNK_ALIGNMENT);
+		if (entitiesSize > chunk.size)
+		{
+			return { 0, 0 };
+		}
+		return { (uint8*)data + chunk.offset + entitiesSize, chunk.size - entitiesSize };
+	}
+};
+
+// Entities are only written if they have a tag. All others are helpers like colliders and constraints, which are written with their owners.
+template <typename component_t>
+static std::vector<entity_handle> getTaggedEntitiesWithComponent(game_scene& scene)
+{
+	std::vector<entity_handle> result;
+	if constexpr (std::is_same_v<component_t, tag_component>)
+	{
+		for (entity_handle entity : scene.view<tag_component>())
+		{
+			result.push_back(entity);
+		}
+	}
+	else
+	{
+		for (entity_handle entity : scene.view<component_t, tag_component>())
+		{
+			result.push_back(entity);
+		}
+	}
+	return result;
+}
+
+template <typename component_t>
+static void writePlainPool(game_scene& scene, uint64 id, binary_scene_writer& writer)
+{
+	static_assert(std::is_trivially_copyable_v<component_t>);
+
+	std::vector<entity_handle> entities = getTaggedEntitiesWithComponent<component_t>(scene);
+	if (entities.empty())
+	{
+		return;
+	}
+
+	writer.beginChunk(id, (uint32)entities.size());
+	writer.writeEntities(entities);
+	for (entity_handle entity : entities)
+	{
+		writer.stream.write(scene.registry.get<component_t>(entity));
+	}
+	writer.endChunk();
+}
+
+template <typename component_t>
+static void writePerEntityPool(game_scene& scene, uint64 id, binary_scene_writer& writer)
+{
+	std::vector<entity_handle> entities = getTaggedEntitiesWithComponent<component_t>(scene);
+	if (entities.empty())
+	{
+		return;
+	}
+
+	writer.beginChunk(id, (uint32)entities.size());
+	writer.writeEntities(entities);
+	for (entity_handle entity : entities)
+	{
+		scene_entity e = { entity, scene };
+		serializeToMemoryStream(e, *e.getComponentIfExists<component_t>(), writer.stream);
+	}
+	writer.endChunk();
+}
+
+static void writeMeshPool(game_scene& scene, binary_scene_writer& writer)
+{
+	std::vector<entity_handle> entities = getTaggedEntitiesWithComponent<mesh_component>(scene);
+	if (entities.empty())
+	{
+		return;
+	}
+
+	std::vector<binary_scene_mesh_asset> assets;
+	std::unordered_map<multi_mesh*, uint32> meshToAsset;
+
+	std::vector<uint32> assetIndices;
+	assetIndices.reserve(entities.size());
+
+	for (entity_handle entity : entities)
+	{
+		multi_mesh* mesh = scene.registry.get<mesh_component>(entity).mesh.get();
+
+		uint32 assetIndex = -1;
+		if (mesh)
+		{
+			auto [it, inserted] = meshToAsset.try_emplace(mesh, (uint32)assets.size());
+			if (inserted)
+			{
+				assets.push_back({ mesh->handle, mesh->flags, 0 });
+			}
+			assetIndex = it->second;
+		}
+		assetIndices.push_back(assetIndex);
+	}
+
+	writer.beginChunk(BINARY_SCENE_CHUNK_MESH_ASSETS, (uint32)assets.size());
+	writer.stream.writeBytes(assets.data(), assets.size() * sizeof(binary_scene_mesh_asset));
+	writer.endChunk();
+
+	writer.beginChunk(BINARY_SCENE_CHUNK_COMPONENT("Mesh"), (uint32)entities.size());
+	writer.writeEntities(entities);
+	writer.stream.writeBytes(assetIndices.data(), assetIndices.size() * sizeof(uint32));
+	writer.endChunk();
+}
+
+static void writeColliderPool(game_scene& scene, binary_scene_writer& writer)
+{
+	std::vector<entity_handle> entities = getTaggedEntitiesWithComponent<physics_reference_component>(scene);
+	if (entities.empty())
+	{
+		return;
+	}
+
+	writer.beginChunk(BINARY_SCENE_CHUNK_COMPONENT("Colliders"), (uint32)entities.size());
+	writer.writeEntities(entities);
+	for (entity_handle entity : entities)
+	{
+		scene_entity e = { entity, scene };
+		writer.stream.write(e.getComponent<physics_reference_component>().numColliders);
+		for (collider_component& collider : collider_component_iterator(e))
+		{
+			writer.stream.write<collider_union>(collider);
+		}
+	}
+	writer.endChunk();
+}
+
+static void writeConstraints(game_scene& scene, binary_scene_writer& writer)
+{
+	uint32 numConstraints = 0;
+
+	writer.beginChunk(BINARY_SCENE_CHUNK_CONSTRAINTS, 0);
+	for (entity_handle entity : scene.view<physics_reference_component, tag_component>())
+	{
+		scene_entity e = { entity, scene };
+		for (auto [constraintEntity, constraintType] : constraint_entity_iterator(e))
+		{
+			// Each constraint is referenced by both entities. Only write it once.
+			if (constraintEntity.getComponent<constraint_entity_reference_component>().entityA == entity)
+			{
+				serializeConstraintToMemoryStream(constraintEntity, constraintType, writer.stream);
+				++numConstraints;
+			}
+		}
+	}
+	writer.endChunk();
+	writer.chunks.back().count = numConstraints;
+}
+
+void serializeSceneToBinaryFile(editor_scene& scene, const renderer_settings& rendererSettings)
+{
+	if (scene.savePath.empty() || scene.savePath.extension() != ".scb")
+	{
+		fs::path filename = saveFileDialog("Binary scene files", "scb");
+		if (filename.empty())
+		{
+			return;
+		}
+
+		scene.savePath = filename;
+	}
+
+	CPU_PROFILE_BLOCK("Serialize binary scene");
+
+	game_scene& gameScene = scene.editorScene;
+	binary_scene_writer writer;
+
+	writer.beginChunk(BINARY_SCENE_CHUNK_SETTINGS, 1);
+	writer.stream.write(scene.camera);
+	writer.stream.write(rendererSettings);
+	writer.stream.write(scene.sun);
+	writer.stream.write(scene.environment.isProcedural());
+	writer.stream.write(scene.environment.isProcedural() ? asset_handle{ 0 } : scene.environment.sky->handle);
+	writer.stream.write(scene.environment.lastSunDirection);
+	writer.stream.write(scene.environment.giMode);
+	writer.stream.write(scene.environment.globalIlluminationIntensity);
+	writer.stream.write(scene.environment.skyIntensity);
+	writer.endChunk();
+
+	std::vector<entity_handle> entities = getTaggedEntitiesWithComponent<tag_component>(gameScene);
+	writer.beginChunk(BINARY_SCENE_CHUNK_ENTITIES, (uint32)entities.size());
+	writer.writeEntities(entities);
+	writer.endChunk();
+
+	// Transforms.
+	writePlainPool<tag_component>(gameScene, BINARY_SCENE_CHUNK_COMPONENT("Tag"), writer);
+	writePlainPool<transform_component>(gameScene, BINARY_SCENE_CHUNK_COMPONENT("Transform"), writer);
+	writePlainPool<position_component>(gameScene, BINARY_SCENE_CHUNK_COMPONENT("Position"), writer);
+	writePlainPool<position_rotation_component>(gameScene, BINARY_SCENE_CHUNK_COMPONENT("Position/Rotation"), writer);
+	writePlainPool<position_scale_component>(gameScene, BINARY_SCENE_CHUNK_COMPONENT("Position/Scale"), writer);
+	writePlainPool<dynamic_transform_component>(gameScene, BINARY_SCENE_CHUNK_COMPONENT("Dynamic"), writer);
+
+	// Rendering.
+	writeMeshPool(gameScene, writer);
+	writePlainPool<point_light_component>(gameScene, BINARY_SCENE_CHUNK_COMPONENT("Point light"), writer);
+	writePlainPool<spot_light_component>(gameScene, BINARY_SCENE_CHUNK_COMPONENT("Spot light"), writer);
+
+	// Physics.
+	writePerEntityPool<rigid_body_component>(gameScene, BINARY_SCENE_CHUNK_COMPONENT("Rigid body"), writer);
+	writePlainPool<force_field_component>(gameScene, BINARY_SCENE_CHUNK_COMPONENT("Force field"), writer);
+	writePerEntityPool<cloth_component>(gameScene, BINARY_SCENE_CHUNK_COMPONENT("Cloth"), writer);
+	writePerEntityPool<cloth_render_component>(gameScene, BINARY_SCENE_CHUNK_COMPONENT("Cloth render"), writer);
+	writeColliderPool(gameScene, writer);
+	writeConstraints(gameScene, writer);
+
+	// Terrain.
+	writePerEntityPool<terrain_component>(gameScene, BINARY_SCENE_CHUNK_COMPONENT("Terrain"), writer);
+	writePerEntityPool<heightmap_collider_component>(gameScene, BINARY_SCENE_CHUNK_COMPONENT("Heightmap collider"), writer);
+	writePerEntityPool<grass_component>(gameScene, BINARY_SCENE_CHUNK_COMPONENT("Grass"), writer);
+	writePerEntityPool<proc_placement_component>(gameScene, BINARY_SCENE_CHUNK_COMPONENT("Procedural placement"), writer);
+	writePerEntityPool<water_component>(gameScene, BINARY_SCENE_CHUNK_COMPONENT("Water"), writer);
+
+	binary_scene_header header = { BINARY_SCENE_MAGIC, BINARY_SCENE_VERSION, (uint32)entities.size(), (uint32)writer.chunks.size() };
+
+	uint64 tableSize = sizeof(binary_scene_header) + writer.chunks.size() * sizeof(binary_scene_chunk);
+	uint64 dataOffset = alignTo(tableSize, (uint64)BINARY_SCENE_CHUNK_ALIGNMENT);
+	for (binary_scene_chunk& chunk : writer.chunks)
+	{
+		chunk.offset += dataOffset;
+	}
+
+	uint8 padding[BINARY_SCENE_CHUNK_ALIGNMENT] = {};
+
+	std::ofstream fout(scene.savePath, std::ios::binary);
+	fout.write((const char*)&header, sizeof(header));
+	fout.write((const char*)writer.chunks.data(), writer.chunks.size() * sizeof(binary_scene_chunk));
+	fout.write((const char*)padding, dataOffset - tableSize);
+	fout.write((const char*)writer.storage.data(), writer.stream.writeOffset);
+
+	LOG_MESSAGE("Scene saved to '%ws'", scene.savePath.c_str());
+}
+
+template <typename component_t>
+struct decoded_pool
+{
+	const entity_handle* entities = 0;
+	uint32 count = 0;
+	std::vector<component_t> components;
+};
+
+template <typename component_t>
+static void decodePlainPool(thread_job_context& context, const binary_scene_reader& reader, uint64 id, decoded_pool<component_t>& pool)
+{
+	const binary_scene_chunk* chunk = reader.findChunk(id);
+	if (!chunk)
+	{
+		return;
+	}
+
+	read_stream records = reader.getRecords(*chunk);
+	if (records.size < chunk->count * sizeof(component_t))
+	{
+		LOG_ERROR("Component chunk is truncated");
+		return;
+	}
+
+	pool.entities = reader.getEntities(*chunk);
+	pool.count = chunk->count;
+
+	context.addWork([&pool, records]()
+	{
+		pool.components.resize(pool.count);
+		memcpy(pool.components.data(), records.buffer, pool.count * sizeof(component_t));
+	});
+}
+
+static void decodeMeshPool(thread_job_context& context, const binary_scene_reader& reader, const std::vector<ref<multi_mesh>>& meshes, decoded_pool<mesh_component>& pool)
+{
+	const binary_scene_chunk* chunk = reader.findChunk(BINARY_SCENE_CHUNK_COMPONENT("Mesh"));
+	if (!chunk)
+	{
+		return;
+	}
+
+	read_stream records = reader.getRecords(*chunk);
+	if (records.size < chunk->count * sizeof(uint32))
+	{
+		LOG_ERROR("Mesh chunk is truncated");
+		return;
+	}
+
+	pool.entities = reader.getEntities(*chunk);
+	pool.count = chunk->count;
+
+	context.addWork([&pool, &meshes, records]()
+	{
+		const uint32* assetIndices = (const uint32*)records.buffer;
+
+		pool.components.resize(pool.count);
+		for (uint32 i = 0; i < pool.count; ++i)
+		{
+			uint32 assetIndex = assetIndices[i];
+			pool.components[i].mesh = (assetIndex < meshes.size()) ? meshes[assetIndex] : nullptr;
+		}
+	});
+}
+
+template <typename component_t>
+static void commitPool(entt::registry& registry, decoded_pool<component_t>& pool)
+{
+	if (pool.count && pool.components.size() == pool.count)
+	{
+		registry.insert<component_t>(pool.entities, pool.entities + pool.count, pool.components.begin());
+	}
+}
+
+template <typename component_t>
+static void loadPerEntityPool(entt::registry& registry, const binary_scene_reader& reader, uint64 id)
+{
+	const binary_scene_chunk* chunk = reader.findChunk(id);
+	if (!chunk)
+	{
+		return;
+	}
+
+	const entity_handle* entities = reader.getEntities(*chunk);
+	read_stream stream = reader.getRecords(*chunk);
+	for (uint32 i = 0; i < chunk->count && stream.size; ++i)
+	{
+		deserializeFromMemoryStream<component_t>(scene_entity(entities[i], &registry), stream);
+	}
+}
+
+static void loadColliderPool(entt::registry& registry, const binary_scene_reader& reader)
+{
+	const binary_scene_chunk* chunk = reader.findChunk(BINARY_SCENE_CHUNK_COMPONENT("Colliders"));
+	if (!chunk)
+	{
+		return;
+	}
+
+	const entity_handle* entities = reader.getEntities(*chunk);
+	read_stream stream = reader.getRecords(*chunk);
+	for (uint32 i = 0; i < chunk->count && stream.size; ++i)
+	{
+		scene_entity entity(entities[i], &registry);
+
+		READ(uint32, numColliders);
+		for (uint32 j = 0; j < numColliders && stream.size; ++j)
+		{
+			READ(collider_union, u);
+			entity.addComponent<collider_component>(collider_component::fromUnion(u));
+		}
+	}
+}
+
+static void loadConstraints(entt::registry& registry, const binary_scene_reader& reader)
+{
+	const binary_scene_chunk* chunk = reader.findChunk(BINARY_SCENE_CHUNK_CONSTRAINTS);
+	if (!chunk)
+	{
+		return;
+	}
+
+	read_stream stream = { (uint8*)reader.data + chunk->offset, chunk->size };
+	for (uint32 i = 0; i < chunk->count && stream.size; ++i)
+	{
+		deserializeConstraintFromMemoryStream(&registry, stream);
+	}
+}
+
+bool deserializeSceneFromBinaryFile(editor_scene& scene, renderer_settings& rendererSettings, std::string& environmentName)
+{
+	fs::path filename = openFileDialog("Binary scene files", "scb");
+	if (filename.empty())
+	{
+		return false;
+	}
+
+	CPU_PROFILE_BLOCK("Deserialize binary scene");
+
+	mapped_file file;
+	if (!file.open(filename))
+	{
+		LOG_ERROR("Could not open file '%ws'", filename.c_str());
+		return false;
+	}
+
+	binary_scene_reader reader;
+	const binary_scene_chunk* settingsChunk = 0;
+	const binary_scene_chunk* entitiesChunk = 0;
+	if (!reader.initialize(file.data, file.size)
+		|| !(settingsChunk = reader.findChunk(BINARY_SCENE_CHUNK_SETTINGS))
+		|| !(entitiesChunk = reader.findChunk(BINARY_SCENE_CHUNK_ENTITIES))
+		|| entitiesChunk->size < entitiesChunk->count * sizeof(entity_handle))
+	{
+		LOG_ERROR("'%ws' is not a valid binary scene file", filename.c_str());
+		return false;
+	}
+
+	scene.snapshot.discard();
+	scene.editorScene = game_scene();
+	scene.savePath = std::move(filename);
+
+	entt::registry& registry = scene.editorScene.registry;
+
+
+	// Settings.
+	{
+		read_stream stream = { (uint8*)reader.data + settingsChunk->offset, settingsChunk->size };
+
+		stream.read(scene.camera);
+		stream.read(rendererSettings);
+		stream.read(scene.sun);
+
+		READ(bool, proceduralEnvironment);
+		READ(asset_handle, skyHandle);
+		READ(vec3, lastSunDirection);
+
+		stream.read(scene.environment.giMode);
+		stream.read(scene.environment.globalIlluminationIntensity);
+		stream.read(scene.environment.skyIntensity);
+
+		if (proceduralEnvironment)
+		{
+			scene.environment.setToProcedural(lastSunDirection);
+		}
+		else
+		{
+			environmentName = getPathFromAssetHandle(skyHandle).string();
+		}
+	}
+
+
+	// Create all top level entities with their original handles before any helper entity (collider, constraint) exists.
+	// This keeps the references between entities valid.
+	const entity_handle* entities = reader.getEntities(*entitiesChunk);
+	for (uint32 i = 0; i < entitiesChunk->count; ++i)
+	{
+		entity_handle entity = registry.create(entities[i]);
+		ASSERT(entity == entities[i]);
+	}
+
+
+	// Resolve each referenced mesh exactly once.
+	std::vector<ref<multi_mesh>> meshes;
+	if (const binary_scene_chunk* chunk = reader.findChunk(BINARY_SCENE_CHUNK_MESH_ASSETS))
+	{
+		const binary_scene_mesh_asset* assets = (const binary_scene_mesh_asset*)(reader.data + chunk->offset);
+		uint32 numAssets = (uint32)min<uint64>(chunk->count, chunk->size / sizeof(binary_scene_mesh_asset));
+
+		meshes.resize(numAssets);
+		for (uint32 i = 0; i < numAssets; ++i)
+		{
+			meshes[i] = loadMeshFromHandle(assets[i].handle, assets[i].flags);
+		}
+	}
+
+
+	// Decode plain data pools in parallel.
+	decoded_pool<tag_component> tags;
+	decoded_pool<transform_component> transforms;
+	decoded_pool<position_component> positions;
+	decoded_pool<position_rotation_component> positionRotations;
+	decoded_pool<position_scale_component> positionScales;
+	decoded_pool<dynamic_transform_component> dynamicTransforms;
+	decoded_pool<mesh_component> meshComponents;
+	decoded_pool<point_light_component> pointLights;
+	decoded_pool<spot_light_component> spotLights;
+	decoded_pool<force_field_component> forceFields;
+
+	thread_job_context context;
+
+	decodePlainPool(context, reader, BINARY_SCENE_CHUNK_COMPONENT("Tag"), tags);
+	decodePlainPool(context, reader, BINARY_SCENE_CHUNK_COMPONENT("Transform"), transforms);
+	decodePlainPool(context, reader, BINARY_SCENE_CHUNK_COMPONENT("Position"), positions);
+	decodePlainPool(context, reader, BINARY_SCENE_CHUNK_COMPONENT("Position/Rotation"), positionRotations);
+	decodePlainPool(context, reader, BINARY_SCENE_CHUNK_COMPONENT("Position/Scale"), positionScales);
+	decodePlainPool(context, reader, BINARY_SCENE_CHUNK_COMPONENT("Dynamic"), dynamicTransforms);
+	decodeMeshPool(context, reader, meshes, meshComponents);
+	decodePlainPool(context, reader, BINARY_SCENE_CHUNK_COMPONENT("Point light"), pointLights);
+	decodePlainPool(context, reader, BINARY_SCENE_CHUNK_COMPONENT("Spot light"), spotLights);
+	decodePlainPool(context, reader, BINARY_SCENE_CHUNK_COMPONENT("Force field"), forceFields);
+
+	context.waitForWorkCompletion();
+
+	// Bulk insert. The registry updates its groups here, so this is single threaded.
+	commitPool(registry, tags);
+	commitPool(registry, transforms);
+	commitPool(registry, positions);
+	commitPool(registry, positionRotations);
+	commitPool(registry, positionScales);
+	commitPool(registry, dynamicTransforms);
+	commitPool(registry, meshComponents);
+	commitPool(registry, pointLights);
+	commitPool(registry, spotLights);
+	commitPool(registry, forceFields);
+
+
+	// Components with construction side effects. These require the transforms to be present already.
+	loadPerEntityPool<rigid_body_component>(registry, reader, BINARY_SCENE_CHUNK_COMPONENT("Rigid body"));
+	loadPerEntityPool<cloth_component>(registry, reader, BINARY_SCENE_CHUNK_COMPONENT("Cloth"));
+	loadPerEntityPool<cloth_render_component>(registry, reader, BINARY_SCENE_CHUNK_COMPONENT("Cloth render"));
+	loadColliderPool(registry, reader);
+	loadConstraints(registry, reader);
+
+	loadPerEntityPool<terrain_component>(registry, reader, BINARY_SCENE_CHUNK_COMPONENT("Terrain"));
+	loadPerEntityPool<heightmap_collider_component>(registry, reader, BINARY_SCENE_CHUNK_COMPONENT("Heightmap collider"));
+	loadPerEntityPool<grass_component>(registry, reader, BINARY_SCENE_CHUNK_COMPONENT("Grass"));
+	loadPerEntityPool<proc_placement_component>(registry, reader, BINARY_SCENE_CHUNK_COMPONENT("Procedural placement"));
+	loadPerEntityPool<water_component>(registry, reader, BINARY_SCENE_CHUNK_COMPONENT("Water"));
+
+	LOG_MESSAGE("Scene loaded from '%ws'", scene.savePath.c_str());
+
+	return true;
+}
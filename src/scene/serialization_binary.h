@@ -1,7 +1,12 @@
 #pragma once
 
 #include "scene.h"
+#include "rendering/main_renderer.h"
 
 uint64 serializeEntityToMemory(scene_entity entity, void* memory, uint64 maxSize);
 bool deserializeEntityFromMemory(scene_entity entity, void* memory, uint64 size);
 
+
+// Whole scene in a chunked binary format (*.scb). Much faster to load than YAML for large scenes.
+void serializeSceneToBinaryFile(editor_scene& scene, const renderer_settings& rendererSettings);
+bool deserializeSceneFromBinaryFile(editor_scene& scene, renderer_settings& rendererSettings, std::string& environmentName);
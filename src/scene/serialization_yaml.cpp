@@ -82,6 +82,7 @@ namespace YAML
 			n["Gravity factor"] = c.gravityFactor;
 			n["Linear damping"] = c.linearDamping;
 			n["Angular damping"] = c.angularDamping;
+			n["Continuous collision"] = c.continuousCollision;
 			return n;
 		}
 
@@ -95,6 +96,7 @@ namespace YAML
 			YAML_LOAD(n, c.gravityFactor, "Gravity factor");
 			YAML_LOAD(n, c.linearDamping, "Linear damping");
 			YAML_LOAD(n, c.angularDamping, "Angular damping");
+			YAML_LOAD(n, c.continuousCollision, "Continuous collision");
 
 			return true;
 		}
@@ -466,6 +468,7 @@ bool deserializeSceneFromYAMLFile(editor_scene& scene, renderer_settings& render
 		return false;
 	}
 
+	scene.snapshot.discard();
 	scene.editorScene = game_scene();
 	scene.savePath = std::move(filename);
 
@@ -0,0 +1,590 @@
+#include "pch.h"
+#include "static_render_index.h"
+
+#include "geometry/mesh.h"
+#include "core/threading.h"
+
+#include <algorithm>
+
+
+#define INVALID_PROXY 0xFFFFFFFF
+
+// If more proxies changed in a single frame, the hierarchy is rebuilt from scratch instead of updated incrementally.
+#define MIN_NUM_CHANGES_FOR_REBUILD 64
+
+static const float unboundedRadius = 1e15f; // Meshes without a valid bounding box. Finite, so that surface areas don't overflow.
+
+
+static uint32 getEntityIndex(entity_handle entity)
+{
+	return (uint32)entity & entt::entt_traits<entity_handle>::entity_mask;
+}
+
+static float surfaceArea(const bounding_box& aabb)
+{
+	vec3 d = aabb.maxCorner - aabb.minCorner;
+	return 2.f * (d.x * d.y + d.y * d.z + d.z * d.x);
+}
+
+static bounding_box combine(const bounding_box& a, const bounding_box& b)
+{
+	return bounding_box::fromMinMax(min(a.minCorner, b.minCorner), max(a.maxCorner, b.maxCorner));
+}
+
+static bounding_box getWorldSpaceAABB(const bounding_box& meshAABB, const trs& transform)
+{
+	if (meshAABB.maxCorner.x == meshAABB.minCorner.x)
+	{
+		return bounding_box::fromCenterRadius(vec3(0.f), vec3(unboundedRadius));
+	}
+
+	bounding_box scaled = bounding_box::fromCenterRadius(meshAABB.getCenter() * transform.scale, meshAABB.getRadius() * abs(transform.scale));
+	return scaled.transformToAABB(transform.rotation, transform.position);
+}
+
+
+
+
+void static_render_index::beginSync()
+{
+	++syncIndex;
+	numSynced = 0;
+}
+
+void static_render_index::sync(entity_handle entity, const ref<multi_mesh>& mesh, const trs& transform)
+{
+	uint32 proxyIndex = findProxy(entity);
+
+	if (!mesh || mesh->loadState.load() != asset_loaded)
+	{
+		// Not renderable (yet).
+		if (proxyIndex != INVALID_PROXY)
+		{
+			removeProxy(proxyIndex);
+		}
+		return;
+	}
+
+	if (proxyIndex == INVALID_PROXY)
+	{
+		proxyIndex = addProxy(entity, mesh);
+	}
+
+	static_render_proxy& proxy = proxies[proxyIndex];
+
+	if (proxy.mesh != mesh.get())
+	{
+		removeFromBatch(proxyIndex);
+		addToBatch(proxyIndex, mesh);
+		markDirty(proxyIndex);
+	}
+
+	if (proxy.leaf == -1
+		|| memcmp(&proxy.transform, &transform, sizeof(trs)) != 0
+		|| memcmp(&proxy.meshAABB, &mesh->aabb, sizeof(bounding_box)) != 0)
+	{
+		proxy.transform = transform;
+		proxy.meshAABB = mesh->aabb;
+		proxy.transformMatrix = trsToMat4(transform);
+		proxy.worldAABB = getWorldSpaceAABB(proxy.meshAABB, transform);
+		markDirty(proxyIndex);
+	}
+
+	proxy.lastSync = syncIndex;
+	++numSynced;
+}
+
+void static_render_index::endSync()
+{
+	if (proxies.size() > numSynced)
+	{
+		// Some entities were removed from the scene (or lost one of the required components). Iterate backwards, so that the proxy
+		// swapped into a removed slot has already been checked.
+		for (int32 i = (int32)proxies.size() - 1; i >= 0; --i)
+		{
+			if (proxies[i].lastSync != syncIndex)
+			{
+				removeProxy(i);
+			}
+		}
+	}
+
+	if (pendingInserts.empty())
+	{
+		return;
+	}
+
+	if (pendingInserts.size() >= max((uint32)MIN_NUM_CHANGES_FOR_REBUILD, (uint32)proxies.size() / 4))
+	{
+		rebuild();
+	}
+	else
+	{
+		for (entity_handle entity : pendingInserts)
+		{
+			uint32 proxyIndex = findProxy(entity);
+			if (proxyIndex == INVALID_PROXY)
+			{
+				continue; // Removed again after it was changed.
+			}
+
+			static_render_proxy& proxy = proxies[proxyIndex];
+			if (proxy.leaf != -1)
+			{
+				removeLeaf(proxy.leaf);
+			}
+			else
+			{
+				proxy.leaf = allocateNode();
+			}
+
+			static_bvh_node& node = nodes[proxy.leaf];
+			node.aabb = proxy.worldAABB;
+			node.children[0] = node.children[1] = -1;
+			node.proxy = proxyIndex;
+
+			insertLeaf(proxy.leaf);
+			proxy.dirty = false;
+		}
+	}
+
+	pendingInserts.clear();
+}
+
+uint32 static_render_index::findProxy(entity_handle entity) const
+{
+	uint32 entityIndex = getEntityIndex(entity);
+	if (entityIndex >= entityToProxy.size())
+	{
+		return INVALID_PROXY;
+	}
+
+	uint32 proxyIndex = entityToProxy[entityIndex];
+	if (proxyIndex == INVALID_PROXY || proxies[proxyIndex].entity != entity)
+	{
+		return INVALID_PROXY;
+	}
+	return proxyIndex;
+}
+
+uint32 static_render_index::addProxy(entity_handle entity, const ref<multi_mesh>& mesh)
+{
+	uint32 entityIndex = getEntityIndex(entity);
+	if (entityIndex >= entityToProxy.size())
+	{
+		entityToProxy.resize(entityIndex + 1, INVALID_PROXY);
+	}
+
+	uint32 proxyIndex = (uint32)proxies.size();
+	entityToProxy[entityIndex] = proxyIndex;
+
+	static_render_proxy& proxy = proxies.emplace_back();
+	proxy.entity = entity;
+	proxy.leaf = -1;
+	proxy.dirty = false;
+
+	addToBatch(proxyIndex, mesh);
+
+	return proxyIndex;
+}
+
+void static_render_index::removeProxy(uint32 proxyIndex)
+{
+	static_render_proxy& proxy = proxies[proxyIndex];
+
+	if (proxy.leaf != -1)
+	{
+		removeLeaf(proxy.leaf);
+		freeNode(proxy.leaf);
+	}
+
+	removeFromBatch(proxyIndex);
+
+	entityToProxy[getEntityIndex(proxy.entity)] = INVALID_PROXY;
+
+	uint32 lastIndex = (uint32)proxies.size() - 1;
+	if (proxyIndex != lastIndex)
+	{
+		proxy = proxies[lastIndex];
+
+		entityToProxy[getEntityIndex(proxy.entity)] = proxyIndex;
+		batches[proxy.batch].proxies[proxy.indexInBatch] = proxyIndex;
+		if (proxy.leaf != -1)
+		{
+			nodes[proxy.leaf].proxy = proxyIndex;
+		}
+	}
+
+	proxies.pop_back();
+}
+
+void static_render_index::addToBatch(uint32 proxyIndex, const ref<multi_mesh>& mesh)
+{
+	auto it = meshToBatch.find(mesh.get());
+	if (it == meshToBatch.end())
+	{
+		it = meshToBatch.insert({ mesh.get(), (uint32)batches.size() }).first;
+		batches.push_back({ mesh });
+	}
+
+	static_render_proxy& proxy = proxies[proxyIndex];
+	static_mesh_batch& batch = batches[it->second];
+
+	proxy.mesh = mesh.get();
+	proxy.batch = it->second;
+	proxy.indexInBatch = (uint32)batch.proxies.size();
+	batch.proxies.push_back(proxyIndex);
+}
+
+void static_render_index::removeFromBatch(uint32 proxyIndex)
+{
+	static_render_proxy& proxy = proxies[proxyIndex];
+	uint32 batchIndex = proxy.batch;
+	static_mesh_batch& batch = batches[batchIndex];
+
+	uint32 moved = batch.proxies.back();
+	batch.proxies[proxy.indexInBatch] = moved;
+	proxies[moved].indexInBatch = proxy.indexInBatch;
+	batch.proxies.pop_back();
+
+	if (batch.proxies.empty())
+	{
+		meshToBatch.erase(proxy.mesh);
+
+		uint32 lastBatch = (uint32)batches.size() - 1;
+		if (batchIndex != lastBatch)
+		{
+			batches[batchIndex] = std::move(batches[lastBatch]);
+			meshToBatch[batches[batchIndex].mesh.get()] = batchIndex;
+			for (uint32 p : batches[batchIndex].proxies)
+			{
+				proxies[p].batch = batchIndex;
+			}
+		}
+		batches.pop_back();
+	}
+}
+
+void static_render_index::markDirty(uint32 proxyIndex)
+{
+	static_render_proxy& proxy = proxies[proxyIndex];
+	if (!proxy.dirty)
+	{
+		proxy.dirty = true;
+		pendingInserts.push_back(proxy.entity);
+	}
+}
+
+int32 static_render_index::allocateNode()
+{
+	if (!freeNodes.empty())
+	{
+		int32 node = freeNodes.back();
+		freeNodes.pop_back();
+		return node;
+	}
+
+	nodes.emplace_back();
+	return (int32)nodes.size() - 1;
+}
+
+void static_render_index::freeNode(int32 node)
+{
+	freeNodes.push_back(node);
+}
+
+void static_render_index::insertLeaf(int32 leaf)
+{
+	if (root == -1)
+	{
+		root = leaf;
+		nodes[leaf].parent = -1;
+		return;
+	}
+
+	// Find the best sibling with the surface area heuristic. Descend while the cost of pushing the leaf further down is lower than
+	// making it a sibling of the current node.
+	bounding_box leafAABB = nodes[leaf].aabb;
+	int32 index = root;
+	while (!nodes[index].isLeaf())
+	{
+		const static_bvh_node& node = nodes[index];
+
+		float area = surfaceArea(node.aabb);
+		float combinedArea = surfaceArea(combine(node.aabb, leafAABB));
+
+		float cost = 2.f * combinedArea;
+		float inheritanceCost = 2.f * (combinedArea - area);
+
+		float childCosts[2];
+		for (uint32 i = 0; i < 2; ++i)
+		{
+			const static_bvh_node& child = nodes[node.children[i]];
+			float newArea = surfaceArea(combine(child.aabb, leafAABB));
+			childCosts[i] = (child.isLeaf() ? newArea : (newArea - surfaceArea(child.aabb))) + inheritanceCost;
+		}
+
+		if (cost < childCosts[0] && cost < childCosts[1])
+		{
+			break;
+		}
+
+		index = (childCosts[0] < childCosts[1]) ? node.children[0] : node.children[1];
+	}
+
+	int32 sibling = index;
+	int32 oldParent = nodes[sibling].parent;
+	int32 newParent = allocateNode();
+
+	static_bvh_node& parent = nodes[newParent];
+	parent.parent = oldParent;
+	parent.aabb = combine(leafAABB, nodes[sibling].aabb);
+	parent.children[0] = sibling;
+	parent.children[1] = leaf;
+
+	nodes[sibling].parent = newParent;
+	nodes[leaf].parent = newParent;
+
+	if (oldParent == -1)
+	{
+		root = newParent;
+	}
+	else
+	{
+		static_bvh_node& p = nodes[oldParent];
+		p.children[(p.children[0] == sibling) ? 0 : 1] = newParent;
+		refit(oldParent);
+	}
+}
+
+void static_render_index::removeLeaf(int32 leaf)
+{
+	if (leaf == root)
+	{
+		root = -1;
+		return;
+	}
+
+	int32 parent = nodes[leaf].parent;
+	int32 grandParent = nodes[parent].parent;
+	int32 sibling = (nodes[parent].children[0] == leaf) ? nodes[parent].children[1] : nodes[parent].children[0];
+
+	if (grandParent == -1)
+	{
+		root = sibling;
+		nodes[sibling].parent = -1;
+	}
+	else
+	{
+		static_bvh_node& g = nodes[grandParent];
+		g.children[(g.children[0] == parent) ? 0 : 1] = sibling;
+		nodes[sibling].parent = grandParent;
+		refit(grandParent);
+	}
+
+	freeNode(parent);
+}
+
+void static_render_index::refit(int32 node)
+{
+	while (node != -1)
+	{
+		static_bvh_node& n = nodes[node];
+		n.aabb = combine(nodes[n.children[0]].aabb, nodes[n.children[1]].aabb);
+		node = n.parent;
+	}
+}
+
+void static_render_index::rebuild()
+{
+	nodes.clear();
+	freeNodes.clear();
+	root = -1;
+
+	uint32 numProxies = (uint32)proxies.size();
+	if (numProxies == 0)
+	{
+		return;
+	}
+
+	nodes.reserve(2 * numProxies - 1);
+
+	std::vector<uint32> proxyIndices(numProxies);
+	for (uint32 i = 0; i < numProxies; ++i)
+	{
+		proxyIndices[i] = i;
+		proxies[i].dirty = false;
+	}
+
+	root = buildRecursive(proxyIndices.data(), numProxies, -1);
+}
+
+int32 static_render_index::buildRecursive(uint32* proxyIndices, uint32 count, int32 parent)
+{
+	int32 index = allocateNode();
+
+	if (count == 1)
+	{
+		static_render_proxy& proxy = proxies[proxyIndices[0]];
+		proxy.leaf = index;
+
+		static_bvh_node& node = nodes[index];
+		node.aabb = proxy.worldAABB;
+		node.parent = parent;
+		node.children[0] = node.children[1] = -1;
+		node.proxy = proxyIndices[0];
+		return index;
+	}
+
+	// Median split along the longest axis of the centroids.
+	bounding_box centroidBounds = bounding_box::negativeInfinity();
+	for (uint32 i = 0; i < count; ++i)
+	{
+		centroidBounds.grow(proxies[proxyIndices[i]].worldAABB.getCenter());
+	}
+
+	vec3 extent = centroidBounds.maxCorner - centroidBounds.minCorner;
+	uint32 axis = (extent.x > extent.y) ? ((extent.x > extent.z) ? 0 : 2) : ((extent.y > extent.z) ? 1 : 2);
+
+	uint32 half = count / 2;
+	std::nth_element(proxyIndices, proxyIndices + half, proxyIndices + count, [this, axis](uint32 a, uint32 b)
+	{
+		return proxies[a].worldAABB.getCenter().data[axis] < proxies[b].worldAABB.getCenter().data[axis];
+	});
+
+	int32 left = buildRecursive(proxyIndices, half, index);
+	int32 right = buildRecursive(proxyIndices + half, count - half, index);
+
+	// Don't hold a reference across the recursive calls.
+	static_bvh_node& node = nodes[index];
+	node.parent = parent;
+	node.children[0] = left;
+	node.children[1] = right;
+	node.aabb = combine(nodes[left].aabb, nodes[right].aabb);
+	return index;
+}
+
+
+
+
+enum cull_classification
+{
+	cull_outside,
+	cull_intersecting,
+	cull_inside,
+};
+
+static cull_classification classify(const culling_view& view, const bounding_box& aabb)
+{
+	vec3 center = aabb.getCenter();
+	vec3 radius = aabb.getRadius();
+
+	if (view.type == culling_view_frustum)
+	{
+		cull_classification result = cull_inside;
+		for (uint32 i = 0; i < 6; ++i)
+		{
+			vec4 plane = view.frustum.planes[i];
+			vec3 n = plane.xyz;
+
+			float d = dot(n, center) + plane.w;
+			float r = dot(abs(n), radius);
+
+			if (d + r < 0.f)
+			{
+				return cull_outside;
+			}
+			if (d - r < 0.f)
+			{
+				result = cull_intersecting;
+			}
+		}
+		return result;
+	}
+	else
+	{
+		const bounding_sphere& s = view.sphere;
+		float radiusSquared = s.radius * s.radius;
+
+		vec3 e = max(abs(s.center - center) - radius, vec3(0.f));
+		if (dot(e, e) > radiusSquared)
+		{
+			return cull_outside;
+		}
+
+		vec3 f = abs(s.center - center) + radius; // Farthest corner.
+		return (dot(f, f) <= radiusSquared) ? cull_inside : cull_intersecting;
+	}
+}
+
+#define INSIDE_FLAG 0x80000000
+
+static void cullView(const static_render_index& index, const culling_view& view, uint32* stack, static_render_view_result& result)
+{
+	if (index.root == -1)
+	{
+		return;
+	}
+
+	uint32 stackSize = 0;
+	stack[stackSize++] = (uint32)index.root;
+
+	while (stackSize)
+	{
+		uint32 entry = stack[--stackSize];
+		bool inside = entry & INSIDE_FLAG;
+		const static_bvh_node& node = index.nodes[entry & ~INSIDE_FLAG];
+
+		if (!inside)
+		{
+			cull_classification c = classify(view, node.aabb);
+			if (c == cull_outside)
+			{
+				continue;
+			}
+			inside = (c == cull_inside);
+		}
+
+		if (node.isLeaf())
+		{
+			result.visibleProxies[result.numVisibleProxies++] = node.proxy;
+		}
+		else
+		{
+			// Children of nodes, which are completely inside the view, are not tested anymore.
+			uint32 flag = inside ? INSIDE_FLAG : 0;
+			stack[stackSize++] = (uint32)node.children[0] | flag;
+			stack[stackSize++] = (uint32)node.children[1] | flag;
+		}
+	}
+}
+
+static_render_view_result* static_render_index::cull(thread_job_context& context, const culling_view* views, uint32 numViews, memory_arena& arena) const
+{
+	static_render_view_result* results = arena.allocate<static_render_view_result>(numViews);
+
+	uint32 numProxies = (uint32)proxies.size();
+	uint32 stackCapacity = (uint32)nodes.size() + 1;
+
+	for (uint32 i = 0; i < numViews; ++i)
+	{
+		static_render_view_result& result = results[i];
+		result.visibleProxies = arena.allocate<uint32>(numProxies);
+		result.numVisibleProxies = 0;
+
+		if (numProxies == 0)
+		{
+			continue;
+		}
+
+		uint32* stack = arena.allocate<uint32>(stackCapacity);
+		culling_view view = views[i];
+
+		context.addWork([this, view, stack, &result]()
+		{
+			cullView(*this, view, stack, result);
+		});
+	}
+
+	return results;
+}
@@ -0,0 +1,101 @@
+#pragma once
+
+#include "scene.h"
+#include "core/memory.h"
+#include "physics/bounding_volumes.h"
+#include "rendering/frustum_culling.h"
+
+#include <unordered_map>
+
+struct multi_mesh;
+struct thread_job_context;
+
+
+// Persistent bounding volume hierarchy over static mesh instances, i.e. entities with a transform and a (loaded) mesh, but without
+// a dynamic transform, animation or tree component. The index is stored as a context variable in the scene's registry and is
+// synchronized with the scene once per frame. Only entities which were added, removed, moved or changed their mesh touch the hierarchy.
+// Instance lists per mesh and the instance transforms are cached between frames.
+
+struct static_render_proxy
+{
+	entity_handle entity;
+	multi_mesh* mesh;
+
+	trs transform;
+	bounding_box meshAABB; // In model space. Stored to detect changes.
+
+	mat4 transformMatrix;
+	bounding_box worldAABB;
+
+	int32 leaf = -1; // Node in the hierarchy, -1 if not inserted yet.
+	uint32 batch;
+	uint32 indexInBatch;
+
+	uint32 lastSync;
+	bool dirty;
+};
+
+struct static_mesh_batch
+{
+	ref<multi_mesh> mesh;
+	std::vector<uint32> proxies;
+};
+
+struct static_bvh_node
+{
+	bounding_box aabb;
+	int32 parent;
+	int32 children[2]; // -1 for leaves.
+	uint32 proxy; // Only valid for leaves.
+
+	bool isLeaf() const { return children[0] == -1; }
+};
+
+// Indices into static_render_index::proxies, which are visible in one view.
+struct static_render_view_result
+{
+	uint32* visibleProxies;
+	uint32 numVisibleProxies;
+};
+
+struct static_render_index
+{
+	// Call sync for every static entity between beginSync and endSync. Entities which are not synced are removed.
+	void beginSync();
+	void sync(entity_handle entity, const ref<multi_mesh>& mesh, const trs& transform);
+	void endSync();
+
+	// Traverses the hierarchy once per view. Adds one job per view to the context, the results are valid once the context has finished.
+	// All memory is allocated from the arena.
+	static_render_view_result* cull(thread_job_context& context, const culling_view* views, uint32 numViews, memory_arena& arena) const;
+
+	std::vector<static_render_proxy> proxies;
+	std::vector<static_mesh_batch> batches;
+
+	std::vector<static_bvh_node> nodes;
+	int32 root = -1;
+
+private:
+	uint32 findProxy(entity_handle entity) const;
+	uint32 addProxy(entity_handle entity, const ref<multi_mesh>& mesh);
+	void removeProxy(uint32 proxyIndex);
+	void addToBatch(uint32 proxyIndex, const ref<multi_mesh>& mesh);
+	void removeFromBatch(uint32 proxyIndex);
+	void markDirty(uint32 proxyIndex);
+
+	int32 allocateNode();
+	void freeNode(int32 node);
+	void insertLeaf(int32 leaf);
+	void removeLeaf(int32 leaf);
+	void refit(int32 node);
+	void rebuild();
+	int32 buildRecursive(uint32* proxyIndices, uint32 count, int32 parent);
+
+	std::vector<int32> freeNodes;
+	std::vector<uint32> entityToProxy; // Indexed by the entity part of the handle.
+	std::unordered_map<multi_mesh*, uint32> meshToBatch;
+	std::vector<entity_handle> pendingInserts;
+
+	uint32 syncIndex = 0;
+	uint32 numSynced = 0;
+};
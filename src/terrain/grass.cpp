@@ -265,6 +265,11 @@ struct grass_update_pipeline
 				for (uint32 x = 0; x < data.chunksPerDim; ++x)
 				{
 					auto& chunk = data.chunks[z * data.chunksPerDim + x];
+					if (!chunk.heightmap)
+					{
+						continue; // Not resident (streaming terrain).
+					}
+
 					vec3 chunkMinCorner = minCorner + vec3(x * data.chunkSize, 0.f, z * data.chunkSize);
 					vec3 chunkMaxCorner = chunkMinCorner + chunkSize;
 
@@ -1,5 +1,11 @@
 #include "pch.h"
 #include "heightmap_collider.h"
+#include "core/threading.h"
+#include "core/cpu_profiling.h"
+#include "core/radix_sort.h"
+
+
+#define HEIGHTMAP_RAYS_PER_JOB 256
 
 
 heightmap_collider_component::heightmap_collider_component(uint32 chunksPerDim, float chunkSize, physics_material material)
@@ -18,6 +24,11 @@ void heightmap_collider_component::update(vec3 minCorner, float amplitudeScale)
 	this->heightScale = amplitudeScale / UINT16_MAX;
 }
 
+bool heightmap_collider_component::needsUpdate(vec3 minCorner, float amplitudeScale) const
+{
+	return this->minCorner != minCorner || this->heightScale != amplitudeScale / UINT16_MAX;
+}
+
 float heightmap_collider_component::getHeightAt(vec2 coord) const
 {
 	coord -= vec2(this->minCorner.x, this->minCorner.z);
@@ -40,10 +51,553 @@ float heightmap_collider_component::getHeightAt(vec2 coord) const
 	return col.getHeightAt(coord, heightScale, this->minCorner.y);
 }
 
+bool heightmap_collider_component::isAboveTerrain(const bounding_box& volume) const
+{
+	vec3 minCorner = volume.minCorner - this->minCorner;
+	vec3 maxCorner = volume.maxCorner - this->minCorner;
+
+	minCorner.x *= invChunkSize;
+	minCorner.z *= invChunkSize;
+	maxCorner.x *= invChunkSize;
+	maxCorner.z *= invChunkSize;
+
+	if (maxCorner.x < 0.f || maxCorner.z < 0.f || minCorner.x >= chunksPerDim || minCorner.z >= chunksPerDim)
+	{
+		return true;
+	}
+
+	uint32 minX = max((int32)minCorner.x, 0);
+	uint32 minZ = max((int32)minCorner.z, 0);
+	uint32 maxX = (uint32)clamp((int32)maxCorner.x, 0, (int32)chunksPerDim - 1);
+	uint32 maxZ = (uint32)clamp((int32)maxCorner.z, 0, (int32)chunksPerDim - 1);
+
+	float relativeMinY = minCorner.y * invAmplitudeScale;
+	if (relativeMinY > 1.f)
+	{
+		return true;
+	}
+
+	uint16 minHeight = (uint16)(saturate(relativeMinY) * UINT16_MAX);
+
+	// Cells of 8x8 segments are fine enough to reject most colliders resting on or flying above the terrain.
+	const uint32 stopMipLevel = 3;
+
+	for (uint32 z = minZ; z <= maxZ; ++z)
+	{
+		for (uint32 x = minX; x <= maxX; ++x)
+		{
+			float relMinX = max(minCorner.x - x, 0.f);
+			float relMinZ = max(minCorner.z - z, 0.f);
+			float relMaxX = (maxCorner.x > (x + 1)) ? 1.f : frac(maxCorner.x);
+			float relMaxZ = (maxCorner.z > (z + 1)) ? 1.f : frac(maxCorner.z);
+
+			uint32 chunkSpaceMinX = (uint32)(relMinX * TERRAIN_LOD_0_VERTICES_PER_DIMENSION);
+			uint32 chunkSpaceMinZ = (uint32)(relMinZ * TERRAIN_LOD_0_VERTICES_PER_DIMENSION);
+			uint32 chunkSpaceMaxX = (uint32)(relMaxX * TERRAIN_LOD_0_VERTICES_PER_DIMENSION);
+			uint32 chunkSpaceMaxZ = (uint32)(relMaxZ * TERRAIN_LOD_0_VERTICES_PER_DIMENSION);
+
+			if (!collider(x, z).isBelow(chunkSpaceMinX, chunkSpaceMinZ, chunkSpaceMaxX, chunkSpaceMaxZ, minHeight, stopMipLevel))
+			{
+				return false;
+			}
+		}
+	}
+
+	return true;
+}
+
+uint32 heightmap_collider_component::getChunkIndex(vec2 coord) const
+{
+	coord -= vec2(this->minCorner.x, this->minCorner.z);
+	coord *= invChunkSize;
+
+	uint32 x = (uint32)clamp((int32)coord.x, 0, (int32)chunksPerDim - 1);
+	uint32 z = (uint32)clamp((int32)coord.y, 0, (int32)chunksPerDim - 1);
+
+	return z * chunksPerDim + x;
+}
+
+bool heightmap_collider_component::cast(vec3 origin, vec3 direction, const heightmap_cast_shape& shape, float maxDistance, heightmap_hit& outHit) const
+{
+	// Chunks overlapped by the swept bounds of the shape.
+	vec3 end = origin + direction * maxDistance;
+	vec3 sweptMin = min(origin, end) + min(shape.offsetA, shape.offsetB) - vec3(shape.radius) - this->minCorner;
+	vec3 sweptMax = max(origin, end) + max(shape.offsetA, shape.offsetB) + vec3(shape.radius) - this->minCorner;
+
+	sweptMin.x *= invChunkSize;
+	sweptMin.z *= invChunkSize;
+	sweptMax.x *= invChunkSize;
+	sweptMax.z *= invChunkSize;
+
+	if (sweptMax.x < 0.f || sweptMax.z < 0.f || sweptMin.x >= chunksPerDim || sweptMin.z >= chunksPerDim)
+	{
+		return false;
+	}
+
+	int32 minX = max((int32)sweptMin.x, 0);
+	int32 minZ = max((int32)sweptMin.z, 0);
+	int32 maxX = clamp((int32)sweptMax.x, 0, (int32)chunksPerDim - 1);
+	int32 maxZ = clamp((int32)sweptMax.z, 0, (int32)chunksPerDim - 1);
+
+	// Visit chunks roughly front to back, so that later chunks are culled by their root node.
+	int32 stepX = (direction.x < 0.f) ? -1 : 1;
+	int32 stepZ = (direction.z < 0.f) ? -1 : 1;
+	int32 firstX = (stepX > 0) ? minX : maxX;
+	int32 firstZ = (stepZ > 0) ? minZ : maxZ;
+	int32 numX = maxX - minX + 1;
+	int32 numZ = maxZ - minZ + 1;
+
+	heightmap_hit hit;
+	hit.distance = maxDistance;
+
+	bool result = false;
+	for (int32 iz = 0, z = firstZ; iz < numZ; ++iz, z += stepZ)
+	{
+		for (int32 ix = 0, x = firstX; ix < numX; ++ix, x += stepX)
+		{
+			vec3 chunkMinCorner = vec3(x * chunkSize, 0.f, z * chunkSize) + this->minCorner;
+			result |= collider(x, z).cast(origin, direction, shape, chunkScale, heightScale, chunkMinCorner, hit);
+		}
+	}
+
+	if (result)
+	{
+		outHit = hit;
+	}
+	return result;
+}
+
+bool heightmap_collider_component::raycast(const ray& r, float maxDistance, heightmap_hit& outHit) const
+{
+	heightmap_cast_shape shape = { vec3(0.f), vec3(0.f), 0.f };
+	return cast(r.origin, r.direction, shape, maxDistance, outHit);
+}
+
+bool heightmap_collider_component::sphereCast(const bounding_sphere& sphere, vec3 direction, float maxDistance, heightmap_hit& outHit) const
+{
+	heightmap_cast_shape shape = { vec3(0.f), vec3(0.f), sphere.radius };
+	return cast(sphere.center, direction, shape, maxDistance, outHit);
+}
+
+bool heightmap_collider_component::capsuleCast(const bounding_capsule& capsule, vec3 direction, float maxDistance, heightmap_hit& outHit) const
+{
+	vec3 center = (capsule.positionA + capsule.positionB) * 0.5f;
+	heightmap_cast_shape shape = { capsule.positionA - center, capsule.positionB - center, capsule.radius };
+	return cast(center, direction, shape, maxDistance, outHit);
+}
+
+uint32 heightmap_collider_component::raycast(const ray* rays, uint32 numRays, float maxDistance, heightmap_hit* outHits, memory_arena& arena) const
+{
+	CPU_PROFILE_BLOCK("Heightmap batched raycast");
+
+	memory_marker marker = arena.getMarker();
+
+	uint64* order = arena.allocate<uint64>(numRays);
+	uint64* scratch = arena.allocate<uint64>(numRays);
+
+	for (uint32 i = 0; i < numRays; ++i)
+	{
+		uint64 chunkIndex = getChunkIndex(vec2(rays[i].origin.x, rays[i].origin.z));
+		order[i] = (chunkIndex << 32) | i;
+	}
+
+	radixSort(order, scratch, numRays, [](uint64 key) { return key; });
+
+	volatile uint32 numHits = 0;
+
+	thread_job_context context;
+	for (uint32 first = 0; first < numRays; first += HEIGHTMAP_RAYS_PER_JOB)
+	{
+		uint32 end = min(first + HEIGHTMAP_RAYS_PER_JOB, numRays);
+		context.addWork([this, rays, order, first, end, maxDistance, outHits, &numHits]()
+		{
+			uint32 jobNumHits = 0;
+			for (uint32 i = first; i < end; ++i)
+			{
+				uint32 rayIndex = (uint32)order[i];
+				heightmap_hit& hit = outHits[rayIndex];
+				if (raycast(rays[rayIndex], maxDistance, hit))
+				{
+					++jobNumHits;
+				}
+				else
+				{
+					hit.distance = FLT_MAX;
+				}
+			}
+			atomicAdd(numHits, jobNumHits);
+		});
+	}
+	context.waitForWorkCompletion();
+
+	arena.resetToMarker(marker);
+
+	return numHits;
+}
+
+bool heightmap_collider_chunk::isBelow(uint32 volMinX, uint32 volMinZ, uint32 volMaxX, uint32 volMaxZ, uint32 volMinY, uint32 stopMipLevel) const
+{
+	if (!heights)
+	{
+		return true;
+	}
+
+	struct stack_entry
+	{
+		uint16 mipLevel;
+		uint16 x, z;
+	};
+
+	// Depth first, so at most 3 siblings per level are pending.
+	stack_entry stack[64];
+	uint32 stackSize = 0;
+
+	uint32 numMips = (uint32)mips.size();
+	stack[stackSize++] = { (uint16)(numMips - 1), 0, 0 };
+
+	while (stackSize > 0)
+	{
+		stack_entry entry = stack[--stackSize];
+
+		uint32 minX = entry.x << entry.mipLevel;
+		uint32 minZ = entry.z << entry.mipLevel;
+		uint32 maxX = ((entry.x + 1) << entry.mipLevel) - 1;
+		uint32 maxZ = ((entry.z + 1) << entry.mipLevel) - 1;
+
+		if (maxX < volMinX || minX > volMaxX) continue;
+		if (maxZ < volMinZ || minZ > volMaxZ) continue;
+
+		uint32 numSegmentsPerDim = (TERRAIN_LOD_0_VERTICES_PER_DIMENSION - 1) >> entry.mipLevel;
+		heightmap_min_max minmax = mips[entry.mipLevel][entry.z * numSegmentsPerDim + entry.x];
+		if (minmax.max < volMinY) continue;
+
+		if (entry.mipLevel <= stopMipLevel)
+		{
+			return false;
+		}
+
+		stack[stackSize++] = { (uint16)(entry.mipLevel - 1), (uint16)(2 * entry.x + 0), (uint16)(2 * entry.z + 0) };
+		stack[stackSize++] = { (uint16)(entry.mipLevel - 1), (uint16)(2 * entry.x + 0), (uint16)(2 * entry.z + 1) };
+		stack[stackSize++] = { (uint16)(entry.mipLevel - 1), (uint16)(2 * entry.x + 1), (uint16)(2 * entry.z + 0) };
+		stack[stackSize++] = { (uint16)(entry.mipLevel - 1), (uint16)(2 * entry.x + 1), (uint16)(2 * entry.z + 1) };
+	}
+
+	return true;
+}
+
+// Slab test. Returns the entry distance, clamped to 0 if the origin is inside.
+static bool rayVsBox(vec3 origin, vec3 invDirection, vec3 minCorner, vec3 maxCorner, float maxDistance, float& outDistance)
+{
+	vec3 t0 = (minCorner - origin) * invDirection;
+	vec3 t1 = (maxCorner - origin) * invDirection;
+	vec3 tNear = min(t0, t1);
+	vec3 tFar = max(t0, t1);
+
+	float entry = max(max(tNear.x, tNear.y), max(tNear.z, 0.f));
+	float exit = min(min(tFar.x, tFar.y), min(tFar.z, maxDistance));
+
+	outDistance = entry;
+	return entry <= exit;
+}
+
+static bool sweepSphereVsTriangle(vec3 center, float radius, vec3 direction, vec3 a, vec3 b, vec3 c, float& outT)
+{
+	// Initial overlap with the face, an edge or a vertex.
+	if (squaredLength(center - closestPoint_PointTriangle(center, a, b, c)) <= radius * radius)
+	{
+		outT = 0.f;
+		return true;
+	}
+
+	vec3 normal = noz(cross(b - a, c - a));
+	float distance = dot(center - a, normal);
+
+	ray r = { center, direction };
+
+	outT = FLT_MAX;
+	bool result = false;
+	float t;
+
+	// Face: Triangle moved towards the sphere by its radius.
+	vec3 offset = normal * ((distance >= 0.f) ? radius : -radius);
+	bool frontFacing;
+	if (r.intersectTriangle(a + offset, b + offset, c + offset, t, frontFacing))
+	{
+		outT = t;
+		result = true;
+	}
+
+	// Edges and vertices.
+	if (r.intersectCapsule(bounding_capsule{ a, b, radius }, t) && t < outT) { outT = t; result = true; }
+	if (r.intersectCapsule(bounding_capsule{ b, c, radius }, t) && t < outT) { outT = t; result = true; }
+	if (r.intersectCapsule(bounding_capsule{ c, a, radius }, t) && t < outT) { outT = t; result = true; }
+
+	return result;
+}
+
+// Contact between the interiors of the moving segment p and the static segment e. Contacts at the end points are not reported.
+static bool sweepSegmentVsSegment(vec3 p0, vec3 p1, vec3 e0, vec3 e1, float radius, vec3 direction, float& outT)
+{
+	vec3 s = p1 - p0;
+	vec3 e = e1 - e0;
+
+	vec3 n = cross(s, e);
+	float nLength = length(n);
+	if (nLength < 1e-6f)
+	{
+		return false; // Parallel. Covered by the end points.
+	}
+	n /= nLength;
+
+	// While the closest points are interior, the distance between the segments is the distance along n.
+	float distance = dot(p0 - e0, n);
+	float speed = dot(direction, n);
+	if (distance < 0.f)
+	{
+		distance = -distance;
+		speed = -speed;
+	}
+
+	float t = 0.f;
+	if (distance > radius)
+	{
+		if (speed >= 0.f)
+		{
+			return false;
+		}
+		t = (radius - distance) / speed;
+	}
+
+	// Closest points of the two lines at time t.
+	vec3 r = p0 + direction * t - e0;
+	float ss = dot(s, s);
+	float ee = dot(e, e);
+	float se = dot(s, e);
+	float sr = dot(s, r);
+	float er = dot(e, r);
+	float denom = ss * ee - se * se;
+
+	float paramS = (se * er - sr * ee) / denom;
+	float paramE = (ss * er - se * sr) / denom;
+
+	if (paramS < 0.f || paramS > 1.f || paramE < 0.f || paramE > 1.f)
+	{
+		return false;
+	}
+
+	outT = t;
+	return true;
+}
+
+static bool sweepCapsuleVsTriangle(vec3 p0, vec3 p1, float radius, vec3 direction, vec3 a, vec3 b, vec3 c, float& outT)
+{
+	// Segment already pierces the triangle.
+	{
+		vec3 axis = p1 - p0;
+		float axisLength = length(axis);
+		float t;
+		bool frontFacing;
+		if (axisLength > 0.f && ray{ p0, axis / axisLength }.intersectTriangle(a, b, c, t, frontFacing) && t <= axisLength)
+		{
+			outT = 0.f;
+			return true;
+		}
+	}
+
+	outT = FLT_MAX;
+	bool result = false;
+	float t;
+
+	// Contacts at the caps. Together with the edge contacts below, this also covers contacts of the segment's interior with the face,
+	// since the closest point of a segment to a planar region is either an end point or lies above the region's boundary.
+	if (sweepSphereVsTriangle(p0, radius, direction, a, b, c, t) && t < outT) { outT = t; result = true; }
+	if (sweepSphereVsTriangle(p1, radius, direction, a, b, c, t) && t < outT) { outT = t; result = true; }
+
+	if (sweepSegmentVsSegment(p0, p1, a, b, radius, direction, t) && t < outT) { outT = t; result = true; }
+	if (sweepSegmentVsSegment(p0, p1, b, c, radius, direction, t) && t < outT) { outT = t; result = true; }
+	if (sweepSegmentVsSegment(p0, p1, c, a, radius, direction, t) && t < outT) { outT = t; result = true; }
+
+	return result;
+}
+
+static bool castAgainstTriangle(vec3 origin, vec3 direction, const heightmap_cast_shape& shape, vec3 a, vec3 b, vec3 c, heightmap_hit& hit)
+{
+	vec3 centerA = origin + shape.offsetA;
+	vec3 centerB = origin + shape.offsetB;
+	bool isCapsule = squaredLength(centerB - centerA) > 0.f;
+
+	float t;
+	bool found;
+	if (shape.radius == 0.f)
+	{
+		bool frontFacing;
+		found = ray{ centerA, direction }.intersectTriangle(a, b, c, t, frontFacing);
+	}
+	else if (!isCapsule)
+	{
+		found = sweepSphereVsTriangle(centerA, shape.radius, direction, a, b, c, t);
+	}
+	else
+	{
+		found = sweepCapsuleVsTriangle(centerA, centerB, shape.radius, direction, a, b, c, t);
+	}
+
+	if (!found || t >= hit.distance)
+	{
+		return false;
+	}
+
+	hit.distance = t;
+	hit.normal = noz(cross(b - a, c - a));
+
+	vec3 movement = direction * t;
+	if (shape.radius == 0.f)
+	{
+		hit.point = centerA + movement;
+	}
+	else if (!isCapsule)
+	{
+		hit.point = closestPoint_PointTriangle(centerA + movement, a, b, c);
+	}
+	else
+	{
+		line_segment segment = { centerA + movement, centerB + movement };
+		vec3 p = closestPoint_PointTriangle((segment.a + segment.b) * 0.5f, a, b, c);
+		hit.point = closestPoint_PointTriangle(closestPoint_PointSegment(p, segment), a, b, c);
+	}
+
+	return true;
+}
+
+bool heightmap_collider_chunk::cast(vec3 origin, vec3 direction, const heightmap_cast_shape& shape, float chunkScale, float heightScale, vec3 chunkMinCorner,
+	heightmap_hit& hit) const
+{
+	if (!heights)
+	{
+		return false;
+	}
+
+	// Avoid 0 * inf in the slab test for axis aligned rays.
+	vec3 safeDirection(
+		(direction.x == 0.f) ? 1e-20f : direction.x,
+		(direction.y == 0.f) ? 1e-20f : direction.y,
+		(direction.z == 0.f) ? 1e-20f : direction.z);
+	vec3 invDirection = 1.f / safeDirection;
+
+	// Nodes are extended by the shape's bounds (Minkowski sum), so that the origin can be traced as a ray.
+	vec3 shapeMin = min(shape.offsetA, shape.offsetB) - vec3(shape.radius);
+	vec3 shapeMax = max(shape.offsetA, shape.offsetB) + vec3(shape.radius);
+
+	auto enterNode = [&](uint32 mipLevel, uint32 x, uint32 z, float& outDistance)
+	{
+		uint32 numSegmentsPerDim = (TERRAIN_LOD_0_VERTICES_PER_DIMENSION - 1) >> mipLevel;
+		heightmap_min_max minmax = mips[mipLevel][z * numSegmentsPerDim + x];
+
+		vec3 nodeMin = vec3((float)(x << mipLevel) * chunkScale, minmax.min * heightScale, (float)(z << mipLevel) * chunkScale) + chunkMinCorner;
+		vec3 nodeMax = vec3((float)((x + 1) << mipLevel) * chunkScale, minmax.max * heightScale, (float)((z + 1) << mipLevel) * chunkScale) + chunkMinCorner;
+
+		return rayVsBox(origin, invDirection, nodeMin - shapeMax, nodeMax - shapeMin, hit.distance, outDistance);
+	};
+
+	struct stack_entry
+	{
+		uint16 mipLevel;
+		uint16 x, z;
+		float distance;
+	};
+
+	// Depth first, so at most 4 entries per level are pending.
+	stack_entry stack[64];
+	uint32 stackSize = 0;
+
+	uint32 numMips = (uint32)mips.size();
+
+	float rootDistance;
+	if (!enterNode(numMips - 1, 0, 0, rootDistance))
+	{
+		return false;
+	}
+	stack[stackSize++] = { (uint16)(numMips - 1), 0, 0, rootDistance };
+
+	bool result = false;
+
+	while (stackSize > 0)
+	{
+		stack_entry entry = stack[--stackSize];
+		if (entry.distance >= hit.distance)
+		{
+			continue;
+		}
+
+		if (entry.mipLevel == 0)
+		{
+			uint32 stride = TERRAIN_LOD_0_VERTICES_PER_DIMENSION;
+
+			uint32 aIndex = (stride * entry.z + entry.x);
+			uint32 bIndex = (stride * (entry.z + 1) + entry.x);
+			uint32 cIndex = (stride * entry.z + entry.x + 1);
+			uint32 dIndex = (stride * (entry.z + 1) + entry.x + 1);
+
+			vec3 posA = vec3(entry.x * chunkScale, heights[aIndex] * heightScale, entry.z * chunkScale) + chunkMinCorner;
+			vec3 posB = vec3(entry.x * chunkScale, heights[bIndex] * heightScale, (entry.z + 1) * chunkScale) + chunkMinCorner;
+			vec3 posC = vec3((entry.x + 1) * chunkScale, heights[cIndex] * heightScale, entry.z * chunkScale) + chunkMinCorner;
+			vec3 posD = vec3((entry.x + 1) * chunkScale, heights[dIndex] * heightScale, (entry.z + 1) * chunkScale) + chunkMinCorner;
+
+			result |= castAgainstTriangle(origin, direction, shape, posA, posB, posC, hit);
+			result |= castAgainstTriangle(origin, direction, shape, posC, posB, posD, hit);
+		}
+		else
+		{
+			stack_entry children[4];
+			uint32 numChildren = 0;
+
+			uint32 childLevel = entry.mipLevel - 1;
+			for (uint32 i = 0; i < 4; ++i)
+			{
+				uint32 x = 2 * entry.x + (i & 1);
+				uint32 z = 2 * entry.z + (i >> 1);
+
+				float distance;
+				if (enterNode(childLevel, x, z, distance))
+				{
+					children[numChildren++] = { (uint16)childLevel, (uint16)x, (uint16)z, distance };
+				}
+			}
+
+			// Push far to near, so that the nearest child is processed first.
+			std::sort(children, children + numChildren, [](const stack_entry& a, const stack_entry& b) { return a.distance > b.distance; });
+			for (uint32 i = 0; i < numChildren; ++i)
+			{
+				stack[stackSize++] = children[i];
+			}
+		}
+	}
+
+	return result;
+}
+
+void heightmap_collider_chunk::relinkHeights(uint16* heights)
+{
+	if (!heights || mips.empty())
+	{
+		setHeights(heights);
+		return;
+	}
+
+	this->heights = heights;
+}
+
 void heightmap_collider_chunk::setHeights(uint16* heights)
 {
 	this->heights = heights;
 
+	if (!heights)
+	{
+		// Chunk was evicted (streaming terrain). Release the pyramid as well.
+		std::vector<std::vector<heightmap_min_max>>().swap(mips);
+		return;
+	}
+
 	uint32 numSegments = TERRAIN_LOD_0_VERTICES_PER_DIMENSION - 1;
 	uint32 numMips = log2(numSegments) + 1;
 
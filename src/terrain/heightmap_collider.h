@@ -10,16 +10,46 @@
 #define TERRAIN_LOD_0_VERTICES_PER_DIMENSION 129u
 #endif
 
+struct heightmap_hit
+{
+	float distance; // Along the (normalized) direction. FLT_MAX for misses in batched queries.
+	vec3 point;
+	vec3 normal; // Surface normal of the hit triangle.
+};
+
+// Shape swept along a ray. The offsets are relative to the ray origin. Rays are spheres with radius 0, spheres are capsules with
+// equal offsets.
+struct heightmap_cast_shape
+{
+	vec3 offsetA;
+	vec3 offsetB;
+	float radius;
+};
+
 struct heightmap_collider_chunk
 {
 	void setHeights(uint16* heights);
 
+	// Points the chunk at a copy of the heights it was built from (e.g. after a scene snapshot moved the terrain). Keeps the 
+	// min/max pyramid, unless there is none yet.
+	void relinkHeights(uint16* heights);
+	const uint16* getHeights() const { return heights; }
+
 	template <typename callback_func>
 	void iterateTrianglesInVolume(uint32 volMinX, uint32 volMinZ, uint32 volMaxX, uint32 volMaxZ,
 		uint32 volMinY, uint32 volMaxY, float chunkScale, float heightScale, vec3 chunkMinCorner, memory_arena& arena, const callback_func& func) const;
 
 	float getHeightAt(vec2 coord, float heightScale, float heightOffset) const;
 
+	// Returns true if all terrain in the region is lower than volMinY. Descends the min/max pyramid at most to stopMipLevel, so a 
+	// false result is conservative.
+	bool isBelow(uint32 volMinX, uint32 volMinZ, uint32 volMaxX, uint32 volMaxZ, uint32 volMinY, uint32 stopMipLevel) const;
+
+	// Exact sweep against the triangles of this chunk. Descends the min/max pyramid front to back and skips all nodes which cannot
+	// contain a hit closer than hit.distance. Returns true if hit was updated.
+	bool cast(vec3 origin, vec3 direction, const heightmap_cast_shape& shape, float chunkScale, float heightScale, vec3 chunkMinCorner, 
+		heightmap_hit& hit) const;
+
 private:
 	uint16* heights = 0;
 
@@ -125,12 +155,30 @@ struct heightmap_collider_component
 	heightmap_collider_component(uint32 chunksPerDim, float chunkSize, physics_material material);
 
 	void update(vec3 minCorner, float amplitudeScale);
+	bool needsUpdate(vec3 minCorner, float amplitudeScale) const; // True if update would change anything.
 
 	template <typename callback_func>
 	void iterateTrianglesInVolume(bounding_box volume, memory_arena& arena, const callback_func& func) const;
 
 	float getHeightAt(vec2 coord) const; // Returns -FLT_MAX if outside bounds.
 
+	// Cheap early-out before iterating triangles. Returns true if the volume is completely above the terrain or outside of it. 
+	// Only uses the coarse levels of the min/max pyramids.
+	bool isAboveTerrain(const bounding_box& volume) const;
+
+	// Index of the chunk below the given position (clamped to the terrain). Used to batch queries by chunk.
+	uint32 getChunkIndex(vec2 coord) const;
+
+	// The direction must be normalized. Only hits closer than maxDistance are reported. Shapes which already touch the terrain at 
+	// their start position report a hit at distance 0.
+	bool raycast(const ray& r, float maxDistance, heightmap_hit& outHit) const;
+	bool sphereCast(const bounding_sphere& sphere, vec3 direction, float maxDistance, heightmap_hit& outHit) const;
+	bool capsuleCast(const bounding_capsule& capsule, vec3 direction, float maxDistance, heightmap_hit& outHit) const;
+
+	// Casts many rays at once. The rays are sorted by chunk, so that consecutive rays touch the same height data, and are distributed
+	// over the job system. Misses have distance FLT_MAX. Returns the number of hits.
+	uint32 raycast(const ray* rays, uint32 numRays, float maxDistance, heightmap_hit* outHits, memory_arena& arena) const;
+
 	heightmap_collider_chunk& collider(uint32 x, uint32 z) { return colliders[z * chunksPerDim + x]; }
 	const heightmap_collider_chunk& collider(uint32 x, uint32 z) const { return colliders[z * chunksPerDim + x]; }
 
@@ -139,6 +187,8 @@ struct heightmap_collider_component
 	physics_material material;
 
 private:
+	bool cast(vec3 origin, vec3 direction, const heightmap_cast_shape& shape, float maxDistance, heightmap_hit& outHit) const;
+
 	vec3 minCorner;
 	float invAmplitudeScale = 1.f;
 	float invChunkSize;
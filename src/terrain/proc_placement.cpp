@@ -214,6 +214,11 @@ void proc_placement_component::generate(const render_camera& camera, const terra
 				for (uint32 x = 0; x < terrain.chunksPerDim; ++x)
 				{
 					auto& chunk = terrain.chunk(x, z);
+					if (!chunk.heightmap)
+					{
+						continue; // Not resident (streaming terrain).
+					}
+
 					vec3 chunkMinCorner = minCorner + vec3(x * terrain.chunkSize, 0.f, z * terrain.chunkSize);
 					vec3 chunkMaxCorner = chunkMinCorner + chunkSize;
 
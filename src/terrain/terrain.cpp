@@ -15,6 +15,10 @@
 #include "rendering/render_algorithms.h"
 
 #include "core/random.h"
+#include "core/random_simd.h"
+#include "core/threading.h"
+#include "core/cpu_profiling.h"
+#include "core/log.h"
 #include "scene/components.h"
 
 #include "terrain_rs.hlsli"
@@ -318,6 +322,7 @@ PIPELINE_RENDER_IMPL(terrain_outline_pipeline, terrain_render_data_common)
 struct height_generator
 {
 	fbm_noise_2D noiseFunc = valueNoise;
+	fbm_noise_2D_w8 noiseFunc8 = valueNoise;
 
 	virtual float height(vec2 position) const = 0;
 	virtual vec2 grad(vec2 position) const = 0;
@@ -367,6 +372,46 @@ struct height_generator_warped : height_generator
 
 		return grad;
 	}
+
+	// 8-wide versions of the above. Same math, evaluated over 8 positions at a time.
+
+	w8_float height(w8_vec2 position) const
+	{
+		w8_vec2 fbmPosition(position.x * settings.scale, position.y * settings.scale);
+
+		w8_vec3 domainWarpValue = fbm(noiseFunc8, 
+			w8_vec2(fbmPosition.x + settings.domainWarpNoiseOffset.x, fbmPosition.y + settings.domainWarpNoiseOffset.y), settings.domainWarpOctaves);
+
+		w8_float warp = domainWarpValue.x * settings.domainWarpStrength;
+		w8_vec2 warpedFbmPosition(
+			fbmPosition.x + warp + (settings.noiseOffset.x + 1000.f),
+			fbmPosition.y + warp + (settings.noiseOffset.y + 1000.f));
+		w8_vec3 value = fbm(noiseFunc8, warpedFbmPosition);
+
+		return fmadd(value.x, 0.5f, 0.5f);
+	}
+
+	// Returns the height (with settings.noiseOctaves) in x and its gradient in yz. Both come out of the same fbm evaluation.
+	w8_vec3 heightAndGrad(w8_vec2 position) const
+	{
+		w8_vec2 fbmPosition(position.x * settings.scale, position.y * settings.scale);
+
+		w8_vec3 domainWarpValue = fbm(noiseFunc8, 
+			w8_vec2(fbmPosition.x + settings.domainWarpNoiseOffset.x, fbmPosition.y + settings.domainWarpNoiseOffset.y), settings.domainWarpOctaves);
+
+		w8_float warp = domainWarpValue.x * settings.domainWarpStrength;
+		w8_vec2 warpedFbmPosition(
+			fbmPosition.x + warp + (settings.noiseOffset.x + 1000.f),
+			fbmPosition.y + warp + (settings.noiseOffset.y + 1000.f));
+		w8_vec3 value = fbm(noiseFunc8, warpedFbmPosition, settings.noiseOctaves);
+
+		// See scalar version for the chain rule.
+		float outerScale = 0.5f * settings.scale;
+		w8_float gradX = value.y * fmadd(domainWarpValue.y, settings.domainWarpStrength, 1.f) * outerScale;
+		w8_float gradY = value.z * fmadd(domainWarpValue.z, settings.domainWarpStrength, 1.f) * outerScale;
+
+		return w8_vec3(fmadd(value.x, 0.5f, 0.5f), gradX, gradY);
+	}
 };
 
 struct height_generator_layered : height_generator
@@ -461,70 +506,168 @@ terrain_component::terrain_component(uint32 chunksPerDim, float chunkSize, float
 	this->mudMaterial = mudMaterial;
 }
 
-void terrain_component::generateChunksCPU()
+// Evaluates heights for a grid of dimension x dimension samples, 8 samples at a time. Rows are padded internally, so the dimension
+// doesn't have to be a multiple of 8.
+template <typename store_func>
+static void generateGrid8(uint32 dimension, float positionScale, vec2 minCorner, const store_func& store)
 {
-	thread_job_context context;
+	const w8_float laneOffsets(0.f, 1.f, 2.f, 3.f, 4.f, 5.f, 6.f, 7.f);
 
-	height_generator_warped generator;
-	generator.settings = genSettings;
+	for (uint32 z = 0; z < dimension; ++z)
+	{
+		w8_float positionZ = z * positionScale + minCorner.y;
+
+		for (uint32 x = 0; x < dimension; x += 8)
+		{
+			w8_float positionX = fmadd(laneOffsets + (float)x, positionScale, minCorner.x);
+			store(z * dimension + x, min(dimension - x, 8u), w8_vec2(positionX, positionZ));
+		}
+	}
+}
 
+// Generates heights, heightmap and normal map of a single chunk on the CPU. Thread safe.
+static void generateChunkCPU(const height_generator_warped& generator, vec2 minCorner, float chunkSize, float amplitudeScale, uint32 normalDimension,
+	std::vector<uint16>& outHeights, ref<dx_texture>& outHeightmap, ref<dx_texture>& outNormalmap)
+{
 	uint32 numSegmentsPerDim = TERRAIN_LOD_0_VERTICES_PER_DIMENSION - 1;
 	float positionScale = chunkSize / (float)numSegmentsPerDim;
-	float normalScale = chunkSize / (float)(normalMapDimension - 1);
+	float normalScale = chunkSize / (float)(normalDimension - 1);
 
-	for (int32 cz = 0; cz < (int32)chunksPerDim; ++cz)
+	outHeights.resize(TERRAIN_LOD_0_VERTICES_PER_DIMENSION * TERRAIN_LOD_0_VERTICES_PER_DIMENSION);
+	uint16* heights = outHeights.data();
+	vec2* normals = new vec2[normalDimension * normalDimension];
+
+	generateGrid8(TERRAIN_LOD_0_VERTICES_PER_DIMENSION, positionScale, minCorner, [&generator, heights](uint32 index, uint32 count, w8_vec2 position)
 	{
-		for (int32 cx = 0; cx < (int32)chunksPerDim; ++cx)
+		float height[8];
+		generator.height(position).store(height);
+
+		for (uint32 i = 0; i < count; ++i)
 		{
-			context.addWork([this, cx, cz, generator, positionScale, normalScale]()
-			{
-				vec2 minCorner = vec2(cx * chunkSize, cz * chunkSize);
+			ASSERT(height[i] >= 0.f);
+			ASSERT(height[i] <= 1.f);
 
-				auto& c = chunk(cx, cz);
+			heights[index + i] = (uint16)(height[i] * UINT16_MAX);
+		}
+	});
 
-				c.heights.resize(TERRAIN_LOD_0_VERTICES_PER_DIMENSION * TERRAIN_LOD_0_VERTICES_PER_DIMENSION);
-				uint16* heights = c.heights.data();
-				vec2* normals = new vec2[normalMapDimension * normalMapDimension];
+	outHeightmap = createTexture(heights, TERRAIN_LOD_0_VERTICES_PER_DIMENSION, TERRAIN_LOD_0_VERTICES_PER_DIMENSION, DXGI_FORMAT_R16_UNORM, false, false, true, D3D12_RESOURCE_STATE_GENERIC_READ);
 
-				float minHeight = FLT_MAX;
-				float maxHeight = -FLT_MAX;
 
-				for (uint32 z = 0; z < TERRAIN_LOD_0_VERTICES_PER_DIMENSION; ++z)
-				{
-					for (uint32 x = 0; x < TERRAIN_LOD_0_VERTICES_PER_DIMENSION; ++x)
-					{
-						vec2 position = vec2(x * positionScale, z * positionScale) + minCorner;
+	generateGrid8(normalDimension, normalScale, minCorner, [&generator, normals](uint32 index, uint32 count, w8_vec2 position)
+	{
+		w8_vec3 heightAndGrad = generator.heightAndGrad(position);
 
-						float height = generator.height(position);
+		float gradX[8], gradY[8];
+		heightAndGrad.y.store(gradX);
+		heightAndGrad.z.store(gradY);
 
-						minHeight = min(minHeight, height * amplitudeScale);
-						maxHeight = max(maxHeight, height * amplitudeScale);
+		for (uint32 i = 0; i < count; ++i)
+		{
+			normals[index + i] = vec2(-gradX[i], -gradY[i]);
+		}
+	});
 
-						ASSERT(height >= 0.f);
-						ASSERT(height <= 1.f);
+	outNormalmap = createTexture(normals, normalDimension, normalDimension, DXGI_FORMAT_R32G32_FLOAT);
 
-						heights[z * TERRAIN_LOD_0_VERTICES_PER_DIMENSION + x] = (uint16)(height * UINT16_MAX);
-					}
-				}
+	delete[] normals;
+}
 
-				c.heightmap = createTexture(heights, TERRAIN_LOD_0_VERTICES_PER_DIMENSION, TERRAIN_LOD_0_VERTICES_PER_DIMENSION, DXGI_FORMAT_R16_UNORM, false, false, true, D3D12_RESOURCE_STATE_GENERIC_READ);
+void benchmarkTerrainGenerationCPU(const terrain_generation_settings& settings, float chunkSize, uint32 normalDimension)
+{
+	height_generator_warped generator;
+	generator.settings = settings;
 
+	uint32 numSegmentsPerDim = TERRAIN_LOD_0_VERTICES_PER_DIMENSION - 1;
+	float positionScale = chunkSize / (float)numSegmentsPerDim;
+	float normalScale = chunkSize / (float)(normalDimension - 1);
+	vec2 minCorner(0.f, 0.f);
 
-				for (uint32 z = 0; z < normalMapDimension; ++z)
-				{
-					for (uint32 x = 0; x < normalMapDimension; ++x)
-					{
-						vec2 position = vec2(x * normalScale, z * normalScale) + minCorner;
+	uint32 numHeights = TERRAIN_LOD_0_VERTICES_PER_DIMENSION * TERRAIN_LOD_0_VERTICES_PER_DIMENSION;
+	uint32 numNormals = normalDimension * normalDimension;
 
-						vec2 grad = generator.grad(position);
+	std::vector<float> scalarHeights(numHeights), wideHeights(numHeights);
+	std::vector<vec2> scalarNormals(numNormals), wideNormals(numNormals);
 
-						normals[z * normalMapDimension + x] = -grad;
-					}
-				}
+	{
+		CPU_PRINT_PROFILE_BLOCK("Terrain heights (scalar)");
+		for (uint32 z = 0; z < TERRAIN_LOD_0_VERTICES_PER_DIMENSION; ++z)
+		{
+			for (uint32 x = 0; x < TERRAIN_LOD_0_VERTICES_PER_DIMENSION; ++x)
+			{
+				scalarHeights[z * TERRAIN_LOD_0_VERTICES_PER_DIMENSION + x] = generator.height(vec2(x * positionScale, z * positionScale) + minCorner);
+			}
+		}
+	}
+	{
+		CPU_PRINT_PROFILE_BLOCK("Terrain heights (8-wide)");
+		generateGrid8(TERRAIN_LOD_0_VERTICES_PER_DIMENSION, positionScale, minCorner, [&](uint32 index, uint32 count, w8_vec2 position)
+		{
+			float height[8];
+			generator.height(position).store(height);
+			memcpy(wideHeights.data() + index, height, sizeof(float) * count);
+		});
+	}
+	{
+		CPU_PRINT_PROFILE_BLOCK("Terrain gradients (scalar)");
+		for (uint32 z = 0; z < normalDimension; ++z)
+		{
+			for (uint32 x = 0; x < normalDimension; ++x)
+			{
+				scalarNormals[z * normalDimension + x] = -generator.grad(vec2(x * normalScale, z * normalScale) + minCorner);
+			}
+		}
+	}
+	{
+		CPU_PRINT_PROFILE_BLOCK("Terrain gradients (8-wide)");
+		generateGrid8(normalDimension, normalScale, minCorner, [&](uint32 index, uint32 count, w8_vec2 position)
+		{
+			w8_vec3 heightAndGrad = generator.heightAndGrad(position);
 
-				c.normalmap = createTexture(normals, normalMapDimension, normalMapDimension, DXGI_FORMAT_R32G32_FLOAT);
+			float gradX[8], gradY[8];
+			heightAndGrad.y.store(gradX);
+			heightAndGrad.z.store(gradY);
 
-				delete[] normals;
+			for (uint32 i = 0; i < count; ++i)
+			{
+				wideNormals[index + i] = vec2(-gradX[i], -gradY[i]);
+			}
+		});
+	}
+
+	float maxHeightError = 0.f;
+	for (uint32 i = 0; i < numHeights; ++i)
+	{
+		maxHeightError = max(maxHeightError, abs(scalarHeights[i] - wideHeights[i]));
+	}
+
+	float maxGradError = 0.f;
+	for (uint32 i = 0; i < numNormals; ++i)
+	{
+		vec2 d = abs(scalarNormals[i] - wideNormals[i]);
+		maxGradError = max(maxGradError, max(d.x, d.y));
+	}
+
+	LOG_MESSAGE("Terrain generation benchmark: Max height deviation %f, max gradient deviation %f", maxHeightError, maxGradError);
+}
+
+void terrain_component::generateChunksCPU()
+{
+	thread_job_context context;
+
+	height_generator_warped generator;
+	generator.settings = genSettings;
+
+	for (int32 cz = 0; cz < (int32)chunksPerDim; ++cz)
+	{
+		for (int32 cx = 0; cx < (int32)chunksPerDim; ++cx)
+		{
+			context.addWork([this, cx, cz, generator]()
+			{
+				vec2 minCorner = vec2(cx * chunkSize, cz * chunkSize);
+
+				auto& c = chunk(cx, cz);
+				generateChunkCPU(generator, minCorner, chunkSize, amplitudeScale, normalMapDimension, c.heights, c.heightmap, c.normalmap);
 			});
 		}
 	}
@@ -636,9 +779,267 @@ void terrain_component::generateChunksGPU()
 	}
 }
 
-void terrain_component::update(vec3 positionOffset, heightmap_collider_component* collider)
+// Streamed chunks are generated on the CPU, where a full resolution normal map is too slow.
+const uint32 streamedNormalMapDimension = 512;
+
+struct terrain_chunk_stream_request
 {
-	if (memcmp(&genSettings, &oldGenSettings, sizeof(terrain_generation_settings)) != 0)
+	uint32 chunkIndex;
+
+	std::atomic<bool> cancelled = false;
+	std::atomic<bool> finished = false;
+
+	std::vector<uint16> heights;
+	ref<dx_texture> heightmap;
+	ref<dx_texture> normalmap;
+};
+
+static uint64 getStreamedChunkMemorySize()
+{
+	uint64 heightsSize = TERRAIN_LOD_0_VERTICES_PER_DIMENSION * TERRAIN_LOD_0_VERTICES_PER_DIMENSION * sizeof(uint16);
+	uint64 normalsSize = streamedNormalMapDimension * streamedNormalMapDimension * sizeof(vec2);
+	return heightsSize * 2 + normalsSize; // CPU heights, GPU heightmap and normal map.
+}
+
+void terrain_component::evictChunk(uint32 chunkIndex, heightmap_collider_component* collider)
+{
+	terrain_chunk& c = chunks[chunkIndex];
+
+	if (collider)
+	{
+		collider->collider(chunkIndex % chunksPerDim, chunkIndex / chunksPerDim).setHeights(0);
+	}
+
+	// Textures are retired, so this is safe while the GPU is still using them.
+	c.heightmap = 0;
+	c.normalmap = 0;
+	std::vector<uint16>().swap(c.heights);
+
+	c.residency = terrain_chunk_not_resident;
+}
+
+void terrain_component::evictAllChunks(heightmap_collider_component* collider)
+{
+	for (auto& request : pendingLoads)
+	{
+		request->cancelled.store(true, std::memory_order_relaxed);
+	}
+	pendingLoads.clear();
+
+	for (uint32 i = 0; i < (uint32)chunks.size(); ++i)
+	{
+		if (chunks[i].heightmap || chunks[i].residency != terrain_chunk_not_resident)
+		{
+			evictChunk(i, collider);
+		}
+	}
+	residentChunks.clear();
+}
+
+void terrain_component::updateStreaming(vec3 positionOffset, vec3 streamingFocus, heightmap_collider_component* collider)
+{
+	CPU_PROFILE_BLOCK("Terrain streaming");
+
+	++streamingFrame;
+
+	// Take over finished loads and remove them from the pending list. The results are copied out of the request instead of moved,
+	// because copies of this component (e.g. scene snapshots) may hold the same request.
+	for (uint32 i = 0; i < (uint32)pendingLoads.size();)
+	{
+		const ref<terrain_chunk_stream_request>& request = pendingLoads[i];
+		if (!request->finished.load(std::memory_order_acquire))
+		{
+			++i;
+			continue;
+		}
+
+		if (!request->cancelled.load(std::memory_order_relaxed))
+		{
+			uint32 chunkIndex = request->chunkIndex;
+			terrain_chunk& c = chunks[chunkIndex];
+
+			c.heights = request->heights;
+			c.heightmap = request->heightmap;
+			c.normalmap = request->normalmap;
+			c.residency = terrain_chunk_resident;
+			c.lastUsedFrame = streamingFrame;
+
+			residentChunks.push_back(chunkIndex);
+
+			if (collider)
+			{
+				collider->collider(chunkIndex % chunksPerDim, chunkIndex / chunksPerDim).setHeights(c.heights.data());
+			}
+		}
+
+		pendingLoads[i] = pendingLoads.back();
+		pendingLoads.pop_back();
+	}
+
+
+	// Touch all chunks in the load radius and collect the missing ones. Everything is in chunk space here.
+	struct chunk_candidate
+	{
+		uint32 chunkIndex;
+		float distance;
+	};
+
+	std::vector<chunk_candidate> candidates;
+
+	vec3 minCorner = getMinCorner(positionOffset);
+	float invChunkSize = 1.f / chunkSize;
+	vec2 focus = vec2(streamingFocus.x - minCorner.x, streamingFocus.z - minCorner.z) * invChunkSize;
+	float radius = streaming.loadRadius * invChunkSize;
+
+	int32 minX = max((int32)floor(focus.x - radius), 0);
+	int32 minZ = max((int32)floor(focus.y - radius), 0);
+	int32 maxX = min((int32)floor(focus.x + radius), (int32)chunksPerDim - 1);
+	int32 maxZ = min((int32)floor(focus.y + radius), (int32)chunksPerDim - 1);
+
+	for (int32 z = minZ; z <= maxZ; ++z)
+	{
+		for (int32 x = minX; x <= maxX; ++x)
+		{
+			vec2 center = vec2(x + 0.5f, z + 0.5f);
+			vec2 d = abs(focus - center) - vec2(0.5f);
+			float distance = length(vec2(max(d.x, 0.f), max(d.y, 0.f)));
+			if (distance > radius)
+			{
+				continue;
+			}
+
+			uint32 chunkIndex = z * chunksPerDim + x;
+			terrain_chunk& c = chunks[chunkIndex];
+			c.lastUsedFrame = streamingFrame;
+
+			if (c.residency == terrain_chunk_not_resident)
+			{
+				candidates.push_back({ chunkIndex, length(focus - center) });
+			}
+		}
+	}
+
+
+	// Cancel loads which left the load radius. The loader thread skips them if it has not started yet.
+	uint32 numActiveLoads = 0;
+	for (auto& request : pendingLoads)
+	{
+		if (request->cancelled.load(std::memory_order_relaxed))
+		{
+			continue;
+		}
+
+		terrain_chunk& c = chunks[request->chunkIndex];
+		if (c.lastUsedFrame != streamingFrame)
+		{
+			request->cancelled.store(true, std::memory_order_relaxed);
+			c.residency = terrain_chunk_not_resident;
+		}
+		else
+		{
+			++numActiveLoads;
+		}
+	}
+
+
+	// Evict least recently used chunks until we are within budget. Chunks in the load radius are never evicted.
+	uint64 memoryBudget = (uint64)streaming.memoryBudgetMB * 1024 * 1024;
+	uint64 chunkMemorySize = getStreamedChunkMemorySize();
+	uint64 usedMemory = (residentChunks.size() + numActiveLoads) * chunkMemorySize;
+
+	if (usedMemory > memoryBudget)
+	{
+		std::sort(residentChunks.begin(), residentChunks.end(), [this](uint32 a, uint32 b)
+		{
+			return chunks[a].lastUsedFrame < chunks[b].lastUsedFrame;
+		});
+
+		uint32 numEvicted = 0;
+		while (numEvicted < (uint32)residentChunks.size() && usedMemory > memoryBudget)
+		{
+			uint32 chunkIndex = residentChunks[numEvicted];
+			if (chunks[chunkIndex].lastUsedFrame == streamingFrame)
+			{
+				break;
+			}
+
+			evictChunk(chunkIndex, collider);
+			usedMemory -= chunkMemorySize;
+			++numEvicted;
+		}
+
+		residentChunks.erase(residentChunks.begin(), residentChunks.begin() + numEvicted);
+	}
+
+
+	// Request missing chunks, nearest first. If the load radius needs more memory than the budget allows, the farthest chunks stay missing.
+	std::sort(candidates.begin(), candidates.end(), [](const chunk_candidate& a, const chunk_candidate& b)
+	{
+		return a.distance < b.distance;
+	});
+
+	height_generator_warped generator;
+	generator.settings = genSettings;
+
+	for (const chunk_candidate& candidate : candidates)
+	{
+		// Cancelled requests stay pending until their loader finishes, but they do not count towards the limit.
+		if (numActiveLoads >= streaming.maxLoadsInFlight || usedMemory + chunkMemorySize > memoryBudget)
+		{
+			break;
+		}
+
+		ref<terrain_chunk_stream_request> request = make_ref<terrain_chunk_stream_request>();
+		request->chunkIndex = candidate.chunkIndex;
+
+		vec2 chunkMinCorner = vec2((candidate.chunkIndex % chunksPerDim) * chunkSize, (candidate.chunkIndex / chunksPerDim) * chunkSize);
+		float chunkSize = this->chunkSize;
+		float amplitudeScale = this->amplitudeScale;
+
+		addAsyncLoadWork([request, generator, chunkMinCorner, chunkSize, amplitudeScale]()
+		{
+			if (!request->cancelled.load(std::memory_order_relaxed))
+			{
+				generateChunkCPU(generator, chunkMinCorner, chunkSize, amplitudeScale, streamedNormalMapDimension,
+					request->heights, request->heightmap, request->normalmap);
+			}
+			request->finished.store(true, std::memory_order_release);
+		});
+
+		chunks[candidate.chunkIndex].residency = terrain_chunk_loading;
+		pendingLoads.push_back(request);
+		usedMemory += chunkMemorySize;
+		++numActiveLoads;
+	}
+
+	CPU_PROFILE_STAT("Resident terrain chunks", (uint32)residentChunks.size());
+	CPU_PROFILE_STAT("Loading terrain chunks", numActiveLoads);
+}
+
+void terrain_component::update(vec3 positionOffset, vec3 streamingFocus, heightmap_collider_component* collider)
+{
+	bool settingsChanged = memcmp(&genSettings, &oldGenSettings, sizeof(terrain_generation_settings)) != 0;
+
+	if (streaming.enabled != oldStreamingEnabled)
+	{
+		// Streamed chunks use smaller normal maps and are only partially resident, so start from scratch.
+		evictAllChunks(collider);
+
+		oldStreamingEnabled = streaming.enabled;
+		settingsChanged = true;
+	}
+
+	if (streaming.enabled)
+	{
+		if (settingsChanged)
+		{
+			evictAllChunks(collider);
+			oldGenSettings = genSettings;
+		}
+
+		updateStreaming(positionOffset, streamingFocus, collider);
+	}
+	else if (settingsChanged)
 	{
 		generateChunksGPU();
 
@@ -662,6 +1063,41 @@ void terrain_component::update(vec3 positionOffset, heightmap_collider_component
 	if (collider)
 	{
 		collider->update(getMinCorner(positionOffset), amplitudeScale);
+
+		// The collider does not own its heights. Catches stale pointers, e.g. after a scene snapshot was restored without relinking.
+		for (uint32 cz = 0; cz < chunksPerDim; ++cz)
+		{
+			for (uint32 cx = 0; cx < chunksPerDim; ++cx)
+			{
+				const auto& heights = chunk(cx, cz).heights;
+				ASSERT(collider->collider(cx, cz).getHeights() == (heights.empty() ? 0 : heights.data()));
+			}
+		}
+	}
+}
+
+bool terrain_component::needsUpdate(vec3 positionOffset, const heightmap_collider_component* collider) const
+{
+	if (streaming.enabled || streaming.enabled != oldStreamingEnabled)
+	{
+		return true;
+	}
+	if (memcmp(&genSettings, &oldGenSettings, sizeof(terrain_generation_settings)) != 0)
+	{
+		return true;
+	}
+	return collider && collider->needsUpdate(getMinCorner(positionOffset), amplitudeScale);
+}
+
+void terrain_component::relinkCollider(heightmap_collider_component& collider)
+{
+	for (uint32 cz = 0; cz < chunksPerDim; ++cz)
+	{
+		for (uint32 cx = 0; cx < chunksPerDim; ++cx)
+		{
+			auto& heights = chunk(cx, cz).heights;
+			collider.collider(cx, cz).relinkHeights(heights.empty() ? 0 : heights.data());
+		}
 	}
 }
 
@@ -678,26 +1114,18 @@ void terrain_component::render(const render_camera& camera, struct opaque_render
 
 	positionOffset = getMinCorner(positionOffset);
 
-	int32 lodStride = (chunksPerDim + 2);
-	uint32 paddedNumChunks = (chunksPerDim + 2) * (chunksPerDim + 2);
-	int32* lodBuffer = (int32*)alloca(sizeof(int32) * paddedNumChunks);
-	int32* lods = lodBuffer + lodStride + 1;
-
 	vec3 chunkCenterOffset = vec3(chunkSize, 0.f, chunkSize) * 0.5f;
 
-	for (int32 z = -1; z < (int32)chunksPerDim + 1; ++z)
+	// Computed on the fly instead of into a per-chunk buffer, since streamed terrains may have a huge number of chunks.
+	auto getLOD = [&](int32 x, int32 z)
 	{
-		for (int32 x = -1; x < (int32)chunksPerDim + 1; ++x)
-		{
-			vec3 localMinCorner(x * chunkSize, 0.f, z * chunkSize);
-			vec3 minCorner = localMinCorner + positionOffset;
-			vec3 chunkCenter = minCorner + chunkCenterOffset;
+		vec3 localMinCorner(x * chunkSize, 0.f, z * chunkSize);
+		vec3 minCorner = localMinCorner + positionOffset;
+		vec3 chunkCenter = minCorner + chunkCenterOffset;
 
-			float distance = length(chunkCenter - camera.position);
-			int32 lod = (int32)(saturate(distance / 500.f) * TERRAIN_MAX_LOD);
-			lods[z * lodStride + x] = lod;
-		}
-	}
+		float distance = length(chunkCenter - camera.position);
+		return (int32)(saturate(distance / 500.f) * TERRAIN_MAX_LOD);
+	};
 
 	terrain_water_plane_cb waterPlanes;
 	waterPlanes.numWaterPlanes = min(numWaters, 4u);
@@ -711,55 +1139,70 @@ void terrain_component::render(const render_camera& camera, struct opaque_render
 
 	auto waterCBV = dxContext.uploadDynamicConstantBuffer(waterPlanes);
 
-	for (int32 z = 0; z < (int32)chunksPerDim; ++z)
+	auto renderChunk = [&](int32 x, int32 z)
 	{
-		for (int32 x = 0; x < (int32)chunksPerDim; ++x)
-		{
-			const terrain_chunk& c = chunk(x, z);
+		const terrain_chunk& c = chunk(x, z);
 
-			int32 lod = lods[z * lodStride + x];
+		int32 lod = getLOD(x, z);
 
-			vec3 localMinCorner(x * chunkSize, 0.f, z * chunkSize);
-			vec3 minCorner = localMinCorner + positionOffset;
-			vec3 maxCorner = minCorner + vec3(chunkSize, amplitudeScale, chunkSize);
+		vec3 localMinCorner(x * chunkSize, 0.f, z * chunkSize);
+		vec3 minCorner = localMinCorner + positionOffset;
+		vec3 maxCorner = minCorner + vec3(chunkSize, amplitudeScale, chunkSize);
 
-			terrain_render_data_common common =
-			{
-				minCorner,
-				lod,
-				chunkSize,
-				amplitudeScale,
-				lods[(z)*lodStride + (x - 1)],
-				lods[(z)*lodStride + (x + 1)],
-				lods[(z - 1) * lodStride + (x)],
-				lods[(z + 1) * lodStride + (x)],
-				c.heightmap,
-				entityID,
+		terrain_render_data_common common =
+		{
+			minCorner,
+			lod,
+			chunkSize,
+			amplitudeScale,
+			getLOD(x - 1, z),
+			getLOD(x + 1, z),
+			getLOD(x, z - 1),
+			getLOD(x, z + 1),
+			c.heightmap,
+			entityID,
+		};
+
+		bounding_box aabb = { minCorner, maxCorner };
+		if (!frustum.cullWorldSpaceAABB(aabb))
+		{
+			terrain_render_data data = {
+				common,
+				c.normalmap,
+				groundMaterial, rockMaterial, mudMaterial,
+				waterCBV
 			};
+			renderPass->renderObject<terrain_pipeline, terrain_depth_prepass_pipeline>(data, common);
+		}
 
-			bounding_box aabb = { minCorner, maxCorner };
-			if (!frustum.cullWorldSpaceAABB(aabb))
+		if (shadowPass)
+		{
+			if (!sunFrustum.cullWorldSpaceAABB(aabb))
 			{
-				terrain_render_data data = {
-					common,
-					c.normalmap,
-					groundMaterial, rockMaterial, mudMaterial,
-					waterCBV
-				};
-				renderPass->renderObject<terrain_pipeline, terrain_depth_prepass_pipeline>(data, common);
+				shadowPass->renderStaticObject<terrain_shadow_pipeline>(0, common);
 			}
+		}
 
-			if (shadowPass)
-			{
-				if (!sunFrustum.cullWorldSpaceAABB(aabb))
-				{
-					shadowPass->renderStaticObject<terrain_shadow_pipeline>(0, common);
-				}
-			}
+		if (ldrPass && selected)
+		{
+			ldrPass->renderOutline<terrain_outline_pipeline>(common);
+		}
+	};
 
-			if (ldrPass && selected)
+	if (streaming.enabled)
+	{
+		for (uint32 chunkIndex : residentChunks)
+		{
+			renderChunk(chunkIndex % chunksPerDim, chunkIndex / chunksPerDim);
+		}
+	}
+	else
+	{
+		for (int32 z = 0; z < (int32)chunksPerDim; ++z)
+		{
+			for (int32 x = 0; x < (int32)chunksPerDim; ++x)
 			{
-				ldrPass->renderOutline<terrain_outline_pipeline>(common);
+				renderChunk(x, z);
 			}
 		}
 	}
@@ -8,12 +8,23 @@
 #include "rendering/material.h"
 #include "rendering/render_command.h"
 
+enum terrain_chunk_residency
+{
+	terrain_chunk_not_resident,
+	terrain_chunk_loading,
+	terrain_chunk_resident,
+};
+
 struct terrain_chunk
 {
 	ref<dx_texture> heightmap;
 	ref<dx_texture> normalmap;
 
 	std::vector<uint16> heights;
+
+	// Only used in streaming mode.
+	terrain_chunk_residency residency = terrain_chunk_not_resident;
+	uint64 lastUsedFrame = 0;
 };
 
 struct terrain_generation_settings
@@ -28,6 +39,19 @@ struct terrain_generation_settings
 	uint32 noiseOctaves = 15;
 };
 
+// In streaming mode only the chunks around a focus point (usually the camera) are resident. Missing chunks are generated on the
+// loader threads, nearest first. If the resident chunks exceed the memory budget, the least recently used chunks outside of the
+// load radius are evicted.
+struct terrain_streaming_settings
+{
+	bool enabled = false;
+	float loadRadius = 1000.f;
+	uint32 memoryBudgetMB = 256; // CPU and GPU memory of resident and loading chunks.
+	uint32 maxLoadsInFlight = 8;
+};
+
+struct terrain_chunk_stream_request;
+
 struct terrain_component
 {
 	terrain_component(uint32 chunksPerDim, float chunkSize, float amplitudeScale, 
@@ -46,6 +70,7 @@ struct terrain_component
 	float amplitudeScale;
 
 	terrain_generation_settings genSettings;
+	terrain_streaming_settings streaming;
 
 	ref<pbr_material> groundMaterial;
 	ref<pbr_material> rockMaterial;
@@ -58,7 +83,12 @@ struct terrain_component
 		return positionOffset + vec3(xzOffset, 0.f, xzOffset);
 	}
 
-	void update(vec3 positionOffset, struct heightmap_collider_component* collider = 0);
+	// The streaming focus is ignored if streaming is disabled.
+	void update(vec3 positionOffset, vec3 streamingFocus, struct heightmap_collider_component* collider = 0);
+	bool needsUpdate(vec3 positionOffset, const struct heightmap_collider_component* collider = 0) const; // True if update would write to the terrain or collider.
+
+	// Points the collider chunks at the heights of this terrain. Needed after the terrain was replaced by a copy (scene snapshots).
+	void relinkCollider(struct heightmap_collider_component& collider);
 	void render(const render_camera& camera, struct opaque_render_pass* renderPass, struct sun_shadow_render_pass* shadowPass, struct ldr_render_pass* ldrPass,
 		vec3 positionOffset, uint32 entityID = -1, bool selected = false,
 		struct position_scale_component* waterPlaneTransforms = 0, uint32 numWaters = 0);
@@ -67,16 +97,29 @@ private:
 	void generateChunksCPU();
 	void generateChunksGPU();
 
+	void updateStreaming(vec3 positionOffset, vec3 streamingFocus, struct heightmap_collider_component* collider);
+	void evictChunk(uint32 chunkIndex, struct heightmap_collider_component* collider);
+	void evictAllChunks(struct heightmap_collider_component* collider);
+
 	terrain_generation_settings oldGenSettings;
+	bool oldStreamingEnabled = false;
 
 	std::vector<terrain_chunk> chunks;
 
+	// Streaming only.
+	std::vector<uint32> residentChunks;
+	std::vector<ref<terrain_chunk_stream_request>> pendingLoads;
+	uint64 streamingFrame = 0;
+
 	friend struct grass_component;
 };
 
 
 void initializeTerrainPipelines();
 
+// Generates one chunk on the calling thread with the scalar and the 8-wide CPU generator. Prints the timings and the maximum deviation.
+void benchmarkTerrainGenerationCPU(const terrain_generation_settings& settings, float chunkSize, uint32 normalDimension = 512);
+
 
 
 